@@ -0,0 +1,129 @@
+#!/usr/bin/env python3
+# Copyright (c) 2019 The Kryptofranc Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+"""
+    Minimal stratum v1 client for testing the built-in stratum server.
+
+    Start a regtest node with the stratum server enabled, and mine a block so
+    that it leaves initial block download:
+        kyfd -regtest -daemon -stratum -stratumaddress=<address> -stratumdifficulty=0.0001
+        kyf-cli -regtest generatetoaddress 1 <address>
+
+    Then submit a few shares through the server:
+        stratum_client.py --port 3333 --shares 5
+
+    Share targets are computed from the usual difficulty 1 target,
+    0x00000000ffff0000...0000. The client hashes on the CPU, so use a
+    fractional share difficulty: at 0.0001 a share takes about 430,000 hashes.
+    Regtest blocks after the first keep the genesis difficulty, so only a
+    share that happens to meet it is also a block.
+"""
+
+import argparse
+import hashlib
+import json
+import socket
+import struct
+import sys
+
+
+DIFF1_TARGET = 0x00000000ffff0000000000000000000000000000000000000000000000000000
+
+
+def sha256d(data):
+    return hashlib.sha256(hashlib.sha256(data).digest()).digest()
+
+
+def swap32(data):
+    return b''.join(data[i:i + 4][::-1] for i in range(0, len(data), 4))
+
+
+class StratumClient():
+    def __init__(self, host, port):
+        self.sock = socket.create_connection((host, port))
+        self.file = self.sock.makefile('rw')
+        self.next_id = 1
+        self.difficulty = 1.0
+        self.job = None
+
+    def send(self, method, params):
+        request = {'id': self.next_id, 'method': method, 'params': params}
+        self.next_id += 1
+        self.file.write(json.dumps(request) + '\n')
+        self.file.flush()
+        # Handle notifications until the reply arrives.
+        while True:
+            message = self.read()
+            if message.get('id') == request['id']:
+                return message
+
+    def read(self):
+        line = self.file.readline()
+        if not line:
+            raise ConnectionError('server closed the connection')
+        message = json.loads(line)
+        if message.get('method') == 'mining.set_difficulty':
+            self.difficulty = message['params'][0]
+        elif message.get('method') == 'mining.notify':
+            self.job = message['params']
+        return message
+
+    def wait_for_job(self):
+        while self.job is None:
+            self.read()
+
+
+def mine(client, extranonce1, extranonce2_size, extranonce2):
+    job_id, prevhash, coinb1, coinb2, branch, version, nbits, ntime, _ = client.job
+    en2 = extranonce2.to_bytes(extranonce2_size, 'little').hex()
+    coinbase = bytes.fromhex(coinb1 + extranonce1 + en2 + coinb2)
+    root = sha256d(coinbase)
+    for h in branch:
+        root = sha256d(root + bytes.fromhex(h))
+    header = (struct.pack('<I', int(version, 16)) + swap32(bytes.fromhex(prevhash)) + root +
+              struct.pack('<II', int(ntime, 16), int(nbits, 16)))
+    target = int(DIFF1_TARGET / client.difficulty)
+    for nonce in range(1 << 32):
+        block_hash = sha256d(header + struct.pack('<I', nonce))
+        if int.from_bytes(block_hash, 'little') <= target:
+            return [job_id, en2, ntime, '%08x' % nonce], block_hash
+    return None, None
+
+
+def bits_to_target(nbits):
+    return (nbits & 0xffffff) << (8 * ((nbits >> 24) - 3))
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__, formatter_class=argparse.RawDescriptionHelpFormatter)
+    parser.add_argument('--host', default='127.0.0.1')
+    parser.add_argument('--port', type=int, default=3333)
+    parser.add_argument('--shares', type=int, default=1, help='number of shares to submit')
+    args = parser.parse_args()
+
+    client = StratumClient(args.host, args.port)
+    reply = client.send('mining.subscribe', ['stratum_client.py'])
+    _, extranonce1, extranonce2_size = reply['result']
+    reply = client.send('mining.authorize', ['test', 'x'])
+    if reply['result'] is not True:
+        print('authorize failed: %s' % reply['error'])
+        sys.exit(1)
+
+    extranonce2 = 0
+    for _ in range(args.shares):
+        client.wait_for_job()
+        params, block_hash = mine(client, extranonce1, extranonce2_size, extranonce2)
+        extranonce2 += 1
+        is_block = int.from_bytes(block_hash, 'little') <= bits_to_target(int(client.job[6], 16))
+        reply = client.send('mining.submit', ['test'] + params)
+        print('submitted %s %s: %s' % ('block' if is_block else 'share', block_hash[::-1].hex(),
+                                       'accepted' if reply['result'] else reply['error']))
+        if is_block:
+            # Wait for the job on top of the new block.
+            client.job = None
+
+
+if __name__ == '__main__':
+    main()
@@ -0,0 +1,39 @@
+// Copyright (c) 2011-2018 The Bitcoin Core developers
+// Copyright (c) 2018-2019 The Kryptofranc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <bench/chain_setup.h>
+
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <miner.h>
+#include <txmempool.h>
+#include <validation.h>
+
+#include <memory>
+
+static const size_t NUM_TXS = 1000;
+
+static void AssembleBlock(benchmark::State& state)
+{
+    BenchChainSetup setup(NUM_TXS);
+    {
+        LOCK(cs_main);
+        for (size_t i = 0; i < NUM_TXS; i++) {
+            // Vary the fee so the ancestor-score index has an order to maintain.
+            CValidationState validation_state;
+            bool accepted = AcceptToMemoryPool(mempool, validation_state, setup.SpendCoin(i, 10000 + i * 10, 2), nullptr /* pfMissingInputs */,
+                nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */);
+            assert(accepted);
+        }
+    }
+
+    while (state.KeepRunning()) {
+        std::unique_ptr<CBlockTemplate> block_template = BlockAssembler(Params()).CreateNewBlock(setup.m_script_pub_key);
+        assert(block_template->block.vtx.size() == NUM_TXS + 1);
+    }
+}
+
+BENCHMARK(AssembleBlock, 10);
@@ -0,0 +1,162 @@
+// Copyright (c) 2019 The Kryptofranc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <net_processing.h>
+#include <validation.h>
+
+#include <algorithm>
+#include <deque>
+#include <vector>
+
+/** Size of every simulated block */
+static const int64_t SIM_BLOCK_SIZE = 250000;
+/** Number of blocks to download */
+static const int SIM_BLOCKS = 2000;
+/** Interval at which peers are sent requests, as the message handler does */
+static const int64_t SIM_TICK = 10000;
+/** Simulated time after which a download counts as stuck */
+static const int64_t SIM_TIME_LIMIT = 3600 * 1000000LL;
+
+namespace {
+
+/**
+ * A peer that sends requested blocks one after the other over a link of
+ * fixed bandwidth. A bandwidth of 0 is a peer that never sends anything.
+ */
+struct SimPeer {
+    int64_t bytes_per_sec;
+    int64_t ping;
+    BlockDownloadRate rate;
+    int in_flight = 0;
+    //! When the link is done sending the blocks requested so far
+    int64_t busy_until = 0;
+    //! Heights sent and their arrival times, in order; includes blocks that were since requested from another peer
+    std::deque<std::pair<int, int64_t>> deliveries;
+
+    SimPeer(int64_t bytes_per_sec_in, int64_t ping_in) : bytes_per_sec(bytes_per_sec_in), ping(ping_in) {}
+
+    /** The window BlockDownloadRate should settle on */
+    int ExpectedWindow() const
+    {
+        const int64_t blocks = bytes_per_sec * (BLOCK_DOWNLOAD_QUEUE_TIME * 1000000 + ping) / 1000000 / SIM_BLOCK_SIZE;
+        return std::max<int64_t>(MIN_BLOCKS_IN_TRANSIT_PER_PEER, std::min<int64_t>(blocks, MAX_BLOCKS_IN_TRANSIT_PER_FAST_PEER));
+    }
+};
+
+struct SimResult {
+    bool complete = false;
+    int64_t duration = 0;
+    int reassigned = 0;
+};
+
+/**
+ * Download SIM_BLOCKS blocks from the given peers, the way SendMessages and
+ * FindNextBlocksToDownload do: each peer is kept at its BlockDownloadRate
+ * window, filled with the lowest blocks nobody was asked for, and takes
+ * over blocks near the start of the download window that ShouldTakeOver
+ * says are overdue at a slower peer.
+ */
+SimResult Simulate(std::vector<SimPeer>& peers)
+{
+    SimResult result;
+    // Peer each block is in flight from, or -1
+    std::vector<int> holder(SIM_BLOCKS, -1);
+    std::vector<int64_t> requested(SIM_BLOCKS, 0);
+    std::vector<bool> have(SIM_BLOCKS, false);
+    int first_missing = 0;
+    int64_t now = 0;
+
+    while (first_missing < SIM_BLOCKS && now < SIM_TIME_LIMIT) {
+        // Blocks arriving by now
+        for (size_t p = 0; p < peers.size(); p++) {
+            SimPeer& peer = peers[p];
+            while (!peer.deliveries.empty() && peer.deliveries.front().second <= now) {
+                const int height = peer.deliveries.front().first;
+                const int64_t arrival = peer.deliveries.front().second;
+                peer.deliveries.pop_front();
+                // A block that was reassigned stays in flight from the peer
+                // it was reassigned to, even if the first peer sends it.
+                if (holder[height] == (int)p) {
+                    peer.rate.Update(SIM_BLOCK_SIZE, requested[height], arrival);
+                    peer.in_flight--;
+                    holder[height] = -1;
+                }
+                have[height] = true;
+            }
+        }
+        while (first_missing < SIM_BLOCKS && have[first_missing]) first_missing++;
+
+        // Requests
+        for (size_t p = 0; p < peers.size(); p++) {
+            SimPeer& peer = peers[p];
+            const int window = peer.rate.Window(peer.ping);
+            assert(window >= MIN_BLOCKS_IN_TRANSIT_PER_PEER && window <= std::max(MAX_BLOCKS_IN_TRANSIT_PER_PEER, MAX_BLOCKS_IN_TRANSIT_PER_FAST_PEER));
+            const int end = std::min(SIM_BLOCKS, first_missing + (int)BLOCK_DOWNLOAD_WINDOW);
+            for (int height = first_missing; height < end && peer.in_flight < window; height++) {
+                if (have[height] || holder[height] == (int)p) continue;
+                if (holder[height] != -1) {
+                    SimPeer& other = peers[holder[height]];
+                    if (height > first_missing + BLOCK_DOWNLOAD_REASSIGN_DEPTH ||
+                            !peer.rate.ShouldTakeOver(other.rate, peer.in_flight, requested[height], now)) {
+                        continue;
+                    }
+                    other.in_flight--;
+                    result.reassigned++;
+                }
+                holder[height] = p;
+                requested[height] = now;
+                peer.in_flight++;
+                if (peer.bytes_per_sec > 0) {
+                    const int64_t start = std::max(now + peer.ping / 2, peer.busy_until);
+                    peer.busy_until = start + SIM_BLOCK_SIZE * 1000000 / peer.bytes_per_sec;
+                    peer.deliveries.emplace_back(height, peer.busy_until + peer.ping / 2);
+                }
+            }
+        }
+        now += SIM_TICK;
+    }
+    result.complete = first_missing == SIM_BLOCKS;
+    result.duration = now;
+    return result;
+}
+
+} // namespace
+
+// A fast, a medium and a slow peer, and one that stalls on everything it is
+// asked for. Checks that each peer's window settles where its rate puts it,
+// that the stalling peer's blocks are taken over rather than holding up the
+// download, and that the download finishes close to the time the three
+// working peers need together.
+static void BlockDownloadSimulation(benchmark::State& state)
+{
+    while (state.KeepRunning()) {
+        std::vector<SimPeer> peers;
+        peers.emplace_back(10000000, 50000);  // fast
+        peers.emplace_back(2000000, 100000);  // medium
+        peers.emplace_back(200000, 300000);   // slow
+        peers.emplace_back(0, 100000);        // stalling
+        const SimResult result = Simulate(peers);
+        assert(result.complete);
+
+        for (size_t p = 0; p < 3; p++) {
+            const int window = peers[p].rate.Window(peers[p].ping);
+            const int expected = peers[p].ExpectedWindow();
+            assert(window * 10 >= expected * 9 && window * 10 <= expected * 11);
+        }
+        assert(peers[0].rate.Window(peers[0].ping) > peers[1].rate.Window(peers[1].ping));
+        assert(peers[2].rate.Window(peers[2].ping) == MIN_BLOCKS_IN_TRANSIT_PER_PEER);
+        // A peer that never delivered keeps the window for unknown peers
+        assert(peers[3].rate.nBytesPerSec == 0);
+        assert(peers[3].rate.Window(peers[3].ping) == MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+
+        // Everything the stalling peer was asked for was taken over
+        assert(result.reassigned >= MAX_BLOCKS_IN_TRANSIT_PER_PEER);
+        const int64_t ideal = SIM_BLOCKS * SIM_BLOCK_SIZE * 1000000 / (10000000 + 2000000 + 200000);
+        assert(result.duration <= ideal * 11 / 10);
+    }
+}
+
+BENCHMARK(BlockDownloadSimulation, 400);
@@ -0,0 +1,137 @@
+// Copyright (c) 2019 The Kryptofranc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <crypto/common.h>
+#include <net.h>
+#include <netmessagemaker.h>
+#include <primitives/block.h>
+#include <protocol.h>
+#include <version.h>
+
+#include <memory>
+#include <set>
+#include <vector>
+
+/** Transactions in the relayed block, one input and two outputs each */
+static const size_t RELAY_BLOCK_TXS = 1000;
+
+/** A block of made-up P2PKH spends; relay never looks at the signatures */
+static CBlock RelayBlock()
+{
+    CBlock block;
+    for (size_t i = 0; i < RELAY_BLOCK_TXS; i++) {
+        uint256 prev_hash;
+        WriteLE64(prev_hash.begin(), i + 1);
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(prev_hash, 0);
+        tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 1) << std::vector<unsigned char>(33, 2);
+        tx.vout.resize(2);
+        for (CTxOut& out : tx.vout) {
+            out.scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 3) << OP_EQUALVERIFY << OP_CHECKSIG;
+            out.nValue = COIN;
+        }
+        block.vtx.push_back(MakeTransactionRef(std::move(tx)));
+    }
+    return block;
+}
+
+/**
+ * Peers without sockets: pushed messages stay queued, and are dropped after
+ * each relay so that every iteration starts from empty send queues.
+ */
+class RelayPeers
+{
+public:
+    explicit RelayPeers(size_t num_peers)
+    {
+        for (size_t i = 0; i < num_peers; i++) {
+            m_nodes.emplace_back(new CNode(i, NODE_NETWORK, 0, INVALID_SOCKET, CAddress(CService(), NODE_NONE), 0, 0, CAddress(), "", false));
+        }
+    }
+
+    CConnman m_connman{0x1337, 0x1337};
+    std::vector<std::unique_ptr<CNode>> m_nodes;
+
+    /** Number of distinct payload buffers queued across all peers */
+    size_t CountPayloads()
+    {
+        std::set<const std::vector<unsigned char>*> payloads;
+        for (const auto& node : m_nodes) {
+            LOCK(node->cs_vSend);
+            // Every message is a header buffer followed by its payload.
+            for (size_t i = 1; i < node->vSendMsg.size(); i += 2) {
+                payloads.insert(node->vSendMsg[i].get());
+            }
+        }
+        return payloads.size();
+    }
+
+    void Drain()
+    {
+        for (const auto& node : m_nodes) {
+            LOCK(node->cs_vSend);
+            node->vSendMsg.clear();
+            node->nSendSize = 0;
+            node->fPauseSend = false;
+        }
+    }
+};
+
+// Relaying a new block to every peer: the shared path serializes and hashes
+// it once and queues the same buffers for each peer, the unshared path (how
+// blocks were relayed before CSharedNetMsg) does both once per peer. The
+// payload copies each relay makes are checked on the first iteration.
+static void BlockRelay(benchmark::State& state, size_t num_peers, bool shared)
+{
+    const CBlock block = RelayBlock();
+    const CNetMsgMaker msg_maker(PROTOCOL_VERSION);
+    RelayPeers peers(num_peers);
+    bool first = true;
+
+    while (state.KeepRunning()) {
+        if (shared) {
+            const CSharedNetMsg msg = CConnman::ShareMessage(msg_maker.Make(NetMsgType::BLOCK, block));
+            for (const auto& node : peers.m_nodes) {
+                peers.m_connman.PushMessage(node.get(), msg);
+            }
+        } else {
+            for (const auto& node : peers.m_nodes) {
+                peers.m_connman.PushMessage(node.get(), msg_maker.Make(NetMsgType::BLOCK, block));
+            }
+        }
+        if (first) {
+            assert(peers.CountPayloads() == (shared ? 1 : num_peers));
+            first = false;
+        }
+        peers.Drain();
+    }
+}
+
+static void BlockRelaySharedPeers8(benchmark::State& state)
+{
+    BlockRelay(state, 8, true);
+}
+
+static void BlockRelayUnsharedPeers8(benchmark::State& state)
+{
+    BlockRelay(state, 8, false);
+}
+
+static void BlockRelaySharedPeers64(benchmark::State& state)
+{
+    BlockRelay(state, 64, true);
+}
+
+static void BlockRelayUnsharedPeers64(benchmark::State& state)
+{
+    BlockRelay(state, 64, false);
+}
+
+BENCHMARK(BlockRelaySharedPeers8, 500);
+BENCHMARK(BlockRelayUnsharedPeers8, 50);
+BENCHMARK(BlockRelaySharedPeers64, 500);
+BENCHMARK(BlockRelayUnsharedPeers64, 10);
@@ -0,0 +1,82 @@
+// Copyright (c) 2016-2018 The Bitcoin Core developers
+// Copyright (c) 2018-2019 The Kryptofranc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <coins.h>
+#include <key.h>
+#include <policy/policy.h>
+#include <script/standard.h>
+
+#include <vector>
+
+// Add a pair of P2PK and P2PKH transactions to the coins view, and return
+// the outpoints created.
+static std::vector<COutPoint> SetupDummyInputs(CCoinsViewCache& coinsRet)
+{
+    std::vector<COutPoint> outpoints;
+    CMutableTransaction dummy_tx[2];
+
+    CKey key[4];
+    for (int i = 0; i < 4; i++) {
+        key[i].MakeNewKey(i % 2);
+    }
+
+    // Create some dummy input transactions
+    dummy_tx[0].vout.resize(2);
+    dummy_tx[0].vout[0].nValue = 11 * COIN;
+    dummy_tx[0].vout[0].scriptPubKey << ToByteVector(key[0].GetPubKey()) << OP_CHECKSIG;
+    dummy_tx[0].vout[1].nValue = 50 * COIN;
+    dummy_tx[0].vout[1].scriptPubKey << ToByteVector(key[1].GetPubKey()) << OP_CHECKSIG;
+    AddCoins(coinsRet, CTransaction(dummy_tx[0]), 0);
+
+    dummy_tx[1].vout.resize(2);
+    dummy_tx[1].vout[0].nValue = 21 * COIN;
+    dummy_tx[1].vout[0].scriptPubKey = GetScriptForDestination(key[2].GetPubKey().GetID());
+    dummy_tx[1].vout[1].nValue = 22 * COIN;
+    dummy_tx[1].vout[1].scriptPubKey = GetScriptForDestination(key[3].GetPubKey().GetID());
+    AddCoins(coinsRet, CTransaction(dummy_tx[1]), 0);
+
+    outpoints.emplace_back(dummy_tx[0].GetHash(), 1);
+    outpoints.emplace_back(dummy_tx[1].GetHash(), 0);
+    outpoints.emplace_back(dummy_tx[1].GetHash(), 1);
+    return outpoints;
+}
+
+// Microbenchmark for simple accesses to a CCoinsViewCache database. Note from
+// laanwj, "replicating the actual usage patterns of the client is hard though,
+// many times micro-benchmarks of the database showed completely different
+// characteristics than e.g. reindex timings. But that's not a requirement of
+// every benchmark."
+// (https://github.com/bitcoin/bitcoin/issues/7883#issuecomment-224807484)
+static void CCoinsCaching(benchmark::State& state)
+{
+    CCoinsView coinsDummy;
+    CCoinsViewCache coins(&coinsDummy);
+    std::vector<COutPoint> outpoints = SetupDummyInputs(coins);
+
+    CMutableTransaction t1;
+    t1.vin.resize(3);
+    for (size_t i = 0; i < outpoints.size(); i++) {
+        t1.vin[i].prevout = outpoints[i];
+        t1.vin[i].scriptSig << std::vector<unsigned char>(65, 0);
+    }
+    t1.vin[1].scriptSig << std::vector<unsigned char>(33, 4);
+    t1.vin[2].scriptSig << std::vector<unsigned char>(33, 4);
+    t1.vout.resize(2);
+    t1.vout[0].nValue = 90 * COIN;
+    t1.vout[0].scriptPubKey << OP_1;
+
+    // Benchmark.
+    const CTransaction tx_1(t1);
+    while (state.KeepRunning()) {
+        bool success = AreInputsStandard(tx_1, coins);
+        assert(success);
+        CAmount value = coins.GetValueIn(tx_1);
+        assert(value == (50 + 21 + 22) * COIN);
+    }
+}
+
+BENCHMARK(CCoinsCaching, 170 * 1000);
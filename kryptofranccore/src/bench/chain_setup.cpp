@@ -0,0 +1,196 @@
+// Copyright (c) 2018-2019 The Kryptofranc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/chain_setup.h>
+
+#include <chainparams.h>
+#include <consensus/consensus.h>
+#include <consensus/merkle.h>
+#include <consensus/validation.h>
+#include <keystore.h>
+#include <pow.h>
+#include <random.h>
+#include <script/sigcache.h>
+#include <script/sign.h>
+#include <script/standard.h>
+#include <timedata.h>
+#include <txdb.h>
+#include <txmempool.h>
+#include <util/system.h>
+#include <validation.h>
+#include <validationinterface.h>
+
+#include <stdexcept>
+
+BenchChainSetup::BenchChainSetup(size_t num_coins)
+{
+    SelectParams(CBaseChainParams::MAIN);
+    const CChainParams& chainparams = Params();
+
+    // Keep every iteration on the script interpreter instead of the caches.
+    gArgs.ForceSetArg("-maxsigcachesize", "0");
+    InitSignatureCache();
+    InitScriptExecutionCache();
+
+    ClearDatadirCache();
+    m_path = fs::temp_directory_path() / strprintf("bench_kryptofranc_%lu_%i", (unsigned long)GetTime(), (int)GetRand(1 << 30));
+    fs::create_directories(m_path);
+    gArgs.ForceSetArg("-datadir", m_path.string());
+
+    // ActivateBestChain blocks on a full validation queue unless someone services it.
+    m_threads.create_thread(std::bind(&CScheduler::serviceQueue, &m_scheduler));
+    GetMainSignals().RegisterBackgroundSignalScheduler(m_scheduler);
+
+    pblocktree.reset(new CBlockTreeDB(1 << 20, true));
+    pcoinsdbview.reset(new CCoinsViewDB(1 << 23, true));
+    pcoinsTip.reset(new CCoinsViewCache(pcoinsdbview.get()));
+    if (!LoadGenesisBlock(chainparams)) {
+        throw std::runtime_error("LoadGenesisBlock failed.");
+    }
+    {
+        CValidationState state;
+        if (!ActivateBestChain(state, chainparams)) {
+            throw std::runtime_error(strprintf("ActivateBestChain failed. (%s)", FormatStateMessage(state)));
+        }
+    }
+
+    nScriptCheckThreads = std::min(std::max(GetNumCores(), 1), MAX_SCRIPTCHECK_THREADS);
+    for (int i = 0; i < nScriptCheckThreads - 1; i++) {
+        m_threads.create_thread(&ThreadScriptCheck);
+    }
+
+    std::vector<unsigned char> seed(32, 0x4b);
+    m_key.Set(seed.begin(), seed.end(), true);
+    m_script_pub_key = GetScriptForDestination(m_key.GetPubKey().GetID());
+
+    // Block 1 carries the premine; mature it, then fan it out.
+    std::vector<CBlock> mined;
+    for (int i = 0; i <= COINBASE_MATURITY; i++) {
+        mined.push_back(CreateAndProcessBlock({}));
+    }
+    const CTransactionRef& premine = mined.front().vtx[0];
+
+    CMutableTransaction fanout;
+    fanout.vin.emplace_back(COutPoint(premine->GetHash(), 0));
+    const CAmount value = premine->vout[0].nValue / (num_coins + 1);
+    for (size_t i = 0; i < num_coins; i++) {
+        fanout.vout.emplace_back(value, m_script_pub_key);
+    }
+    CBasicKeyStore keystore;
+    keystore.AddKey(m_key);
+    if (!SignSignature(keystore, *premine, fanout, 0, SIGHASH_ALL)) {
+        throw std::runtime_error("Signing the fan-out transaction failed.");
+    }
+    const CTransactionRef fanout_tx = MakeTransactionRef(std::move(fanout));
+    CreateAndProcessBlock({fanout_tx});
+    {
+        LOCK(cs_main);
+        m_coin_height = chainActive.Height();
+    }
+    for (size_t i = 0; i < num_coins; i++) {
+        m_coins.emplace_back(fanout_tx->GetHash(), i);
+        m_coin_outs.push_back(fanout_tx->vout[i]);
+    }
+
+    // Start from an empty coins cache.
+    FlushStateToDisk();
+}
+
+BenchChainSetup::~BenchChainSetup()
+{
+    m_threads.interrupt_all();
+    m_threads.join_all();
+    GetMainSignals().FlushBackgroundCallbacks();
+    GetMainSignals().UnregisterBackgroundSignalScheduler();
+    mempool.clear();
+    UnloadBlockIndex();
+    pcoinsTip.reset();
+    pcoinsdbview.reset();
+    pblocktree.reset();
+    nScriptCheckThreads = 0;
+    fs::remove_all(m_path);
+}
+
+CTransactionRef BenchChainSetup::Spend(const COutPoint& prevout, const CTxOut& prev_out, CAmount fee, size_t num_outputs) const
+{
+    CMutableTransaction mtx;
+    mtx.vin.emplace_back(prevout);
+    const CAmount value = (prev_out.nValue - fee) / num_outputs;
+    for (size_t o = 0; o < num_outputs; o++) {
+        mtx.vout.emplace_back(value, m_script_pub_key);
+    }
+    CBasicKeyStore keystore;
+    keystore.AddKey(m_key);
+    if (!SignSignature(keystore, m_script_pub_key, mtx, 0, prev_out.nValue, SIGHASH_ALL)) {
+        throw std::runtime_error("Signing a fixture transaction failed.");
+    }
+    return MakeTransactionRef(std::move(mtx));
+}
+
+CTransactionRef BenchChainSetup::SpendCoin(size_t i, CAmount fee, size_t num_outputs) const
+{
+    return Spend(m_coins.at(i), m_coin_outs.at(i), fee, num_outputs);
+}
+
+CTransactionRef BenchChainSetup::SpendOutput(const CTransactionRef& prev, uint32_t n, CAmount fee, size_t num_outputs) const
+{
+    return Spend(COutPoint(prev->GetHash(), n), prev->vout.at(n), fee, num_outputs);
+}
+
+CBlock BenchChainSetup::CreateBlock(const std::vector<CTransactionRef>& txs) const
+{
+    const Consensus::Params& consensus = Params().GetConsensus();
+    CBlock block;
+    LOCK(cs_main);
+    const CBlockIndex* tip = chainActive.Tip();
+
+    CMutableTransaction coinbase;
+    coinbase.vin.resize(1);
+    coinbase.vin[0].prevout.SetNull();
+    coinbase.vin[0].scriptSig = CScript() << (tip->nHeight + 1) << OP_0;
+    coinbase.vout.emplace_back(GetBlockSubsidy(tip->nHeight + 1, consensus), m_script_pub_key);
+    block.vtx.push_back(MakeTransactionRef(std::move(coinbase)));
+    block.vtx.insert(block.vtx.end(), txs.begin(), txs.end());
+
+    block.nVersion = ComputeBlockVersion(tip, consensus);
+    block.hashPrevBlock = tip->GetBlockHash();
+    block.nTime = std::max<int64_t>(tip->GetMedianTimePast() + 1, GetAdjustedTime());
+    // Below height 10000 KYF does not enforce the retarget, which is what lets
+    // a benchmark mine main-net blocks at the proof-of-work limit.
+    block.nBits = UintToArith256(consensus.powLimit).GetCompact();
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    while (!CheckProofOfWork(block.GetHash(), block.nBits, consensus)) {
+        ++block.nNonce;
+    }
+    return block;
+}
+
+CBlock BenchChainSetup::CreateAndProcessBlock(const std::vector<CTransactionRef>& txs)
+{
+    std::shared_ptr<const CBlock> block = std::make_shared<const CBlock>(CreateBlock(txs));
+    if (!ProcessNewBlock(Params(), block, true, nullptr)) {
+        throw std::runtime_error("Fixture block was rejected.");
+    }
+    LOCK(cs_main);
+    if (chainActive.Tip()->GetBlockHash() != block->GetHash()) {
+        throw std::runtime_error("Fixture block was not connected.");
+    }
+    return *block;
+}
+
+CBlockUndo BenchChainSetup::UndoForBlock(const CBlock& block) const
+{
+    std::map<COutPoint, size_t> index;
+    for (size_t i = 0; i < m_coins.size(); i++) {
+        index.emplace(m_coins[i], i);
+    }
+    CBlockUndo undo;
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        undo.vtxundo.emplace_back();
+        for (const CTxIn& txin : block.vtx[i]->vin) {
+            undo.vtxundo.back().vprevout.emplace_back(m_coin_outs.at(index.at(txin.prevout)), m_coin_height, false);
+        }
+    }
+    return undo;
+}
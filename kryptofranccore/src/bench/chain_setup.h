@@ -0,0 +1,69 @@
+// Copyright (c) 2018-2019 The Kryptofranc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KRYPTOFRANC_BENCH_CHAIN_SETUP_H
+#define KRYPTOFRANC_BENCH_CHAIN_SETUP_H
+
+#include <fs.h>
+#include <key.h>
+#include <primitives/block.h>
+#include <primitives/transaction.h>
+#include <scheduler.h>
+#include <script/script.h>
+#include <undo.h>
+
+#include <vector>
+
+#include <boost/thread.hpp>
+
+/**
+ * Kryptofranc main-chain state for benchmarks that need a tip, a coins
+ * database and a mempool.
+ *
+ * The chain starts at the real KYF genesis block and is extended with blocks
+ * mined under main-net consensus rules (subsidy schedule including the
+ * height-1 premine, coinbase maturity, BIP34). The premine coinbase is fanned
+ * out into num_coins confirmed P2PKH outputs owned by m_key, which the
+ * benchmarks then spend. The coins database is an in-memory LevelDB and the
+ * coins cache is flushed after setup, so the first access to each coin is a
+ * database read, just like on a node with a cold -dbcache.
+ *
+ * Signature and script-execution caches are sized to zero so that repeated
+ * iterations keep measuring real script verification.
+ */
+class BenchChainSetup
+{
+public:
+    explicit BenchChainSetup(size_t num_coins);
+    ~BenchChainSetup();
+
+    /** Key owning all fixture coins. */
+    CKey m_key;
+    CScript m_script_pub_key;
+    /** Confirmed, unspent outputs paying to m_script_pub_key. */
+    std::vector<CTxOut> m_coin_outs;
+    std::vector<COutPoint> m_coins;
+    /** Height of the block that created the fixture coins. */
+    int m_coin_height = 0;
+
+    /** Signed transaction spending coin i into num_outputs outputs, paying fee. */
+    CTransactionRef SpendCoin(size_t i, CAmount fee, size_t num_outputs = 1) const;
+    /** Signed transaction spending output n of prev, which must pay to m_script_pub_key, into num_outputs outputs. */
+    CTransactionRef SpendOutput(const CTransactionRef& prev, uint32_t n, CAmount fee, size_t num_outputs = 1) const;
+    /** Block on top of the current tip containing the given transactions, mined. */
+    CBlock CreateBlock(const std::vector<CTransactionRef>& txs) const;
+    /** Mine a block with the given transactions and connect it. */
+    CBlock CreateAndProcessBlock(const std::vector<CTransactionRef>& txs);
+    /** Undo data for a block spending only fixture coins (as needed by BlockFilter). */
+    CBlockUndo UndoForBlock(const CBlock& block) const;
+
+private:
+    CTransactionRef Spend(const COutPoint& prevout, const CTxOut& prev_out, CAmount fee, size_t num_outputs) const;
+
+    fs::path m_path;
+    boost::thread_group m_threads;
+    CScheduler m_scheduler;
+};
+
+#endif // KRYPTOFRANC_BENCH_CHAIN_SETUP_H
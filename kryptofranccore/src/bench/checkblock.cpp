@@ -0,0 +1,80 @@
+// Copyright (c) 2016-2018 The Bitcoin Core developers
+// Copyright (c) 2018-2019 The Kryptofranc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <bench/chain_setup.h>
+
+#include <chainparams.h>
+#include <consensus/validation.h>
+#include <streams.h>
+#include <validation.h>
+
+// These are the two major time-sinks which happen after we have fully received
+// a block off the wire, but before we can relay the block on to peers using
+// compact block relay.
+
+static const size_t BLOCK_TXS = 1000;
+
+static CDataStream SerializedFixtureBlock()
+{
+    BenchChainSetup setup(BLOCK_TXS);
+    std::vector<CTransactionRef> txs;
+    for (size_t i = 0; i < BLOCK_TXS; i++) {
+        txs.push_back(setup.SpendCoin(i, 10000, 2));
+    }
+    CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+    stream << setup.CreateBlock(txs);
+    return stream;
+}
+
+static void DeserializeBlockTest(benchmark::State& state)
+{
+    CDataStream stream = SerializedFixtureBlock();
+    char a = '\0';
+    stream.write(&a, 1); // Prevent compaction
+
+    while (state.KeepRunning()) {
+        CBlock block;
+        stream >> block;
+        bool rewound = stream.Rewind(stream.size() - 1);
+        assert(rewound);
+    }
+}
+
+static void DeserializeAndCheckBlockTest(benchmark::State& state)
+{
+    CDataStream stream = SerializedFixtureBlock();
+    char a = '\0';
+    stream.write(&a, 1); // Prevent compaction
+
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+
+    while (state.KeepRunning()) {
+        CBlock block; // Note that CBlock caches its checked state, so we need to recreate it here
+        stream >> block;
+        bool rewound = stream.Rewind(stream.size() - 1);
+        assert(rewound);
+
+        CValidationState validationState;
+        bool checked = CheckBlock(block, validationState, chainParams->GetConsensus());
+        assert(checked);
+    }
+}
+
+static void CheckGenesisBlock(benchmark::State& state)
+{
+    const auto chainParams = CreateChainParams(CBaseChainParams::MAIN);
+
+    while (state.KeepRunning()) {
+        CBlock block = chainParams->GenesisBlock();
+        CValidationState validationState;
+        bool checked = CheckBlock(block, validationState, chainParams->GetConsensus());
+        assert(checked);
+    }
+}
+
+BENCHMARK(DeserializeBlockTest, 130);
+BENCHMARK(DeserializeAndCheckBlockTest, 160);
+BENCHMARK(CheckGenesisBlock, 100000);
@@ -0,0 +1,103 @@
+// Copyright (c) 2019 The Kryptofranc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <checkqueue.h>
+#include <crypto/sha256.h>
+#include <random.h>
+
+#include <boost/thread/thread.hpp>
+
+// Compares the work-stealing CCheckQueue with the previous batching
+// CBatchCheckQueue on a block-sized workload where a few inputs are far more
+// expensive than the rest, like a block with a handful of large multisig
+// spends among ordinary P2PKH inputs.
+
+static const size_t TXS_PER_BLOCK = 1000;
+static const size_t MAX_INPUTS_PER_TX = 4;
+//! One in this many checks is expensive
+static const int EXPENSIVE_CHECK_RATIO = 500;
+static const int CHEAP_CHECK_ROUNDS = 20;
+static const int EXPENSIVE_CHECK_ROUNDS = 5000;
+
+struct FakeScriptCheck
+{
+    int m_rounds = 0;
+
+    FakeScriptCheck() = default;
+    explicit FakeScriptCheck(int rounds) : m_rounds(rounds) {}
+
+    bool operator()()
+    {
+        unsigned char buf[CSHA256::OUTPUT_SIZE] = {};
+        for (int i = 0; i < m_rounds; i++) {
+            CSHA256().Write(buf, sizeof(buf)).Finalize(buf);
+        }
+        return true;
+    }
+
+    void swap(FakeScriptCheck& other) { std::swap(m_rounds, other.m_rounds); }
+};
+
+template <typename Queue>
+static void CheckQueueBench(benchmark::State& state, Queue& queue, int threads)
+{
+    boost::thread_group workers;
+    for (int i = 0; i < threads - 1; i++) {
+        workers.create_thread([&queue] { queue.Thread(); });
+    }
+
+    FastRandomContext rng(true);
+    std::vector<std::vector<FakeScriptCheck>> block(TXS_PER_BLOCK);
+    for (auto& tx : block) {
+        size_t inputs = 1 + rng.randrange(MAX_INPUTS_PER_TX);
+        for (size_t i = 0; i < inputs; i++) {
+            tx.emplace_back(rng.randrange(EXPENSIVE_CHECK_RATIO) == 0 ? EXPENSIVE_CHECK_ROUNDS : CHEAP_CHECK_ROUNDS);
+        }
+    }
+
+    while (state.KeepRunning()) {
+        CCheckQueueControl<FakeScriptCheck, Queue> control(&queue);
+        for (const auto& tx : block) {
+            // Add() consumes the checks, so hand it a copy.
+            std::vector<FakeScriptCheck> checks(tx);
+            control.Add(checks);
+        }
+        bool ok = control.Wait();
+        assert(ok);
+    }
+
+    workers.interrupt_all();
+    workers.join_all();
+}
+
+static void CheckQueueWorkStealing(benchmark::State& state, int threads)
+{
+    CCheckQueue<FakeScriptCheck> queue(1024);
+    CheckQueueBench(state, queue, threads);
+}
+
+static void CheckQueueBatch(benchmark::State& state, int threads)
+{
+    CBatchCheckQueue<FakeScriptCheck> queue(128);
+    CheckQueueBench(state, queue, threads);
+}
+
+static void CheckQueueWorkStealing_4Threads(benchmark::State& state) { CheckQueueWorkStealing(state, 4); }
+static void CheckQueueWorkStealing_8Threads(benchmark::State& state) { CheckQueueWorkStealing(state, 8); }
+static void CheckQueueWorkStealing_16Threads(benchmark::State& state) { CheckQueueWorkStealing(state, 16); }
+static void CheckQueueWorkStealing_32Threads(benchmark::State& state) { CheckQueueWorkStealing(state, 32); }
+static void CheckQueueBatch_4Threads(benchmark::State& state) { CheckQueueBatch(state, 4); }
+static void CheckQueueBatch_8Threads(benchmark::State& state) { CheckQueueBatch(state, 8); }
+static void CheckQueueBatch_16Threads(benchmark::State& state) { CheckQueueBatch(state, 16); }
+static void CheckQueueBatch_32Threads(benchmark::State& state) { CheckQueueBatch(state, 32); }
+
+BENCHMARK(CheckQueueWorkStealing_4Threads, 50);
+BENCHMARK(CheckQueueWorkStealing_8Threads, 50);
+BENCHMARK(CheckQueueWorkStealing_16Threads, 50);
+BENCHMARK(CheckQueueWorkStealing_32Threads, 50);
+BENCHMARK(CheckQueueBatch_4Threads, 50);
+BENCHMARK(CheckQueueBatch_8Threads, 50);
+BENCHMARK(CheckQueueBatch_16Threads, 50);
+BENCHMARK(CheckQueueBatch_32Threads, 50);
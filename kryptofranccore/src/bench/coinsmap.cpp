@@ -0,0 +1,101 @@
+// Copyright (c) 2019 The Kryptofranc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <coins.h>
+#include <memusage.h>
+#include <random.h>
+#include <script/script.h>
+
+#include <iostream>
+#include <unordered_map>
+
+// Compares CCoinsMap with the std::unordered_map it replaced, on a cache of
+// COINS_IN_CACHE coins. Each iteration performs LOOKUPS_PER_ITER lookups, half
+// of which miss, like the coins cache looking up the inputs of new blocks.
+// The memory each map uses per cached coin is written to stderr, keeping the
+// results on stdout parseable.
+
+typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> UnorderedCoinsMap;
+
+static const size_t COINS_IN_CACHE = 200000;
+static const size_t LOOKUPS_PER_ITER = 1000;
+
+static COutPoint RandomOutPoint(FastRandomContext& rng)
+{
+    return COutPoint(rng.rand256(), rng.randrange(4));
+}
+
+static Coin RandomCoin(FastRandomContext& rng)
+{
+    CScript script;
+    script << OP_DUP << OP_HASH160 << rng.randbytes(20) << OP_EQUALVERIFY << OP_CHECKSIG;
+    return Coin(CTxOut(rng.randrange(1000000), script), rng.randrange(100000), false);
+}
+
+template <typename Map>
+static void FillCoinsMap(Map& map, std::vector<COutPoint>& outpoints, FastRandomContext& rng)
+{
+    for (size_t i = 0; i < COINS_IN_CACHE; i++) {
+        COutPoint outpoint = RandomOutPoint(rng);
+        map.emplace(std::piecewise_construct, std::forward_as_tuple(outpoint), std::forward_as_tuple(RandomCoin(rng)));
+        outpoints.push_back(outpoint);
+    }
+}
+
+static size_t MapMemoryUsage(const CCoinsMap& map) { return map.DynamicMemoryUsage(); }
+static size_t MapMemoryUsage(const UnorderedCoinsMap& map) { return memusage::DynamicUsage(map); }
+
+template <typename Map>
+static void CoinsMapLookup(benchmark::State& state, const char* name)
+{
+    FastRandomContext rng(true);
+    Map map;
+    std::vector<COutPoint> outpoints;
+    FillCoinsMap(map, outpoints, rng);
+    // The scripts are short enough to be held inline, so this is all map overhead and entries.
+    std::cerr << name << ": " << MapMemoryUsage(map) / map.size() << " bytes per cached coin" << std::endl;
+    std::vector<COutPoint> lookups;
+    for (size_t i = 0; i < LOOKUPS_PER_ITER; i++) {
+        lookups.push_back(i % 2 ? outpoints[rng.randrange(outpoints.size())] : RandomOutPoint(rng));
+    }
+
+    size_t found = 0;
+    while (state.KeepRunning()) {
+        for (const COutPoint& outpoint : lookups) {
+            found += map.find(outpoint) != map.end();
+        }
+    }
+    assert(found > 0);
+}
+
+template <typename Map>
+static void CoinsMapInsertErase(benchmark::State& state)
+{
+    FastRandomContext rng(true);
+    Map map;
+    std::vector<COutPoint> outpoints;
+    FillCoinsMap(map, outpoints, rng);
+
+    // Spend LOOKUPS_PER_ITER coins and add as many new ones, as connecting a block does.
+    size_t next = 0;
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < LOOKUPS_PER_ITER; i++) {
+            map.erase(map.find(outpoints[next]));
+            outpoints[next] = RandomOutPoint(rng);
+            map.emplace(std::piecewise_construct, std::forward_as_tuple(outpoints[next]), std::forward_as_tuple(RandomCoin(rng)));
+            next = (next + 1) % outpoints.size();
+        }
+    }
+}
+
+static void CoinsMapLookup_Flat(benchmark::State& state) { CoinsMapLookup<CCoinsMap>(state, "CCoinsMap"); }
+static void CoinsMapLookup_Unordered(benchmark::State& state) { CoinsMapLookup<UnorderedCoinsMap>(state, "std::unordered_map"); }
+static void CoinsMapInsertErase_Flat(benchmark::State& state) { CoinsMapInsertErase<CCoinsMap>(state); }
+static void CoinsMapInsertErase_Unordered(benchmark::State& state) { CoinsMapInsertErase<UnorderedCoinsMap>(state); }
+
+BENCHMARK(CoinsMapLookup_Flat, 5000);
+BENCHMARK(CoinsMapLookup_Unordered, 5000);
+BENCHMARK(CoinsMapInsertErase_Flat, 500);
+BENCHMARK(CoinsMapInsertErase_Unordered, 500);
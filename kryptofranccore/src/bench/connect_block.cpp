@@ -0,0 +1,53 @@
+// Copyright (c) 2018-2019 The Kryptofranc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <bench/chain_setup.h>
+
+#include <chainparams.h>
+#include <coins.h>
+#include <consensus/validation.h>
+#include <validation.h>
+
+// ConnectBlock is reached through TestBlockValidity, which connects the block
+// on a throw-away CCoinsViewCache layered over pcoinsTip.
+
+static const size_t BLOCK_TXS = 1000;
+
+static void ConnectBlock(benchmark::State& state, bool cold_coins)
+{
+    BenchChainSetup setup(BLOCK_TXS);
+    std::vector<CTransactionRef> txs;
+    for (size_t i = 0; i < BLOCK_TXS; i++) {
+        txs.push_back(setup.SpendCoin(i, 10000, 2));
+    }
+    const CBlock block = setup.CreateBlock(txs);
+    const CChainParams& chainparams = Params();
+
+    LOCK(cs_main);
+    while (state.KeepRunning()) {
+        CValidationState validation_state;
+        bool valid = TestBlockValidity(validation_state, chainparams, block, chainActive.Tip());
+        assert(valid);
+        if (cold_coins) {
+            // Every input has to come from the coins database again.
+            for (const COutPoint& prevout : setup.m_coins) {
+                pcoinsTip->Uncache(prevout);
+            }
+        }
+    }
+}
+
+static void ConnectBlockWarmCoins(benchmark::State& state)
+{
+    ConnectBlock(state, false);
+}
+
+static void ConnectBlockColdCoins(benchmark::State& state)
+{
+    ConnectBlock(state, true);
+}
+
+BENCHMARK(ConnectBlockWarmCoins, 5);
+BENCHMARK(ConnectBlockColdCoins, 5);
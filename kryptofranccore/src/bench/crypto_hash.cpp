@@ -0,0 +1,80 @@
+// Copyright (c) 2016-2018 The Bitcoin Core developers
+// Copyright (c) 2018-2019 The Kryptofranc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <crypto/sha256.h>
+#include <crypto/siphash.h>
+#include <hash.h>
+#include <primitives/block.h>
+#include <uint256.h>
+
+#include <vector>
+
+/* Number of bytes to hash per iteration */
+static const uint64_t BUFFER_SIZE = 1000*1000;
+
+static void SHA256(benchmark::State& state)
+{
+    uint8_t hash[CSHA256::OUTPUT_SIZE];
+    std::vector<uint8_t> in(BUFFER_SIZE,0);
+    while (state.KeepRunning())
+        CSHA256().Write(in.data(), in.size()).Finalize(hash);
+}
+
+static void SHA256_32b(benchmark::State& state)
+{
+    std::vector<uint8_t> in(32,0);
+    while (state.KeepRunning()) {
+        CSHA256()
+            .Write(in.data(), in.size())
+            .Finalize(in.data());
+    }
+}
+
+static void SHA256_80b_BlockHeader(benchmark::State& state)
+{
+    CBlockHeader header;
+    while (state.KeepRunning()) {
+        ++header.nNonce;
+        header.GetHash();
+    }
+}
+
+/* SHA256D64 picks the widest TransformD64 kernel (8-way AVX2, 4-way SSE4.1,
+ * 2-way SHA-NI or the scalar one) that fits the remaining number of blobs, so
+ * each of these exercises a different kernel where the CPU supports it. */
+static void SHA256D64Blocks(benchmark::State& state, size_t blocks)
+{
+    std::vector<uint8_t> in(64 * blocks);
+    while (state.KeepRunning()) {
+        SHA256D64(in.data(), in.data(), blocks);
+    }
+}
+
+static void SHA256D64_1(benchmark::State& state) { SHA256D64Blocks(state, 1); }
+static void SHA256D64_2(benchmark::State& state) { SHA256D64Blocks(state, 2); }
+static void SHA256D64_4(benchmark::State& state) { SHA256D64Blocks(state, 4); }
+static void SHA256D64_8(benchmark::State& state) { SHA256D64Blocks(state, 8); }
+static void SHA256D64_1024(benchmark::State& state) { SHA256D64Blocks(state, 1024); }
+
+static void SipHash_32b(benchmark::State& state)
+{
+    uint256 x;
+    uint64_t k1 = 0;
+    while (state.KeepRunning()) {
+        *((uint64_t*)x.begin()) = SipHashUint256(0, ++k1, x);
+    }
+}
+
+BENCHMARK(SHA256, 340);
+BENCHMARK(SHA256_32b, 4700 * 1000);
+BENCHMARK(SHA256_80b_BlockHeader, 2000 * 1000);
+BENCHMARK(SHA256D64_1, 4000 * 1000);
+BENCHMARK(SHA256D64_2, 2000 * 1000);
+BENCHMARK(SHA256D64_4, 1000 * 1000);
+BENCHMARK(SHA256D64_8, 500 * 1000);
+BENCHMARK(SHA256D64_1024, 7400);
+BENCHMARK(SipHash_32b, 40 * 1000 * 1000);
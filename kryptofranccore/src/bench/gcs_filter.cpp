@@ -0,0 +1,69 @@
+// Copyright (c) 2018 The Bitcoin Core developers
+// Copyright (c) 2018-2019 The Kryptofranc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <bench/chain_setup.h>
+
+#include <blockfilter.h>
+
+static void ConstructGCSFilter(benchmark::State& state)
+{
+    GCSFilter::ElementSet elements;
+    for (int i = 0; i < 10000; ++i) {
+        GCSFilter::Element element(32);
+        element[0] = static_cast<unsigned char>(i);
+        element[1] = static_cast<unsigned char>(i >> 8);
+        elements.insert(std::move(element));
+    }
+
+    uint64_t siphash_k0 = 0;
+    while (state.KeepRunning()) {
+        GCSFilter filter({siphash_k0, 0, 20, 1 << 20}, elements);
+
+        siphash_k0++;
+    }
+}
+
+static void MatchGCSFilter(benchmark::State& state)
+{
+    GCSFilter::ElementSet elements;
+    for (int i = 0; i < 10000; ++i) {
+        GCSFilter::Element element(32);
+        element[0] = static_cast<unsigned char>(i);
+        element[1] = static_cast<unsigned char>(i >> 8);
+        elements.insert(std::move(element));
+    }
+    GCSFilter filter({0, 0, 20, 1 << 20}, elements);
+
+    while (state.KeepRunning()) {
+        filter.Match(GCSFilter::Element());
+    }
+}
+
+// BIP 158 basic filter over a block of fixture spends, i.e. the work the
+// filter index does for every connected block.
+static void ConstructBasicBlockFilter(benchmark::State& state)
+{
+    static const size_t BLOCK_TXS = 1000;
+    CBlock block;
+    CBlockUndo block_undo;
+    {
+        BenchChainSetup setup(BLOCK_TXS);
+        std::vector<CTransactionRef> txs;
+        for (size_t i = 0; i < BLOCK_TXS; i++) {
+            txs.push_back(setup.SpendCoin(i, 10000, 2));
+        }
+        block = setup.CreateBlock(txs);
+        block_undo = setup.UndoForBlock(block);
+    }
+
+    while (state.KeepRunning()) {
+        BlockFilter filter(BlockFilterType::BASIC, block, block_undo);
+    }
+}
+
+BENCHMARK(ConstructGCSFilter, 1000);
+BENCHMARK(MatchGCSFilter, 50 * 1000);
+BENCHMARK(ConstructBasicBlockFilter, 200);
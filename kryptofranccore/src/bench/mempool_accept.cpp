@@ -0,0 +1,34 @@
+// Copyright (c) 2018-2019 The Kryptofranc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <bench/chain_setup.h>
+
+#include <consensus/validation.h>
+#include <txmempool.h>
+#include <validation.h>
+
+static const size_t NUM_TXS = 500;
+
+static void AcceptToMemoryPoolBench(benchmark::State& state)
+{
+    BenchChainSetup setup(NUM_TXS);
+    std::vector<CTransactionRef> txs;
+    for (size_t i = 0; i < NUM_TXS; i++) {
+        txs.push_back(setup.SpendCoin(i, 10000, 2));
+    }
+
+    while (state.KeepRunning()) {
+        LOCK(cs_main);
+        for (const auto& tx : txs) {
+            CValidationState validation_state;
+            bool accepted = AcceptToMemoryPool(mempool, validation_state, tx, nullptr /* pfMissingInputs */,
+                nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */);
+            assert(accepted);
+        }
+        mempool.clear();
+    }
+}
+
+BENCHMARK(AcceptToMemoryPoolBench, 5);
@@ -0,0 +1,67 @@
+// Copyright (c) 2019 The Kryptofranc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+#include <bench/chain_setup.h>
+
+#include <consensus/validation.h>
+#include <txmempool.h>
+#include <util/system.h>
+#include <validation.h>
+
+static const CAmount CHAIN_TX_FEE = 10000;
+
+/** num_chains chains of chain_length transactions, each spending the previous one */
+static std::vector<CTransactionRef> CreateChains(const BenchChainSetup& setup, size_t num_chains, size_t chain_length)
+{
+    std::vector<CTransactionRef> txs;
+    for (size_t c = 0; c < num_chains; c++) {
+        txs.push_back(setup.SpendCoin(c, CHAIN_TX_FEE));
+        for (size_t i = 1; i < chain_length; i++) {
+            txs.push_back(setup.SpendOutput(txs.back(), 0, CHAIN_TX_FEE));
+        }
+    }
+    return txs;
+}
+
+static void AcceptChains(benchmark::State& state, const std::vector<CTransactionRef>& txs)
+{
+    while (state.KeepRunning()) {
+        LOCK(cs_main);
+        for (const auto& tx : txs) {
+            CValidationState validation_state;
+            bool accepted = AcceptToMemoryPool(mempool, validation_state, tx, nullptr /* pfMissingInputs */,
+                nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */);
+            assert(accepted);
+        }
+        mempool.clear();
+    }
+}
+
+// Chains as long as the default ancestor and descendant limits allow
+static void MempoolChainAccept(benchmark::State& state)
+{
+    BenchChainSetup setup(20);
+    AcceptChains(state, CreateChains(setup, 20, DEFAULT_ANCESTOR_LIMIT));
+}
+
+// A single chain of 500 transactions, with the limits raised to allow it, so
+// that every walk over its ancestors visits hundreds of entries
+static void MempoolLongChainAccept(benchmark::State& state)
+{
+    BenchChainSetup setup(1);
+    const std::vector<CTransactionRef> txs = CreateChains(setup, 1, 500);
+    gArgs.ForceSetArg("-limitancestorcount", "1000");
+    gArgs.ForceSetArg("-limitdescendantcount", "1000");
+    gArgs.ForceSetArg("-limitancestorsize", "1000");
+    gArgs.ForceSetArg("-limitdescendantsize", "1000");
+    AcceptChains(state, txs);
+    gArgs.ForceSetArg("-limitancestorcount", std::to_string(DEFAULT_ANCESTOR_LIMIT));
+    gArgs.ForceSetArg("-limitdescendantcount", std::to_string(DEFAULT_DESCENDANT_LIMIT));
+    gArgs.ForceSetArg("-limitancestorsize", std::to_string(DEFAULT_ANCESTOR_SIZE_LIMIT));
+    gArgs.ForceSetArg("-limitdescendantsize", std::to_string(DEFAULT_DESCENDANT_SIZE_LIMIT));
+}
+
+BENCHMARK(MempoolChainAccept, 5);
+BENCHMARK(MempoolLongChainAccept, 2);
@@ -0,0 +1,97 @@
+// Copyright (c) 2019 The Kryptofranc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <consensus/consensus.h>
+#include <crypto/common.h>
+#include <random.h>
+#include <txmempool.h>
+#include <validation.h>
+
+#include <vector>
+
+/** Dynamic memory usage the mempools are filled up to */
+static const size_t CLUSTER_MEMPOOL_BYTES = 300 << 20;
+/** Chains added before each trim */
+static const size_t CLUSTER_BATCH_CHAINS = 40;
+
+/** Makes chains of DEFAULT_ANCESTOR_LIMIT transactions, with fees that vary from one transaction to the next */
+class ChainMaker
+{
+public:
+    void AddChain(CTxMemPool& pool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, pool.cs)
+    {
+        // The chain starts from a made-up confirmed output; the mempool
+        // does not look up coins when entries are added unchecked.
+        uint256 prev_hash;
+        WriteLE64(prev_hash.begin(), ++m_chains);
+        for (unsigned int i = 0; i < DEFAULT_ANCESTOR_LIMIT; i++) {
+            CMutableTransaction tx;
+            tx.vin.resize(1);
+            tx.vin[0].prevout = COutPoint(prev_hash, 0);
+            tx.vin[0].scriptSig = CScript() << std::vector<unsigned char>(72, 1) << std::vector<unsigned char>(33, 2);
+            tx.vout.resize(1);
+            tx.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << std::vector<unsigned char>(20, 3) << OP_EQUALVERIFY << OP_CHECKSIG;
+            tx.vout[0].nValue = (DEFAULT_ANCESTOR_LIMIT - i) * COIN;
+            const CTransactionRef ptx = MakeTransactionRef(std::move(tx));
+            const CAmount fee = 1000 + m_rng.randrange(20000);
+            LockPoints lp;
+            pool.addUnchecked(CTxMemPoolEntry(ptx, fee, 0 /* time */, 1 /* height */, false /* spendsCoinbase */, 4 /* sigOpCost */, lp));
+            prev_hash = ptx->GetHash();
+        }
+    }
+
+    void Fill(CTxMemPool& pool) EXCLUSIVE_LOCKS_REQUIRED(cs_main, pool.cs)
+    {
+        while (pool.DynamicMemoryUsage() < CLUSTER_MEMPOOL_BYTES) {
+            AddChain(pool);
+        }
+    }
+
+private:
+    FastRandomContext m_rng{true};
+    uint64_t m_chains{0};
+};
+
+// New chains keep arriving at a full mempool, which evicts as much as it
+// takes in from the bottom of the chunk order.
+static void MempoolClusterTrim(benchmark::State& state)
+{
+    CTxMemPool pool;
+    ChainMaker maker;
+    LOCK2(cs_main, pool.cs);
+    maker.Fill(pool);
+
+    while (state.KeepRunning()) {
+        for (size_t i = 0; i < CLUSTER_BATCH_CHAINS; i++) {
+            maker.AddChain(pool);
+        }
+        pool.TrimToSize(CLUSTER_MEMPOOL_BYTES);
+    }
+}
+
+// Reading a block's worth of transactions off the top of the chunk order,
+// as block assembly does.
+static void MempoolClusterSelect(benchmark::State& state)
+{
+    CTxMemPool pool;
+    ChainMaker maker;
+    LOCK2(cs_main, pool.cs);
+    maker.Fill(pool);
+
+    while (state.KeepRunning()) {
+        uint64_t weight = 0;
+        for (const CTxMemPool::Chunk& chunk : pool.setChunks) {
+            const CTxMemPool::vecEntries& txs = pool.GetClusterTxs(chunk.cluster);
+            for (size_t i = chunk.begin; i < chunk.end; i++) {
+                weight += txs[i]->GetTxWeight();
+            }
+            if (weight >= MAX_BLOCK_WEIGHT) break;
+        }
+    }
+}
+
+BENCHMARK(MempoolClusterTrim, 10);
+BENCHMARK(MempoolClusterSelect, 50);
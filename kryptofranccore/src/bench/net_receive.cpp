@@ -0,0 +1,130 @@
+// Copyright (c) 2019 The Kryptofranc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <bench/bench.h>
+
+#include <chainparams.h>
+#include <net.h>
+#include <netmessagemaker.h>
+#include <protocol.h>
+#include <version.h>
+
+#include <algorithm>
+#include <list>
+#include <string.h>
+#include <vector>
+
+/** Bytes handed over per read, as much as SocketRecvData asks recv for */
+static const unsigned int RECV_CHUNK_SIZE = 0x10000;
+
+/** The bytes of count messages of the given command and payload size, back to back */
+static void AppendMessages(std::vector<char>& wire, const std::string& command, size_t payload_size, size_t count)
+{
+    // Messages are framed with the network's message start
+    SelectParams(CBaseChainParams::MAIN);
+    for (size_t i = 0; i < count; i++) {
+        CSerializedNetMsg msg;
+        msg.command = command;
+        msg.data.assign(payload_size, (unsigned char)i);
+        const CSharedNetMsg shared = CConnman::ShareMessage(std::move(msg));
+        wire.insert(wire.end(), shared.header->begin(), shared.header->end());
+        wire.insert(wire.end(), shared.payload->begin(), shared.payload->end());
+    }
+}
+
+// Feeds a stream of messages to a peer the way SocketRecvData does, and
+// takes every complete message off it as ProcessMessages would. In place,
+// large bodies are received straight into the message (GetRecvBuffer);
+// otherwise every read is copied from a stack buffer. With recycle,
+// processed messages go back to the receive pool (RecycleRecvMsgs) rather
+// than being freed.
+static void ReceiveMessages(benchmark::State& state, const std::vector<char>& wire, bool in_place, bool recycle)
+{
+    CNode node(0, NODE_NETWORK, 0, INVALID_SOCKET, CAddress(CService(), NODE_NONE), 0, 0, CAddress(), "", false);
+    std::vector<char> buf(RECV_CHUNK_SIZE);
+
+    while (state.KeepRunning()) {
+        size_t pos = 0;
+        while (pos < wire.size()) {
+            unsigned int size = 0;
+            char* dest = in_place ? node.GetRecvBuffer(RECV_CHUNK_SIZE, size) : nullptr;
+            if (!dest) {
+                dest = buf.data();
+                size = buf.size();
+            }
+            size = std::min<size_t>(size, wire.size() - pos);
+            memcpy(dest, wire.data() + pos, size);
+            pos += size;
+
+            bool complete = false;
+            bool ok = node.ReceiveMsgBytes(dest, size, complete);
+            assert(ok);
+            if (complete) {
+                std::list<CNetMessage> msgs;
+                node.TakeCompleteRecvMsgs(msgs);
+                if (recycle) {
+                    node.RecycleRecvMsgs(msgs);
+                }
+            }
+        }
+    }
+}
+
+static std::vector<char> SmallMessages()
+{
+    std::vector<char> wire;
+    AppendMessages(wire, NetMsgType::TX, 250, 2000);
+    return wire;
+}
+
+static std::vector<char> MediumMessages()
+{
+    std::vector<char> wire;
+    AppendMessages(wire, NetMsgType::CMPCTBLOCK, 20000, 200);
+    return wire;
+}
+
+static std::vector<char> LargeMessages()
+{
+    std::vector<char> wire;
+    AppendMessages(wire, NetMsgType::BLOCK, 1000000, 4);
+    return wire;
+}
+
+static void ReceiveSmallMessages(benchmark::State& state)
+{
+    ReceiveMessages(state, SmallMessages(), true, true);
+}
+
+static void ReceiveSmallMessagesNoReuse(benchmark::State& state)
+{
+    ReceiveMessages(state, SmallMessages(), true, false);
+}
+
+static void ReceiveMediumMessages(benchmark::State& state)
+{
+    ReceiveMessages(state, MediumMessages(), true, true);
+}
+
+static void ReceiveMediumMessagesNoReuse(benchmark::State& state)
+{
+    ReceiveMessages(state, MediumMessages(), true, false);
+}
+
+static void ReceiveLargeMessages(benchmark::State& state)
+{
+    ReceiveMessages(state, LargeMessages(), true, true);
+}
+
+static void ReceiveLargeMessagesCopied(benchmark::State& state)
+{
+    ReceiveMessages(state, LargeMessages(), false, true);
+}
+
+BENCHMARK(ReceiveSmallMessages, 100);
+BENCHMARK(ReceiveSmallMessagesNoReuse, 100);
+BENCHMARK(ReceiveMediumMessages, 50);
+BENCHMARK(ReceiveMediumMessagesNoReuse, 50);
+BENCHMARK(ReceiveLargeMessages, 50);
+BENCHMARK(ReceiveLargeMessagesCopied, 50);
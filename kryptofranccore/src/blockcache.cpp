@@ -0,0 +1,152 @@
+// Copyright (c) 2019 The Kryptofranc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <blockcache.h>
+
+#include <chain.h>
+#include <chainparams.h>
+#include <netmessagemaker.h>
+#include <pow.h>
+#include <primitives/block.h>
+#include <streams.h>
+#include <validation.h>
+#include <version.h>
+
+CBlockCache g_block_cache(DEFAULT_BLOCK_CACHE_SIZE << 20);
+
+static size_t EntrySize(const CSharedNetMsg& msg)
+{
+    return msg.header->size() + (msg.payload ? msg.payload->size() : 0);
+}
+
+/** Check the header of a serialized block read for pindex, as ReadBlockFromDisk does */
+static bool CheckBlockData(const std::vector<unsigned char>& data, const CBlockIndex* pindex)
+{
+    CBlockHeader header;
+    try {
+        VectorReader(SER_NETWORK, PROTOCOL_VERSION, data, 0) >> header;
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pindex->GetBlockPos().ToString());
+    }
+    const uint256 hash = header.GetHash();
+    if (hash != pindex->GetBlockHash())
+        return error("%s: GetHash() doesn't match index for %s at %s", __func__, pindex->ToString(), pindex->GetBlockPos().ToString());
+    if (!CheckProofOfWork(hash, header.nBits, Params().GetConsensus()))
+        return error("%s: Errors in block header at %s", __func__, pindex->GetBlockPos().ToString());
+    return true;
+}
+
+void CBlockCache::SetMaxSize(size_t max_bytes)
+{
+    LOCK(cs);
+    m_max_bytes = max_bytes;
+    Evict();
+}
+
+bool CBlockCache::Lookup(const Key& key, CSharedNetMsg& msg)
+{
+    LOCK(cs);
+    auto it = m_entries.find(key);
+    if (it == m_entries.end()) return false;
+    m_lru.splice(m_lru.begin(), m_lru, it->second);
+    msg = it->second->second;
+    return true;
+}
+
+void CBlockCache::Insert(const Key& key, const CSharedNetMsg& msg)
+{
+    LOCK(cs);
+    if (EntrySize(msg) > m_max_bytes || m_entries.count(key)) return;
+    m_lru.emplace_front(key, msg);
+    m_entries.emplace(key, m_lru.begin());
+    m_bytes += EntrySize(msg);
+    Evict();
+}
+
+void CBlockCache::Evict()
+{
+    while (m_bytes > m_max_bytes) {
+        const auto& entry = m_lru.back();
+        m_bytes -= EntrySize(entry.second);
+        m_entries.erase(entry.first);
+        m_lru.pop_back();
+    }
+}
+
+void CBlockCache::Count(bool fHit)
+{
+    LOCK(cs);
+    // A disabled cache has nothing to report
+    if (m_max_bytes == 0) return;
+    if (fHit) {
+        m_hits++;
+    } else {
+        m_misses++;
+    }
+}
+
+bool CBlockCache::Get(const CBlockIndex* pindex, bool fWitness, CSharedNetMsg& msg)
+{
+    bool fHit = false;
+    const bool ret = Read(pindex, fWitness, msg, fHit);
+    Count(fHit);
+    return ret;
+}
+
+bool CBlockCache::GetBlock(const CBlockIndex* pindex, CBlock& block)
+{
+    bool fHit = false;
+    const bool ret = ReadBlock(pindex, block, fHit);
+    Count(fHit);
+    return ret;
+}
+
+bool CBlockCache::Read(const CBlockIndex* pindex, bool fWitness, CSharedNetMsg& msg, bool& fHit)
+{
+    const Key key(pindex->GetBlockHash(), fWitness);
+    if (Lookup(key, msg)) {
+        fHit = true;
+        return true;
+    }
+
+    CSerializedNetMsg serialized;
+    if (fWitness) {
+        // The network format matches the format on disk
+        serialized.command = NetMsgType::BLOCK;
+        if (!ReadRawBlockFromDisk(serialized.data, pindex, Params().MessageStart())) return false;
+        // Nothing is served from the cache that reading the block would reject
+        if (!CheckBlockData(serialized.data, pindex)) return false;
+    } else {
+        // Served from memory if the witness form is cached
+        CBlock block;
+        if (!ReadBlock(pindex, block, fHit)) return false;
+        serialized = CNetMsgMaker(PROTOCOL_VERSION).Make(SERIALIZE_TRANSACTION_NO_WITNESS, NetMsgType::BLOCK, block);
+    }
+    msg = CConnman::ShareMessage(std::move(serialized));
+    Insert(key, msg);
+    return true;
+}
+
+bool CBlockCache::ReadBlock(const CBlockIndex* pindex, CBlock& block, bool& fHit)
+{
+    CSharedNetMsg msg;
+    if (!Read(pindex, true, msg, fHit)) return false;
+    try {
+        VectorReader(SER_NETWORK, PROTOCOL_VERSION, *msg.payload, 0) >> block;
+    } catch (const std::exception& e) {
+        return error("%s: Deserialize or I/O error - %s at %s", __func__, e.what(), pindex->GetBlockPos().ToString());
+    }
+    const uint256 hash = block.GetHash();
+    if (hash != pindex->GetBlockHash())
+        return error("%s: GetHash() doesn't match index for %s at %s", __func__, pindex->ToString(), pindex->GetBlockPos().ToString());
+    if (!CheckProofOfWork(hash, block.nBits, Params().GetConsensus()))
+        return error("%s: Errors in block header at %s", __func__, pindex->GetBlockPos().ToString());
+    return true;
+}
+
+CBlockCache::Stats CBlockCache::GetStats() const
+{
+    LOCK(cs);
+    return Stats{m_hits, m_misses, m_entries.size(), m_bytes, m_max_bytes};
+}
@@ -0,0 +1,93 @@
+// Copyright (c) 2019 The Kryptofranc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KRYPTOFRANC_BLOCKCACHE_H
+#define KRYPTOFRANC_BLOCKCACHE_H
+
+#include <net.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <list>
+#include <map>
+#include <stdint.h>
+#include <utility>
+
+class CBlock;
+class CBlockIndex;
+
+extern CCriticalSection cs_main;
+
+/** Default for -blockcachesize, in MiB */
+static const unsigned int DEFAULT_BLOCK_CACHE_SIZE = 32;
+
+/**
+ * Size-bounded LRU cache of serialized blocks, in witness and non-witness
+ * form.
+ *
+ * Public nodes serve the same recent blocks to many syncing peers, so
+ * getdata, getblocktxn and REST requests are answered from here rather than
+ * by reading and deserializing the block from disk each time. Entries are
+ * block messages ready to be pushed to peers; their payload is the
+ * serialized block. Blocks read from disk are checked against their index
+ * entry and for proof of work, as ReadBlockFromDisk checks them, before they
+ * are cached. Callers must check that the block data is available (not
+ * pruned) before asking for it.
+ */
+class CBlockCache
+{
+public:
+    struct Stats {
+        uint64_t hits;
+        uint64_t misses;
+        size_t entries;
+        size_t bytes;
+        size_t max_bytes;
+    };
+
+    explicit CBlockCache(size_t max_bytes) : m_max_bytes(max_bytes) {}
+
+    /** Change the size limit, evicting entries as needed. 0 disables the cache. */
+    void SetMaxSize(size_t max_bytes);
+
+    /**
+     * Get a block message for pindex, reading the block from disk on a miss.
+     * Returns false if the block could not be read.
+     */
+    bool Get(const CBlockIndex* pindex, bool fWitness, CSharedNetMsg& msg) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+    /** Get the deserialized block for pindex, going through the witness form in the cache */
+    bool GetBlock(const CBlockIndex* pindex, CBlock& block) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+
+    Stats GetStats() const;
+
+private:
+    typedef std::pair<uint256, bool> Key;
+    typedef std::list<std::pair<Key, CSharedNetMsg>> LruList;
+
+    mutable CCriticalSection cs;
+    size_t m_max_bytes GUARDED_BY(cs);
+    size_t m_bytes GUARDED_BY(cs){0};
+    uint64_t m_hits GUARDED_BY(cs){0};
+    uint64_t m_misses GUARDED_BY(cs){0};
+    //! Most recently used at the front
+    LruList m_lru GUARDED_BY(cs);
+    std::map<Key, LruList::iterator> m_entries GUARDED_BY(cs);
+
+    /**
+     * Get and GetBlock without counting the request, so that each external
+     * request counts once. fHit is set if the block was not read from disk.
+     */
+    bool Read(const CBlockIndex* pindex, bool fWitness, CSharedNetMsg& msg, bool& fHit) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    bool ReadBlock(const CBlockIndex* pindex, CBlock& block, bool& fHit) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
+    /** Count one request as a hit or a miss, unless the cache is disabled */
+    void Count(bool fHit);
+    bool Lookup(const Key& key, CSharedNetMsg& msg);
+    void Insert(const Key& key, const CSharedNetMsg& msg);
+    void Evict() EXCLUSIVE_LOCKS_REQUIRED(cs);
+};
+
+extern CBlockCache g_block_cache;
+
+#endif // KRYPTOFRANC_BLOCKCACHE_H
@@ -380,9 +380,10 @@ public:
         consensus.BIP65Height = 1; // optimization starting from 1; // BIP66 activated on regtest (Used in functional tests)
         consensus.powLimit = uint256S("7fffffffffffffffffffffffffffffffffffffffffffffffffffffffffffffff");
 
-        consensus.nPowTargetSpacing = 2.5 * 60 * 10; // retarget difficulty every 10 blocs or 1500s or 25 min
-        consensus.nPowTargetTimespan =   2.5 * 60 ; // block generated every...
-        assert(consensus.nPowTargetTimespan<= consensus.nPowTargetSpacing );
+        consensus.nPowTargetTimespan = 2.5 * 60 * 10; // retarget difficulty every 10 blocs or 1500s or 25 min
+        consensus.nPowTargetSpacing = 2.5 * 60; // block generated every...
+        // GetNextWorkRequired divides by the number of blocks per retarget
+        assert(consensus.DifficultyAdjustmentInterval() > 0);
         consensus.fPowAllowMinDifficultyBlocks = true;
         consensus.fPowNoRetargeting = true;
         consensus.nRuleChangeActivationThreshold = 108; // 75% for testchains
@@ -8,13 +8,17 @@
 #include <sync.h>
 
 #include <algorithm>
+#include <assert.h>
+#include <atomic>
+#include <deque>
+#include <stdint.h>
 #include <vector>
 
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/mutex.hpp>
 
-template <typename T>
-class CCheckQueueControl;
+/** Maximum number of threads (including the master) that can work on one CCheckQueue. */
+static const int MAX_CHECKQUEUE_WORKERS = 128;
 
 /**
  * Queue for verifications that have to be performed.
@@ -25,10 +29,263 @@ class CCheckQueueControl;
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every worker (and the master) owns a bounded deque. The master spreads
+  * the verifications it adds over all deques; workers take from their own
+  * deque first and steal from the others once it runs dry, so a few
+  * expensive verifications cannot leave the other workers idle. Taking a
+  * verification is a single compare-and-swap on the deque it comes from.
+  * The mutex is only used to put idle threads to sleep and wake them up.
   */
 template <typename T>
 class CCheckQueue
 {
+private:
+    /**
+     * Bounded single-producer, multi-consumer ring of pending verifications.
+     * Only the master pushes (at m_bottom); anyone takes from m_top.
+     * Indices increase monotonically and are reduced modulo the capacity.
+     */
+    class WorkDeque
+    {
+    private:
+        std::vector<std::atomic<T*>> m_slots;
+        std::atomic<uint64_t> m_top{0};
+        std::atomic<uint64_t> m_bottom{0};
+
+    public:
+        explicit WorkDeque(size_t capacity) : m_slots(capacity) {}
+
+        //! Master only. Returns false if the deque is full.
+        bool Push(T* check)
+        {
+            const uint64_t b = m_bottom.load(std::memory_order_relaxed);
+            if (b - m_top.load() >= m_slots.size()) {
+                return false;
+            }
+            m_slots[b % m_slots.size()].store(check, std::memory_order_relaxed);
+            m_bottom.store(b + 1);
+            return true;
+        }
+
+        T* Take()
+        {
+            uint64_t t = m_top.load();
+            while (t < m_bottom.load()) {
+                T* check = m_slots[t % m_slots.size()].load(std::memory_order_relaxed);
+                // The slot can only be reused after m_top has moved past t,
+                // in which case the exchange fails and t is reloaded.
+                if (m_top.compare_exchange_weak(t, t + 1)) {
+                    return check;
+                }
+            }
+            return nullptr;
+        }
+    };
+
+    //! Capacity of each worker's deque
+    const size_t nDequeCapacity;
+
+    //! Deques of the registered workers. Slot 0 belongs to the master.
+    std::atomic<WorkDeque*> vDeques[MAX_CHECKQUEUE_WORKERS];
+
+    //! Number of initialized entries in vDeques.
+    std::atomic<int> nDeques{0};
+
+    //! Deque the next verification is pushed to (master only).
+    int nNextDeque{0};
+
+    //! Storage for the verifications of the current round. Only the master
+    //! modifies the container; elements stay in place until the round ends.
+    std::deque<T> storage;
+
+    //! Mutex to protect sleeping, waking up and worker registration
+    boost::mutex mutex;
+
+    //! Worker threads block on this when out of work
+    boost::condition_variable condWorker;
+
+    //! Master thread blocks on this when out of work
+    boost::condition_variable condMaster;
+
+    //! Verifications pushed to a deque and not taken yet.
+    std::atomic<int> nQueued{0};
+
+    //! Verifications added in this round that haven't completed yet.
+    std::atomic<unsigned int> nTodo{0};
+
+    //! Number of workers waiting on condWorker.
+    std::atomic<int> nSleeping{0};
+
+    //! The temporary evaluation result.
+    std::atomic<bool> fAllOk{true};
+
+    //! Add a deque for a new worker and return its index.
+    int Register()
+    {
+        const int nSelf = nDeques.load();
+        assert(nSelf < MAX_CHECKQUEUE_WORKERS);
+        vDeques[nSelf] = new WorkDeque(nDequeCapacity);
+        nDeques = nSelf + 1;
+        return nSelf;
+    }
+
+    //! Take a verification, starting with the given deque and then stealing from the others.
+    T* Take(int nSelf)
+    {
+        const int nCount = nDeques.load();
+        for (int i = 0; i < nCount; i++) {
+            T* check = vDeques[(nSelf + i) % nCount].load()->Take();
+            if (check != nullptr) {
+                nQueued--;
+                return check;
+            }
+        }
+        return nullptr;
+    }
+
+    void Run(T* pcheck)
+    {
+        T check;
+        check.swap(*pcheck);
+        // Once a verification failed, the remaining ones are only drained.
+        if (fAllOk.load(std::memory_order_relaxed) && !check()) {
+            fAllOk = false;
+        }
+        if (--nTodo == 0) {
+            // We processed the last element; inform the master it can exit and return the result
+            boost::unique_lock<boost::mutex> lock(mutex);
+            condMaster.notify_one();
+        }
+    }
+
+public:
+    //! Mutex to ensure only one concurrent CCheckQueueControl
+    boost::mutex ControlMutex;
+
+    //! Create a new check queue
+    explicit CCheckQueue(unsigned int nDequeCapacityIn) : nDequeCapacity(nDequeCapacityIn)
+    {
+        for (auto& deque : vDeques) {
+            deque = nullptr;
+        }
+        Register();
+    }
+
+    //! Worker thread
+    void Thread()
+    {
+        int nSelf;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nSelf = Register();
+        }
+        while (true) {
+            T* check = Take(nSelf);
+            if (check != nullptr) {
+                Run(check);
+                continue;
+            }
+            boost::unique_lock<boost::mutex> lock(mutex);
+            nSleeping++;
+            try {
+                while (nQueued.load() <= 0) {
+                    condWorker.wait(lock);
+                }
+            } catch (...) {
+                nSleeping--;
+                throw;
+            }
+            nSleeping--;
+        }
+    }
+
+    //! Wait until execution finishes, and return whether all evaluations were successful.
+    bool Wait()
+    {
+        while (true) {
+            T* check = Take(0);
+            if (check != nullptr) {
+                Run(check);
+                continue;
+            }
+            boost::unique_lock<boost::mutex> lock(mutex);
+            // Only the master adds work, so nothing new is queued while it sleeps.
+            while (nTodo.load() != 0 && nQueued.load() <= 0) {
+                condMaster.wait(lock);
+            }
+            if (nTodo.load() == 0) {
+                break;
+            }
+        }
+        storage.clear();
+        // reset the status for new work later
+        return fAllOk.exchange(true);
+    }
+
+    //! Add a batch of checks to the queue
+    void Add(std::vector<T>& vChecks)
+    {
+        if (vChecks.empty()) {
+            return;
+        }
+        const int nCount = nDeques.load();
+        nTodo += vChecks.size();
+        unsigned int nPushed = 0;
+        for (T& check : vChecks) {
+            storage.emplace_back();
+            check.swap(storage.back());
+            T* pcheck = &storage.back();
+            bool fPushed = false;
+            for (int i = 0; i < nCount && !fPushed; i++) {
+                nNextDeque = (nNextDeque + 1) % nCount;
+                fPushed = vDeques[nNextDeque].load()->Push(pcheck);
+            }
+            if (fPushed) {
+                nPushed++;
+            } else {
+                // Every deque is full; verify it right away.
+                Run(pcheck);
+            }
+        }
+        nQueued += nPushed;
+        // Pairs with the nSleeping/nQueued check in Thread(): either the worker
+        // sees the new work, or we see it going to sleep and wake it up.
+        if (nPushed && nSleeping.load() > 0) {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (nPushed == 1)
+                condWorker.notify_one();
+            else
+                condWorker.notify_all();
+        }
+    }
+
+    ~CCheckQueue()
+    {
+        for (auto& deque : vDeques) {
+            delete deque.load();
+        }
+    }
+
+};
+
+/**
+ * Queue for verifications that have to be performed.
+  * The verifications are represented by a type T, which must provide an
+  * operator(), returning a bool.
+  *
+  * One thread (the master) is assumed to push batches of verifications
+  * onto the queue, where they are processed by N-1 worker threads. When
+  * the master is done adding work, it temporarily joins the worker pool
+  * as an N'th worker, until all jobs are done.
+  *
+  * This is the original implementation, which hands out batches of work
+  * from a single mutex-protected vector. Validation uses CCheckQueue; this
+  * one is kept so the benchmarks can compare the two.
+  */
+template <typename T>
+class CBatchCheckQueue
+{
 private:
     //! Mutex to protect the inner state
     boost::mutex mutex;
@@ -128,7 +385,7 @@ public:
     boost::mutex ControlMutex;
 
     //! Create a new check queue
-    explicit CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn) {}
+    explicit CBatchCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), nBatchSize(nBatchSizeIn) {}
 
     //! Worker thread
     void Thread()
@@ -157,7 +414,7 @@ public:
             condWorker.notify_all();
     }
 
-    ~CCheckQueue()
+    ~CBatchCheckQueue()
     {
     }
 
@@ -167,18 +424,18 @@ public:
  * RAII-style controller object for a CCheckQueue that guarantees the passed
  * queue is finished before continuing.
  */
-template <typename T>
+template <typename T, typename Q = CCheckQueue<T>>
 class CCheckQueueControl
 {
 private:
-    CCheckQueue<T> * const pqueue;
+    Q * const pqueue;
     bool fDone;
 
 public:
     CCheckQueueControl() = delete;
     CCheckQueueControl(const CCheckQueueControl&) = delete;
     CCheckQueueControl& operator=(const CCheckQueueControl&) = delete;
-    explicit CCheckQueueControl(CCheckQueue<T> * const pqueueIn) : pqueue(pqueueIn), fDone(false)
+    explicit CCheckQueueControl(Q * const pqueueIn) : pqueue(pqueueIn), fDone(false)
     {
         // passed queue is supposed to be unused, or nullptr
         if (pqueue != nullptr) {
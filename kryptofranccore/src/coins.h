@@ -11,6 +11,7 @@
 #include <primitives/transaction.h>
 #include <compressor.h>
 #include <core_memusage.h>
+#include <flathashmap.h>
 #include <crypto/siphash.h>
 #include <memusage.h>
 #include <serialize.h>
@@ -86,8 +87,8 @@ public:
 class SaltedOutpointHasher
 {
 private:
-    /** Salt */
-    const uint64_t k0, k1;
+    /** Salt (not const, so that coin maps can be swapped) */
+    uint64_t k0, k1;
 
 public:
     SaltedOutpointHasher();
@@ -121,7 +122,7 @@ struct CCoinsCacheEntry
     explicit CCoinsCacheEntry(Coin&& coin_) : coin(std::move(coin_)), flags(0) {}
 };
 
-typedef std::unordered_map<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
+typedef flathashmap<COutPoint, CCoinsCacheEntry, SaltedOutpointHasher> CCoinsMap;
 
 /** Cursor for iterating over CoinsView state */
 class CCoinsViewCursor
@@ -250,6 +251,14 @@ public:
      */
     const Coin& AccessCoin(const COutPoint &output) const;
 
+    /**
+     * Insert a coin that the caller read from the backing view itself, as if
+     * it had been fetched through AccessCoin. Used to warm the cache with the
+     * inputs of a block before connecting it. The entry is not marked dirty,
+     * and nothing happens if the outpoint is already cached.
+     */
+    void PreloadCoin(const COutPoint &outpoint, Coin&& coin);
+
     /**
      * Add a coin. Set potential_overwrite to true if a non-pruned version may
      * already exist.
@@ -475,6 +475,20 @@ public:
             }
         return false;
     }
+
+    /** get_entries appends every element that has not been allow_erased to
+     * out, e.g. to save the cache to disk.
+     *
+     * get_entries is not threadsafe with insert.
+     *
+     * @param out the vector to append the elements to
+     */
+    void get_entries(std::vector<Element>& out) const
+    {
+        for (uint32_t i = 0; i < size; ++i)
+            if (!collection_flags.bit_is_set(i))
+                out.push_back(table[i]);
+    }
 };
 } // namespace CuckooCache
 
@@ -0,0 +1,276 @@
+// Copyright (c) 2019 The Kryptofranc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KRYPTOFRANC_FLATHASHMAP_H
+#define KRYPTOFRANC_FLATHASHMAP_H
+
+#include <memusage.h>
+#include <support/allocators/pool.h>
+
+#include <assert.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <iterator>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+/**
+ * Hash map using open addressing with linear probing.
+ *
+ * The table is a flat array of 8-byte slots, each holding 32 bits of the
+ * key's hash and the index of the element in a NodePool. Looking up a key
+ * usually touches a single cache line of the table, plus the element that
+ * matches: probes past other keys rarely have to look at their elements. The
+ * pool avoids a heap allocation per element and makes the memory usage exact
+ * rather than an estimate.
+ *
+ * Differences from std::unordered_map:
+ * - Inserting may invalidate iterators, but references to elements stay
+ *   valid until the element is erased.
+ * - Erasing leaves a tombstone rather than moving other elements, so erasing
+ *   while iterating is safe (erase returns the next iterator). Tombstones are
+ *   purged when the table is rebuilt on a later insert.
+ * - clear() releases all memory, including the table itself.
+ * - Only the subset of the interface used for the coins cache is provided.
+ */
+template <typename K, typename V, typename Hash>
+class flathashmap
+{
+public:
+    typedef K key_type;
+    typedef V mapped_type;
+    typedef std::pair<const K, V> value_type;
+    typedef size_t size_type;
+
+private:
+    typedef NodePool<value_type> Pool;
+
+    struct Slot {
+        //! Upper bits of the key's hash, or EMPTY/TOMBSTONE if node is 0
+        uint32_t tag;
+        typename Pool::Index node;
+    };
+    static const uint32_t EMPTY = 0;
+    static const uint32_t TOMBSTONE = 1;
+    static const size_t MIN_BUCKETS = 16;
+
+    std::vector<Slot> m_slots;
+    size_t m_size = 0;
+    size_t m_tombstones = 0;
+    Pool m_pool;
+    Hash m_hasher;
+
+    //! Keep used slots, including tombstones, at no more than 3/4 of the table.
+    static bool TooFull(size_t used, size_t buckets) { return used * 4 > buckets * 3; }
+
+    //! The slot tag for a hash; the lower bits select the bucket.
+    static uint32_t Tag(uint64_t hash)
+    {
+        uint32_t tag = hash >> 32;
+        return tag <= TOMBSTONE ? tag + 2 : tag;
+    }
+
+    //! Index of the slot holding key, or of the empty slot ending its probe sequence.
+    size_t FindSlot(const K& key, uint64_t hash) const
+    {
+        const size_t mask = m_slots.size() - 1;
+        const uint32_t tag = Tag(hash);
+        for (size_t i = hash & mask; ; i = (i + 1) & mask) {
+            const Slot& slot = m_slots[i];
+            if (slot.node) {
+                if (slot.tag == tag && m_pool[slot.node].first == key) return i;
+            } else if (slot.tag == EMPTY) {
+                return i;
+            }
+        }
+    }
+
+    void Rehash(size_t buckets)
+    {
+        std::vector<Slot> old(buckets, Slot{EMPTY, 0});
+        old.swap(m_slots);
+        const size_t mask = buckets - 1;
+        for (const Slot& slot : old) {
+            if (!slot.node) continue;
+            size_t i = m_hasher(m_pool[slot.node].first) & mask;
+            while (m_slots[i].node) i = (i + 1) & mask;
+            m_slots[i] = slot;
+        }
+        m_tombstones = 0;
+    }
+
+    //! Make room for one more element, growing the table or purging tombstones.
+    void Reserve()
+    {
+        if (m_slots.empty()) {
+            Rehash(MIN_BUCKETS);
+        } else if (TooFull(m_size + m_tombstones + 1, m_slots.size())) {
+            Rehash(TooFull(2 * (m_size + 1), m_slots.size()) ? m_slots.size() * 2 : m_slots.size());
+        }
+    }
+
+    template <typename MapType, typename Value>
+    class base_iterator
+    {
+    protected:
+        friend class flathashmap;
+        MapType* m_map = nullptr;
+        const Slot* m_slot = nullptr;
+
+        base_iterator(MapType* map, const Slot* slot) : m_map(map), m_slot(slot) { Skip(); }
+        void Skip()
+        {
+            const Slot* end = m_map->m_slots.data() + m_map->m_slots.size();
+            while (m_slot != end && !m_slot->node) ++m_slot;
+        }
+
+    public:
+        typedef std::forward_iterator_tag iterator_category;
+        typedef Value value_type;
+        typedef ptrdiff_t difference_type;
+        typedef Value* pointer;
+        typedef Value& reference;
+
+        base_iterator() = default;
+        Value& operator*() const { return m_map->m_pool[m_slot->node]; }
+        Value* operator->() const { return &m_map->m_pool[m_slot->node]; }
+    };
+
+public:
+    class iterator : public base_iterator<flathashmap, value_type>
+    {
+        friend class flathashmap;
+        iterator(flathashmap* map, const Slot* slot) : base_iterator<flathashmap, value_type>(map, slot) {}
+    public:
+        iterator() = default;
+        iterator& operator++() { ++this->m_slot; this->Skip(); return *this; }
+        iterator operator++(int) { iterator copy(*this); ++(*this); return copy; }
+        friend bool operator==(const iterator& a, const iterator& b) { return a.m_slot == b.m_slot; }
+        friend bool operator!=(const iterator& a, const iterator& b) { return a.m_slot != b.m_slot; }
+    };
+
+    class const_iterator : public base_iterator<const flathashmap, const value_type>
+    {
+        friend class flathashmap;
+        const_iterator(const flathashmap* map, const Slot* slot) : base_iterator<const flathashmap, const value_type>(map, slot) {}
+    public:
+        const_iterator() = default;
+        const_iterator(const iterator& it) : base_iterator<const flathashmap, const value_type>(it.m_map, it.m_slot) {}
+        const_iterator& operator++() { ++this->m_slot; this->Skip(); return *this; }
+        const_iterator operator++(int) { const_iterator copy(*this); ++(*this); return copy; }
+        friend bool operator==(const const_iterator& a, const const_iterator& b) { return a.m_slot == b.m_slot; }
+        friend bool operator!=(const const_iterator& a, const const_iterator& b) { return a.m_slot != b.m_slot; }
+    };
+
+    flathashmap() = default;
+    flathashmap(const flathashmap&) = delete;
+    flathashmap& operator=(const flathashmap&) = delete;
+    ~flathashmap() { clear(); }
+
+    iterator begin() { return iterator(this, m_slots.data()); }
+    iterator end() { return iterator(this, m_slots.data() + m_slots.size()); }
+    const_iterator begin() const { return const_iterator(this, m_slots.data()); }
+    const_iterator end() const { return const_iterator(this, m_slots.data() + m_slots.size()); }
+
+    bool empty() const { return m_size == 0; }
+    size_type size() const { return m_size; }
+    size_type bucket_count() const { return m_slots.size(); }
+
+    iterator find(const K& key)
+    {
+        if (m_size == 0) return end();
+        const Slot* slot = &m_slots[FindSlot(key, m_hasher(key))];
+        return slot->node ? iterator(this, slot) : end();
+    }
+
+    const_iterator find(const K& key) const
+    {
+        if (m_size == 0) return end();
+        const Slot* slot = &m_slots[FindSlot(key, m_hasher(key))];
+        return slot->node ? const_iterator(this, slot) : end();
+    }
+
+    size_type count(const K& key) const { return find(key) != end(); }
+
+    /**
+     * Construct an element from a key tuple and a mapped value tuple, as
+     * std::unordered_map::emplace(std::piecewise_construct, ...) does. Nothing
+     * is constructed if the key is already present.
+     */
+    template <typename KeyTuple, typename ValueTuple>
+    std::pair<iterator, bool> emplace(std::piecewise_construct_t pc, KeyTuple&& key_args, ValueTuple&& value_args)
+    {
+        const K& key = std::get<0>(key_args);
+        const uint64_t hash = m_hasher(key);
+        if (m_size > 0) {
+            const size_t i = FindSlot(key, hash);
+            if (m_slots[i].node) return std::make_pair(iterator(this, &m_slots[i]), false);
+        }
+        Reserve();
+        // The key is not present, so take the first free slot on its probe
+        // sequence, which may be a tombstone.
+        const size_t mask = m_slots.size() - 1;
+        size_t i = hash & mask;
+        while (m_slots[i].node) i = (i + 1) & mask;
+        if (m_slots[i].tag == TOMBSTONE) --m_tombstones;
+        m_slots[i].node = m_pool.New(pc, std::forward<KeyTuple>(key_args), std::forward<ValueTuple>(value_args));
+        m_slots[i].tag = Tag(hash);
+        ++m_size;
+        return std::make_pair(iterator(this, &m_slots[i]), true);
+    }
+
+    V& operator[](const K& key)
+    {
+        return emplace(std::piecewise_construct, std::forward_as_tuple(key), std::tuple<>()).first->second;
+    }
+
+    iterator erase(const_iterator it)
+    {
+        Slot& slot = m_slots[it.m_slot - m_slots.data()];
+        assert(slot.node);
+        m_pool.Delete(slot.node);
+        slot.node = 0;
+        slot.tag = TOMBSTONE;
+        --m_size;
+        ++m_tombstones;
+        return iterator(this, &slot + 1);
+    }
+
+    size_type erase(const K& key)
+    {
+        const_iterator it = find(key);
+        if (it == end()) return 0;
+        erase(it);
+        return 1;
+    }
+
+    void clear()
+    {
+        for (const Slot& slot : m_slots) {
+            if (slot.node) m_pool.Delete(slot.node);
+        }
+        std::vector<Slot>().swap(m_slots);
+        m_size = 0;
+        m_tombstones = 0;
+        m_pool.Clear();
+    }
+
+    void swap(flathashmap& other)
+    {
+        m_slots.swap(other.m_slots);
+        std::swap(m_size, other.m_size);
+        std::swap(m_tombstones, other.m_tombstones);
+        m_pool.swap(other.m_pool);
+        std::swap(m_hasher, other.m_hasher);
+    }
+
+    size_t DynamicMemoryUsage() const
+    {
+        return memusage::DynamicUsage(m_slots) + m_pool.DynamicMemoryUsage();
+    }
+};
+
+#endif // KRYPTOFRANC_FLATHASHMAP_H
@@ -189,7 +189,24 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
 
+            bool fDeferred = false;
+            jreq.defer = [req, &jreq, &fDeferred]() -> JSONRPCReplyFn {
+                fDeferred = true;
+                std::shared_ptr<HTTPRequest> deferred = req->Detach();
+                UniValue id = jreq.id;
+                return [deferred, id](const UniValue& result, const UniValue& error) {
+                    if (!error.isNull()) {
+                        JSONErrorReply(deferred.get(), error, id);
+                        return;
+                    }
+                    deferred->WriteHeader("Content-Type", "application/json");
+                    deferred->WriteReply(HTTP_OK, JSONRPCReply(result, NullUniValue, id));
+                };
+            };
+
             UniValue result = tableRPC.execute(jreq);
+            // The method will reply by itself
+            if (fDeferred) return true;
 
             // Send reply
             strReply = JSONRPCReply(result, NullUniValue, jreq.id);
@@ -13,6 +13,7 @@
 #include <shutdown.h>
 #include <sync.h>
 #include <ui_interface.h>
+#include <util/memory.h>
 
 #include <memory>
 #include <stdio.h>
@@ -596,6 +597,16 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     req = nullptr; // transferred back to main thread
 }
 
+std::unique_ptr<HTTPRequest> HTTPRequest::Detach()
+{
+    assert(!replySent && req);
+    std::unique_ptr<HTTPRequest> detached = MakeUnique<HTTPRequest>(req);
+    // The new object is now responsible for the reply
+    replySent = true;
+    req = nullptr;
+    return detached;
+}
+
 CService HTTPRequest::GetPeer() const
 {
     evhttp_connection* con = evhttp_request_get_connection(req);
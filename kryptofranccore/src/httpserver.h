@@ -8,6 +8,7 @@
 #include <string>
 #include <stdint.h>
 #include <functional>
+#include <memory>
 
 static const int DEFAULT_HTTP_THREADS=4;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
@@ -114,6 +115,14 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Hand the request over to a new object, so that it can be replied to
+     * after the handler returns, from any thread.
+     *
+     * @note Do not call any other methods on this object afterwards.
+     */
+    std::unique_ptr<HTTPRequest> Detach();
 };
 
 /** Event handler closure.
@@ -14,6 +14,7 @@
 #include <addrman.h>
 #include <amount.h>
 #include <banman.h>
+#include <blockcache.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
@@ -25,17 +26,20 @@
 #include <interfaces/chain.h>
 #include <index/txindex.h>
 #include <key.h>
+#include <mempooljournal.h>
 #include <validation.h>
 #include <miner.h>
 #include <netbase.h>
 #include <net.h>
 #include <net_processing.h>
+#include <node/utxo_snapshot.h>
 #include <policy/feerate.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
 #include <rpc/server.h>
 #include <rpc/register.h>
 #include <rpc/blockchain.h>
+#include <rpc/mining.h>
 #include <rpc/util.h>
 #include <script/standard.h>
 #include <script/sigcache.h>
@@ -44,11 +48,14 @@
 #include <timedata.h>
 #include <txdb.h>
 #include <txmempool.h>
+#include <txreconciliation.h>
+#include <stratum.h>
 #include <torcontrol.h>
 #include <ui_interface.h>
 #include <util/system.h>
 #include <util/moneystr.h>
 #include <validationinterface.h>
+#include <validationstats.h>
 #include <warnings.h>
 #include <walletinitinterface.h>
 #include <stdint.h>
@@ -75,6 +82,7 @@
 #endif
 
 bool fFeeEstimatesInitialized = false;
+static bool fSigCachesInitialized = false;
 static const bool DEFAULT_PROXYRANDOMIZE = true;
 static const bool DEFAULT_REST_ENABLE = false;
 static const bool DEFAULT_STOPAFTERBLOCKIMPORT = false;
@@ -185,6 +193,7 @@ void Interrupt()
     InterruptRPC();
     InterruptREST();
     InterruptTorControl();
+    InterruptStratumServer();
     InterruptMapPort();
     if (g_connman)
         g_connman->Interrupt();
@@ -230,6 +239,10 @@ void Shutdown(InitInterfaces& interfaces)
     threadGroup.interrupt_all();
     threadGroup.join_all();
 
+    // Blocks may be submitted until the stratum server stops, so stop it
+    // before the chain state is flushed.
+    StopStratumServer();
+
     // After the threads that potentially access these pointers have been stopped,
     // destruct and reset all to nullptr.
     peerLogic.reset();
@@ -237,8 +250,14 @@ void Shutdown(InitInterfaces& interfaces)
     g_banman.reset();
     g_txindex.reset();
 
-    if (g_is_mempool_loaded && gArgs.GetArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
-        DumpMempool();
+    // Only started once the mempool was loaded
+    if (g_mempool_journal) {
+        g_mempool_journal->Stop();
+        g_mempool_journal.reset();
+    }
+
+    if (fSigCachesInitialized && gArgs.GetBoolArg("-persistsigcache", DEFAULT_PERSIST_SIGCACHE)) {
+        DumpSignatureCaches();
     }
 
     if (fFeeEstimatesInitialized)
@@ -374,7 +393,10 @@ void SetupServerArgs()
 
     gArgs.AddArg("-version", "Print version and exit", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-alertnotify=<cmd>", "Execute command when a relevant alert is received or we see a really long fork (%s in cmd is replaced by message)", false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-assumeutxo=<blockhash>:<utxohash>:<nchaintx>", "Block hash, UTXO set hash and chain transaction count (base_hash, hash_serialized_3 and nchaintx of dumptxoutset on a node you trust) that the snapshot given with -loadutxosnapshot must match. Required by -loadutxosnapshot.", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-assumevalid=<hex>", strprintf("If this block is in the chain assume that it and its ancestors are valid and potentially skip their script verification (0 to verify all, default: %s, testnet: %s)", defaultChainParams->GetConsensus().defaultAssumeValid.GetHex(), testnetChainParams->GetConsensus().defaultAssumeValid.GetHex()), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-backgroundflush", strprintf("Write the coins cache to disk on a background thread, so block validation and RPCs keep running during a flush (default: %u)", DEFAULT_BACKGROUND_FLUSH), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-blockcachesize=<n>", strprintf("Keep up to <n> MiB of serialized blocks in memory for serving peers and REST requests, 0 to disable (default: %u)", DEFAULT_BLOCK_CACHE_SIZE), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blocksdir=<dir>", "Specify blocks directory (default: <datadir>/blocks)", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blocknotify=<cmd>", "Execute command when the best block changes (%s in cmd is replaced by block hash)", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-blockreconstructionextratxn=<n>", strprintf("Extra transactions to keep in memory for compact block reconstructions (default: %u)", DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN), false, OptionsCategory::OPTIONS);
@@ -387,13 +409,15 @@ void SetupServerArgs()
     gArgs.AddArg("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER), true, OptionsCategory::OPTIONS);
     gArgs.AddArg("-includeconf=<file>", "Specify additional configuration file, relative to the -datadir path (only useable from configuration file, not command line)", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-loadblock=<file>", "Imports blocks from external blk000??.dat file on startup", false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-loadutxosnapshot=<file>", "Bootstrap an empty chain state from a UTXO snapshot written by the dumptxoutset RPC. Blocks below the snapshot are not downloaded or validated, so the snapshot must match -assumeutxo. This mode is incompatible with -txindex and -reindex-chainstate.", false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-maxmempool=<n>", strprintf("Keep the transaction memory pool below <n> megabytes (default: %u)", DEFAULT_MAX_MEMPOOL_SIZE), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-maxorphantx=<n>", strprintf("Keep at most <n> unconnectable transactions in memory (default: %u)", DEFAULT_MAX_ORPHAN_TRANSACTIONS), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-mempoolexpiry=<n>", strprintf("Do not keep transactions in the mempool longer than <n> hours (default: %u)", DEFAULT_MEMPOOL_EXPIRY), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-minimumchainwork=<hex>", strprintf("Minimum work assumed to exist on a valid chain in hex (default: %s, testnet: %s)", defaultChainParams->GetConsensus().nMinimumChainWork.GetHex(), testnetChainParams->GetConsensus().nMinimumChainWork.GetHex()), true, OptionsCategory::OPTIONS);
-    gArgs.AddArg("-par=<n>", strprintf("Set the number of script verification threads (%u to %d, 0 = auto, <0 = leave that many cores free, default: %d)",
-        -GetNumCores(), MAX_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-par=<n>", strprintf("Set the number of script verification threads (%u to %d, 0 = auto (at most %d), <0 = leave that many cores free, default: %d)",
+        -GetNumCores(), MAX_SCRIPTCHECK_THREADS, MAX_AUTO_SCRIPTCHECK_THREADS, DEFAULT_SCRIPTCHECK_THREADS), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-persistmempool", strprintf("Whether to save the mempool on shutdown and load on restart (default: %u)", DEFAULT_PERSIST_MEMPOOL), false, OptionsCategory::OPTIONS);
+    gArgs.AddArg("-persistsigcache", strprintf("Whether to save the signature and script execution caches on shutdown and load them on restart (default: %u)", DEFAULT_PERSIST_SIGCACHE), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-pid=<file>", strprintf("Specify pid file. Relative paths will be prefixed by a net-specific datadir location. (default: %s)", KRYPTOFRANC_PID_FILENAME), false, OptionsCategory::OPTIONS);
     gArgs.AddArg("-prune=<n>", strprintf("Reduce storage requirements by enabling pruning (deleting) of old blocks. This allows the pruneblockchain RPC to be called to delete specific blocks, and enables automatic pruning of old blocks if a target size in MiB is provided. This mode is incompatible with -txindex and -rescan. "
             "Warning: Reverting this setting requires re-downloading the entire blockchain. "
@@ -425,6 +449,7 @@ void SetupServerArgs()
     gArgs.AddArg("-maxsendbuffer=<n>", strprintf("Maximum per-connection send buffer, <n>*1000 bytes (default: %u)", DEFAULT_MAXSENDBUFFER), false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-maxtimeadjustment", strprintf("Maximum allowed median peer time offset adjustment. Local perspective of time may be influenced by peers forward or backward by this amount. (default: %u seconds)", DEFAULT_MAX_TIME_ADJUSTMENT), false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-maxuploadtarget=<n>", strprintf("Tries to keep outbound traffic under the given target (in MiB per 24h), 0 = no limit (default: %d)", DEFAULT_MAX_UPLOAD_TARGET), false, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-msghandlers=<n>", strprintf("Number of threads that process peer messages. Each peer is handled by one of them, so its messages stay in order (1 to %d, default: %d)", MAX_MESSAGE_HANDLER_THREADS, DEFAULT_MESSAGE_HANDLER_THREADS), false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-onion=<ip:port>", "Use separate SOCKS5 proxy to reach peers via Tor hidden services, set -noonion to disable (default: -proxy)", false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-onlynet=<net>", "Make outgoing connections only through network <net> (ipv4, ipv6 or onion). Incoming connections are not affected by this option. This option can be specified multiple times to allow multiple networks.", false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-peerbloomfilters", strprintf("Support filtering of blocks and transaction with bloom filters (default: %u)", DEFAULT_PEERBLOOMFILTERS), false, OptionsCategory::CONNECTION);
@@ -437,6 +462,7 @@ void SetupServerArgs()
     gArgs.AddArg("-peertimeout=<n>", strprintf("Specify p2p connection timeout in seconds. This option determines the amount of time a peer may be inactive before the connection to it is dropped. (minimum: 1, default: %d)", DEFAULT_PEER_CONNECT_TIMEOUT), true, OptionsCategory::CONNECTION);
     gArgs.AddArg("-torcontrol=<ip>:<port>", strprintf("Tor control port to use if onion listening enabled (default: %s)", DEFAULT_TOR_CONTROL), false, OptionsCategory::CONNECTION);
     gArgs.AddArg("-torpassword=<pass>", "Tor control port password (default: empty)", false, OptionsCategory::CONNECTION);
+    gArgs.AddArg("-txreconciliation", strprintf("Reconcile transaction announcements with peers that support it instead of flooding them, except to a few outbound peers (default: %u)", DEFAULT_TXRECONCILIATION), false, OptionsCategory::CONNECTION);
 #ifdef USE_UPNP
 #if USE_UPNP
     gArgs.AddArg("-upnp", "Use UPnP to map the listening port (default: 1 when listening and no -proxy)", false, OptionsCategory::CONNECTION);
@@ -488,8 +514,10 @@ void SetupServerArgs()
     gArgs.AddArg("-dropmessagestest=<n>", "Randomly drop 1 of every <n> network messages", true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-stopafterblockimport", strprintf("Stop running after importing blocks from disk (default: %u)", DEFAULT_STOPAFTERBLOCKIMPORT), true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-stopatheight", strprintf("Stop running after reaching the given height in the main chain (default: %u)", DEFAULT_STOPATHEIGHT), true, OptionsCategory::DEBUG_TEST);
+    gArgs.AddArg("-validationstatswindow=<n>", strprintf("Keep per-stage validation timings of the last <n> connected blocks for getvalidationstats (default: %u)", DEFAULT_VALIDATION_STATS_WINDOW), true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-limitancestorcount=<n>", strprintf("Do not accept transactions if number of in-mempool ancestors is <n> or more (default: %u)", DEFAULT_ANCESTOR_LIMIT), true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-limitancestorsize=<n>", strprintf("Do not accept transactions whose size with all in-mempool ancestors exceeds <n> kilobytes (default: %u)", DEFAULT_ANCESTOR_SIZE_LIMIT), true, OptionsCategory::DEBUG_TEST);
+    gArgs.AddArg("-limitclustercount=<n>", strprintf("Do not accept transactions that would join in-mempool transactions into a cluster of more than <n> transactions (default: %u)", DEFAULT_CLUSTER_LIMIT), true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-limitdescendantcount=<n>", strprintf("Do not accept transactions if any ancestor would have <n> or more in-mempool descendants (default: %u)", DEFAULT_DESCENDANT_LIMIT), true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-limitdescendantsize=<n>", strprintf("Do not accept transactions if any ancestor would have more than <n> kilobytes of in-mempool descendants (default: %u).", DEFAULT_DESCENDANT_SIZE_LIMIT), true, OptionsCategory::DEBUG_TEST);
     gArgs.AddArg("-addrmantest", "Allows to test address relay on localhost", true, OptionsCategory::DEBUG_TEST);
@@ -527,6 +555,13 @@ void SetupServerArgs()
     gArgs.AddArg("-blockmaxweight=<n>", strprintf("Set maximum BIP141 block weight (default: %d)", DEFAULT_BLOCK_MAX_WEIGHT), false, OptionsCategory::BLOCK_CREATION);
     gArgs.AddArg("-blockmintxfee=<amt>", strprintf("Set lowest fee rate (in %s/kB) for transactions to be included in block creation. (default: %s)", CURRENCY_UNIT, FormatMoney(DEFAULT_BLOCK_MIN_TX_FEE)), false, OptionsCategory::BLOCK_CREATION);
     gArgs.AddArg("-blockversion=<n>", "Override block version to test forking scenarios", true, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-longpollfeedelta=<amt>", strprintf("Answer a getblocktemplate long poll before the tip changes once at least this much (in %s) in fees has entered the mempool, and the request has waited for a minute (default: %s)", CURRENCY_UNIT, FormatMoney(DEFAULT_LONGPOLL_FEE_DELTA)), false, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-stratum", strprintf("Accept stratum v1 mining connections (default: %u)", DEFAULT_STRATUM_ENABLE), false, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-stratumaddress=<addr>", "Address to pay the rewards of blocks mined through stratum to (required with -stratum)", false, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-stratumallowip=<ip>", "Allow stratum connections from the given source in addition to localhost. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). Clients are not authenticated, so only list trusted networks. This option can be specified multiple times", false, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-stratumbind=<addr>", strprintf("Bind the stratum server to the given address (default: %s)", DEFAULT_STRATUM_BIND), false, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-stratumdifficulty=<n>", strprintf("Share difficulty for stratum clients, relative to the usual 0x1d00ffff difficulty 1 target and possibly fractional; blocks are always accepted as shares (default: %g)", DEFAULT_STRATUM_DIFFICULTY), false, OptionsCategory::BLOCK_CREATION);
+    gArgs.AddArg("-stratumport=<port>", strprintf("Listen for stratum connections on <port> (default: %u)", DEFAULT_STRATUM_PORT), false, OptionsCategory::BLOCK_CREATION);
 
     gArgs.AddArg("-rest", strprintf("Accept public REST requests (default: %u)", DEFAULT_REST_ENABLE), false, OptionsCategory::RPC);
     gArgs.AddArg("-rpcallowip=<ip>", "Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times", false, OptionsCategory::RPC);
@@ -730,6 +765,9 @@ static void ThreadImport(std::vector<fs::path> vImportFiles)
         LoadMempool();
     }
     g_is_mempool_loaded = !ShutdownRequested();
+    if (g_is_mempool_loaded && g_mempool_journal) {
+        g_mempool_journal->Start();
+    }
 }
 
 /** Sanity checks
@@ -1050,6 +1088,7 @@ bool AppInitParameterInteraction()
     }
     fCheckBlockIndex = gArgs.GetBoolArg("-checkblockindex", chainparams.DefaultConsistencyChecks());
     fCheckpointsEnabled = gArgs.GetBoolArg("-checkpoints", DEFAULT_CHECKPOINTS_ENABLED);
+    g_validation_stats.SetWindow(std::max<int64_t>(gArgs.GetArg("-validationstatswindow", DEFAULT_VALIDATION_STATS_WINDOW), 0));
 
     hashAssumeValid = uint256S(gArgs.GetArg("-assumevalid", chainparams.GetConsensus().defaultAssumeValid.GetHex()));
     if (!hashAssumeValid.IsNull())
@@ -1089,7 +1128,7 @@ bool AppInitParameterInteraction()
     // -par=0 means autodetect, but nScriptCheckThreads==0 means no concurrency
     nScriptCheckThreads = gArgs.GetArg("-par", DEFAULT_SCRIPTCHECK_THREADS);
     if (nScriptCheckThreads <= 0)
-        nScriptCheckThreads += GetNumCores();
+        nScriptCheckThreads = std::min(nScriptCheckThreads + GetNumCores(), MAX_AUTO_SCRIPTCHECK_THREADS);
     if (nScriptCheckThreads <= 1)
         nScriptCheckThreads = 0;
     else if (nScriptCheckThreads > MAX_SCRIPTCHECK_THREADS)
@@ -1145,6 +1184,13 @@ bool AppInitParameterInteraction()
             return InitError(AmountErrMsg("blockmintxfee", gArgs.GetArg("-blockmintxfee", "")));
     }
 
+    if (gArgs.IsArgSet("-longpollfeedelta"))
+    {
+        CAmount n = 0;
+        if (!ParseMoney(gArgs.GetArg("-longpollfeedelta", ""), n))
+            return InitError(AmountErrMsg("longpollfeedelta", gArgs.GetArg("-longpollfeedelta", "")));
+    }
+
     // Feerate used to define dust.  Shouldn't be changed lightly as old
     // implementations may inadvertently create non-standard transactions
     if (gArgs.IsArgSet("-dustrelayfee"))
@@ -1304,11 +1350,18 @@ bool AppInitMain(InitInterfaces& interfaces)
 
     InitSignatureCache();
     InitScriptExecutionCache();
+    g_block_cache.SetMaxSize(std::max<int64_t>(0, gArgs.GetArg("-blockcachesize", DEFAULT_BLOCK_CACHE_SIZE)) << 20);
+    if (gArgs.GetBoolArg("-persistsigcache", DEFAULT_PERSIST_SIGCACHE)) {
+        LoadSignatureCaches();
+    }
+    fSigCachesInitialized = true;
 
     LogPrintf("Using %u threads for script verification\n", nScriptCheckThreads);
     if (nScriptCheckThreads) {
-        for (int i=0; i<nScriptCheckThreads-1; i++)
+        for (int i=0; i<nScriptCheckThreads-1; i++) {
             threadGroup.create_thread(&ThreadScriptCheck);
+            threadGroup.create_thread(&ThreadCoinsPrefetch);
+        }
     }
 
     // Start the lightweight task scheduler thread
@@ -1446,6 +1499,7 @@ bool AppInitMain(InitInterfaces& interfaces)
     fListen = gArgs.GetBoolArg("-listen", DEFAULT_LISTEN);
     fDiscover = gArgs.GetBoolArg("-discover", true);
     g_relay_txes = !gArgs.GetBoolArg("-blocksonly", DEFAULT_BLOCKSONLY);
+    g_enable_txreconciliation = g_relay_txes && gArgs.GetBoolArg("-txreconciliation", DEFAULT_TXRECONCILIATION);
 
     for (const std::string& strAddr : gArgs.GetArgs("-externalip")) {
         CService addrLocal;
@@ -1547,6 +1601,12 @@ bool AppInitMain(InitInterfaces& interfaces)
                     break;
                 }
 
+                // Blocks below a UTXO snapshot are not on disk, so the chain state cannot be rebuilt from them.
+                if (fHaveUTXOSnapshot && fReindexChainState) {
+                    strLoadError = _("The chain state was loaded from a UTXO snapshot and cannot be rebuilt with -reindex-chainstate. Use -reindex to redownload the entire blockchain");
+                    break;
+                }
+
                 // At this point blocktree args are consistent with what's on disk.
                 // If we're not mid-reindex (based on disk + args), add a genesis block on disk
                 // (otherwise we use the one already on disk).
@@ -1593,6 +1653,26 @@ bool AppInitMain(InitInterfaces& interfaces)
                 break;
             }
 
+            if (is_coinsview_empty && !fReset && !fReindexChainState && gArgs.IsArgSet("-loadutxosnapshot")) {
+                const fs::path snapshot_path = fs::absolute(gArgs.GetArg("-loadutxosnapshot", ""), GetDataDir());
+                const std::string assume_utxo = gArgs.GetArg("-assumeutxo", "");
+                uint64_t chain_tx_count;
+                if (assume_utxo.size() <= 130 || assume_utxo[64] != ':' || assume_utxo[129] != ':' || !IsHex(assume_utxo.substr(0, 64)) || !IsHex(assume_utxo.substr(65, 64)) || !ParseUInt64(assume_utxo.substr(130), &chain_tx_count)) {
+                    return InitError(_("-loadutxosnapshot requires -assumeutxo=<blockhash>:<utxohash>:<nchaintx>, with the hash of the snapshot's block, the hash of its UTXO set and the chain's transaction count as reported by a node you trust"));
+                }
+                uiInterface.InitMessage(_("Loading UTXO snapshot..."));
+                std::string snapshot_error;
+                if (!LoadUTXOSnapshot(chainparams, snapshot_path, uint256S(assume_utxo.substr(0, 64)), uint256S(assume_utxo.substr(65, 64)), chain_tx_count, snapshot_error)) {
+                    return InitError(strprintf(_("Unable to load UTXO snapshot %s: %s"), snapshot_path.string(), snapshot_error));
+                }
+                LOCK(cs_main);
+                if (!LoadChainTip(chainparams)) {
+                    strLoadError = _("Error initializing block database");
+                    break;
+                }
+                is_coinsview_empty = false;
+            }
+
             if (!fReset) {
                 // Note that RewindBlockIndex MUST run even if we're about to -reindex-chainstate.
                 // It both disconnects blocks based on chainActive, and drops block data in
@@ -1675,6 +1755,9 @@ bool AppInitMain(InitInterfaces& interfaces)
 
     // ********************************************************* Step 8: start indexers
     if (gArgs.GetBoolArg("-txindex", DEFAULT_TXINDEX)) {
+        if (fHaveUTXOSnapshot) {
+            return InitError(_("A chain state loaded from a UTXO snapshot is incompatible with -txindex."));
+        }
         g_txindex = MakeUnique<TxIndex>(nTxIndexCache, false, fReindex);
         g_txindex->Start();
     }
@@ -1699,6 +1782,12 @@ bool AppInitMain(InitInterfaces& interfaces)
         }
     }
 
+    // blocks below a UTXO snapshot cannot be served either
+    if (fHaveUTXOSnapshot) {
+        LogPrintf("Unsetting NODE_NETWORK, chain state was loaded from a UTXO snapshot\n");
+        nLocalServices = ServiceFlags(nLocalServices & ~NODE_NETWORK);
+    }
+
     if (chainparams.GetConsensus().vDeployments[Consensus::DEPLOYMENT_SEGWIT].nTimeout != 0) {
         // Only advertise witness capabilities if they have a reasonable start time.
         // This allows us to have the code merged without a defined softfork, by setting its
@@ -1735,6 +1824,17 @@ bool AppInitMain(InitInterfaces& interfaces)
         vImportFiles.push_back(strFile);
     }
 
+    if (gArgs.GetBoolArg("-backgroundflush", DEFAULT_BACKGROUND_FLUSH)) {
+        threadGroup.create_thread(&ThreadCoinsFlush);
+    }
+
+    if (gArgs.GetArg("-persistmempool", DEFAULT_PERSIST_MEMPOOL)) {
+        g_mempool_journal = MakeUnique<CMempoolJournal>(mempool, GetDataDir());
+        scheduler.scheduleEvery([]{
+            g_mempool_journal->Maintain();
+        }, MEMPOOL_JOURNAL_FLUSH_INTERVAL * 1000);
+    }
+
     threadGroup.create_thread(std::bind(&ThreadImport, vImportFiles));
 
     // Wait for genesis block to be processed
@@ -1768,6 +1868,10 @@ bool AppInitMain(InitInterfaces& interfaces)
     if (gArgs.GetBoolArg("-listenonion", DEFAULT_LISTEN_ONION))
         StartTorControl();
 
+    if (gArgs.GetBoolArg("-stratum", DEFAULT_STRATUM_ENABLE) && !StartStratumServer()) {
+        return false;
+    }
+
     Discover();
 
     // Map ports with UPnP
@@ -1792,6 +1896,7 @@ bool AppInitMain(InitInterfaces& interfaces)
     connOptions.nMaxOutboundTimeframe = nMaxOutboundTimeframe;
     connOptions.nMaxOutboundLimit = nMaxOutboundLimit;
     connOptions.m_peer_connect_timeout = peer_connect_timeout;
+    connOptions.nMessageHandlerThreads = gArgs.GetArg("-msghandlers", DEFAULT_MESSAGE_HANDLER_THREADS);
 
     for (const std::string& strBind : gArgs.GetArgs("-bind")) {
         CService addrBind;
@@ -0,0 +1,440 @@
+// Copyright (c) 2019 The Kryptofranc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <mempooljournal.h>
+
+#include <clientversion.h>
+#include <crypto/common.h>
+#include <hash.h>
+#include <logging.h>
+#include <random.h>
+#include <streams.h>
+#include <txmempool.h>
+#include <util/system.h>
+#include <util/time.h>
+
+#include <functional>
+#include <limits>
+#include <set>
+
+std::unique_ptr<CMempoolJournal> g_mempool_journal;
+
+/** mempool.dat without a journal id */
+static const uint64_t MEMPOOL_DUMP_VERSION_NO_JOURNAL = 1;
+static const uint64_t MEMPOOL_DUMP_VERSION = 2;
+static const uint64_t MEMPOOL_JOURNAL_VERSION = 1;
+
+#define MICRO 0.000001
+
+static uint32_t RecordChecksum(const CDataStream& record)
+{
+    return ReadLE32(Hash(record.begin(), record.end()).begin());
+}
+
+/** Order entries so that transactions come after those of their parents that are among them */
+static void SortParentsFirst(std::vector<MempoolDiskEntry>& entries)
+{
+    std::map<uint256, size_t> index;
+    for (size_t i = 0; i < entries.size(); i++) {
+        index.emplace(entries[i].tx->GetHash(), i);
+    }
+    std::vector<std::vector<size_t>> children(entries.size());
+    std::vector<size_t> num_parents(entries.size());
+    for (size_t i = 0; i < entries.size(); i++) {
+        std::set<size_t> parents;
+        for (const CTxIn& txin : entries[i].tx->vin) {
+            auto it = index.find(txin.prevout.hash);
+            if (it != index.end() && it->second != i) parents.insert(it->second);
+        }
+        for (size_t parent : parents) children[parent].push_back(i);
+        num_parents[i] = parents.size();
+    }
+
+    // Keep the order of the entries where it allows
+    std::set<size_t> ready;
+    for (size_t i = 0; i < entries.size(); i++) {
+        if (num_parents[i] == 0) ready.insert(i);
+    }
+    std::vector<MempoolDiskEntry> sorted;
+    sorted.reserve(entries.size());
+    while (!ready.empty()) {
+        const size_t i = *ready.begin();
+        ready.erase(ready.begin());
+        sorted.push_back(std::move(entries[i]));
+        for (size_t child : children[i]) {
+            if (--num_parents[child] == 0) ready.insert(child);
+        }
+    }
+    entries.swap(sorted);
+}
+
+bool ReadMempoolFiles(const fs::path& dir, std::vector<MempoolDiskEntry>& entries, std::map<uint256, CAmount>& deltas)
+{
+    uint64_t journal_id = 0;
+    std::vector<MempoolDiskEntry> loaded;
+    std::map<uint256, size_t> index;
+    auto add = [&](const CTransactionRef& tx, int64_t nTime, int64_t nFeeDelta) {
+        auto inserted = index.emplace(tx->GetHash(), loaded.size());
+        if (inserted.second) {
+            loaded.push_back(MempoolDiskEntry{tx, nTime, nFeeDelta});
+        } else {
+            loaded[inserted.first->second] = MempoolDiskEntry{tx, nTime, nFeeDelta};
+        }
+    };
+
+    {
+        FILE* filestr = fsbridge::fopen(dir / "mempool.dat", "rb");
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        if (file.IsNull()) {
+            LogPrintf("Failed to open mempool file from disk. Continuing anyway.\n");
+            return false;
+        }
+        try {
+            uint64_t version;
+            file >> version;
+            if (version == MEMPOOL_DUMP_VERSION) {
+                file >> journal_id;
+            } else if (version != MEMPOOL_DUMP_VERSION_NO_JOURNAL) {
+                return false;
+            }
+            uint64_t num;
+            file >> num;
+            while (num--) {
+                CTransactionRef tx;
+                int64_t nTime;
+                int64_t nFeeDelta;
+                file >> tx;
+                file >> nTime;
+                file >> nFeeDelta;
+                add(tx, nTime, nFeeDelta);
+            }
+            file >> deltas;
+        } catch (const std::exception& e) {
+            LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
+            return false;
+        }
+    }
+
+    FILE* filestr = journal_id ? fsbridge::fopen(dir / "mempool.journal", "rb") : nullptr;
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (!file.IsNull()) {
+        uint64_t records = 0;
+        try {
+            uint64_t version, id;
+            file >> version >> id;
+            if (version != MEMPOOL_JOURNAL_VERSION || id != journal_id) {
+                throw std::runtime_error("journal does not belong to the snapshot");
+            }
+            while (true) {
+                uint32_t size;
+                file >> size;
+                if (size > MAX_SIZE) throw std::runtime_error("record too large");
+                CDataStream record(std::vector<unsigned char>(size), SER_DISK, CLIENT_VERSION);
+                file.read(record.data(), size);
+                uint32_t checksum;
+                file >> checksum;
+                if (checksum != RecordChecksum(record)) throw std::runtime_error("checksum mismatch");
+
+                uint8_t type;
+                uint256 hash;
+                CTransactionRef tx;
+                int64_t nTime;
+                int64_t nFeeDelta;
+                record >> type;
+                switch ((MempoolJournalRecord)type) {
+                case MempoolJournalRecord::ADD:
+                    record >> tx >> nTime >> nFeeDelta;
+                    add(tx, nTime, nFeeDelta);
+                    break;
+                case MempoolJournalRecord::REMOVE: {
+                    record >> hash;
+                    auto it = index.find(hash);
+                    if (it != index.end()) {
+                        loaded[it->second].tx.reset();
+                        index.erase(it);
+                    }
+                    break;
+                }
+                case MempoolJournalRecord::PRIORITISE: {
+                    record >> hash >> nFeeDelta;
+                    auto it = index.find(hash);
+                    if (it != index.end()) loaded[it->second].nFeeDelta = nFeeDelta;
+                    break;
+                }
+                case MempoolJournalRecord::DELTAS:
+                    record >> deltas;
+                    for (MempoolDiskEntry& entry : loaded) {
+                        if (!entry.tx) continue;
+                        auto it = deltas.find(entry.tx->GetHash());
+                        entry.nFeeDelta = it == deltas.end() ? 0 : it->second;
+                    }
+                    break;
+                default:
+                    throw std::runtime_error("unknown record type");
+                }
+                records++;
+            }
+        } catch (const std::exception& e) {
+            // Reading normally ends here, at the end of the file or at a
+            // record that was cut short by a crash.
+            LogPrint(BCLog::MEMPOOL, "Stopped reading mempool journal after %u records: %s\n", records, e.what());
+        }
+        LogPrintf("Replayed %u mempool journal records\n", records);
+    }
+
+    entries.clear();
+    for (MempoolDiskEntry& entry : loaded) {
+        if (!entry.tx) continue;
+        // The entry's own delta already includes it
+        deltas.erase(entry.tx->GetHash());
+        entries.push_back(std::move(entry));
+    }
+    SortParentsFirst(entries);
+    return true;
+}
+
+bool WriteMempoolSnapshot(const fs::path& dir, uint64_t journal_id, const std::vector<TxMempoolInfo>& vinfo, std::map<uint256, CAmount> deltas, uint64_t& bytes)
+{
+    try {
+        FILE* filestr = fsbridge::fopen(dir / "mempool.dat.new", "wb");
+        if (!filestr) {
+            return false;
+        }
+
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+
+        uint64_t version = MEMPOOL_DUMP_VERSION;
+        file << version;
+        file << journal_id;
+
+        file << (uint64_t)vinfo.size();
+        for (const auto& i : vinfo) {
+            file << *(i.tx);
+            file << (int64_t)i.nTime;
+            file << (int64_t)i.nFeeDelta;
+            deltas.erase(i.tx->GetHash());
+        }
+
+        file << deltas;
+        if (!FileCommit(file.Get()))
+            throw std::runtime_error("FileCommit failed");
+        bytes = ftell(file.Get());
+        file.fclose();
+        RenameOver(dir / "mempool.dat.new", dir / "mempool.dat");
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to dump mempool: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
+    return true;
+}
+
+CMempoolJournal::CMempoolJournal(CTxMemPool& pool, const fs::path& dir) : m_pool(pool), m_dir(dir)
+{
+}
+
+CMempoolJournal::~CMempoolJournal()
+{
+    Stop();
+}
+
+bool CMempoolJournal::IsActive() const
+{
+    LOCK(cs);
+    return m_active;
+}
+
+void CMempoolJournal::TransactionAdded(CTransactionRef tx)
+{
+    AssertLockHeld(m_pool.cs);
+    CTxMemPool::txiter it = m_pool.mapTx.find(tx->GetHash());
+    assert(it != m_pool.mapTx.end());
+    LOCK(cs);
+    m_pending.push_back(Record{MempoolJournalRecord::ADD, tx, it->GetTime(), it->GetModifiedFee() - it->GetFee()});
+}
+
+void CMempoolJournal::TransactionRemoved(CTransactionRef tx, MemPoolRemovalReason reason)
+{
+    LOCK(cs);
+    m_pending.push_back(Record{MempoolJournalRecord::REMOVE, tx, 0, 0});
+}
+
+void CMempoolJournal::TransactionPrioritised(CTransactionRef tx)
+{
+    AssertLockHeld(m_pool.cs);
+    CTxMemPool::txiter it = m_pool.mapTx.find(tx->GetHash());
+    assert(it != m_pool.mapTx.end());
+    LOCK(cs);
+    m_pending.push_back(Record{MempoolJournalRecord::PRIORITISE, tx, 0, it->GetModifiedFee() - it->GetFee()});
+}
+
+bool CMempoolJournal::Start()
+{
+    {
+        LOCK(cs);
+        if (m_active) return true;
+        m_active = true;
+    }
+    m_conn_added = m_pool.NotifyEntryAdded.connect(std::bind(&CMempoolJournal::TransactionAdded, this, std::placeholders::_1));
+    m_conn_removed = m_pool.NotifyEntryRemoved.connect(std::bind(&CMempoolJournal::TransactionRemoved, this, std::placeholders::_1, std::placeholders::_2));
+    m_conn_prioritised = m_pool.NotifyEntryPrioritised.connect(std::bind(&CMempoolJournal::TransactionPrioritised, this, std::placeholders::_1));
+
+    // Start from a snapshot of what was loaded
+    LOCK(m_file_mutex);
+    return DoCompact();
+}
+
+void CMempoolJournal::Maintain()
+{
+    LOCK(m_file_mutex);
+    if (!IsActive()) return;
+    if (Flush() && m_journal_bytes <= std::max(m_snapshot_bytes, MEMPOOL_JOURNAL_MIN_COMPACT_SIZE)) return;
+    DoCompact();
+}
+
+bool CMempoolJournal::Compact()
+{
+    LOCK(m_file_mutex);
+    return DoCompact();
+}
+
+void CMempoolJournal::Stop()
+{
+    LOCK(m_file_mutex);
+    {
+        LOCK(cs);
+        if (!m_active) return;
+        m_active = false;
+    }
+    m_conn_added.disconnect();
+    m_conn_removed.disconnect();
+    m_conn_prioritised.disconnect();
+
+    std::map<uint256, CAmount> deltas;
+    {
+        LOCK(m_pool.cs);
+        deltas = m_pool.mapDeltas;
+    }
+    std::vector<Record> records;
+    {
+        LOCK(cs);
+        records.swap(m_pending);
+    }
+    const int64_t start = GetTimeMicros();
+    if (!m_file || !Write(records, &deltas)) {
+        // Without a journal to add to, write out the whole mempool
+        DoCompact();
+    }
+    if (m_file) {
+        fclose(m_file);
+        m_file = nullptr;
+    }
+    LogPrintf("Wrote %u mempool journal records: %gs\n", records.size(), (GetTimeMicros() - start) * MICRO);
+}
+
+bool CMempoolJournal::Flush()
+{
+    if (!m_file) return false;
+    std::vector<Record> records;
+    {
+        LOCK(cs);
+        records.swap(m_pending);
+    }
+    // On failure, the next compaction takes a snapshot that includes these
+    return Write(records, nullptr);
+}
+
+bool CMempoolJournal::Write(const std::vector<Record>& records, const std::map<uint256, CAmount>* deltas)
+{
+    CDataStream buffer(SER_DISK, CLIENT_VERSION);
+    CDataStream record(SER_DISK, CLIENT_VERSION);
+    auto frame = [&buffer, &record]() {
+        buffer << (uint32_t)record.size();
+        buffer.write(record.data(), record.size());
+        buffer << RecordChecksum(record);
+        record.clear();
+    };
+    for (const Record& r : records) {
+        record << (uint8_t)r.type;
+        switch (r.type) {
+        case MempoolJournalRecord::ADD:
+            record << *r.tx << r.nTime << r.nFeeDelta;
+            break;
+        case MempoolJournalRecord::REMOVE:
+            record << r.tx->GetHash();
+            break;
+        case MempoolJournalRecord::PRIORITISE:
+            record << r.tx->GetHash() << r.nFeeDelta;
+            break;
+        case MempoolJournalRecord::DELTAS:
+            break;
+        }
+        frame();
+    }
+    if (deltas) {
+        record << (uint8_t)MempoolJournalRecord::DELTAS << *deltas;
+        frame();
+    }
+    if (buffer.empty()) return true;
+
+    if (fwrite(buffer.data(), 1, buffer.size(), m_file) != buffer.size() || !FileCommit(m_file)) {
+        LogPrintf("Failed to write mempool journal. It will be started over.\n");
+        fclose(m_file);
+        m_file = nullptr;
+        return false;
+    }
+    m_journal_bytes += buffer.size();
+    return true;
+}
+
+bool CMempoolJournal::DoCompact()
+{
+    const int64_t start = GetTimeMicros();
+    const uint64_t journal_id = GetRand(std::numeric_limits<uint64_t>::max() - 1) + 1;
+    std::vector<TxMempoolInfo> vinfo;
+    std::map<uint256, CAmount> deltas;
+    size_t recorded;
+    {
+        LOCK2(m_pool.cs, cs);
+        vinfo = m_pool.infoAll();
+        deltas = m_pool.mapDeltas;
+        // The snapshot includes the changes recorded so far
+        recorded = m_pending.size();
+    }
+
+    uint64_t snapshot_bytes;
+    if (!WriteMempoolSnapshot(m_dir, journal_id, vinfo, std::move(deltas), snapshot_bytes)) return false;
+    // The old journal does not belong to the new snapshot, so it is ignored
+    // from here on even if replacing it fails.
+    if (m_file) {
+        fclose(m_file);
+        m_file = nullptr;
+    }
+    {
+        LOCK(cs);
+        m_pending.erase(m_pending.begin(), m_pending.begin() + recorded);
+    }
+
+    try {
+        FILE* filestr = fsbridge::fopen(m_dir / "mempool.journal.new", "wb");
+        if (!filestr) {
+            return false;
+        }
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        file << MEMPOOL_JOURNAL_VERSION << journal_id;
+        if (!FileCommit(file.Get()))
+            throw std::runtime_error("FileCommit failed");
+        file.fclose();
+        if (!RenameOver(m_dir / "mempool.journal.new", m_dir / "mempool.journal"))
+            throw std::runtime_error("rename failed");
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to start mempool journal: %s\n", e.what());
+        return false;
+    }
+    m_file = fsbridge::fopen(m_dir / "mempool.journal", "ab");
+    if (!m_file) return false;
+    m_journal_bytes = 2 * sizeof(uint64_t);
+    m_snapshot_bytes = snapshot_bytes;
+    LogPrint(BCLog::MEMPOOL, "Compacted mempool journal: %u transactions, %u bytes, %gs\n", vinfo.size(), snapshot_bytes, (GetTimeMicros() - start) * MICRO);
+    return true;
+}
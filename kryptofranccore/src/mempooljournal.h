@@ -0,0 +1,126 @@
+// Copyright (c) 2019 The Kryptofranc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KRYPTOFRANC_MEMPOOLJOURNAL_H
+#define KRYPTOFRANC_MEMPOOLJOURNAL_H
+
+#include <amount.h>
+#include <fs.h>
+#include <primitives/transaction.h>
+#include <sync.h>
+#include <uint256.h>
+
+#include <boost/signals2/connection.hpp>
+
+#include <map>
+#include <memory>
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+class CTxMemPool;
+enum class MemPoolRemovalReason;
+struct TxMempoolInfo;
+
+/** Seconds between writes of the mempool journal to disk */
+static const int64_t MEMPOOL_JOURNAL_FLUSH_INTERVAL = 30;
+/** The journal is compacted once it is larger than the snapshot and than this, in bytes */
+static const uint64_t MEMPOOL_JOURNAL_MIN_COMPACT_SIZE = 16 << 20;
+
+/** Types of records in the mempool journal */
+enum class MempoolJournalRecord : uint8_t {
+    ADD = 1,        //!< Transaction added, with its time and fee delta
+    REMOVE = 2,     //!< Transaction removed, by txid
+    PRIORITISE = 3, //!< New fee delta of a transaction, by txid
+    DELTAS = 4,     //!< All fee deltas, written when the journal is stopped
+};
+
+/** A mempool transaction as saved on disk */
+struct MempoolDiskEntry
+{
+    CTransactionRef tx;
+    int64_t nTime;
+    int64_t nFeeDelta;
+};
+
+/**
+ * Read the mempool snapshot (mempool.dat) and replay the journal written
+ * since it was taken on top. entries come out with parents before their
+ * children; deltas holds the fee deltas of transactions not among them.
+ * Returns false if there is no usable snapshot.
+ */
+bool ReadMempoolFiles(const fs::path& dir, std::vector<MempoolDiskEntry>& entries, std::map<uint256, CAmount>& deltas);
+
+/**
+ * Write a snapshot of the mempool to mempool.dat. A journal is only replayed
+ * on top of the snapshot with the same journal_id; 0 matches none.
+ */
+bool WriteMempoolSnapshot(const fs::path& dir, uint64_t journal_id, const std::vector<TxMempoolInfo>& vinfo, std::map<uint256, CAmount> deltas, uint64_t& bytes);
+
+/**
+ * Append-only record of the changes to a mempool since its last snapshot.
+ *
+ * Additions, removals and prioritisations are queued as they happen, which
+ * is cheap as the transactions are shared with the mempool, and written out
+ * every MEMPOOL_JOURNAL_FLUSH_INTERVAL seconds. Once the journal outgrows the
+ * snapshot, a new snapshot is written and the journal started over. Shutdown
+ * then only has to write what was queued since the last flush, instead of
+ * the whole mempool.
+ */
+class CMempoolJournal
+{
+public:
+    CMempoolJournal(CTxMemPool& pool, const fs::path& dir);
+    ~CMempoolJournal();
+    CMempoolJournal(const CMempoolJournal&) = delete;
+    CMempoolJournal& operator=(const CMempoolJournal&) = delete;
+
+    /** Write a snapshot of the mempool and start recording its changes */
+    bool Start();
+    /** Write out what was recorded, and compact the journal if it has grown too large */
+    void Maintain();
+    /** Write a snapshot of the mempool and start the journal over */
+    bool Compact();
+    /** Write out what was recorded and the fee deltas, and stop recording */
+    void Stop();
+    bool IsActive() const;
+
+private:
+    struct Record
+    {
+        MempoolJournalRecord type;
+        CTransactionRef tx;
+        int64_t nTime;
+        int64_t nFeeDelta;
+    };
+
+    CTxMemPool& m_pool;
+    const fs::path m_dir;
+
+    //! Held while writing to the files; taken before the mempool lock and cs
+    Mutex m_file_mutex;
+    FILE* m_file GUARDED_BY(m_file_mutex){nullptr};
+    uint64_t m_journal_bytes GUARDED_BY(m_file_mutex){0};
+    uint64_t m_snapshot_bytes GUARDED_BY(m_file_mutex){0};
+
+    mutable Mutex cs;
+    bool m_active GUARDED_BY(cs){false};
+    //! Changes not yet written out, in the order they happened
+    std::vector<Record> m_pending GUARDED_BY(cs);
+
+    boost::signals2::scoped_connection m_conn_added;
+    boost::signals2::scoped_connection m_conn_removed;
+    boost::signals2::scoped_connection m_conn_prioritised;
+
+    void TransactionAdded(CTransactionRef tx);
+    void TransactionRemoved(CTransactionRef tx, MemPoolRemovalReason reason);
+    void TransactionPrioritised(CTransactionRef tx);
+    bool Flush() EXCLUSIVE_LOCKS_REQUIRED(m_file_mutex);
+    bool DoCompact() EXCLUSIVE_LOCKS_REQUIRED(m_file_mutex);
+    bool Write(const std::vector<Record>& records, const std::map<uint256, CAmount>* deltas) EXCLUSIVE_LOCKS_REQUIRED(m_file_mutex);
+};
+
+extern std::unique_ptr<CMempoolJournal> g_mempool_journal;
+
+#endif // KRYPTOFRANC_MEMPOOLJOURNAL_H
@@ -6,6 +6,7 @@
 #include <miner.h>
 
 #include <amount.h>
+#include <arith_uint256.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <coins.h>
@@ -13,6 +14,8 @@
 #include <consensus/merkle.h>
 #include <consensus/tx_verify.h>
 #include <consensus/validation.h>
+#include <crypto/common.h>
+#include <crypto/sha256.h>
 #include <hash.h>
 #include <net.h>
 #include <policy/feerate.h>
@@ -20,13 +23,18 @@
 #include <pow.h>
 #include <primitives/transaction.h>
 #include <script/standard.h>
+#include <streams.h>
 #include <timedata.h>
 #include <util/moneystr.h>
 #include <util/system.h>
 #include <validationinterface.h>
+#include <version.h>
 
 #include <algorithm>
+#include <atomic>
+#include <functional>
 #include <queue>
+#include <thread>
 #include <utility>
 
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev)
@@ -85,21 +93,17 @@ void BlockAssembler::resetBlock()
     // These counters do not include coinbase tx
     nBlockTx = 0;
     nFees = 0;
+    fBlockFull = false;
 }
 
 Optional<int64_t> BlockAssembler::m_last_block_num_txs{nullopt};
 Optional<int64_t> BlockAssembler::m_last_block_weight{nullopt};
 
-std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn)
+void BlockAssembler::SelectTransactions(CBlockIndex* pindexPrev, int& nPackagesSelected)
 {
-    int64_t nTimeStart = GetTimeMicros();
-
     resetBlock();
 
     pblocktemplate.reset(new CBlockTemplate());
-
-    if(!pblocktemplate.get())
-        return nullptr;
     pblock = &pblocktemplate->block; // pointer for convenience
 
     // Add dummy coinbase tx as first transaction
@@ -107,9 +111,6 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     pblocktemplate->vTxFees.push_back(-1); // updated at end
     pblocktemplate->vTxSigOpsCost.push_back(-1); // updated at end
 
-    LOCK2(cs_main, mempool.cs);
-    CBlockIndex* pindexPrev = chainActive.Tip();
-    assert(pindexPrev != nullptr);
     nHeight = pindexPrev->nHeight + 1;
 
     pblock->nVersion = ComputeBlockVersion(pindexPrev, chainparams.GetConsensus());
@@ -136,14 +137,12 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     // transaction (which in most cases can be a no-op).
     fIncludeWitness = IsWitnessEnabled(pindexPrev, chainparams.GetConsensus());
 
-    int nPackagesSelected = 0;
-    int nDescendantsUpdated = 0;
-    addPackageTxs(nPackagesSelected, nDescendantsUpdated);
-
-    int64_t nTime1 = GetTimeMicros();
+    addPackageTxs(nPackagesSelected);
+}
 
-    m_last_block_num_txs = nBlockTx;
-    m_last_block_weight = nBlockWeight;
+void BlockAssembler::FinishBlock(CBlockTemplate& blocktemplate, const CScript& scriptPubKeyIn, const CBlockIndex* pindexPrev) const
+{
+    CBlock& block = blocktemplate.block;
 
     // Create coinbase transaction.
     CMutableTransaction coinbaseTx;
@@ -153,18 +152,37 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     coinbaseTx.vout[0].scriptPubKey = scriptPubKeyIn;
     coinbaseTx.vout[0].nValue = nFees + GetBlockSubsidy(nHeight, chainparams.GetConsensus());
     coinbaseTx.vin[0].scriptSig = CScript() << nHeight << OP_0;
-    pblock->vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
-    pblocktemplate->vchCoinbaseCommitment = GenerateCoinbaseCommitment(*pblock, pindexPrev, chainparams.GetConsensus());
-    pblocktemplate->vTxFees[0] = -nFees;
+    block.vtx[0] = MakeTransactionRef(std::move(coinbaseTx));
+    blocktemplate.vchCoinbaseCommitment = GenerateCoinbaseCommitment(block, pindexPrev, chainparams.GetConsensus());
+    blocktemplate.vTxFees[0] = -nFees;
 
-    LogPrintf("CreateNewBlock(): block weight: %u txs: %u fees: %ld sigops %d\n", GetBlockWeight(*pblock), nBlockTx, nFees, nBlockSigOpsCost);
+    LogPrintf("CreateNewBlock(): block weight: %u txs: %u fees: %ld sigops %d\n", GetBlockWeight(block), nBlockTx, nFees, nBlockSigOpsCost);
 
     // Fill in header
-    pblock->hashPrevBlock  = pindexPrev->GetBlockHash();
-    UpdateTime(pblock, chainparams.GetConsensus(), pindexPrev);
-    pblock->nBits          = GetNextWorkRequired(pindexPrev, pblock, chainparams.GetConsensus());
-    pblock->nNonce         = 0;
-    pblocktemplate->vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*pblock->vtx[0]);
+    block.hashPrevBlock  = pindexPrev->GetBlockHash();
+    UpdateTime(&block, chainparams.GetConsensus(), pindexPrev);
+    block.nBits          = GetNextWorkRequired(pindexPrev, &block, chainparams.GetConsensus());
+    block.nNonce         = 0;
+    blocktemplate.vTxSigOpsCost[0] = WITNESS_SCALE_FACTOR * GetLegacySigOpCount(*block.vtx[0]);
+}
+
+std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& scriptPubKeyIn)
+{
+    int64_t nTimeStart = GetTimeMicros();
+
+    LOCK2(cs_main, mempool.cs);
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    assert(pindexPrev != nullptr);
+
+    int nPackagesSelected = 0;
+    SelectTransactions(pindexPrev, nPackagesSelected);
+
+    int64_t nTime1 = GetTimeMicros();
+
+    m_last_block_num_txs = nBlockTx;
+    m_last_block_weight = nBlockWeight;
+
+    FinishBlock(*pblocktemplate, scriptPubKeyIn, pindexPrev);
 
     CValidationState state;
     if (!TestBlockValidity(state, chainparams, *pblock, pindexPrev, false, false)) {
@@ -172,24 +190,11 @@ std::unique_ptr<CBlockTemplate> BlockAssembler::CreateNewBlock(const CScript& sc
     }
     int64_t nTime2 = GetTimeMicros();
 
-    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages, %d updated descendants), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, nDescendantsUpdated, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
+    LogPrint(BCLog::BENCH, "CreateNewBlock() packages: %.2fms (%d packages), validity: %.2fms (total %.2fms)\n", 0.001 * (nTime1 - nTimeStart), nPackagesSelected, 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
 
     return std::move(pblocktemplate);
 }
 
-void BlockAssembler::onlyUnconfirmed(CTxMemPool::setEntries& testSet)
-{
-    for (CTxMemPool::setEntries::iterator iit = testSet.begin(); iit != testSet.end(); ) {
-        // Only test txs not already in the block
-        if (inBlock.count(*iit)) {
-            testSet.erase(iit++);
-        }
-        else {
-            iit++;
-        }
-    }
-}
-
 bool BlockAssembler::TestPackage(uint64_t packageSize, int64_t packageSigOpsCost) const
 {
     // TODO: switch to weight-based accounting for packages instead of vsize-based accounting.
@@ -204,7 +209,7 @@ bool BlockAssembler::TestPackage(uint64_t packageSize, int64_t packageSigOpsCost
 // - transaction finality (locktime)
 // - premature witness (in case segwit transactions are added to mempool before
 //   segwit activation)
-bool BlockAssembler::TestPackageTransactions(const CTxMemPool::setEntries& package)
+bool BlockAssembler::TestPackageTransactions(const CTxMemPool::vecEntries& package)
 {
     for (CTxMemPool::txiter it : package) {
         if (!IsFinalTx(it->GetTx(), nHeight, nLockTimeCutoff))
@@ -234,83 +239,31 @@ void BlockAssembler::AddToBlock(CTxMemPool::txiter iter)
     }
 }
 
-int BlockAssembler::UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded,
-        indexed_modified_transaction_set &mapModifiedTx)
+void BlockAssembler::RemoveFromBlock(CTxMemPool::txiter iter)
 {
-    int nDescendantsUpdated = 0;
-    for (CTxMemPool::txiter it : alreadyAdded) {
-        CTxMemPool::setEntries descendants;
-        mempool.CalculateDescendants(it, descendants);
-        // Insert all descendants (not yet in block) into the modified set
-        for (CTxMemPool::txiter desc : descendants) {
-            if (alreadyAdded.count(desc))
-                continue;
-            ++nDescendantsUpdated;
-            modtxiter mit = mapModifiedTx.find(desc);
-            if (mit == mapModifiedTx.end()) {
-                CTxMemPoolModifiedEntry modEntry(desc);
-                modEntry.nSizeWithAncestors -= it->GetTxSize();
-                modEntry.nModFeesWithAncestors -= it->GetModifiedFee();
-                modEntry.nSigOpCostWithAncestors -= it->GetSigOpCost();
-                mapModifiedTx.insert(modEntry);
-            } else {
-                mapModifiedTx.modify(mit, update_for_parent_inclusion(it));
-            }
-        }
-    }
-    return nDescendantsUpdated;
+    std::vector<CTransactionRef>& vtx = pblock->vtx;
+    const size_t pos = std::find(vtx.begin() + 1, vtx.end(), iter->GetSharedTx()) - vtx.begin();
+    assert(pos < vtx.size());
+    vtx.erase(vtx.begin() + pos);
+    pblocktemplate->vTxFees.erase(pblocktemplate->vTxFees.begin() + pos);
+    pblocktemplate->vTxSigOpsCost.erase(pblocktemplate->vTxSigOpsCost.begin() + pos);
+    nBlockWeight -= iter->GetTxWeight();
+    --nBlockTx;
+    nBlockSigOpsCost -= iter->GetSigOpCost();
+    nFees -= iter->GetFee();
+    inBlock.erase(iter);
 }
 
-// Skip entries in mapTx that are already in a block or are present
-// in mapModifiedTx (which implies that the mapTx ancestor state is
-// stale due to ancestor inclusion in the block)
-// Also skip transactions that we've already failed to add. This can happen if
-// we consider a transaction in mapModifiedTx and it fails: we can then
-// potentially consider it again while walking mapTx.  It's currently
-// guaranteed to fail again, but as a belt-and-suspenders check we put it in
-// failedTx and avoid re-evaluation, since the re-evaluation would be using
-// cached size/sigops/fee values that are not actually correct.
-bool BlockAssembler::SkipMapTxEntry(CTxMemPool::txiter it, indexed_modified_transaction_set &mapModifiedTx, CTxMemPool::setEntries &failedTx)
+// This transaction selection algorithm takes the mempool's chunks in the
+// order the mempool keeps them in: best feerate first, and each chunk after
+// the chunks of its cluster that it depends on. Nothing needs to be re-sorted
+// as transactions are selected, since a chunk's feerate does not depend on
+// which of its ancestors are already in the block. Once a chunk is left out,
+// the rest of its cluster is too, as it may depend on that chunk.
+void BlockAssembler::addPackageTxs(int &nPackagesSelected)
 {
-    assert (it != mempool.mapTx.end());
-    return mapModifiedTx.count(it) || inBlock.count(it) || failedTx.count(it);
-}
-
-void BlockAssembler::SortForBlock(const CTxMemPool::setEntries& package, std::vector<CTxMemPool::txiter>& sortedEntries)
-{
-    // Sort package by ancestor count
-    // If a transaction A depends on transaction B, then A's ancestor count
-    // must be greater than B's.  So this is sufficient to validly order the
-    // transactions for block inclusion.
-    sortedEntries.clear();
-    sortedEntries.insert(sortedEntries.begin(), package.begin(), package.end());
-    std::sort(sortedEntries.begin(), sortedEntries.end(), CompareTxIterByAncestorCount());
-}
-
-// This transaction selection algorithm orders the mempool based
-// on feerate of a transaction including all unconfirmed ancestors.
-// Since we don't remove transactions from the mempool as we select them
-// for block inclusion, we need an alternate method of updating the feerate
-// of a transaction with its not-yet-selected ancestors as we go.
-// This is accomplished by walking the in-mempool descendants of selected
-// transactions and storing a temporary modified state in mapModifiedTxs.
-// Each time through the loop, we compare the best transaction in
-// mapModifiedTxs with the next transaction in the mempool to decide what
-// transaction package to work on next.
-void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated)
-{
-    // mapModifiedTx will store sorted packages after they are modified
-    // because some of their txs are already in the block
-    indexed_modified_transaction_set mapModifiedTx;
-    // Keep track of entries that failed inclusion, to avoid duplicate work
-    CTxMemPool::setEntries failedTx;
-
-    // Start by adding all descendants of previously added txs to mapModifiedTx
-    // and modifying them for their already included ancestors
-    UpdatePackagesForAdded(inBlock, mapModifiedTx);
-
-    CTxMemPool::indexed_transaction_set::index<ancestor_score>::type::iterator mi = mempool.mapTx.get<ancestor_score>().begin();
-    CTxMemPool::txiter iter;
+    // Clusters of which a chunk was left out
+    std::set<uint64_t> skippedClusters;
 
     // Limit the number of attempts to add transactions to the block when it is
     // close to full; this is just a simple heuristic to finish quickly if the
@@ -318,68 +271,16 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
     const int64_t MAX_CONSECUTIVE_FAILURES = 1000;
     int64_t nConsecutiveFailed = 0;
 
-    while (mi != mempool.mapTx.get<ancestor_score>().end() || !mapModifiedTx.empty())
-    {
-        // First try to find a new transaction in mapTx to evaluate.
-        if (mi != mempool.mapTx.get<ancestor_score>().end() &&
-                SkipMapTxEntry(mempool.mapTx.project<0>(mi), mapModifiedTx, failedTx)) {
-            ++mi;
-            continue;
-        }
-
-        // Now that mi is not stale, determine which transaction to evaluate:
-        // the next entry from mapTx, or the best from mapModifiedTx?
-        bool fUsingModified = false;
-
-        modtxscoreiter modit = mapModifiedTx.get<ancestor_score>().begin();
-        if (mi == mempool.mapTx.get<ancestor_score>().end()) {
-            // We're out of entries in mapTx; use the entry from mapModifiedTx
-            iter = modit->iter;
-            fUsingModified = true;
-        } else {
-            // Try to compare the mapTx entry to the mapModifiedTx entry
-            iter = mempool.mapTx.project<0>(mi);
-            if (modit != mapModifiedTx.get<ancestor_score>().end() &&
-                    CompareTxMemPoolEntryByAncestorFee()(*modit, CTxMemPoolModifiedEntry(iter))) {
-                // The best entry in mapModifiedTx has higher score
-                // than the one from mapTx.
-                // Switch which transaction (package) to consider
-                iter = modit->iter;
-                fUsingModified = true;
-            } else {
-                // Either no entry in mapModifiedTx, or it's worse than mapTx.
-                // Increment mi for the next loop iteration.
-                ++mi;
-            }
-        }
-
-        // We skip mapTx entries that are inBlock, and mapModifiedTx shouldn't
-        // contain anything that is inBlock.
-        assert(!inBlock.count(iter));
-
-        uint64_t packageSize = iter->GetSizeWithAncestors();
-        CAmount packageFees = iter->GetModFeesWithAncestors();
-        int64_t packageSigOpsCost = iter->GetSigOpCostWithAncestors();
-        if (fUsingModified) {
-            packageSize = modit->nSizeWithAncestors;
-            packageFees = modit->nModFeesWithAncestors;
-            packageSigOpsCost = modit->nSigOpCostWithAncestors;
-        }
-
-        if (packageFees < blockMinFeeRate.GetFee(packageSize)) {
+    for (const CTxMemPool::Chunk& chunk : mempool.setChunks) {
+        if (chunk.fee < blockMinFeeRate.GetFee(chunk.size)) {
             // Everything else we might consider has a lower fee rate
             return;
         }
+        if (skippedClusters.count(chunk.cluster)) continue;
 
-        if (!TestPackage(packageSize, packageSigOpsCost)) {
-            if (fUsingModified) {
-                // Since we always look at the best entry in mapModifiedTx,
-                // we must erase failed entries so that we can consider the
-                // next best entry on the next loop iteration
-                mapModifiedTx.get<ancestor_score>().erase(modit);
-                failedTx.insert(iter);
-            }
-
+        if (!TestPackage(chunk.size, chunk.sigOpCost)) {
+            fBlockFull = true;
+            skippedClusters.insert(chunk.cluster);
             ++nConsecutiveFailed;
 
             if (nConsecutiveFailed > MAX_CONSECUTIVE_FAILURES && nBlockWeight >
@@ -390,41 +291,155 @@ void BlockAssembler::addPackageTxs(int &nPackagesSelected, int &nDescendantsUpda
             continue;
         }
 
-        CTxMemPool::setEntries ancestors;
-        uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
-        std::string dummy;
-        mempool.CalculateMemPoolAncestors(*iter, ancestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
-
-        onlyUnconfirmed(ancestors);
-        ancestors.insert(iter);
+        const CTxMemPool::vecEntries& clusterTxs = mempool.GetClusterTxs(chunk.cluster);
+        const CTxMemPool::vecEntries package(clusterTxs.begin() + chunk.begin, clusterTxs.begin() + chunk.end);
 
         // Test if all tx's are Final
-        if (!TestPackageTransactions(ancestors)) {
-            if (fUsingModified) {
-                mapModifiedTx.get<ancestor_score>().erase(modit);
-                failedTx.insert(iter);
-            }
+        if (!TestPackageTransactions(package)) {
+            skippedClusters.insert(chunk.cluster);
             continue;
         }
 
-        // This transaction will make it in; reset the failed counter.
+        // This chunk will make it in; reset the failed counter.
         nConsecutiveFailed = 0;
 
-        // Package can be added. Sort the entries in a valid order.
-        std::vector<CTxMemPool::txiter> sortedEntries;
-        SortForBlock(ancestors, sortedEntries);
-
-        for (size_t i=0; i<sortedEntries.size(); ++i) {
-            AddToBlock(sortedEntries[i]);
-            // Erase from the modified set, if present
-            mapModifiedTx.erase(sortedEntries[i]);
+        // The chunk is already in an order that is valid in a block.
+        for (CTxMemPool::txiter it : package) {
+            AddToBlock(it);
         }
 
         ++nPackagesSelected;
+    }
+}
 
-        // Update transactions that depend on each of these
-        nDescendantsUpdated += UpdatePackagesForAdded(ancestors, mapModifiedTx);
+BlockTemplateBuilder::BlockTemplateBuilder(const CChainParams& params) : m_assembler(params)
+{
+    m_conn_added = mempool.NotifyEntryAdded.connect(std::bind(&BlockTemplateBuilder::TransactionAdded, this, std::placeholders::_1));
+    m_conn_removed = mempool.NotifyEntryRemoved.connect(std::bind(&BlockTemplateBuilder::TransactionRemoved, this, std::placeholders::_1, std::placeholders::_2));
+    m_conn_prioritised = mempool.NotifyEntryPrioritised.connect(std::bind(&BlockTemplateBuilder::TransactionPrioritised, this, std::placeholders::_1));
+}
+
+void BlockTemplateBuilder::MarkStale()
+{
+    m_stale = true;
+    ++m_selection_version;
+    // Entries of the selection may be about to leave the mempool, so don't
+    // keep iterators to them around.
+    m_assembler.inBlock.clear();
+}
+
+void BlockTemplateBuilder::TransactionAdded(CTransactionRef tx)
+{
+    AssertLockHeld(mempool.cs);
+    if (m_stale) return;
+
+    CTxMemPool::txiter it = mempool.mapTx.find(tx->GetHash());
+    assert(it != mempool.mapTx.end());
+    for (CTxMemPool::txiter parent : mempool.GetMemPoolParents(it)) {
+        if (!m_assembler.inBlock.count(parent)) {
+            // The new transaction may pay for its unselected ancestors.
+            MarkStale();
+            return;
+        }
     }
+
+    // All ancestors are in the block, so the transaction is a package of its
+    // own, checked the way addPackageTxs checks a chunk.
+    const CFeeRate feerate(it->GetModifiedFee(), it->GetTxSize());
+    if (it->GetModifiedFee() < m_assembler.blockMinFeeRate.GetFee(it->GetTxSize())) return;
+    if (!m_assembler.TestPackageTransactions(CTxMemPool::vecEntries{it})) return;
+    if (!m_assembler.TestPackage(it->GetTxSize(), it->GetSigOpCost())) {
+        m_assembler.fBlockFull = true;
+        // It may be worth more than some of the selected transactions.
+        if (m_min_feerate < feerate) MarkStale();
+        return;
+    }
+    m_assembler.AddToBlock(it);
+    m_min_feerate = std::min(m_min_feerate, feerate);
+    ++m_selection_version;
+}
+
+void BlockTemplateBuilder::TransactionRemoved(CTransactionRef tx, MemPoolRemovalReason reason)
+{
+    AssertLockHeld(mempool.cs);
+    if (m_stale) return;
+
+    if (reason == MemPoolRemovalReason::BLOCK || reason == MemPoolRemovalReason::CONFLICT || reason == MemPoolRemovalReason::REORG) {
+        // The tip is changing, which requires a rebuild anyway.
+        MarkStale();
+        return;
+    }
+    // The entry is still in mapTx while listeners are notified.
+    CTxMemPool::txiter it = mempool.mapTx.find(tx->GetHash());
+    assert(it != mempool.mapTx.end());
+    if (!m_assembler.inBlock.count(it)) return;
+    if (m_assembler.fBlockFull) {
+        // The space could go to a package that was left out.
+        MarkStale();
+        return;
+    }
+    // Its in-mempool descendants are removed along with it, and will be
+    // dropped from the block by their own notifications.
+    m_assembler.RemoveFromBlock(it);
+    ++m_selection_version;
+}
+
+void BlockTemplateBuilder::TransactionPrioritised(CTransactionRef tx)
+{
+    AssertLockHeld(mempool.cs);
+    MarkStale();
+}
+
+std::unique_ptr<CBlockTemplate> BlockTemplateBuilder::CreateNewBlock(const CScript& scriptPubKeyIn)
+{
+    int64_t nTimeStart = GetTimeMicros();
+
+    LOCK2(cs_main, mempool.cs);
+    CBlockIndex* pindexPrev = chainActive.Tip();
+    assert(pindexPrev != nullptr);
+
+    const bool fRebuild = m_stale || pindexPrev != m_tip;
+    if (fRebuild) {
+        int nPackagesSelected = 0;
+        m_assembler.SelectTransactions(pindexPrev, nPackagesSelected);
+        m_tip = pindexPrev;
+        m_stale = false;
+        ++m_selection_version;
+        m_min_feerate = CFeeRate(MAX_MONEY);
+        for (CTxMemPool::txiter it : m_assembler.inBlock) {
+            m_min_feerate = std::min(m_min_feerate, CFeeRate(it->GetModifiedFee(), it->GetTxSize()));
+        }
+    }
+    int64_t nTime1 = GetTimeMicros();
+
+    BlockAssembler::m_last_block_num_txs = m_assembler.nBlockTx;
+    BlockAssembler::m_last_block_weight = m_assembler.nBlockWeight;
+
+    std::unique_ptr<CBlockTemplate> pblocktemplate(new CBlockTemplate(*m_assembler.pblocktemplate));
+    m_assembler.FinishBlock(*pblocktemplate, scriptPubKeyIn, pindexPrev);
+
+    // Incremental updates are checked like rebuilt selections: their
+    // transactions were only checked one at a time against the mempool, and
+    // the block as a whole (sigops, weight, finality at the tip's median time
+    // past) is only checked here. A template that fails is rebuilt next time.
+    // Nothing the check depends on changes while the selection, the tip and
+    // the coinbase script stay the same, so its result is reused until then.
+    const bool fValidate = m_selection_version != m_valid_version || pindexPrev != m_valid_tip || scriptPubKeyIn != m_valid_script;
+    if (fValidate) {
+        CValidationState state;
+        if (!TestBlockValidity(state, m_assembler.chainparams, pblocktemplate->block, pindexPrev, false, false)) {
+            MarkStale();
+            throw std::runtime_error(strprintf("%s: TestBlockValidity failed: %s", __func__, FormatStateMessage(state)));
+        }
+        m_valid_version = m_selection_version;
+        m_valid_tip = pindexPrev;
+        m_valid_script = scriptPubKeyIn;
+    }
+    int64_t nTime2 = GetTimeMicros();
+
+    LogPrint(BCLog::BENCH, "BlockTemplateBuilder::CreateNewBlock() %s selection: %.2fms, finish%s: %.2fms (total %.2fms)\n", fRebuild ? "rebuilt" : "incremental", 0.001 * (nTime1 - nTimeStart), fValidate ? " and validity" : "", 0.001 * (nTime2 - nTime1), 0.001 * (nTime2 - nTimeStart));
+
+    return pblocktemplate;
 }
 
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce)
@@ -445,3 +460,81 @@ void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned
     pblock->vtx[0] = MakeTransactionRef(std::move(txCoinbase));
     pblock->hashMerkleRoot = BlockMerkleRoot(*pblock);
 }
+
+//! Number of nonces a ScanHeaderNonces thread claims at a time
+static const uint64_t NONCE_SCAN_CHUNK = 4096;
+
+bool ScanHeaderNonces(CBlockHeader& header, const Consensus::Params& params, uint32_t nNonceLimit, int nThreads, uint64_t& nMaxTries, uint64_t& nHashes)
+{
+    bool fNegative;
+    bool fOverflow;
+    arith_uint256 bnTarget;
+    bnTarget.SetCompact(header.nBits, &fNegative, &fOverflow);
+    // No nonce could pass CheckProofOfWork, so the scan would never end.
+    if (fNegative || bnTarget == 0 || fOverflow || bnTarget > UintToArith256(params.powLimit)) {
+        throw std::runtime_error(strprintf("%s: invalid nBits %08x", __func__, header.nBits));
+    }
+    if (header.nNonce >= nNonceLimit) {
+        throw std::runtime_error(strprintf("%s: nonce %u is not below the limit %u", __func__, header.nNonce, nNonceLimit));
+    }
+
+    // Only the last 16 bytes of the header (the end of the merkle root, the
+    // time, the bits and the nonce) go into the second SHA256 block, so the
+    // state after the first block is shared by every nonce.
+    CDataStream ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << header;
+    assert(ss.size() == 80);
+    CSHA256 midstate;
+    midstate.Write((const unsigned char*)ss.data(), 64);
+
+    const uint32_t nStart = header.nNonce;
+    const uint64_t nRange = std::min<uint64_t>(nNonceLimit - nStart, nMaxTries);
+    std::atomic<uint64_t> next{0};
+    // Offset of the lowest nonce found so far, or nRange
+    std::atomic<uint64_t> found{nRange};
+    std::atomic<uint64_t> hashes{0};
+
+    auto scan = [&]() {
+        unsigned char tail[16];
+        memcpy(tail, ss.data() + 64, sizeof(tail));
+        uint64_t nDone = 0;
+        while (true) {
+            const uint64_t begin = next.fetch_add(NONCE_SCAN_CHUNK);
+            if (begin >= nRange || begin >= found.load()) break;
+            const uint64_t end = std::min(begin + NONCE_SCAN_CHUNK, nRange);
+            for (uint64_t i = begin; i < end; i++) {
+                WriteLE32(tail + 12, nStart + i);
+                unsigned char buf[CSHA256::OUTPUT_SIZE];
+                CSHA256(midstate).Write(tail, sizeof(tail)).Finalize(buf);
+                uint256 hash;
+                CSHA256().Write(buf, sizeof(buf)).Finalize(hash.begin());
+                ++nDone;
+                if (UintToArith256(hash) <= bnTarget) {
+                    // Chunks are claimed in order and all chunks below the
+                    // best find are finished, so the lowest nonce wins no
+                    // matter how the threads were scheduled.
+                    uint64_t prev = found.load();
+                    while (i < prev && !found.compare_exchange_weak(prev, i)) {}
+                    break;
+                }
+            }
+        }
+        hashes += nDone;
+    };
+
+    std::vector<std::thread> threads;
+    for (int i = 1; i < nThreads; i++) {
+        threads.emplace_back(scan);
+    }
+    scan();
+    for (std::thread& thread : threads) {
+        thread.join();
+    }
+
+    const uint64_t nFound = found;
+    const bool fFound = nFound < nRange;
+    nHashes += hashes;
+    nMaxTries -= fFound ? nFound + 1 : nFound;
+    header.nNonce = nStart + nFound;
+    return fFound;
+}
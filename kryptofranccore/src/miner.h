@@ -15,8 +15,7 @@
 #include <memory>
 #include <stdint.h>
 
-#include <boost/multi_index_container.hpp>
-#include <boost/multi_index/ordered_index.hpp>
+#include <boost/signals2/connection.hpp>
 
 class CBlockIndex;
 class CChainParams;
@@ -34,99 +33,12 @@ struct CBlockTemplate
     std::vector<unsigned char> vchCoinbaseCommitment;
 };
 
-// Container for tracking updates to ancestor feerate as we include (parent)
-// transactions in a block
-struct CTxMemPoolModifiedEntry {
-    explicit CTxMemPoolModifiedEntry(CTxMemPool::txiter entry)
-    {
-        iter = entry;
-        nSizeWithAncestors = entry->GetSizeWithAncestors();
-        nModFeesWithAncestors = entry->GetModFeesWithAncestors();
-        nSigOpCostWithAncestors = entry->GetSigOpCostWithAncestors();
-    }
-
-    int64_t GetModifiedFee() const { return iter->GetModifiedFee(); }
-    uint64_t GetSizeWithAncestors() const { return nSizeWithAncestors; }
-    CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
-    size_t GetTxSize() const { return iter->GetTxSize(); }
-    const CTransaction& GetTx() const { return iter->GetTx(); }
-
-    CTxMemPool::txiter iter;
-    uint64_t nSizeWithAncestors;
-    CAmount nModFeesWithAncestors;
-    int64_t nSigOpCostWithAncestors;
-};
-
-/** Comparator for CTxMemPool::txiter objects.
- *  It simply compares the internal memory address of the CTxMemPoolEntry object
- *  pointed to. This means it has no meaning, and is only useful for using them
- *  as key in other indexes.
- */
-struct CompareCTxMemPoolIter {
-    bool operator()(const CTxMemPool::txiter& a, const CTxMemPool::txiter& b) const
-    {
-        return &(*a) < &(*b);
-    }
-};
-
-struct modifiedentry_iter {
-    typedef CTxMemPool::txiter result_type;
-    result_type operator() (const CTxMemPoolModifiedEntry &entry) const
-    {
-        return entry.iter;
-    }
-};
-
-// A comparator that sorts transactions based on number of ancestors.
-// This is sufficient to sort an ancestor package in an order that is valid
-// to appear in a block.
-struct CompareTxIterByAncestorCount {
-    bool operator()(const CTxMemPool::txiter &a, const CTxMemPool::txiter &b) const
-    {
-        if (a->GetCountWithAncestors() != b->GetCountWithAncestors())
-            return a->GetCountWithAncestors() < b->GetCountWithAncestors();
-        return CTxMemPool::CompareIteratorByHash()(a, b);
-    }
-};
-
-typedef boost::multi_index_container<
-    CTxMemPoolModifiedEntry,
-    boost::multi_index::indexed_by<
-        boost::multi_index::ordered_unique<
-            modifiedentry_iter,
-            CompareCTxMemPoolIter
-        >,
-        // sorted by modified ancestor fee rate
-        boost::multi_index::ordered_non_unique<
-            // Reuse same tag from CTxMemPool's similar index
-            boost::multi_index::tag<ancestor_score>,
-            boost::multi_index::identity<CTxMemPoolModifiedEntry>,
-            CompareTxMemPoolEntryByAncestorFee
-        >
-    >
-> indexed_modified_transaction_set;
-
-typedef indexed_modified_transaction_set::nth_index<0>::type::iterator modtxiter;
-typedef indexed_modified_transaction_set::index<ancestor_score>::type::iterator modtxscoreiter;
-
-struct update_for_parent_inclusion
-{
-    explicit update_for_parent_inclusion(CTxMemPool::txiter it) : iter(it) {}
-
-    void operator() (CTxMemPoolModifiedEntry &e)
-    {
-        e.nModFeesWithAncestors -= iter->GetFee();
-        e.nSizeWithAncestors -= iter->GetTxSize();
-        e.nSigOpCostWithAncestors -= iter->GetSigOpCost();
-    }
-
-    CTxMemPool::txiter iter;
-};
-
 /** Generate a new block, without valid proof-of-work */
 class BlockAssembler
 {
 private:
+    friend class BlockTemplateBuilder;
+
     // The constructed block template
     std::unique_ptr<CBlockTemplate> pblocktemplate;
     // A convenience pointer that always refers to the CBlock in pblocktemplate
@@ -143,6 +55,8 @@ private:
     uint64_t nBlockSigOpsCost;
     CAmount nFees;
     CTxMemPool::setEntries inBlock;
+    // Whether a package was left out because it did not fit in the block
+    bool fBlockFull;
 
     // Chain context for the block
     int nHeight;
@@ -169,36 +83,98 @@ private:
     // utility functions
     /** Clear the block's state and prepare for assembling a new block */
     void resetBlock();
+    /** Start a new block on top of pindexPrev and fill it with transactions from the mempool */
+    void SelectTransactions(CBlockIndex* pindexPrev, int& nPackagesSelected) EXCLUSIVE_LOCKS_REQUIRED(cs_main, mempool.cs);
+    /** Fill in the coinbase and header of a copy of the block, with coinbase to scriptPubKeyIn */
+    void FinishBlock(CBlockTemplate& blocktemplate, const CScript& scriptPubKeyIn, const CBlockIndex* pindexPrev) const;
     /** Add a tx to the block */
     void AddToBlock(CTxMemPool::txiter iter);
+    /** Remove a tx that was added with AddToBlock */
+    void RemoveFromBlock(CTxMemPool::txiter iter);
 
     // Methods for how to add transactions to a block.
-    /** Add transactions based on feerate including unconfirmed ancestors
-      * Increments nPackagesSelected / nDescendantsUpdated with corresponding
-      * statistics from the package selection (for logging statistics). */
-    void addPackageTxs(int &nPackagesSelected, int &nDescendantsUpdated) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
+    /** Add transactions a mempool chunk at a time, best feerate first
+      * Increments nPackagesSelected with the number of chunks selected
+      * (for logging statistics). */
+    void addPackageTxs(int &nPackagesSelected) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
 
     // helper functions for addPackageTxs()
-    /** Remove confirmed (inBlock) entries from given set */
-    void onlyUnconfirmed(CTxMemPool::setEntries& testSet);
     /** Test if a new package would "fit" in the block */
     bool TestPackage(uint64_t packageSize, int64_t packageSigOpsCost) const;
     /** Perform checks on each transaction in a package:
       * locktime, premature-witness, serialized size (if necessary)
       * These checks should always succeed, and they're here
       * only as an extra check in case of suboptimal node configuration */
-    bool TestPackageTransactions(const CTxMemPool::setEntries& package);
-    /** Return true if given transaction from mapTx has already been evaluated,
-      * or if the transaction's cached data in mapTx is incorrect. */
-    bool SkipMapTxEntry(CTxMemPool::txiter it, indexed_modified_transaction_set &mapModifiedTx, CTxMemPool::setEntries &failedTx) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
-    /** Sort the package in an order that is valid to appear in a block */
-    void SortForBlock(const CTxMemPool::setEntries& package, std::vector<CTxMemPool::txiter>& sortedEntries);
-    /** Add descendants of given transactions to mapModifiedTx with ancestor
-      * state updated assuming given transactions are inBlock. Returns number
-      * of updated descendants. */
-    int UpdatePackagesForAdded(const CTxMemPool::setEntries& alreadyAdded, indexed_modified_transaction_set &mapModifiedTx) EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
+    bool TestPackageTransactions(const CTxMemPool::vecEntries& package);
 };
 
+/**
+ * Keeps the transaction selection of a BlockAssembler up to date as the
+ * mempool changes, so that repeated block templates do not each run the full
+ * package selection.
+ *
+ * The selection is rebuilt when the tip changes. In between, a transaction
+ * entering the mempool is appended if all of its in-mempool parents are
+ * already selected and it fits, and a selected transaction leaving the
+ * mempool is dropped. Whenever a rebuild could pick a different set (a child
+ * of an unselected parent, a transaction competing for space in a full
+ * block, a prioritisetransaction call) the selection is marked stale and the
+ * next template rebuilds it.
+ *
+ * TestBlockValidity runs once per change to the selection. Templates from an
+ * unchanged selection, tip and coinbase script reuse its result.
+ */
+class BlockTemplateBuilder
+{
+private:
+    BlockAssembler m_assembler;
+    //! Tip the selection was built on
+    const CBlockIndex* m_tip GUARDED_BY(mempool.cs) = nullptr;
+    bool m_stale GUARDED_BY(mempool.cs) = true;
+    //! Lowest modified feerate of a selected transaction
+    CFeeRate m_min_feerate GUARDED_BY(mempool.cs);
+    //! Bumped whenever transactions are added to or dropped from the selection
+    uint64_t m_selection_version GUARDED_BY(mempool.cs) = 0;
+    //! Selection, tip and coinbase script of the last template that passed TestBlockValidity
+    uint64_t m_valid_version GUARDED_BY(mempool.cs) = 0;
+    const CBlockIndex* m_valid_tip GUARDED_BY(mempool.cs) = nullptr;
+    CScript m_valid_script GUARDED_BY(mempool.cs);
+
+    boost::signals2::scoped_connection m_conn_added;
+    boost::signals2::scoped_connection m_conn_removed;
+    boost::signals2::scoped_connection m_conn_prioritised;
+
+    void MarkStale() EXCLUSIVE_LOCKS_REQUIRED(mempool.cs);
+    void TransactionAdded(CTransactionRef tx);
+    void TransactionRemoved(CTransactionRef tx, MemPoolRemovalReason reason);
+    void TransactionPrioritised(CTransactionRef tx);
+
+public:
+    explicit BlockTemplateBuilder(const CChainParams& params);
+    BlockTemplateBuilder(const BlockTemplateBuilder&) = delete;
+    BlockTemplateBuilder& operator=(const BlockTemplateBuilder&) = delete;
+
+    /** Construct a block template with coinbase to scriptPubKeyIn from the current selection */
+    std::unique_ptr<CBlockTemplate> CreateNewBlock(const CScript& scriptPubKeyIn);
+};
+
+/**
+ * Search for a nonce that gives header a valid proof of work, trying nonces
+ * from header.nNonce up to (but not including) nNonceLimit, and at most
+ * nMaxTries of them. The nonces are split across nThreads threads, which
+ * hash from the SHA256 midstate of the first 64 header bytes.
+ *
+ * On return header.nNonce is the lowest nonce that was found, or the first
+ * one not tried, and nMaxTries is reduced by the number of nonces a serial
+ * search would have tried: those before it, and the one found. nHashes is increased by the number
+ * of hashes computed. Returns whether a nonce was found.
+ *
+ * Throws std::runtime_error if header.nBits is not a target CheckProofOfWork
+ * could accept, or header.nNonce is not below nNonceLimit, since neither
+ * search would make progress.
+ */
+bool ScanHeaderNonces(CBlockHeader& header, const Consensus::Params& params, uint32_t nNonceLimit, int nThreads, uint64_t& nMaxTries, uint64_t& nHashes);
+
 /** Modify the extranonce in a block */
 void IncrementExtraNonce(CBlock* pblock, const CBlockIndex* pindexPrev, unsigned int& nExtraNonce);
 int64_t UpdateTime(CBlockHeader* pblock, const Consensus::Params& consensusParams, const CBlockIndex* pindexPrev);
@@ -26,12 +26,17 @@
 #include <string.h>
 #else
 #include <fcntl.h>
+#include <sys/uio.h>
 #endif
 
 #ifdef USE_POLL
 #include <poll.h>
 #endif
 
+#ifdef USE_EPOLL
+#include <sys/epoll.h>
+#endif
+
 #ifdef USE_UPNP
 #include <miniupnpc/miniupnpc.h>
 #include <miniupnpc/miniwget.h>
@@ -71,6 +76,19 @@ enum BindFlags {
 // The sleep time needs to be small to avoid new sockets stalling
 static const uint64_t SELECT_TIMEOUT_MILLISECONDS = 50;
 
+// Size of a single read from a socket; typical socket buffer is 8K-64K
+static const size_t SOCKET_RECV_SIZE = 0x10000;
+
+// Maximum number of queued buffers handed to a single sendmsg call
+static const int SOCKET_SEND_MAX_BUFFERS = 64;
+
+#ifdef USE_EPOLL
+// Maximum number of socket events handled per epoll_wait call
+static const int EPOLL_MAX_EVENTS = 256;
+// The epoll socket handler only looks at every node this often (in milliseconds)
+static const int64_t EPOLL_INACTIVITY_CHECK_MILLISECONDS = 1000;
+#endif
+
 const std::string NET_MESSAGE_COMMAND_OTHER = "*other*";
 
 static const uint64_t RANDOMIZER_ID_NETGROUP = 0x6c0edd8036ef4036ULL; // SHA256("netgroup")[0:8]
@@ -564,10 +582,20 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
     nRecvBytes += nBytes;
     while (nBytes > 0) {
 
-        // get current incomplete message, or create a new one
+        // get current incomplete message, or reuse or create a new one
         if (vRecvMsg.empty() ||
-            vRecvMsg.back().complete())
-            vRecvMsg.push_back(CNetMessage(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION));
+            vRecvMsg.back().complete()) {
+            bool fReused = false;
+            {
+                LOCK(cs_vRecvPool);
+                if (!vRecvPool.empty()) {
+                    vRecvMsg.splice(vRecvMsg.end(), vRecvPool, vRecvPool.begin());
+                    fReused = true;
+                }
+            }
+            if (!fReused)
+                vRecvMsg.push_back(CNetMessage(Params().MessageStart(), SER_NETWORK, INIT_PROTO_VERSION));
+        }
 
         CNetMessage& msg = vRecvMsg.back();
 
@@ -606,6 +634,40 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete
     return true;
 }
 
+char* CNode::GetRecvBuffer(unsigned int nMax, unsigned int& nSize)
+{
+    LOCK(cs_vRecv);
+    if (vRecvMsg.empty() || !vRecvMsg.back().in_data)
+        return nullptr;
+    return vRecvMsg.back().GetDataBuffer(nMax, nSize);
+}
+
+size_t CNode::TakeCompleteRecvMsgs(std::list<CNetMessage>& msgs)
+{
+    size_t nSize = 0;
+    auto it(vRecvMsg.begin());
+    for (; it != vRecvMsg.end(); ++it) {
+        if (!it->complete())
+            break;
+        nSize += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
+    }
+    msgs.splice(msgs.end(), vRecvMsg, vRecvMsg.begin(), it);
+    return nSize;
+}
+
+void CNode::RecycleRecvMsgs(std::list<CNetMessage>& msgs)
+{
+    LOCK(cs_vRecvPool);
+    for (auto it = msgs.begin(); it != msgs.end() && vRecvPool.size() < RECV_POOL_SIZE; ) {
+        auto next = std::next(it);
+        if (it->hdr.nMessageSize <= RECV_POOL_MAX_MESSAGE_SIZE) {
+            it->Reset(INIT_PROTO_VERSION);
+            vRecvPool.splice(vRecvPool.end(), msgs, it);
+        }
+        it = next;
+    }
+}
+
 void CNode::SetSendVersion(int nVersionIn)
 {
     // Send version may only be changed in the version message, and
@@ -675,12 +737,44 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
     }
 
     hasher.Write((const unsigned char*)pch, nCopy);
-    memcpy(&vRecv[nDataPos], pch, nCopy);
+    // Data received through GetDataBuffer is in place already
+    if (pch != &vRecv[nDataPos])
+        memcpy(&vRecv[nDataPos], pch, nCopy);
     nDataPos += nCopy;
 
     return nCopy;
 }
 
+char* CNetMessage::GetDataBuffer(unsigned int nMax, unsigned int& nSize)
+{
+    // Oversized messages get the peer disconnected instead
+    if (hdr.nMessageSize > MAX_PROTOCOL_MESSAGE_LENGTH)
+        return nullptr;
+    unsigned int nRemaining = hdr.nMessageSize - nDataPos;
+    if (nRemaining < RECV_IN_PLACE_MIN_SIZE)
+        return nullptr;
+    nSize = std::min(nRemaining, nMax);
+    if (vRecv.size() < nDataPos + nSize) {
+        // As in readData, allocate up to 256 KiB ahead
+        vRecv.resize(std::min(hdr.nMessageSize, nDataPos + nSize + 256 * 1024));
+    }
+    return &vRecv[nDataPos];
+}
+
+void CNetMessage::Reset(int nVersionIn)
+{
+    in_data = false;
+    hdrbuf.clear();
+    hdrbuf.resize(24);
+    nHdrPos = 0;
+    vRecv.clear();
+    nDataPos = 0;
+    nTime = 0;
+    hasher.Reset();
+    data_hash.SetNull();
+    SetVersion(nVersionIn);
+}
+
 const uint256& CNetMessage::GetMessageHash() const
 {
     assert(complete());
@@ -695,27 +789,57 @@ size_t CConnman::SocketSendData(CNode *pnode) const EXCLUSIVE_LOCKS_REQUIRED(pno
     size_t nSentSize = 0;
 
     while (it != pnode->vSendMsg.end()) {
-        const auto &data = *it;
-        assert(data.size() > pnode->nSendOffset);
+        assert((*it)->size() > pnode->nSendOffset);
         int nBytes = 0;
+        size_t nAttempted = 0;
         {
             LOCK(pnode->cs_hSocket);
             if (pnode->hSocket == INVALID_SOCKET)
                 break;
-            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
+#ifdef WIN32
+            const auto& data = **it;
+            nAttempted = data.size() - pnode->nSendOffset;
+            nBytes = send(pnode->hSocket, reinterpret_cast<const char*>(data.data()) + pnode->nSendOffset, nAttempted, MSG_NOSIGNAL | MSG_DONTWAIT);
+#else
+            // Hand as many queued buffers as possible to the kernel at once,
+            // so that a header and its payload go out in a single call.
+            struct iovec iov[SOCKET_SEND_MAX_BUFFERS];
+            int nBuffers = 0;
+            size_t nOffset = pnode->nSendOffset;
+            for (auto it_gather = it; it_gather != pnode->vSendMsg.end() && nBuffers < SOCKET_SEND_MAX_BUFFERS; ++it_gather) {
+                const auto& data = **it_gather;
+                iov[nBuffers].iov_base = const_cast<unsigned char*>(data.data()) + nOffset;
+                iov[nBuffers].iov_len = data.size() - nOffset;
+                nAttempted += iov[nBuffers].iov_len;
+                nOffset = 0;
+                nBuffers++;
+            }
+            struct msghdr msg = {};
+            msg.msg_iov = iov;
+            msg.msg_iovlen = nBuffers;
+            nBytes = sendmsg(pnode->hSocket, &msg, MSG_NOSIGNAL | MSG_DONTWAIT);
+#endif
         }
         if (nBytes > 0) {
             pnode->nLastSend = GetSystemTimeInSeconds();
             pnode->nSendBytes += nBytes;
-            pnode->nSendOffset += nBytes;
             nSentSize += nBytes;
-            if (pnode->nSendOffset == data.size()) {
+            // Drop the buffers that were sent completely
+            size_t nLeft = nBytes;
+            while (nLeft > 0) {
+                const size_t nRemaining = (*it)->size() - pnode->nSendOffset;
+                if (nLeft < nRemaining) {
+                    pnode->nSendOffset += nLeft;
+                    break;
+                }
+                nLeft -= nRemaining;
                 pnode->nSendOffset = 0;
-                pnode->nSendSize -= data.size();
-                pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+                pnode->nSendSize -= (*it)->size();
                 it++;
-            } else {
-                // could not send full message; stop sending more
+            }
+            pnode->fPauseSend = pnode->nSendSize > nSendBufferMaxSize;
+            if ((size_t)nBytes < nAttempted) {
+                // could not send everything; stop sending more
                 break;
             }
         } else {
@@ -969,6 +1093,9 @@ void CConnman::AcceptConnection(const ListenSocket& hListenSocket) {
 
     LogPrint(BCLog::NET, "connection from %s accepted\n", addr.ToString());
 
+#ifdef USE_EPOLL
+    EpollAddNode(pnode);
+#endif
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
@@ -1248,6 +1375,73 @@ void CConnman::SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_s
 }
 #endif
 
+/**
+ * Read once from the node's socket, and hand complete messages to the
+ * message handler. The socket is closed when the peer has disconnected or on
+ * errors. Returns the number of bytes read. fDrained is set when the read
+ * returned less than was asked for, or nothing, so that no data is left
+ * waiting in the socket.
+ */
+size_t CConnman::SocketRecvData(CNode* pnode, bool& fDrained)
+{
+    fDrained = true;
+    char pchBuf[SOCKET_RECV_SIZE];
+    // The rest of a large message is received in place rather than copied
+    unsigned int nBufSize = 0;
+    char* pchDest = pnode->GetRecvBuffer(SOCKET_RECV_SIZE, nBufSize);
+    if (!pchDest) {
+        pchDest = pchBuf;
+        nBufSize = sizeof(pchBuf);
+    }
+    int nBytes = 0;
+    {
+        LOCK(pnode->cs_hSocket);
+        if (pnode->hSocket == INVALID_SOCKET)
+            return 0;
+        nBytes = recv(pnode->hSocket, pchDest, nBufSize, MSG_DONTWAIT);
+    }
+    if (nBytes > 0)
+    {
+        fDrained = (unsigned int)nBytes < nBufSize;
+        bool notify = false;
+        if (!pnode->ReceiveMsgBytes(pchDest, nBytes, notify))
+            pnode->CloseSocketDisconnect();
+        RecordBytesRecv(nBytes);
+        if (notify) {
+            std::list<CNetMessage> msgs;
+            size_t nSizeAdded = pnode->TakeCompleteRecvMsgs(msgs);
+            {
+                LOCK(pnode->cs_vProcessMsg);
+                pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), msgs);
+                pnode->nProcessQueueSize += nSizeAdded;
+                pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
+            }
+            WakeMessageHandler(pnode->GetId());
+        }
+        return nBytes;
+    }
+    else if (nBytes == 0)
+    {
+        // socket closed gracefully
+        if (!pnode->fDisconnect) {
+            LogPrint(BCLog::NET, "socket closed\n");
+        }
+        pnode->CloseSocketDisconnect();
+    }
+    else if (nBytes < 0)
+    {
+        // error
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
+        {
+            if (!pnode->fDisconnect)
+                LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
+            pnode->CloseSocketDisconnect();
+        }
+    }
+    return 0;
+}
+
 void CConnman::SocketHandler()
 {
     std::set<SOCKET> recv_set, send_set, error_set;
@@ -1297,57 +1491,8 @@ void CConnman::SocketHandler()
         }
         if (recvSet || errorSet)
         {
-            // typical socket buffer is 8K-64K
-            char pchBuf[0x10000];
-            int nBytes = 0;
-            {
-                LOCK(pnode->cs_hSocket);
-                if (pnode->hSocket == INVALID_SOCKET)
-                    continue;
-                nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
-            }
-            if (nBytes > 0)
-            {
-                bool notify = false;
-                if (!pnode->ReceiveMsgBytes(pchBuf, nBytes, notify))
-                    pnode->CloseSocketDisconnect();
-                RecordBytesRecv(nBytes);
-                if (notify) {
-                    size_t nSizeAdded = 0;
-                    auto it(pnode->vRecvMsg.begin());
-                    for (; it != pnode->vRecvMsg.end(); ++it) {
-                        if (!it->complete())
-                            break;
-                        nSizeAdded += it->vRecv.size() + CMessageHeader::HEADER_SIZE;
-                    }
-                    {
-                        LOCK(pnode->cs_vProcessMsg);
-                        pnode->vProcessMsg.splice(pnode->vProcessMsg.end(), pnode->vRecvMsg, pnode->vRecvMsg.begin(), it);
-                        pnode->nProcessQueueSize += nSizeAdded;
-                        pnode->fPauseRecv = pnode->nProcessQueueSize > nReceiveFloodSize;
-                    }
-                    WakeMessageHandler();
-                }
-            }
-            else if (nBytes == 0)
-            {
-                // socket closed gracefully
-                if (!pnode->fDisconnect) {
-                    LogPrint(BCLog::NET, "socket closed\n");
-                }
-                pnode->CloseSocketDisconnect();
-            }
-            else if (nBytes < 0)
-            {
-                // error
-                int nErr = WSAGetLastError();
-                if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
-                {
-                    if (!pnode->fDisconnect)
-                        LogPrintf("socket recv error %s\n", NetworkErrorString(nErr));
-                    pnode->CloseSocketDisconnect();
-                }
-            }
+            bool fDrained;
+            SocketRecvData(pnode, fDrained);
         }
 
         //
@@ -1371,10 +1516,157 @@ void CConnman::SocketHandler()
     }
 }
 
+#ifdef USE_EPOLL
+/** Add the node's socket to the epoll set. Call before the node is added to vNodes. */
+void CConnman::EpollAddNode(CNode* pnode)
+{
+    if (m_epoll_fd == -1) return;
+
+    // Edge-triggered: an event is only reported when the socket becomes
+    // readable or writable, so the handler has to remember sockets it has
+    // not drained yet.
+    struct epoll_event event;
+    event.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+    event.data.ptr = pnode;
+    LOCK(pnode->cs_hSocket);
+    if (pnode->hSocket == INVALID_SOCKET) return;
+    if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, pnode->hSocket, &event) != 0) {
+        LogPrintf("epoll_ctl failed for peer=%d: %s\n", pnode->GetId(), NetworkErrorString(errno));
+        pnode->fDisconnect = true;
+    }
+}
+
+void CConnman::SocketHandlerEpoll()
+{
+    // Only wait if every socket that is still ready is held back, by a full
+    // receive queue or by unsent data that is waiting for the socket to drain.
+    int nTimeout = SELECT_TIMEOUT_MILLISECONDS;
+    for (CNode* pnode : m_sockets_ready) {
+        LOCK(pnode->cs_vSend);
+        if ((pnode->fSocketSendReady && !pnode->vSendMsg.empty()) ||
+            (pnode->fSocketRecvReady && !pnode->fPauseRecv && pnode->vSendMsg.empty())) {
+            nTimeout = 0;
+            break;
+        }
+    }
+
+    struct epoll_event events[EPOLL_MAX_EVENTS];
+    int nEvents = epoll_wait(m_epoll_fd, events, EPOLL_MAX_EVENTS, nTimeout);
+
+    if (interruptNet) return;
+
+    if (nEvents < 0) {
+        if (errno != EINTR) {
+            LogPrintf("socket epoll_wait error %s\n", NetworkErrorString(errno));
+            if (!interruptNet.sleep_for(std::chrono::milliseconds(SELECT_TIMEOUT_MILLISECONDS)))
+                return;
+        }
+        nEvents = 0;
+    }
+
+    for (int i = 0; i < nEvents; ++i) {
+        const struct epoll_event& event = events[i];
+        bool fListenSocket = false;
+        for (const ListenSocket& hListenSocket : vhListenSocket) {
+            if (event.data.ptr == &hListenSocket) {
+                AcceptConnection(hListenSocket);
+                fListenSocket = true;
+                break;
+            }
+        }
+        if (fListenSocket) continue;
+
+        // The node cannot have been deleted: that only happens on this
+        // thread, after its socket has been closed, which removes it from
+        // the epoll set.
+        CNode* pnode = static_cast<CNode*>(event.data.ptr);
+        if (event.events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)) pnode->fSocketRecvReady = true;
+        if (event.events & EPOLLOUT) pnode->fSocketSendReady = true;
+        if (!pnode->fSocketQueued) {
+            pnode->fSocketQueued = true;
+            pnode->AddRef();
+            m_sockets_ready.push_back(pnode);
+        }
+    }
+
+    //
+    // Service the ready sockets
+    //
+    size_t nKept = 0;
+    for (CNode* pnode : m_sockets_ready)
+    {
+        bool fKeep = !interruptNet;
+        {
+            LOCK(pnode->cs_hSocket);
+            if (pnode->hSocket == INVALID_SOCKET) fKeep = false;
+        }
+
+        bool fSendQueued = false;
+        if (fKeep) {
+            // As with select, drain the send queue before receiving more
+            LOCK(pnode->cs_vSend);
+            if (pnode->fSocketSendReady && !pnode->vSendMsg.empty()) {
+                size_t nBytes = SocketSendData(pnode);
+                if (nBytes) {
+                    RecordBytesSent(nBytes);
+                }
+                // Data left over means the socket is full; wait for EPOLLOUT
+                if (!pnode->vSendMsg.empty()) pnode->fSocketSendReady = false;
+            }
+            fSendQueued = !pnode->vSendMsg.empty();
+        }
+
+        if (fKeep && pnode->fSocketRecvReady && !pnode->fPauseRecv && !fSendQueued) {
+            // A read shorter than asked for means the socket has been
+            // drained; new data will be reported by another event. Reads
+            // into a message are asked for less than SOCKET_RECV_SIZE once
+            // little of it is left, so compare against what was asked for.
+            bool fDrained;
+            SocketRecvData(pnode, fDrained);
+            if (fDrained) pnode->fSocketRecvReady = false;
+        }
+
+        if (fKeep && (pnode->fSocketRecvReady || (pnode->fSocketSendReady && fSendQueued))) {
+            m_sockets_ready[nKept++] = pnode;
+        } else {
+            pnode->fSocketRecvReady = false;
+            pnode->fSocketQueued = false;
+            pnode->Release();
+        }
+    }
+    m_sockets_ready.resize(nKept);
+}
+#endif
+
 void CConnman::ThreadSocketHandler()
 {
+#ifdef USE_EPOLL
+    int64_t nLastDisconnect = 0;
+    int64_t nLastInactivityCheck = 0;
+#endif
     while (!interruptNet)
     {
+#ifdef USE_EPOLL
+        if (m_epoll_fd != -1) {
+            // The epoll handler returns as soon as any socket is ready, so
+            // only go over all nodes as often as the other handlers wake up.
+            const int64_t nNow = GetTimeMillis();
+            if (nNow - nLastDisconnect >= (int64_t)SELECT_TIMEOUT_MILLISECONDS) {
+                nLastDisconnect = nNow;
+                DisconnectNodes();
+                NotifyNumConnectionsChanged();
+            }
+            if (nNow - nLastInactivityCheck >= EPOLL_INACTIVITY_CHECK_MILLISECONDS) {
+                nLastInactivityCheck = nNow;
+                LOCK(cs_vNodes);
+                for (CNode* pnode : vNodes) {
+                    InactivityCheck(pnode);
+                }
+            }
+            SocketHandlerEpoll();
+            continue;
+        }
+#endif
         DisconnectNodes();
         NotifyNumConnectionsChanged();
         SocketHandler();
@@ -1384,10 +1676,26 @@ void CConnman::ThreadSocketHandler()
 void CConnman::WakeMessageHandler()
 {
     {
-        std::lock_guard<std::mutex> lock(mutexMsgProc);
-        fMsgProcWake = true;
+        LOCK(mutexMsgProc);
+        vMsgProcWake.assign(vMsgProcWake.size(), true);
+    }
+    condMsgProc.notify_all();
+}
+
+void CConnman::WakeMessageHandler(NodeId id)
+{
+    {
+        LOCK(mutexMsgProc);
+        if (vMsgProcWake.empty()) return;
+        vMsgProcWake[id % nMessageHandlerThreads] = true;
+    }
+    // The threads share the condition variable, so wake them all to let
+    // the right one see its flag.
+    if (nMessageHandlerThreads == 1) {
+        condMsgProc.notify_one();
+    } else {
+        condMsgProc.notify_all();
     }
-    condMsgProc.notify_one();
 }
 
 
@@ -1939,22 +2247,28 @@ void CConnman::OpenNetworkConnection(const CAddress& addrConnect, bool fCountFai
         pnode->m_manual_connection = true;
 
     m_msgproc->InitializeNode(pnode);
+#ifdef USE_EPOLL
+    EpollAddNode(pnode);
+#endif
     {
         LOCK(cs_vNodes);
         vNodes.push_back(pnode);
     }
 }
 
-void CConnman::ThreadMessageHandler()
+void CConnman::ThreadMessageHandler(int nThread)
 {
     while (!flagInterruptMsgProc)
     {
+        // Each node is handled by a single thread, so its messages are
+        // processed in order.
         std::vector<CNode*> vNodesCopy;
         {
             LOCK(cs_vNodes);
-            vNodesCopy = vNodes;
-            for (CNode* pnode : vNodesCopy) {
+            for (CNode* pnode : vNodes) {
+                if (pnode->GetId() % nMessageHandlerThreads != nThread) continue;
                 pnode->AddRef();
+                vNodesCopy.push_back(pnode);
             }
         }
 
@@ -1988,9 +2302,9 @@ void CConnman::ThreadMessageHandler()
 
         WAIT_LOCK(mutexMsgProc, lock);
         if (!fMoreWork) {
-            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this] { return fMsgProcWake; });
+            condMsgProc.wait_until(lock, std::chrono::steady_clock::now() + std::chrono::milliseconds(100), [this, nThread] { return vMsgProcWake[nThread]; });
         }
-        fMsgProcWake = false;
+        vMsgProcWake[nThread] = false;
     }
 }
 
@@ -2234,6 +2548,25 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         semAddnode = MakeUnique<CSemaphore>(nMaxAddnode);
     }
 
+#ifdef USE_EPOLL
+    m_epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+    if (m_epoll_fd == -1) {
+        LogPrintf("epoll_create1 failed, falling back to poll: %s\n", NetworkErrorString(errno));
+    }
+    for (ListenSocket& hListenSocket : vhListenSocket) {
+        if (m_epoll_fd == -1) break;
+        // Level-triggered, as connections are accepted one per event
+        struct epoll_event event;
+        event.events = EPOLLIN;
+        event.data.ptr = &hListenSocket;
+        if (epoll_ctl(m_epoll_fd, EPOLL_CTL_ADD, hListenSocket.socket, &event) != 0) {
+            LogPrintf("epoll_ctl failed for listening socket, falling back to poll: %s\n", NetworkErrorString(errno));
+            close(m_epoll_fd);
+            m_epoll_fd = -1;
+        }
+    }
+#endif
+
     //
     // Start threads
     //
@@ -2244,7 +2577,7 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
 
     {
         LOCK(mutexMsgProc);
-        fMsgProcWake = false;
+        vMsgProcWake.assign(nMessageHandlerThreads, false);
     }
 
     // Send and receive from sockets, accept connections
@@ -2270,7 +2603,9 @@ bool CConnman::Start(CScheduler& scheduler, const Options& connOptions)
         threadOpenConnections = std::thread(&TraceThread<std::function<void()> >, "opencon", std::function<void()>(std::bind(&CConnman::ThreadOpenConnections, this, connOptions.m_specified_outgoing)));
 
     // Process messages
-    threadMessageHandler = std::thread(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this)));
+    for (int i = 0; i < nMessageHandlerThreads; i++) {
+        threadMessageHandlers.emplace_back(&TraceThread<std::function<void()> >, "msghand", std::function<void()>(std::bind(&CConnman::ThreadMessageHandler, this, i)));
+    }
 
     // Dump network addresses
     scheduler.scheduleEvery(std::bind(&CConnman::DumpAddresses, this), DUMP_PEERS_INTERVAL * 1000);
@@ -2319,8 +2654,11 @@ void CConnman::Interrupt()
 
 void CConnman::Stop()
 {
-    if (threadMessageHandler.joinable())
-        threadMessageHandler.join();
+    for (std::thread& thread : threadMessageHandlers) {
+        if (thread.joinable())
+            thread.join();
+    }
+    threadMessageHandlers.clear();
     if (threadOpenConnections.joinable())
         threadOpenConnections.join();
     if (threadOpenAddedConnections.joinable())
@@ -2344,6 +2682,15 @@ void CConnman::Stop()
             if (!CloseSocket(hListenSocket.socket))
                 LogPrintf("CloseSocket(hListenSocket) failed with error %s\n", NetworkErrorString(WSAGetLastError()));
 
+#ifdef USE_EPOLL
+    // The nodes are deleted below regardless of their references
+    m_sockets_ready.clear();
+    if (m_epoll_fd != -1) {
+        close(m_epoll_fd);
+        m_epoll_fd = -1;
+    }
+#endif
+
     // clean up some globals (to help leak detection)
     for (CNode *pnode : vNodes) {
         DeleteNode(pnode);
@@ -2690,20 +3037,35 @@ bool CConnman::NodeFullyConnected(const CNode* pnode)
     return pnode && pnode->fSuccessfullyConnected && !pnode->fDisconnect;
 }
 
-void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
+CSharedNetMsg CConnman::ShareMessage(CSerializedNetMsg&& msg)
 {
-    size_t nMessageSize = msg.data.size();
-    size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
-    LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->GetId());
-
     std::vector<unsigned char> serializedHeader;
     serializedHeader.reserve(CMessageHeader::HEADER_SIZE);
-    uint256 hash = Hash(msg.data.data(), msg.data.data() + nMessageSize);
-    CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), nMessageSize);
+    uint256 hash = Hash(msg.data.data(), msg.data.data() + msg.data.size());
+    CMessageHeader hdr(Params().MessageStart(), msg.command.c_str(), msg.data.size());
     memcpy(hdr.pchChecksum, hash.begin(), CMessageHeader::CHECKSUM_SIZE);
 
     CVectorWriter{SER_NETWORK, INIT_PROTO_VERSION, serializedHeader, 0, hdr};
 
+    CSharedNetMsg shared;
+    shared.header = std::make_shared<const std::vector<unsigned char>>(std::move(serializedHeader));
+    if (!msg.data.empty())
+        shared.payload = std::make_shared<const std::vector<unsigned char>>(std::move(msg.data));
+    shared.command = std::move(msg.command);
+    return shared;
+}
+
+void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
+{
+    PushMessage(pnode, ShareMessage(std::move(msg)));
+}
+
+void CConnman::PushMessage(CNode* pnode, const CSharedNetMsg& msg)
+{
+    size_t nMessageSize = msg.payload ? msg.payload->size() : 0;
+    size_t nTotalSize = nMessageSize + CMessageHeader::HEADER_SIZE;
+    LogPrint(BCLog::NET, "sending %s (%d bytes) peer=%d\n",  SanitizeString(msg.command.c_str()), nMessageSize, pnode->GetId());
+
     size_t nBytesSent = 0;
     {
         LOCK(pnode->cs_vSend);
@@ -2715,9 +3077,9 @@ void CConnman::PushMessage(CNode* pnode, CSerializedNetMsg&& msg)
 
         if (pnode->nSendSize > nSendBufferMaxSize)
             pnode->fPauseSend = true;
-        pnode->vSendMsg.push_back(std::move(serializedHeader));
+        pnode->vSendMsg.push_back(msg.header);
         if (nMessageSize)
-            pnode->vSendMsg.push_back(std::move(msg.data));
+            pnode->vSendMsg.push_back(msg.payload);
 
         // If write queue empty, attempt "optimistic write"
         if (optimisticSend == true)
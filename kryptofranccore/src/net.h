@@ -54,6 +54,12 @@ static const unsigned int MAX_LOCATOR_SZ = 101;
 static const unsigned int MAX_ADDR_TO_SEND = 1000;
 /** Maximum length of incoming protocol messages (no message over 4 MB is currently acceptable). */
 static const unsigned int MAX_PROTOCOL_MESSAGE_LENGTH = 4 * 1000 * 1000;
+/** Number of processed messages each peer keeps for reuse by the next ones it receives */
+static const size_t RECV_POOL_SIZE = 4;
+/** Messages larger than this are freed after processing rather than kept for reuse */
+static const unsigned int RECV_POOL_MAX_MESSAGE_SIZE = 32 * 1024;
+/** Message data at least this large is received straight into the message rather than copied there */
+static const unsigned int RECV_IN_PLACE_MIN_SIZE = 16 * 1024;
 /** Maximum length of strSubVer in `version` message */
 static const unsigned int MAX_SUBVERSION_LENGTH = 256;
 /** Maximum number of automatic outgoing nodes */
@@ -82,6 +88,10 @@ static const uint64_t MAX_UPLOAD_TIMEFRAME = 60 * 60 * 24;
 static const bool DEFAULT_BLOCKSONLY = false;
 /** -peertimeout default */
 static const int64_t DEFAULT_PEER_CONNECT_TIMEOUT = 60;
+/** -msghandlers default */
+static const int DEFAULT_MESSAGE_HANDLER_THREADS = 1;
+/** Maximum number of message handler threads */
+static const int MAX_MESSAGE_HANDLER_THREADS = 16;
 
 static const bool DEFAULT_FORCEDNSSEED = false;
 static const size_t DEFAULT_MAXRECEIVEBUFFER = 5 * 1000;
@@ -113,6 +123,22 @@ struct CSerializedNetMsg
     std::string command;
 };
 
+/** An immutable buffer queued for sending, which may be shared between peers */
+typedef std::shared_ptr<const std::vector<unsigned char>> CSendBuffer;
+
+/**
+ * A message with its header already computed, whose buffers are reference
+ * counted. Pushing it to any number of peers neither copies nor hashes the
+ * payload again, so a block is serialized once however many peers it is
+ * relayed to.
+ */
+struct CSharedNetMsg
+{
+    std::string command;
+    CSendBuffer header;
+    CSendBuffer payload;
+};
+
 
 class NetEventsInterface;
 class CConnman
@@ -148,6 +174,7 @@ public:
         bool m_use_addrman_outgoing = true;
         std::vector<std::string> m_specified_outgoing;
         std::vector<std::string> m_added_nodes;
+        int nMessageHandlerThreads = DEFAULT_MESSAGE_HANDLER_THREADS;
     };
 
     void Init(const Options& connOptions) {
@@ -164,6 +191,7 @@ public:
         nSendBufferMaxSize = connOptions.nSendBufferMaxSize;
         nReceiveFloodSize = connOptions.nReceiveFloodSize;
         m_peer_connect_timeout = connOptions.m_peer_connect_timeout;
+        nMessageHandlerThreads = std::max(1, std::min(connOptions.nMessageHandlerThreads, MAX_MESSAGE_HANDLER_THREADS));
         {
             LOCK(cs_totalBytesSent);
             nMaxOutboundTimeframe = connOptions.nMaxOutboundTimeframe;
@@ -201,6 +229,9 @@ public:
     bool ForNode(NodeId id, std::function<bool(CNode* pnode)> func);
 
     void PushMessage(CNode* pnode, CSerializedNetMsg&& msg);
+    void PushMessage(CNode* pnode, const CSharedNetMsg& msg);
+    /** Compute the header of msg, and take ownership of its payload so that it can be pushed to many peers */
+    static CSharedNetMsg ShareMessage(CSerializedNetMsg&& msg);
 
     template<typename Callable>
     void ForEachNode(Callable&& func)
@@ -309,7 +340,10 @@ public:
 
     unsigned int GetReceiveFloodSize() const;
 
+    /** Wake all message handler threads */
     void WakeMessageHandler();
+    /** Wake the message handler thread that processes messages from peer id */
+    void WakeMessageHandler(NodeId id);
 
     /** Attempts to obfuscate tx time through exponentially distributed emitting.
         Works assuming that a single interval is used.
@@ -332,14 +366,19 @@ private:
     void AddOneShot(const std::string& strDest);
     void ProcessOneShot();
     void ThreadOpenConnections(std::vector<std::string> connect);
-    void ThreadMessageHandler();
+    void ThreadMessageHandler(int nThread);
     void AcceptConnection(const ListenSocket& hListenSocket);
     void DisconnectNodes();
     void NotifyNumConnectionsChanged();
     void InactivityCheck(CNode *pnode);
+    size_t SocketRecvData(CNode* pnode, bool& fDrained);
     bool GenerateSelectSet(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
     void SocketEvents(std::set<SOCKET> &recv_set, std::set<SOCKET> &send_set, std::set<SOCKET> &error_set);
     void SocketHandler();
+#ifdef USE_EPOLL
+    void EpollAddNode(CNode* pnode);
+    void SocketHandlerEpoll();
+#endif
     void ThreadSocketHandler();
     void ThreadDNSAddressSeed();
 
@@ -401,6 +440,12 @@ private:
     std::vector<CNode*> vNodes GUARDED_BY(cs_vNodes);
     std::list<CNode*> vNodesDisconnected;
     mutable CCriticalSection cs_vNodes;
+#ifdef USE_EPOLL
+    /** epoll set the socket handler waits on, or -1 to use poll or select */
+    int m_epoll_fd{-1};
+    /** Nodes whose socket may still be readable or writable, each holding a reference (socket handler only) */
+    std::vector<CNode*> m_sockets_ready;
+#endif
     std::atomic<NodeId> nLastNodeId{0};
     unsigned int nPrevNodeCount{0};
 
@@ -422,8 +467,11 @@ private:
     /** SipHasher seeds for deterministic randomness */
     const uint64_t nSeed0, nSeed1;
 
-    /** flag for waking the message processor. */
-    bool fMsgProcWake;
+    /** Number of message handler threads; each node is handled by one of them */
+    int nMessageHandlerThreads{DEFAULT_MESSAGE_HANDLER_THREADS};
+
+    /** flags for waking the message processor threads. */
+    std::vector<bool> vMsgProcWake GUARDED_BY(mutexMsgProc);
 
     std::condition_variable condMsgProc;
     Mutex mutexMsgProc;
@@ -435,7 +483,7 @@ private:
     std::thread threadSocketHandler;
     std::thread threadOpenAddedConnections;
     std::thread threadOpenConnections;
-    std::thread threadMessageHandler;
+    std::vector<std::thread> threadMessageHandlers;
 
     /** flag for deciding to connect to an extra outbound peer,
      *  in excess of nMaxOutbound
@@ -617,8 +665,13 @@ public:
         vRecv.SetVersion(nVersionIn);
     }
 
+    /** Make this an empty message again, keeping the memory it allocated */
+    void Reset(int nVersionIn);
+
     int readHeader(const char *pch, unsigned int nBytes);
     int readData(const char *pch, unsigned int nBytes);
+    /** Space to receive up to nMax more bytes of message data in place, or nullptr if there is not much left to receive */
+    char* GetDataBuffer(unsigned int nMax, unsigned int& nSize);
 };
 
 
@@ -633,7 +686,7 @@ public:
     size_t nSendSize{0}; // total size of all vSendMsg entries
     size_t nSendOffset{0}; // offset inside the first vSendMsg already sent
     uint64_t nSendBytes GUARDED_BY(cs_vSend){0};
-    std::deque<std::vector<unsigned char>> vSendMsg GUARDED_BY(cs_vSend);
+    std::deque<CSendBuffer> vSendMsg GUARDED_BY(cs_vSend);
     CCriticalSection cs_vSend;
     CCriticalSection cs_hSocket;
     CCriticalSection cs_vRecv;
@@ -642,6 +695,10 @@ public:
     std::list<CNetMessage> vProcessMsg GUARDED_BY(cs_vProcessMsg);
     size_t nProcessQueueSize{0};
 
+    // Processed messages, reset and kept to receive the next ones into
+    CCriticalSection cs_vRecvPool;
+    std::list<CNetMessage> vRecvPool GUARDED_BY(cs_vRecvPool);
+
     CCriticalSection cs_sendProcessing;
 
     std::deque<CInv> vRecvGetData;
@@ -689,6 +746,11 @@ public:
     const uint64_t nKeyedNetGroup;
     std::atomic_bool fPauseRecv{false};
     std::atomic_bool fPauseSend{false};
+    // Readiness reported by the edge-triggered epoll socket handler, and
+    // whether the node is in its list of ready sockets (socket handler only)
+    bool fSocketRecvReady{false};
+    bool fSocketSendReady{false};
+    bool fSocketQueued{false};
 
 protected:
     mapMsgCmdSize mapSendBytesPerMsgCmd;
@@ -699,8 +761,10 @@ public:
     std::atomic<int> nStartingHeight{-1};
 
     // flood relay
-    std::vector<CAddress> vAddrToSend;
-    CRollingBloomFilter addrKnown;
+    // Addresses are pushed to a peer from the handler threads of other peers
+    CCriticalSection cs_addrSend;
+    std::vector<CAddress> vAddrToSend GUARDED_BY(cs_addrSend);
+    CRollingBloomFilter addrKnown GUARDED_BY(cs_addrSend);
     bool fGetAddr{false};
     std::set<uint256> setKnown;
     int64_t nNextAddrSend GUARDED_BY(cs_sendProcessing){0};
@@ -791,6 +855,16 @@ public:
     }
 
     bool ReceiveMsgBytes(const char *pch, unsigned int nBytes, bool& complete);
+    /**
+     * Buffer to receive the rest of a large message straight into, to be
+     * passed to ReceiveMsgBytes once filled. nullptr if no large message
+     * is being received.
+     */
+    char* GetRecvBuffer(unsigned int nMax, unsigned int& nSize);
+    /** Move the complete messages received so far to the end of msgs, returning their total size */
+    size_t TakeCompleteRecvMsgs(std::list<CNetMessage>& msgs);
+    /** Keep processed messages for reuse by the next ones received */
+    void RecycleRecvMsgs(std::list<CNetMessage>& msgs);
 
     void SetRecvVersion(int nVersionIn)
     {
@@ -822,11 +896,13 @@ public:
 
     void AddAddressKnown(const CAddress& _addr)
     {
+        LOCK(cs_addrSend);
         addrKnown.insert(_addr.GetKey());
     }
 
     void PushAddress(const CAddress& _addr, FastRandomContext &insecure_rand)
     {
+        LOCK(cs_addrSend);
         // Known checking here is only to save space from duplicates.
         // SendMessages will filter it again for knowns that were added
         // after addresses were pushed.
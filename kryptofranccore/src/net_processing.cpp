@@ -9,6 +9,7 @@
 
 #include <addrman.h>
 #include <banman.h>
+#include <blockcache.h>
 #include <arith_uint256.h>
 #include <blockencodings.h>
 #include <chainparams.h>
@@ -27,6 +28,7 @@
 #include <scheduler.h>
 #include <tinyformat.h>
 #include <txmempool.h>
+#include <txreconciliation.h>
 #include <ui_interface.h>
 #include <util/system.h>
 #include <util/moneystr.h>
@@ -77,6 +79,8 @@ struct COrphanTx {
 CCriticalSection g_cs_orphans;
 std::map<uint256, COrphanTx> mapOrphanTransactions GUARDED_BY(g_cs_orphans);
 
+bool g_enable_txreconciliation = DEFAULT_TXRECONCILIATION;
+
 void EraseOrphansFor(NodeId peer);
 
 /** Increase a node's misbehavior score. */
@@ -96,6 +100,8 @@ static constexpr unsigned int INVENTORY_BROADCAST_MAX = 7 * INVENTORY_BROADCAST_
 static constexpr unsigned int AVG_FEEFILTER_BROADCAST_INTERVAL = 10 * 60;
 /** Maximum feefilter broadcast delay after significant change. */
 static constexpr unsigned int MAX_FEEFILTER_CHANGE_DELAY = 5 * 60;
+/** Maximum number of transactions from one peer validated together. */
+static constexpr unsigned int MAX_TX_BATCH = 100;
 
 // Internal stuff
 namespace {
@@ -138,6 +144,7 @@ namespace {
         const CBlockIndex* pindex;                               //!< Optional.
         bool fValidatedHeaders;                                  //!< Whether this block has validated headers at the time of request.
         std::unique_ptr<PartiallyDownloadedBlock> partialBlock;  //!< Optional, used for CMPCTBLOCK downloads
+        int64_t nTimeRequested;                                  //!< When the block was requested (in microseconds).
     };
     std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> > mapBlocksInFlight GUARDED_BY(cs_main);
 
@@ -153,6 +160,9 @@ namespace {
     /** Number of outbound peers with m_chain_sync.m_protect. */
     int g_outbound_peers_with_protect_from_disconnect GUARDED_BY(cs_main) = 0;
 
+    /** Number of outbound peers we reconcile with but still flood transactions to. */
+    int g_recon_flood_peers GUARDED_BY(cs_main) = 0;
+
     /** When our tip was last updated. */
     std::atomic<int64_t> g_last_tip_update(0);
 
@@ -227,6 +237,8 @@ struct CNodeState {
     int64_t nDownloadingSince;
     int nBlocksInFlight;
     int nBlocksInFlightValidHeaders;
+    //! How fast this peer delivers the blocks we request.
+    BlockDownloadRate m_download_rate;
     //! Whether we consider this a preferred download peer.
     bool fPreferredDownload;
     //! Whether this peer wants invs or headers (when possible) for block announcements.
@@ -279,6 +291,12 @@ struct CNodeState {
     //! Time of last new block announcement
     int64_t m_last_block_announcement;
 
+    //! Whether we offered transaction reconciliation, and the salt we sent
+    bool m_recon_offered;
+    uint64_t m_recon_salt;
+    //! Reconciliation state, if both sides offered it
+    std::unique_ptr<TxReconState> m_recon;
+
     CNodeState(CAddress addrIn, std::string addrNameIn) : address(addrIn), name(addrNameIn) {
         fCurrentlyConnected = false;
         nMisbehavior = 0;
@@ -303,6 +321,8 @@ struct CNodeState {
         fSupportsDesiredCmpctVersion = false;
         m_chain_sync = { 0, nullptr, false, false };
         m_last_block_announcement = 0;
+        m_recon_offered = false;
+        m_recon_salt = 0;
     }
 };
 
@@ -349,9 +369,15 @@ static void PushNodeVersion(CNode *pnode, CConnman* connman, int64_t nTime)
 
 // Returns a bool indicating whether we requested this block.
 // Also used if a block was /not/ received and timed out or started with another peer
-static bool MarkBlockAsReceived(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+// When received from nodeid, the block is only marked as received if it is in
+// flight from that peer: a block reassigned to a faster peer may still arrive
+// from the one it was first requested from, and the new request stays tracked.
+static bool MarkBlockAsReceived(const uint256& hash, NodeId nodeid = -1) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
     std::map<uint256, std::pair<NodeId, std::list<QueuedBlock>::iterator> >::iterator itInFlight = mapBlocksInFlight.find(hash);
     if (itInFlight != mapBlocksInFlight.end()) {
+        if (nodeid != -1 && itInFlight->second.first != nodeid) {
+            return true;
+        }
         CNodeState *state = State(itInFlight->second.first);
         assert(state != nullptr);
         state->nBlocksInFlightValidHeaders -= itInFlight->second.second->fValidatedHeaders;
@@ -372,6 +398,25 @@ static bool MarkBlockAsReceived(const uint256& hash) EXCLUSIVE_LOCKS_REQUIRED(cs
     return false;
 }
 
+// Update nodeid's download rate if it delivered a block we requested from it
+static void UpdateBlockDownloadRate(NodeId nodeid, const uint256& hash, size_t nBytes) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
+    auto itInFlight = mapBlocksInFlight.find(hash);
+    if (itInFlight == mapBlocksInFlight.end() || itInFlight->second.first != nodeid) return;
+    CNodeState *state = State(nodeid);
+    assert(state != nullptr);
+    state->m_download_rate.Update(nBytes, itInFlight->second.second->nTimeRequested, GetTimeMicros());
+}
+
+// The number of blocks to keep in flight from a peer during block download
+static int BlockDownloadWindow(const CNodeState& state, int64_t nPingUsec) {
+    return state.m_download_rate.Window(nPingUsec);
+}
+
+// Whether a block requested from holder should be requested from state's peer instead
+static bool ShouldReassignBlock(const CNodeState& state, const CNodeState& holder, const QueuedBlock& queued) {
+    return state.m_download_rate.ShouldTakeOver(holder.m_download_rate, state.nBlocksInFlight, queued.nTimeRequested, GetTimeMicros());
+}
+
 // returns false, still setting pit, if the block was already in flight from the same peer
 // pit will only be valid as long as the same cs_main lock is being held
 static bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlockIndex* pindex = nullptr, std::list<QueuedBlock>::iterator** pit = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main) {
@@ -391,7 +436,7 @@ static bool MarkBlockAsInFlight(NodeId nodeid, const uint256& hash, const CBlock
     MarkBlockAsReceived(hash);
 
     std::list<QueuedBlock>::iterator it = state->vBlocksInFlight.insert(state->vBlocksInFlight.end(),
-            {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr)});
+            {hash, pindex, pindex != nullptr, std::unique_ptr<PartiallyDownloadedBlock>(pit ? new PartiallyDownloadedBlock(&mempool) : nullptr), GetTimeMicros()});
     state->nBlocksInFlight++;
     state->nBlocksInFlightValidHeaders += it->fValidatedHeaders;
     if (state->nBlocksInFlight == 1) {
@@ -588,9 +633,23 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
                 if (vBlocks.size() == count) {
                     return;
                 }
-            } else if (waitingfor == -1) {
-                // This is the first already-in-flight block.
-                waitingfor = mapBlocksInFlight[pindex->GetBlockHash()].first;
+            } else {
+                const auto& inFlight = mapBlocksInFlight[pindex->GetBlockHash()];
+                if (waitingfor == -1) {
+                    // This is the first already-in-flight block.
+                    waitingfor = inFlight.first;
+                }
+                // Blocks at the start of the window hold up validation and
+                // the window itself, so take them over from much slower peers
+                // rather than waiting for the stalling timeout.
+                if (pindex->nHeight <= state->pindexLastCommonBlock->nHeight + BLOCK_DOWNLOAD_REASSIGN_DEPTH &&
+                        inFlight.first != nodeid && ShouldReassignBlock(*state, *State(inFlight.first), *inFlight.second)) {
+                    LogPrint(BCLog::NET, "Reassigning block %s from peer=%d to faster peer=%d\n", pindex->GetBlockHash().ToString(), inFlight.first, nodeid);
+                    vBlocks.push_back(pindex);
+                    if (vBlocks.size() == count) {
+                        return;
+                    }
+                }
             }
         }
     }
@@ -598,6 +657,41 @@ static void FindNextBlocksToDownload(NodeId nodeid, unsigned int count, std::vec
 
 } // namespace
 
+void BlockDownloadRate::Update(size_t nBytes, int64_t nTimeRequested, int64_t nNow)
+{
+    // Requested blocks arrive one after the other, so the time spent on this
+    // one starts when the previous one arrived, unless it was requested later.
+    const int64_t nStart = std::max(nTimeRequested, nLastDelivery);
+    const int64_t nRate = (int64_t)nBytes * 1000000 / std::max<int64_t>(nNow - nStart, 1000);
+    if (nBytesPerSec == 0) {
+        nBytesPerSec = std::max<int64_t>(nRate, 1);
+        nAvgSize = nBytes;
+    } else {
+        nBytesPerSec = std::max<int64_t>((nBytesPerSec * 7 + nRate) / 8, 1);
+        nAvgSize = (nAvgSize * 7 + nBytes) / 8;
+    }
+    nLastDelivery = nNow;
+}
+
+int BlockDownloadRate::Window(int64_t nPingUsec) const
+{
+    if (nBytesPerSec == 0) return MAX_BLOCKS_IN_TRANSIT_PER_PEER;
+    int64_t nTime = BLOCK_DOWNLOAD_QUEUE_TIME * 1000000;
+    if (nPingUsec != std::numeric_limits<int64_t>::max()) nTime += nPingUsec;
+    const int64_t nBlocks = nBytesPerSec * nTime / 1000000 / std::max<int64_t>(nAvgSize, 1);
+    return std::max<int64_t>(MIN_BLOCKS_IN_TRANSIT_PER_PEER, std::min<int64_t>(nBlocks, MAX_BLOCKS_IN_TRANSIT_PER_FAST_PEER));
+}
+
+bool BlockDownloadRate::ShouldTakeOver(const BlockDownloadRate& holder, int nBlocksInFlight, int64_t nTimeRequested, int64_t nNow) const
+{
+    if (nBytesPerSec == 0) return false;
+    if (holder.nBytesPerSec * BLOCK_DOWNLOAD_REASSIGN_FACTOR > nBytesPerSec) return false;
+    // Give the holder at least as long as we would need for the block and
+    // every other block we are waiting for, times the speed factor.
+    const int64_t nExpected = std::max<int64_t>(nAvgSize, 1) * (nBlocksInFlight + 1) * 1000000 / nBytesPerSec;
+    return nNow - nTimeRequested > nExpected * BLOCK_DOWNLOAD_REASSIGN_FACTOR;
+}
+
 // This function is used for testing the stale tip eviction logic, see
 // denialofservice_tests.cpp
 void UpdateLastBlockAnnounceTime(NodeId node, int64_t time_in_seconds)
@@ -648,6 +742,8 @@ void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTim
     assert(nPeersWithValidatedDownloads >= 0);
     g_outbound_peers_with_protect_from_disconnect -= state->m_chain_sync.m_protect;
     assert(g_outbound_peers_with_protect_from_disconnect >= 0);
+    g_recon_flood_peers -= (state->m_recon && state->m_recon->m_flood);
+    assert(g_recon_flood_peers >= 0);
 
     mapNodeState.erase(nodeid);
 
@@ -657,6 +753,7 @@ void PeerLogicValidation::FinalizeNode(NodeId nodeid, bool& fUpdateConnectionTim
         assert(nPreferredDownload == 0);
         assert(nPeersWithValidatedDownloads == 0);
         assert(g_outbound_peers_with_protect_from_disconnect == 0);
+        assert(g_recon_flood_peers == 0);
     }
     LogPrint(BCLog::NET, "Cleared nodestate for peer=%d\n", nodeid);
 }
@@ -669,6 +766,11 @@ bool GetNodeStateStats(NodeId nodeid, CNodeStateStats &stats) {
     stats.nMisbehavior = state->nMisbehavior;
     stats.nSyncHeight = state->pindexBestKnownBlock ? state->pindexBestKnownBlock->nHeight : -1;
     stats.nCommonHeight = state->pindexLastCommonBlock ? state->pindexLastCommonBlock->nHeight : -1;
+    if (state->m_recon) {
+        stats.fTxReconciliation = true;
+        stats.nReconciliations = state->m_recon->m_reconciliations;
+        stats.nReconciliationFailures = state->m_recon->m_failures;
+    }
     for (const QueuedBlock& queue : state->vBlocksInFlight) {
         if (queue.pindex)
             stats.vHeightInFlight.push_back(queue.pindex->nHeight);
@@ -913,6 +1015,26 @@ static std::shared_ptr<const CBlock> most_recent_block GUARDED_BY(cs_most_recent
 static std::shared_ptr<const CBlockHeaderAndShortTxIDs> most_recent_compact_block GUARDED_BY(cs_most_recent_block);
 static uint256 most_recent_block_hash GUARDED_BY(cs_most_recent_block);
 static bool fWitnessesPresentInMostRecentCompactBlock GUARDED_BY(cs_most_recent_block);
+// Whether most_recent_block has been connected, so its scripts are valid
+static bool fMostRecentBlockConnected GUARDED_BY(cs_most_recent_block);
+// most_recent_block and most_recent_compact_block as messages, serialized on
+// first use and shared by every peer they are sent to; indexed by whether
+// witnesses are stripped
+static CSharedNetMsg most_recent_block_msg[2] GUARDED_BY(cs_most_recent_block);
+static CSharedNetMsg most_recent_compact_block_msg[2] GUARDED_BY(cs_most_recent_block);
+
+static CSharedNetMsg MostRecentBlockMessage(bool fCompact, int nSendFlags) EXCLUSIVE_LOCKS_REQUIRED(cs_most_recent_block)
+{
+    CSharedNetMsg& msg = (fCompact ? most_recent_compact_block_msg : most_recent_block_msg)[nSendFlags ? 1 : 0];
+    if (!msg.header) {
+        const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
+        if (fCompact)
+            msg = CConnman::ShareMessage(msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *most_recent_compact_block));
+        else
+            msg = CConnman::ShareMessage(msgMaker.Make(nSendFlags, NetMsgType::BLOCK, *most_recent_block));
+    }
+    return msg;
+}
 
 /**
  * Maintain state about the best-seen block and fast-announce a compact block
@@ -920,7 +1042,6 @@ static bool fWitnessesPresentInMostRecentCompactBlock GUARDED_BY(cs_most_recent_
  */
 void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std::shared_ptr<const CBlock>& pblock) {
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> pcmpctblock = std::make_shared<const CBlockHeaderAndShortTxIDs> (*pblock, true);
-    const CNetMsgMaker msgMaker(PROTOCOL_VERSION);
 
     LOCK(cs_main);
 
@@ -938,12 +1059,15 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
         most_recent_block = pblock;
         most_recent_compact_block = pcmpctblock;
         fWitnessesPresentInMostRecentCompactBlock = fWitnessEnabled;
+        fMostRecentBlockConnected = false;
+        for (CSharedNetMsg& msg : most_recent_block_msg) msg = CSharedNetMsg();
+        for (CSharedNetMsg& msg : most_recent_compact_block_msg) msg = CSharedNetMsg();
     }
 
-    connman->ForEachNode([this, &pcmpctblock, pindex, &msgMaker, fWitnessEnabled, &hashBlock](CNode* pnode) {
+    CSharedNetMsg cmpctmsg;
+    connman->ForEachNode([this, &cmpctmsg, pindex, fWitnessEnabled, &hashBlock](CNode* pnode) {
         AssertLockHeld(cs_main);
 
-        // TODO: Avoid the repeated-serialization here
         if (pnode->nVersion < INVALID_CB_NO_BAN_VERSION || pnode->fDisconnect)
             return;
         ProcessBlockAvailability(pnode->GetId());
@@ -955,7 +1079,12 @@ void PeerLogicValidation::NewPoWValidBlock(const CBlockIndex *pindex, const std:
 
             LogPrint(BCLog::NET, "%s sending header-and-ids %s to peer=%d\n", "PeerLogicValidation::NewPoWValidBlock",
                     hashBlock.ToString(), pnode->GetId());
-            connman->PushMessage(pnode, msgMaker.Make(NetMsgType::CMPCTBLOCK, *pcmpctblock));
+            if (!cmpctmsg.header) {
+                // Still this block: cs_main is held, under which it is set
+                LOCK(cs_most_recent_block);
+                cmpctmsg = MostRecentBlockMessage(true, 0);
+            }
+            connman->PushMessage(pnode, cmpctmsg);
             state.pindexBestHeaderSent = pindex;
         }
     });
@@ -1032,6 +1161,11 @@ void PeerLogicValidation::BlockChecked(const CBlock& block, const CValidationSta
     }
     if (it != mapBlockSource.end())
         mapBlockSource.erase(it);
+
+    if (state.IsValid()) {
+        LOCK(cs_most_recent_block);
+        if (most_recent_block_hash == hash) fMostRecentBlockConnected = true;
+    }
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -1127,12 +1261,33 @@ void static ProcessGetBlockData(CNode* pfrom, const CChainParams& chainparams, c
     std::shared_ptr<const CBlock> a_recent_block;
     std::shared_ptr<const CBlockHeaderAndShortTxIDs> a_recent_compact_block;
     bool fWitnessesPresentInARecentCompactBlock;
+    bool fRecentBlockConnected;
+    uint256 recent_block_hash;
     const Consensus::Params& consensusParams = chainparams.GetConsensus();
     {
         LOCK(cs_most_recent_block);
         a_recent_block = most_recent_block;
         a_recent_compact_block = most_recent_compact_block;
         fWitnessesPresentInARecentCompactBlock = fWitnessesPresentInMostRecentCompactBlock;
+        fRecentBlockConnected = fMostRecentBlockConnected;
+        recent_block_hash = most_recent_block_hash;
+    }
+
+    // Serve the most recent block without cs_main, so that message handler
+    // threads do not queue up behind validation to relay a new block. Once
+    // it has been connected it passes all the checks below.
+    if ((inv.type == MSG_BLOCK || inv.type == MSG_WITNESS_BLOCK) && fRecentBlockConnected && a_recent_block &&
+            recent_block_hash == inv.hash && inv.hash != pfrom->hashContinue) {
+        CSharedNetMsg msg;
+        {
+            LOCK(cs_most_recent_block);
+            if (most_recent_block_hash == inv.hash)
+                msg = MostRecentBlockMessage(false, inv.type == MSG_BLOCK ? SERIALIZE_TRANSACTION_NO_WITNESS : 0);
+        }
+        if (msg.header) {
+            connman->PushMessage(pfrom, msg);
+            return;
+        }
     }
 
     bool need_activate_chain = false;
@@ -1194,19 +1349,19 @@ void static ProcessGetBlockData(CNode* pfrom, const CChainParams& chainparams, c
         std::shared_ptr<const CBlock> pblock;
         if (a_recent_block && a_recent_block->GetHash() == pindex->GetBlockHash()) {
             pblock = a_recent_block;
-        } else if (inv.type == MSG_WITNESS_BLOCK) {
-            // Fast-path: in this case it is possible to serve the block directly from disk,
-            // as the network format matches the format on disk
-            std::vector<uint8_t> block_data;
-            if (!ReadRawBlockFromDisk(block_data, pindex, chainparams.MessageStart())) {
+        } else if (inv.type == MSG_BLOCK || inv.type == MSG_WITNESS_BLOCK) {
+            // Fast-path: serve the serialized block from the cache, which
+            // shares one buffer between all the peers asking for it
+            CSharedNetMsg msg;
+            if (!g_block_cache.Get(pindex, inv.type == MSG_WITNESS_BLOCK, msg)) {
                 assert(!"cannot load block from disk");
             }
-            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::BLOCK, MakeSpan(block_data)));
+            connman->PushMessage(pfrom, msg);
             // Don't set pblock as we've sent the block
         } else {
-            // Send block from disk
+            // Send block from disk, or from the cache
             std::shared_ptr<CBlock> pblockRead = std::make_shared<CBlock>();
-            if (!ReadBlockFromDisk(*pblockRead, pindex, consensusParams))
+            if (!g_block_cache.GetBlock(pindex, *pblockRead))
                 assert(!"cannot load block from disk");
             pblock = pblockRead;
         }
@@ -1251,7 +1406,16 @@ void static ProcessGetBlockData(CNode* pfrom, const CChainParams& chainparams, c
                 int nSendFlags = fPeerWantsWitness ? 0 : SERIALIZE_TRANSACTION_NO_WITNESS;
                 if (CanDirectFetch(consensusParams) && pindex->nHeight >= chainActive.Height() - MAX_CMPCTBLOCK_DEPTH) {
                     if ((fPeerWantsWitness || !fWitnessesPresentInARecentCompactBlock) && a_recent_compact_block && a_recent_compact_block->header.GetHash() == pindex->GetBlockHash()) {
-                        connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *a_recent_compact_block));
+                        CSharedNetMsg msg;
+                        {
+                            LOCK(cs_most_recent_block);
+                            if (most_recent_block_hash == pindex->GetBlockHash())
+                                msg = MostRecentBlockMessage(true, nSendFlags);
+                        }
+                        if (msg.header)
+                            connman->PushMessage(pfrom, msg);
+                        else
+                            connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *a_recent_compact_block));
                     } else {
                         CBlockHeaderAndShortTxIDs cmpctblock(*pblock, fPeerWantsWitness);
                         connman->PushMessage(pfrom, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
@@ -1646,6 +1810,82 @@ void static ProcessOrphanTx(CConnman* connman, std::set<uint256>& orphan_work_se
     }
 }
 
+/** Announce reconciled transactions to a peer, in as many inv messages as needed */
+static void AnnounceReconciled(CNode* pto, const std::vector<uint256>& txids, CConnman* connman)
+{
+    const CNetMsgMaker msgMaker(pto->GetSendVersion());
+    std::vector<CInv> vInv;
+    vInv.reserve(std::min<size_t>(txids.size(), MAX_INV_SZ));
+    for (const uint256& txid : txids) {
+        vInv.push_back(CInv(MSG_TX, txid));
+        if (vInv.size() == MAX_INV_SZ) {
+            connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
+            vInv.clear();
+        }
+    }
+    if (!vInv.empty()) {
+        connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
+    }
+}
+
+static std::vector<uint256> ReconSetTxids(const std::map<uint32_t, uint256>& set)
+{
+    std::vector<uint256> txids;
+    txids.reserve(set.size());
+    for (const auto& entry : set) {
+        txids.push_back(entry.second);
+    }
+    return txids;
+}
+
+/**
+ * Take the tx messages queued right behind the one being processed off the
+ * peer's queue, so that they can be validated in one batch.
+ */
+static void TakeQueuedTransactions(CNode* pfrom, const CChainParams& chainparams, CConnman* connman, std::vector<CTransactionRef>& txs)
+{
+    std::list<CNetMessage> msgs;
+    {
+        LOCK(pfrom->cs_vProcessMsg);
+        while (txs.size() + msgs.size() < MAX_TX_BATCH && !pfrom->vProcessMsg.empty() &&
+               pfrom->vProcessMsg.front().hdr.GetCommand() == NetMsgType::TX) {
+            msgs.splice(msgs.end(), pfrom->vProcessMsg, pfrom->vProcessMsg.begin());
+            pfrom->nProcessQueueSize -= msgs.back().vRecv.size() + CMessageHeader::HEADER_SIZE;
+        }
+        if (msgs.empty()) return;
+        pfrom->fPauseRecv = pfrom->nProcessQueueSize > connman->GetReceiveFloodSize();
+    }
+
+    // The same checks as ProcessMessages makes before handing over a message
+    for (CNetMessage& msg : msgs) {
+        msg.SetVersion(pfrom->GetRecvVersion());
+        if (memcmp(msg.hdr.pchMessageStart, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE) != 0) {
+            LogPrint(BCLog::NET, "PROCESSMESSAGE: INVALID MESSAGESTART %s peer=%d\n", SanitizeString(msg.hdr.GetCommand()), pfrom->GetId());
+            pfrom->fDisconnect = true;
+            break;
+        }
+        if (!msg.hdr.IsValid(chainparams.MessageStart())) {
+            LogPrint(BCLog::NET, "PROCESSMESSAGE: ERRORS IN HEADER %s peer=%d\n", SanitizeString(msg.hdr.GetCommand()), pfrom->GetId());
+            continue;
+        }
+        const uint256& hash = msg.GetMessageHash();
+        if (memcmp(hash.begin(), msg.hdr.pchChecksum, CMessageHeader::CHECKSUM_SIZE) != 0) {
+            LogPrint(BCLog::NET, "%s(%s, %u bytes): CHECKSUM ERROR peer=%d\n", __func__,
+                SanitizeString(msg.hdr.GetCommand()), msg.hdr.nMessageSize, pfrom->GetId());
+            continue;
+        }
+        try {
+            CTransactionRef ptx;
+            msg.vRecv >> ptx;
+            txs.push_back(std::move(ptx));
+        } catch (const std::exception& e) {
+            LogPrint(BCLog::NET, "%s(%s, %u bytes): Exception '%s' caught peer=%d\n", __func__,
+                SanitizeString(msg.hdr.GetCommand()), msg.hdr.nMessageSize, e.what(), pfrom->GetId());
+        }
+    }
+    pfrom->RecycleRecvMsgs(msgs);
+}
+
 bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStream& vRecv, int64_t nTimeReceived, const CChainParams& chainparams, CConnman* connman, const std::atomic<bool>& interruptMsgProc, bool enable_bip61)
 {
     LogPrint(BCLog::NET, "received: %s (%u bytes) peer=%d\n", SanitizeString(strCommand), vRecv.size(), pfrom->GetId());
@@ -1912,6 +2152,24 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             nCMPCTBLOCKVersion = 1;
             connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDCMPCT, fAnnounceUsingCMPCTBLOCK, nCMPCTBLOCKVersion));
         }
+        bool fRelayTxes;
+        {
+            LOCK(pfrom->cs_filter);
+            fRelayTxes = pfrom->fRelayTxes;
+        }
+        if (g_enable_txreconciliation && fRelayTxes && !pfrom->fFeeler && !pfrom->fOneShot) {
+            // Offer to reconcile transactions; the side that made the
+            // connection requests the reconciliations.
+            const bool fInitiator = !pfrom->fInbound;
+            const uint64_t nSalt = GetRand(std::numeric_limits<uint64_t>::max());
+            {
+                LOCK(cs_main);
+                CNodeState* nodestate = State(pfrom->GetId());
+                nodestate->m_recon_offered = true;
+                nodestate->m_recon_salt = nSalt;
+            }
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SENDRECON, fInitiator, TXRECONCILIATION_VERSION, nSalt));
+        }
         pfrom->fSuccessfullyConnected = true;
         return true;
     }
@@ -2191,7 +2449,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         }
 
         CBlock block;
-        bool ret = ReadBlockFromDisk(block, pindex, chainparams.GetConsensus());
+        bool ret = g_block_cache.GetBlock(pindex, block);
         assert(ret);
 
         SendBlockTransactions(block, req, pfrom, connman);
@@ -2274,143 +2532,167 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             return true;
         }
 
-        CTransactionRef ptx;
-        vRecv >> ptx;
-        const CTransaction& tx = *ptx;
-
-        CInv inv(MSG_TX, tx.GetHash());
-        pfrom->AddInventoryKnown(inv);
+        std::vector<CTransactionRef> txs(1);
+        vRecv >> txs.front();
+        // Validate whatever transactions the peer sent right after this one
+        // together with it, so that their scripts are checked in parallel
+        TakeQueuedTransactions(pfrom, chainparams, connman, txs);
 
         LOCK2(cs_main, g_cs_orphans);
 
-        bool fMissingInputs = false;
-        CValidationState state;
-
-        pfrom->setAskFor.erase(inv.hash);
-        mapAlreadyAskedFor.erase(inv.hash);
+        std::vector<CTransactionRef> to_accept;
+        std::vector<bool> already_have(txs.size());
+        for (size_t i = 0; i < txs.size(); i++) {
+            CInv inv(MSG_TX, txs[i]->GetHash());
+            pfrom->AddInventoryKnown(inv);
+            pfrom->setAskFor.erase(inv.hash);
+            mapAlreadyAskedFor.erase(inv.hash);
+            already_have[i] = AlreadyHave(inv);
+            if (!already_have[i]) to_accept.push_back(txs[i]);
+        }
 
         std::list<CTransactionRef> lRemovedTxn;
-
-        if (!AlreadyHave(inv) &&
-            AcceptToMemoryPool(mempool, state, ptx, &fMissingInputs, &lRemovedTxn, false /* bypass_limits */, 0 /* nAbsurdFee */)) {
+        std::vector<CValidationState> states;
+        std::vector<bool> accepted, missing_inputs;
+        AcceptToMemoryPoolBatch(mempool, to_accept, states, accepted, missing_inputs, &lRemovedTxn, 0 /* nAbsurdFee */);
+        if (std::find(accepted.begin(), accepted.end(), true) != accepted.end()) {
             mempool.check(pcoinsTip.get());
-            RelayTransaction(tx, connman);
-            for (unsigned int i = 0; i < tx.vout.size(); i++) {
-                auto it_by_prev = mapOrphanTransactionsByPrev.find(COutPoint(inv.hash, i));
-                if (it_by_prev != mapOrphanTransactionsByPrev.end()) {
-                    for (const auto& elem : it_by_prev->second) {
-                        pfrom->orphan_work_set.insert(elem->first);
-                    }
-                }
+        }
+
+        for (size_t i = 0, j = 0; i < txs.size(); i++) {
+            const CTransactionRef& ptx = txs[i];
+            const CTransaction& tx = *ptx;
+            CInv inv(MSG_TX, tx.GetHash());
+            CValidationState state;
+            bool fMissingInputs = false;
+            bool fAccepted = false;
+            if (!already_have[i]) {
+                state = states[j];
+                fMissingInputs = missing_inputs[j];
+                fAccepted = accepted[j];
+                j++;
             }
 
-            pfrom->nLastTXTime = GetTime();
+            if (fAccepted) {
+                RelayTransaction(tx, connman);
+                for (unsigned int n = 0; n < tx.vout.size(); n++) {
+                    auto it_by_prev = mapOrphanTransactionsByPrev.find(COutPoint(inv.hash, n));
+                    if (it_by_prev != mapOrphanTransactionsByPrev.end()) {
+                        for (const auto& elem : it_by_prev->second) {
+                            pfrom->orphan_work_set.insert(elem->first);
+                        }
+                    }
+                }
 
-            LogPrint(BCLog::MEMPOOL, "AcceptToMemoryPool: peer=%d: accepted %s (poolsz %u txn, %u kB)\n",
-                pfrom->GetId(),
-                tx.GetHash().ToString(),
-                mempool.size(), mempool.DynamicMemoryUsage() / 1000);
+                pfrom->nLastTXTime = GetTime();
 
-            // Recursively process any orphan transactions that depended on this one
-            ProcessOrphanTx(connman, pfrom->orphan_work_set, lRemovedTxn);
-        }
-        else if (fMissingInputs)
-        {
-            bool fRejectedParents = false; // It may be the case that the orphans parents have all been rejected
-            for (const CTxIn& txin : tx.vin) {
-                if (recentRejects->contains(txin.prevout.hash)) {
-                    fRejectedParents = true;
-                    break;
-                }
+                LogPrint(BCLog::MEMPOOL, "AcceptToMemoryPool: peer=%d: accepted %s (poolsz %u txn, %u kB)\n",
+                    pfrom->GetId(),
+                    tx.GetHash().ToString(),
+                    mempool.size(), mempool.DynamicMemoryUsage() / 1000);
             }
-            if (!fRejectedParents) {
-                uint32_t nFetchFlags = GetFetchFlags(pfrom);
+            else if (fMissingInputs)
+            {
+                bool fRejectedParents = false; // It may be the case that the orphans parents have all been rejected
                 for (const CTxIn& txin : tx.vin) {
-                    CInv _inv(MSG_TX | nFetchFlags, txin.prevout.hash);
-                    pfrom->AddInventoryKnown(_inv);
-                    if (!AlreadyHave(_inv)) pfrom->AskFor(_inv);
+                    if (recentRejects->contains(txin.prevout.hash)) {
+                        fRejectedParents = true;
+                        break;
+                    }
                 }
-                AddOrphanTx(ptx, pfrom->GetId());
+                if (!fRejectedParents) {
+                    uint32_t nFetchFlags = GetFetchFlags(pfrom);
+                    for (const CTxIn& txin : tx.vin) {
+                        CInv _inv(MSG_TX | nFetchFlags, txin.prevout.hash);
+                        pfrom->AddInventoryKnown(_inv);
+                        if (!AlreadyHave(_inv)) pfrom->AskFor(_inv);
+                    }
+                    AddOrphanTx(ptx, pfrom->GetId());
 
-                // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
-                unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, gArgs.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
-                unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
-                if (nEvicted > 0) {
-                    LogPrint(BCLog::MEMPOOL, "mapOrphan overflow, removed %u tx\n", nEvicted);
+                    // DoS prevention: do not allow mapOrphanTransactions to grow unbounded
+                    unsigned int nMaxOrphanTx = (unsigned int)std::max((int64_t)0, gArgs.GetArg("-maxorphantx", DEFAULT_MAX_ORPHAN_TRANSACTIONS));
+                    unsigned int nEvicted = LimitOrphanTxSize(nMaxOrphanTx);
+                    if (nEvicted > 0) {
+                        LogPrint(BCLog::MEMPOOL, "mapOrphan overflow, removed %u tx\n", nEvicted);
+                    }
+                } else {
+                    LogPrint(BCLog::MEMPOOL, "not keeping orphan with rejected parents %s\n",tx.GetHash().ToString());
+                    // We will continue to reject this tx since it has rejected
+                    // parents so avoid re-requesting it from other peers.
+                    recentRejects->insert(tx.GetHash());
                 }
             } else {
-                LogPrint(BCLog::MEMPOOL, "not keeping orphan with rejected parents %s\n",tx.GetHash().ToString());
-                // We will continue to reject this tx since it has rejected
-                // parents so avoid re-requesting it from other peers.
-                recentRejects->insert(tx.GetHash());
-            }
-        } else {
-            if (!tx.HasWitness() && !state.CorruptionPossible()) {
-                // Do not use rejection cache for witness transactions or
-                // witness-stripped transactions, as they can have been malleated.
-                // See https://github.com/kryptofranc/kryptofranc/issues/8279 for details.
-                assert(recentRejects);
-                recentRejects->insert(tx.GetHash());
-                if (RecursiveDynamicUsage(*ptx) < 100000) {
+                if (!tx.HasWitness() && !state.CorruptionPossible()) {
+                    // Do not use rejection cache for witness transactions or
+                    // witness-stripped transactions, as they can have been malleated.
+                    // See https://github.com/kryptofranc/kryptofranc/issues/8279 for details.
+                    assert(recentRejects);
+                    recentRejects->insert(tx.GetHash());
+                    if (RecursiveDynamicUsage(*ptx) < 100000) {
+                        AddToCompactExtraTransactions(ptx);
+                    }
+                } else if (tx.HasWitness() && RecursiveDynamicUsage(*ptx) < 100000) {
                     AddToCompactExtraTransactions(ptx);
                 }
-            } else if (tx.HasWitness() && RecursiveDynamicUsage(*ptx) < 100000) {
-                AddToCompactExtraTransactions(ptx);
+
+                if (pfrom->fWhitelisted && gArgs.GetBoolArg("-whitelistforcerelay", DEFAULT_WHITELISTFORCERELAY)) {
+                    // Always relay transactions received from whitelisted peers, even
+                    // if they were already in the mempool or rejected from it due
+                    // to policy, allowing the node to function as a gateway for
+                    // nodes hidden behind it.
+                    //
+                    // Never relay transactions that we would assign a non-zero DoS
+                    // score for, as we expect peers to do the same with us in that
+                    // case.
+                    int nDoS = 0;
+                    if (!state.IsInvalid(nDoS) || nDoS == 0) {
+                        LogPrintf("Force relaying tx %s from whitelisted peer=%d\n", tx.GetHash().ToString(), pfrom->GetId());
+                        RelayTransaction(tx, connman);
+                    } else {
+                        LogPrintf("Not relaying invalid transaction %s from whitelisted peer=%d (%s)\n", tx.GetHash().ToString(), pfrom->GetId(), FormatStateMessage(state));
+                    }
+                }
             }
 
-            if (pfrom->fWhitelisted && gArgs.GetBoolArg("-whitelistforcerelay", DEFAULT_WHITELISTFORCERELAY)) {
-                // Always relay transactions received from whitelisted peers, even
-                // if they were already in the mempool or rejected from it due
-                // to policy, allowing the node to function as a gateway for
-                // nodes hidden behind it.
-                //
-                // Never relay transactions that we would assign a non-zero DoS
-                // score for, as we expect peers to do the same with us in that
-                // case.
-                int nDoS = 0;
-                if (!state.IsInvalid(nDoS) || nDoS == 0) {
-                    LogPrintf("Force relaying tx %s from whitelisted peer=%d\n", tx.GetHash().ToString(), pfrom->GetId());
-                    RelayTransaction(tx, connman);
-                } else {
-                    LogPrintf("Not relaying invalid transaction %s from whitelisted peer=%d (%s)\n", tx.GetHash().ToString(), pfrom->GetId(), FormatStateMessage(state));
+            // If a tx has been detected by recentRejects, we will have reached
+            // this point and the tx will have been ignored. Because we haven't run
+            // the tx through AcceptToMemoryPool, we won't have computed a DoS
+            // score for it or determined exactly why we consider it invalid.
+            //
+            // This means we won't penalize any peer subsequently relaying a DoSy
+            // tx (even if we penalized the first peer who gave it to us) because
+            // we have to account for recentRejects showing false positives. In
+            // other words, we shouldn't penalize a peer if we aren't *sure* they
+            // submitted a DoSy tx.
+            //
+            // Note that recentRejects doesn't just record DoSy or invalid
+            // transactions, but any tx not accepted by the mempool, which may be
+            // due to node policy (vs. consensus). So we can't blanket penalize a
+            // peer simply for relaying a tx that our recentRejects has caught,
+            // regardless of false positives.
+
+            int nDoS = 0;
+            if (state.IsInvalid(nDoS))
+            {
+                LogPrint(BCLog::MEMPOOLREJ, "%s from peer=%d was not accepted: %s\n", tx.GetHash().ToString(),
+                    pfrom->GetId(),
+                    FormatStateMessage(state));
+                if (enable_bip61 && state.GetRejectCode() > 0 && state.GetRejectCode() < REJECT_INTERNAL) { // Never send AcceptToMemoryPool's internal codes over P2P
+                    connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::REJECT, strCommand, (unsigned char)state.GetRejectCode(),
+                                       state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash));
+                }
+                if (nDoS > 0) {
+                    Misbehaving(pfrom->GetId(), nDoS);
                 }
             }
         }
 
+        // Recursively process any orphan transactions that depended on the accepted ones
+        ProcessOrphanTx(connman, pfrom->orphan_work_set, lRemovedTxn);
+
         for (const CTransactionRef& removedTx : lRemovedTxn)
             AddToCompactExtraTransactions(removedTx);
 
-        // If a tx has been detected by recentRejects, we will have reached
-        // this point and the tx will have been ignored. Because we haven't run
-        // the tx through AcceptToMemoryPool, we won't have computed a DoS
-        // score for it or determined exactly why we consider it invalid.
-        //
-        // This means we won't penalize any peer subsequently relaying a DoSy
-        // tx (even if we penalized the first peer who gave it to us) because
-        // we have to account for recentRejects showing false positives. In
-        // other words, we shouldn't penalize a peer if we aren't *sure* they
-        // submitted a DoSy tx.
-        //
-        // Note that recentRejects doesn't just record DoSy or invalid
-        // transactions, but any tx not accepted by the mempool, which may be
-        // due to node policy (vs. consensus). So we can't blanket penalize a
-        // peer simply for relaying a tx that our recentRejects has caught,
-        // regardless of false positives.
-
-        int nDoS = 0;
-        if (state.IsInvalid(nDoS))
-        {
-            LogPrint(BCLog::MEMPOOLREJ, "%s from peer=%d was not accepted: %s\n", tx.GetHash().ToString(),
-                pfrom->GetId(),
-                FormatStateMessage(state));
-            if (enable_bip61 && state.GetRejectCode() > 0 && state.GetRejectCode() < REJECT_INTERNAL) { // Never send AcceptToMemoryPool's internal codes over P2P
-                connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::REJECT, strCommand, (unsigned char)state.GetRejectCode(),
-                                   state.GetRejectReason().substr(0, MAX_REJECT_MESSAGE_LENGTH), inv.hash));
-            }
-            if (nDoS > 0) {
-                Misbehaving(pfrom->GetId(), nDoS);
-            }
-        }
         return true;
     }
 
@@ -2528,7 +2810,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 PartiallyDownloadedBlock& partialBlock = *(*queuedBlockIt)->partialBlock;
                 ReadStatus status = partialBlock.InitData(cmpctblock, vExtraTxnForCompact);
                 if (status == READ_STATUS_INVALID) {
-                    MarkBlockAsReceived(pindex->GetBlockHash()); // Reset in-flight state in case of whitelist
+                    MarkBlockAsReceived(pindex->GetBlockHash(), pfrom->GetId()); // Reset in-flight state in case of whitelist
                     Misbehaving(pfrom->GetId(), 100, strprintf("Peer %d sent us invalid compact block\n", pfrom->GetId()));
                     return true;
                 } else if (status == READ_STATUS_FAILED) {
@@ -2655,7 +2937,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
             PartiallyDownloadedBlock& partialBlock = *it->second.second->partialBlock;
             ReadStatus status = partialBlock.FillBlock(*pblock, resp.txn);
             if (status == READ_STATUS_INVALID) {
-                MarkBlockAsReceived(resp.blockhash); // Reset in-flight state in case of whitelist
+                MarkBlockAsReceived(resp.blockhash, pfrom->GetId()); // Reset in-flight state in case of whitelist
                 Misbehaving(pfrom->GetId(), 100, strprintf("Peer %d sent us invalid compact block/non-matching block transactions\n", pfrom->GetId()));
                 return true;
             } else if (status == READ_STATUS_FAILED) {
@@ -2681,7 +2963,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
                 // though the block was successfully read, and rely on the
                 // handling in ProcessNewBlock to ensure the block index is
                 // updated, reject messages go out, etc.
-                MarkBlockAsReceived(resp.blockhash); // it is now an empty pointer
+                MarkBlockAsReceived(resp.blockhash, pfrom->GetId()); // it is now an empty pointer
                 fBlockRead = true;
                 // mapBlockSource is only used for sending reject messages and DoS scores,
                 // so the race between here and cs_main in ProcessNewBlock is fine.
@@ -2738,6 +3020,7 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
     if (strCommand == NetMsgType::BLOCK && !fImporting && !fReindex) // Ignore blocks received while importing
     {
         std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+        const size_t nBlockSize = vRecv.size();
         vRecv >> *pblock;
 
         LogPrint(BCLog::NET, "received block %s peer=%d\n", pblock->GetHash().ToString(), pfrom->GetId());
@@ -2746,9 +3029,10 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         const uint256 hash(pblock->GetHash());
         {
             LOCK(cs_main);
+            UpdateBlockDownloadRate(pfrom->GetId(), hash, nBlockSize);
             // Also always process if we requested the block explicitly, as we may
             // need it even though it is not a candidate for a new best tip.
-            forceProcessing |= MarkBlockAsReceived(hash);
+            forceProcessing |= MarkBlockAsReceived(hash, pfrom->GetId());
             // mapBlockSource is only used for sending reject messages and DoS scores,
             // so the race between here and cs_main in ProcessNewBlock is fine.
             mapBlockSource.emplace(hash, std::make_pair(pfrom->GetId(), true));
@@ -2783,7 +3067,10 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         }
         pfrom->fSentAddr = true;
 
-        pfrom->vAddrToSend.clear();
+        {
+            LOCK(pfrom->cs_addrSend);
+            pfrom->vAddrToSend.clear();
+        }
         std::vector<CAddress> vAddr = connman->GetAddresses();
         FastRandomContext insecure_rand;
         for (const CAddress &addr : vAddr) {
@@ -2957,6 +3244,118 @@ bool static ProcessMessage(CNode* pfrom, const std::string& strCommand, CDataStr
         return true;
     }
 
+    if (strCommand == NetMsgType::SENDRECON) {
+        bool fInitiator = false;
+        uint32_t nVersion = 0;
+        uint64_t nRemoteSalt = 0;
+        vRecv >> fInitiator >> nVersion >> nRemoteSalt;
+
+        LOCK(cs_main);
+        CNodeState* nodestate = State(pfrom->GetId());
+        // Only the side that made the connection may request reconciliations
+        if (!nodestate->m_recon_offered || nodestate->m_recon || nVersion < TXRECONCILIATION_VERSION || fInitiator != pfrom->fInbound) {
+            return true;
+        }
+        // Keep flooding to a few outbound peers, so transactions still
+        // propagate quickly across the network.
+        const bool fFlood = !pfrom->fInbound && g_recon_flood_peers < RECON_OUTBOUND_FLOOD_PEERS;
+        if (fFlood) g_recon_flood_peers++;
+        nodestate->m_recon = MakeUnique<TxReconState>(!pfrom->fInbound, fFlood, nodestate->m_recon_salt, nRemoteSalt);
+        LogPrint(BCLog::NET, "reconciling transactions with peer=%d%s\n", pfrom->GetId(), fFlood ? " (flooding)" : "");
+        return true;
+    }
+
+    if (strCommand == NetMsgType::REQRECON) {
+        uint32_t nRemoteSize = 0;
+        uint16_t nQ = 0;
+        vRecv >> nRemoteSize >> nQ;
+
+        LOCK(cs_main);
+        TxReconState* recon = State(pfrom->GetId())->m_recon.get();
+        if (!recon || recon->m_initiator) return true;
+        if (nQ > RECON_Q_PRECISION) {
+            Misbehaving(pfrom->GetId(), 10, strprintf("reqrecon q=%u", nQ));
+            return false;
+        }
+        // A previous request the peer did not follow up on: its transactions
+        // are still to be announced.
+        recon->m_local_set.insert(recon->m_snapshot.begin(), recon->m_snapshot.end());
+        recon->m_snapshot.clear();
+        recon->m_snapshot.swap(recon->m_local_set);
+        const size_t nCells = TxReconSketch::CellsFor(recon->m_snapshot.size(), nRemoteSize, (double)nQ / RECON_Q_PRECISION);
+        connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::SKETCH, recon->Sketch(recon->m_snapshot, nCells)));
+        return true;
+    }
+
+    if (strCommand == NetMsgType::SKETCH) {
+        TxReconSketch remote;
+        vRecv >> remote;
+
+        LOCK(cs_main);
+        TxReconState* recon = State(pfrom->GetId())->m_recon.get();
+        if (!recon || !recon->m_initiator || !recon->m_awaiting_sketch) return true;
+        if (!remote.IsValid()) {
+            Misbehaving(pfrom->GetId(), 20, strprintf("sketch cells=%u", remote.GetCells()));
+            return false;
+        }
+        recon->m_awaiting_sketch = false;
+
+        TxReconSketch diff = recon->Sketch(recon->m_local_set, remote.GetCells());
+        std::vector<uint32_t> only_ours, only_theirs;
+        if (diff.Subtract(remote) && diff.Decode(only_ours, only_theirs)) {
+            std::vector<uint256> txids;
+            txids.reserve(only_ours.size());
+            for (const uint32_t short_id : only_ours) {
+                auto it = recon->m_local_set.find(short_id);
+                if (it != recon->m_local_set.end()) txids.push_back(it->second);
+            }
+            AnnounceReconciled(pfrom, txids, connman);
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::RECONCILDIFF, true, only_theirs));
+
+            // Measure how much the sets differed beyond their sizes, to size
+            // the next sketch.
+            const size_t nLocal = recon->m_local_set.size();
+            const size_t nRemote = nLocal - only_ours.size() + only_theirs.size();
+            const size_t nMin = std::min(nLocal, nRemote);
+            const size_t nSizeDiff = std::max(nLocal, nRemote) - nMin;
+            const size_t nDiff = only_ours.size() + only_theirs.size();
+            if (nMin > 0) recon->m_q = std::min(1.0, (double)(nDiff - std::min(nDiff, nSizeDiff)) / nMin);
+        } else {
+            // Too many differences to decode: fall back to announcing everything
+            AnnounceReconciled(pfrom, ReconSetTxids(recon->m_local_set), connman);
+            connman->PushMessage(pfrom, msgMaker.Make(NetMsgType::RECONCILDIFF, false, std::vector<uint32_t>()));
+            recon->m_failures++;
+        }
+        recon->m_local_set.clear();
+        recon->m_reconciliations++;
+        return true;
+    }
+
+    if (strCommand == NetMsgType::RECONCILDIFF) {
+        bool fSuccess = false;
+        std::vector<uint32_t> vShortIds;
+        vRecv >> fSuccess >> vShortIds;
+
+        LOCK(cs_main);
+        TxReconState* recon = State(pfrom->GetId())->m_recon.get();
+        if (!recon || recon->m_initiator) return true;
+        if (fSuccess) {
+            std::vector<uint256> txids;
+            txids.reserve(std::min(vShortIds.size(), recon->m_snapshot.size()));
+            for (const uint32_t short_id : vShortIds) {
+                auto it = recon->m_snapshot.find(short_id);
+                if (it != recon->m_snapshot.end()) txids.push_back(it->second);
+            }
+            AnnounceReconciled(pfrom, txids, connman);
+        } else {
+            AnnounceReconciled(pfrom, ReconSetTxids(recon->m_snapshot), connman);
+            recon->m_failures++;
+        }
+        recon->m_snapshot.clear();
+        recon->m_reconciliations++;
+        return true;
+    }
+
     if (strCommand == NetMsgType::NOTFOUND) {
         // We do not care about the NOTFOUND message, but logging an Unknown Command
         // message would be undesirable as we transmit it ourselves.
@@ -3039,6 +3438,12 @@ bool PeerLogicValidation::ProcessMessages(CNode* pfrom, std::atomic<bool>& inter
         return false;
 
     std::list<CNetMessage> msgs;
+    // Hand the message back to the node for reuse on every way out
+    struct RecvMsgRecycler {
+        CNode* pnode;
+        std::list<CNetMessage>& msgs;
+        ~RecvMsgRecycler() { pnode->RecycleRecvMsgs(msgs); }
+    } recycler{pfrom, msgs};
     {
         LOCK(pfrom->cs_vProcessMsg);
         if (pfrom->vProcessMsg.empty())
@@ -3344,6 +3749,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
         //
         if (pto->nNextAddrSend < nNow) {
             pto->nNextAddrSend = PoissonNextSend(nNow, AVG_ADDRESS_BROADCAST_INTERVAL);
+            LOCK(pto->cs_addrSend);
             std::vector<CAddress> vAddr;
             vAddr.reserve(pto->vAddrToSend.size());
             for (const CAddress& addr : pto->vAddrToSend)
@@ -3481,7 +3887,7 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                         LOCK(cs_most_recent_block);
                         if (most_recent_block_hash == pBestIndex->GetBlockHash()) {
                             if (state.fWantsCmpctWitness || !fWitnessesPresentInMostRecentCompactBlock)
-                                connman->PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, *most_recent_compact_block));
+                                connman->PushMessage(pto, MostRecentBlockMessage(true, nSendFlags));
                             else {
                                 CBlockHeaderAndShortTxIDs cmpctblock(*most_recent_block, state.fWantsCmpctWitness);
                                 connman->PushMessage(pto, msgMaker.Make(nSendFlags, NetMsgType::CMPCTBLOCK, cmpctblock));
@@ -3651,8 +4057,10 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
                         continue;
                     }
                     if (pto->pfilter && !pto->pfilter->IsRelevantAndUpdate(*txinfo.tx)) continue;
-                    // Send
-                    vInv.push_back(CInv(MSG_TX, hash));
+                    // Send, or leave it to the next reconciliation with the peer
+                    if (!(state.m_recon && state.m_recon->Add(hash))) {
+                        vInv.push_back(CInv(MSG_TX, hash));
+                    }
                     nRelayedTransactions++;
                     {
                         // Expire old relay messages
@@ -3678,6 +4086,20 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
         if (!vInv.empty())
             connman->PushMessage(pto, msgMaker.Make(NetMsgType::INV, vInv));
 
+        //
+        // Message: reqrecon
+        //
+        if (state.m_recon && state.m_recon->m_initiator) {
+            TxReconState& recon = *state.m_recon;
+            // Ask again if the peer never answered the last request
+            if (nNow >= recon.m_next_request && (!recon.m_awaiting_sketch || nNow >= recon.m_next_request + RECON_REQUEST_INTERVAL * 1000000)) {
+                const uint16_t nQ = (uint16_t)(recon.m_q * RECON_Q_PRECISION);
+                connman->PushMessage(pto, msgMaker.Make(NetMsgType::REQRECON, (uint32_t)recon.m_local_set.size(), nQ));
+                recon.m_awaiting_sketch = true;
+                recon.m_next_request = nNow + RECON_REQUEST_INTERVAL * 1000000;
+            }
+        }
+
         // Detect whether we're stalling
         nNow = GetTimeMicros();
         if (state.nStallingSince && state.nStallingSince < nNow - 1000000 * BLOCK_STALLING_TIMEOUT) {
@@ -3743,10 +4165,11 @@ bool PeerLogicValidation::SendMessages(CNode* pto)
         // Message: getdata (blocks)
         //
         std::vector<CInv> vGetData;
-        if (!pto->fClient && ((fFetch && !pto->m_limited_node) || !IsInitialBlockDownload()) && state.nBlocksInFlight < MAX_BLOCKS_IN_TRANSIT_PER_PEER) {
+        const int nDownloadWindow = BlockDownloadWindow(state, pto->nMinPingUsecTime);
+        if (!pto->fClient && ((fFetch && !pto->m_limited_node) || !IsInitialBlockDownload()) && state.nBlocksInFlight < nDownloadWindow) {
             std::vector<const CBlockIndex*> vToDownload;
             NodeId staller = -1;
-            FindNextBlocksToDownload(pto->GetId(), MAX_BLOCKS_IN_TRANSIT_PER_PEER - state.nBlocksInFlight, vToDownload, staller, consensusParams);
+            FindNextBlocksToDownload(pto->GetId(), nDownloadWindow - state.nBlocksInFlight, vToDownload, staller, consensusParams);
             for (const CBlockIndex *pindex : vToDownload) {
                 uint32_t nFetchFlags = GetFetchFlags(pto);
                 vGetData.push_back(CInv(MSG_BLOCK | nFetchFlags, pindex->GetBlockHash()));
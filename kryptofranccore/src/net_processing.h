@@ -22,6 +22,9 @@ static const unsigned int DEFAULT_BLOCK_RECONSTRUCTION_EXTRA_TXN = 100;
 /** Default for BIP61 (sending reject messages) */
 static constexpr bool DEFAULT_ENABLE_BIP61{true};
 
+/** Whether to offer transaction reconciliation to peers (-txreconciliation) */
+extern bool g_enable_txreconciliation;
+
 class PeerLogicValidation final : public CValidationInterface, public NetEventsInterface {
 private:
     CConnman* const connman;
@@ -81,11 +84,40 @@ private:
     const bool m_enable_bip61;
 };
 
+/**
+ * A peer's block delivery rate during block download. It sizes the peer's
+ * download window and decides when blocks held up by slower peers are
+ * requested from it instead. Times are in microseconds.
+ */
+struct BlockDownloadRate {
+    //! Moving average of the rate at which the peer delivers requested blocks, in bytes per second, or 0 if unknown.
+    int64_t nBytesPerSec = 0;
+    //! Moving average of the size of blocks delivered by the peer.
+    int64_t nAvgSize = 0;
+    //! When the peer last delivered a requested block.
+    int64_t nLastDelivery = 0;
+
+    /** Account for a block of nBytes, requested at nTimeRequested, that arrived at nNow */
+    void Update(size_t nBytes, int64_t nTimeRequested, int64_t nNow);
+    /** The number of blocks to keep in flight: as many as the peer can deliver within its ping time plus BLOCK_DOWNLOAD_QUEUE_TIME */
+    int Window(int64_t nPingUsec) const;
+    /**
+     * Whether a block requested at nTimeRequested from a peer with rate holder
+     * should be requested from this peer, which has nBlocksInFlight blocks in
+     * flight, instead, because this peer is that much faster and the block is
+     * overdue.
+     */
+    bool ShouldTakeOver(const BlockDownloadRate& holder, int nBlocksInFlight, int64_t nTimeRequested, int64_t nNow) const;
+};
+
 struct CNodeStateStats {
     int nMisbehavior = 0;
     int nSyncHeight = -1;
     int nCommonHeight = -1;
     std::vector<int> vHeightInFlight;
+    bool fTxReconciliation = false;
+    uint64_t nReconciliations = 0;
+    uint64_t nReconciliationFailures = 0;
 };
 
 /** Get statistics from node state */
@@ -0,0 +1,95 @@
+// Copyright (c) 2010 Satoshi Nakamoto
+// Copyright (c) 2009-2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/coinstats.h>
+
+#include <coins.h>
+#include <hash.h>
+#include <serialize.h>
+#include <sync.h>
+#include <util/system.h>
+#include <validation.h>
+#include <version.h>
+
+#include <boost/thread.hpp>
+
+void ApplyHash(CHashWriter& ss, CoinsHashType type, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
+{
+    assert(!outputs.empty());
+    const Coin& first = outputs.begin()->second;
+    ss << hash;
+    if (type == CoinsHashType::SERIALIZED_2) {
+        ss << VARINT(first.nHeight * 2 + first.fCoinBase ? 1u : 0u);
+    } else {
+        ss << VARINT(first.nHeight * 2 + (first.fCoinBase ? 1u : 0u));
+    }
+    for (const auto& output : outputs) {
+        ss << VARINT(output.first + 1);
+        ss << output.second.out.scriptPubKey;
+        ss << VARINT(output.second.out.nValue, VarIntMode::NONNEGATIVE_SIGNED);
+    }
+    ss << VARINT(0u);
+}
+
+void ApplyStats(CCoinsStats &stats, const std::map<uint32_t, Coin>& outputs)
+{
+    assert(!outputs.empty());
+    stats.nTransactions++;
+    for (const auto& output : outputs) {
+        stats.nTransactionOutputs++;
+        stats.nTotalAmount += output.second.out.nValue;
+        stats.nBogoSize += 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
+                           2 /* scriptPubKey len */ + output.second.out.scriptPubKey.size() /* scriptPubKey */;
+    }
+}
+
+//! Calculate statistics about the unspent transaction output set
+bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
+{
+    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
+    assert(pcursor);
+
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    CHashWriter ss3(SER_GETHASH, PROTOCOL_VERSION);
+    stats.hashBlock = pcursor->GetBestBlock();
+    {
+        LOCK(cs_main);
+        // A cursor created in the middle of a write has no best block.
+        const CBlockIndex* pindex = LookupBlockIndex(stats.hashBlock);
+        if (!pindex) return false;
+        stats.nHeight = pindex->nHeight;
+    }
+    ss << stats.hashBlock;
+    ss3 << stats.hashBlock;
+    uint256 prevkey;
+    std::map<uint32_t, Coin> outputs;
+    while (pcursor->Valid()) {
+        boost::this_thread::interruption_point();
+        COutPoint key;
+        Coin coin;
+        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
+            if (!outputs.empty() && key.hash != prevkey) {
+                ApplyStats(stats, outputs);
+                ApplyHash(ss, CoinsHashType::SERIALIZED_2, prevkey, outputs);
+                ApplyHash(ss3, CoinsHashType::SERIALIZED_3, prevkey, outputs);
+                outputs.clear();
+            }
+            prevkey = key.hash;
+            outputs[key.n] = std::move(coin);
+        } else {
+            return error("%s: unable to read value", __func__);
+        }
+        pcursor->Next();
+    }
+    if (!outputs.empty()) {
+        ApplyStats(stats, outputs);
+        ApplyHash(ss, CoinsHashType::SERIALIZED_2, prevkey, outputs);
+        ApplyHash(ss3, CoinsHashType::SERIALIZED_3, prevkey, outputs);
+    }
+    stats.hashSerialized = ss.GetHash();
+    stats.hashSerialized3 = ss3.GetHash();
+    stats.nDiskSize = view->EstimateSize();
+    return true;
+}
@@ -0,0 +1,59 @@
+// Copyright (c) 2010 Satoshi Nakamoto
+// Copyright (c) 2009-2018 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KRYPTOFRANC_NODE_COINSTATS_H
+#define KRYPTOFRANC_NODE_COINSTATS_H
+
+#include <amount.h>
+#include <uint256.h>
+
+#include <cstdint>
+#include <map>
+
+class CCoinsView;
+class CHashWriter;
+class Coin;
+
+struct CCoinsStats
+{
+    int nHeight;
+    uint256 hashBlock;
+    uint64_t nTransactions;
+    uint64_t nTransactionOutputs;
+    uint64_t nBogoSize;
+    uint256 hashSerialized;
+    uint256 hashSerialized3;
+    uint64_t nDiskSize;
+    CAmount nTotalAmount;
+
+    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0), nDiskSize(0), nTotalAmount(0) {}
+};
+
+/** Serialized UTXO set hashes, as reported by gettxoutsetinfo */
+enum class CoinsHashType {
+    /**
+     * hash_serialized_2. Each transaction's height and coinbase flag are
+     * hashed as a single 0 or 1 because of a missing pair of parentheses, so
+     * the hash does not commit to them. Kept for gettxoutsetinfo only.
+     */
+    SERIALIZED_2,
+    //! hash_serialized_3, which commits to the height and coinbase flag
+    SERIALIZED_3,
+};
+
+/**
+ * Add the unspent outputs of one transaction to a running UTXO set hash of
+ * the given type. Transactions must be passed in txid order, the order in
+ * which the coins database stores them.
+ */
+void ApplyHash(CHashWriter& ss, CoinsHashType type, const uint256& hash, const std::map<uint32_t, Coin>& outputs);
+
+//! Add the unspent outputs of one transaction to stats
+void ApplyStats(CCoinsStats &stats, const std::map<uint32_t, Coin>& outputs);
+
+//! Calculate statistics about the unspent transaction output set
+bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats);
+
+#endif // KRYPTOFRANC_NODE_COINSTATS_H
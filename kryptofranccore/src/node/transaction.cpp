@@ -101,3 +101,70 @@ TransactionError BroadcastTransaction(const CTransactionRef tx, uint256& hashTx,
 
     return TransactionError::OK;
 }
+
+void BroadcastTransactions(const std::vector<CTransactionRef>& txs, std::vector<TransactionError>& errors, std::vector<std::string>& err_strings, const CAmount& highfee)
+{
+    std::promise<void> promise;
+    errors.assign(txs.size(), TransactionError::OK);
+    err_strings.assign(txs.size(), std::string());
+
+    { // cs_main scope
+    LOCK(cs_main);
+    CCoinsViewCache &view = *pcoinsTip;
+    std::vector<CTransactionRef> to_accept;
+    std::vector<size_t> to_accept_index;
+    for (size_t i = 0; i < txs.size(); i++) {
+        const uint256& hashTx = txs[i]->GetHash();
+        bool fHaveChain = false;
+        for (size_t o = 0; !fHaveChain && o < txs[i]->vout.size(); o++) {
+            const Coin& existingCoin = view.AccessCoin(COutPoint(hashTx, o));
+            fHaveChain = !existingCoin.IsSpent();
+        }
+        if (fHaveChain) {
+            errors[i] = TransactionError::ALREADY_IN_CHAIN;
+        } else if (!mempool.exists(hashTx)) {
+            to_accept.push_back(txs[i]);
+            to_accept_index.push_back(i);
+        }
+    }
+
+    // push to local node and sync with wallets
+    std::vector<CValidationState> states;
+    std::vector<bool> accepted, missing_inputs;
+    AcceptToMemoryPoolBatch(mempool, to_accept, states, accepted, missing_inputs, nullptr /* plTxnReplaced */, highfee);
+    for (size_t j = 0; j < to_accept.size(); j++) {
+        const size_t i = to_accept_index[j];
+        if (accepted[j]) continue;
+        if (states[j].IsInvalid()) {
+            err_strings[i] = FormatStateMessage(states[j]);
+            errors[i] = TransactionError::MEMPOOL_REJECTED;
+        } else if (missing_inputs[j]) {
+            errors[i] = TransactionError::MISSING_INPUTS;
+        } else {
+            err_strings[i] = FormatStateMessage(states[j]);
+            errors[i] = TransactionError::MEMPOOL_ERROR;
+        }
+    }
+
+    // As in BroadcastTransaction, let the wallet see what was accepted
+    // before returning
+    CallFunctionInValidationInterfaceQueue([&promise] {
+        promise.set_value();
+    });
+
+    } // cs_main
+
+    promise.get_future().wait();
+
+    for (size_t i = 0; i < txs.size(); i++) {
+        if (errors[i] != TransactionError::OK) continue;
+        if (!g_connman) {
+            errors[i] = TransactionError::P2P_DISABLED;
+            continue;
+        }
+        CInv inv(MSG_TX, txs[i]->GetHash());
+        g_connman->ForEachNode([&inv](CNode* pnode) {
+            pnode->PushInventory(inv);
+        });
+    }
+}
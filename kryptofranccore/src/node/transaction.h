@@ -9,6 +9,9 @@
 #include <primitives/transaction.h>
 #include <uint256.h>
 
+#include <string>
+#include <vector>
+
 enum class TransactionError {
     OK, //!< No error
     MISSING_INPUTS,
@@ -34,4 +37,15 @@ std::string TransactionErrorString(const TransactionError error);
  */
 NODISCARD TransactionError BroadcastTransaction(CTransactionRef tx, uint256& txid, std::string& err_string, const CAmount& highfee);
 
+/**
+ * Broadcast a batch of transactions, validating them together and in order,
+ * so that later ones may spend earlier ones.
+ *
+ * @param[in]  txs the transactions to broadcast
+ * @param[out] &errors the result for each transaction
+ * @param[out] &err_strings error string for each transaction, if available
+ * @param[in]  highfee Reject txs with fees higher than this (if 0, accept any fee)
+ */
+void BroadcastTransactions(const std::vector<CTransactionRef>& txs, std::vector<TransactionError>& errors, std::vector<std::string>& err_strings, const CAmount& highfee);
+
 #endif // KRYPTOFRANC_NODE_TRANSACTION_H
@@ -0,0 +1,341 @@
+// Copyright (c) 2019 The Kryptofranc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <node/utxo_snapshot.h>
+
+#include <arith_uint256.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <clientversion.h>
+#include <coins.h>
+#include <consensus/validation.h>
+#include <hash.h>
+#include <node/coinstats.h>
+#include <primitives/block.h>
+#include <shutdown.h>
+#include <streams.h>
+#include <sync.h>
+#include <txdb.h>
+#include <ui_interface.h>
+#include <util/system.h>
+#include <validation.h>
+
+#include <functional>
+#include <map>
+#include <string.h>
+
+#include <boost/thread.hpp>
+
+static const unsigned char SNAPSHOT_MAGIC[] = {'k', 'y', 'f', 'u', 't', 'x', 'o', 0xff};
+
+//! Number of coins written to the coins database per batch while loading a snapshot
+static const size_t SNAPSHOT_LOAD_BATCH_COINS = 1 << 18;
+
+static void WriteSnapshotTx(CAutoFile& file, const uint256& txid, const std::map<uint32_t, Coin>& outputs)
+{
+    file << txid;
+    WriteCompactSize(file, outputs.size());
+    for (const auto& output : outputs) {
+        file << VARINT(output.first);
+        file << output.second;
+    }
+}
+
+bool DumpUTXOSnapshot(const fs::path& path, SnapshotMetadata& metadata, std::string& error)
+{
+    std::unique_ptr<CCoinsViewCursor> pcursor;
+    std::vector<CBlockHeader> headers;
+    {
+        LOCK(cs_main);
+        // The cursor sees the coins database as of its creation, so once the
+        // chain state is flushed it matches the tip for the rest of the dump.
+        if (!FlushStateToDisk()) {
+            error = "Unable to flush the chain state to disk";
+            return false;
+        }
+        pcursor.reset(pcoinsdbview->Cursor());
+        const CBlockIndex* tip = LookupBlockIndex(pcursor->GetBestBlock());
+        if (!tip) {
+            error = "The coins database is not at a known block";
+            return false;
+        }
+        metadata = SnapshotMetadata();
+        metadata.base_blockhash = tip->GetBlockHash();
+        metadata.base_height = tip->nHeight;
+        metadata.chain_tx_count = tip->nChainTx;
+        headers.resize(tip->nHeight);
+        for (const CBlockIndex* pindex = tip; pindex->pprev; pindex = pindex->pprev) {
+            headers[pindex->nHeight - 1] = pindex->GetBlockHeader();
+        }
+    }
+
+    const fs::path temppath = path.string() + ".incomplete";
+    try {
+        CAutoFile file(fsbridge::fopen(temppath, "wb"), SER_DISK, CLIENT_VERSION);
+        if (file.IsNull()) {
+            error = strprintf("Unable to open %s for writing", temppath.string());
+            return false;
+        }
+        file.write((const char*)SNAPSHOT_MAGIC, sizeof(SNAPSHOT_MAGIC));
+        // Coin count and hash are filled in once all coins are written.
+        file << metadata;
+        file << headers;
+
+        CCoinsStats stats;
+        CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+        ss << metadata.base_blockhash;
+        uint256 prevkey;
+        std::map<uint32_t, Coin> outputs;
+        while (pcursor->Valid()) {
+            boost::this_thread::interruption_point();
+            COutPoint key;
+            Coin coin;
+            if (!pcursor->GetKey(key) || !pcursor->GetValue(coin)) {
+                error = "Unable to read UTXO set";
+                return false;
+            }
+            if (!outputs.empty() && key.hash != prevkey) {
+                ApplyStats(stats, outputs);
+                ApplyHash(ss, CoinsHashType::SERIALIZED_3, prevkey, outputs);
+                WriteSnapshotTx(file, prevkey, outputs);
+                outputs.clear();
+            }
+            prevkey = key.hash;
+            outputs[key.n] = std::move(coin);
+            pcursor->Next();
+        }
+        if (!outputs.empty()) {
+            ApplyStats(stats, outputs);
+            ApplyHash(ss, CoinsHashType::SERIALIZED_3, prevkey, outputs);
+            WriteSnapshotTx(file, prevkey, outputs);
+        }
+        metadata.coins_count = stats.nTransactionOutputs;
+        metadata.utxo_hash = ss.GetHash();
+
+        if (fseek(file.Get(), sizeof(SNAPSHOT_MAGIC), SEEK_SET) != 0) {
+            error = "Unable to update snapshot header";
+            return false;
+        }
+        file << metadata;
+        if (!FileCommit(file.Get())) {
+            error = "Unable to commit snapshot file to disk";
+            return false;
+        }
+    } catch (const std::exception& e) {
+        error = strprintf("Failed to write snapshot: %s", e.what());
+        return false;
+    }
+    if (!RenameOver(temppath, path)) {
+        error = strprintf("Unable to rename %s to %s", temppath.string(), path.string());
+        return false;
+    }
+    LogPrintf("Wrote UTXO snapshot of %u coins at height %d to %s\n", metadata.coins_count, metadata.base_height, path.string());
+    return true;
+}
+
+/**
+ * Read the coins section of a snapshot, passing every coin to fn and
+ * computing the UTXO set hash along the way. Fails if the coins are not in
+ * coins database order or their number does not match the header.
+ */
+static bool ReadSnapshotCoins(CAutoFile& file, const SnapshotMetadata& metadata, const std::function<bool(const COutPoint&, Coin&&)>& fn, uint256& utxo_hash, std::string& error)
+{
+    CCoinsStats stats;
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << metadata.base_blockhash;
+    uint256 prevkey;
+    int last_progress = -1;
+    while (stats.nTransactionOutputs < metadata.coins_count) {
+        if (ShutdownRequested()) {
+            error = "Shutdown requested";
+            return false;
+        }
+        uint256 txid;
+        file >> txid;
+        if (stats.nTransactions > 0 && !(prevkey < txid)) {
+            error = "Transactions are not in coins database order";
+            return false;
+        }
+        prevkey = txid;
+        const uint64_t count = ReadCompactSize(file);
+        if (count == 0 || count > metadata.coins_count - stats.nTransactionOutputs) {
+            error = "Invalid number of outputs";
+            return false;
+        }
+        std::map<uint32_t, Coin> outputs;
+        for (uint64_t i = 0; i < count; i++) {
+            uint32_t n;
+            Coin coin;
+            file >> VARINT(n);
+            file >> coin;
+            if (coin.IsSpent() || !outputs.emplace(n, std::move(coin)).second) {
+                error = "Invalid output";
+                return false;
+            }
+        }
+        ApplyStats(stats, outputs);
+        ApplyHash(ss, CoinsHashType::SERIALIZED_3, txid, outputs);
+        for (auto& output : outputs) {
+            if (!fn(COutPoint(txid, output.first), std::move(output.second))) {
+                error = "Unable to write coins database";
+                return false;
+            }
+        }
+        const int progress = (int)(stats.nTransactionOutputs * 100 / metadata.coins_count);
+        if (progress != last_progress) {
+            uiInterface.ShowProgress(_("Loading UTXO snapshot..."), progress, false);
+            last_progress = progress;
+        }
+    }
+    utxo_hash = ss.GetHash();
+    return true;
+}
+
+/**
+ * The body of LoadUTXOSnapshot. Sets coins_written once anything has been
+ * written to the coins database, which the caller erases again on failure.
+ */
+static bool LoadSnapshot(const CChainParams& chainparams, const fs::path& path, const uint256& base_blockhash, const uint256& expected_utxo_hash, uint64_t chain_tx_count, bool& coins_written, std::string& error)
+{
+    CAutoFile file(fsbridge::fopen(path, "rb"), SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        error = "Unable to open file";
+        return false;
+    }
+
+    try {
+        unsigned char magic[sizeof(SNAPSHOT_MAGIC)];
+        file.read((char*)magic, sizeof(magic));
+        if (memcmp(magic, SNAPSHOT_MAGIC, sizeof(magic)) != 0) {
+            error = "Not a UTXO snapshot file";
+            return false;
+        }
+        SnapshotMetadata metadata;
+        file >> metadata;
+        if (metadata.nVersion != UTXO_SNAPSHOT_VERSION) {
+            error = strprintf("Unsupported snapshot version %u", metadata.nVersion);
+            return false;
+        }
+        if (metadata.base_blockhash != base_blockhash) {
+            error = strprintf("Snapshot is of block %s, not of the block given with -assumeutxo (%s)", metadata.base_blockhash.ToString(), base_blockhash.ToString());
+            return false;
+        }
+        LogPrintf("Loading UTXO snapshot of %u coins at height %d (%s)\n", metadata.coins_count, metadata.base_height, metadata.base_blockhash.ToString());
+
+        std::vector<CBlockHeader> headers;
+        file >> headers;
+        if (headers.empty() || headers.size() != metadata.base_height || headers.back().GetHash() != metadata.base_blockhash) {
+            error = "Block headers do not match the snapshot's base block";
+            return false;
+        }
+        if (headers.front().hashPrevBlock != chainparams.GetConsensus().hashGenesisBlock) {
+            error = "Snapshot is for a different network";
+            return false;
+        }
+        // The transaction count is not covered by the UTXO set hash, so only
+        // the one the operator gave is used.
+        if (metadata.chain_tx_count != chain_tx_count) {
+            error = strprintf("Snapshot header claims %u transactions up to its block, not the number given with -assumeutxo (%u)", metadata.chain_tx_count, chain_tx_count);
+            return false;
+        }
+        if (chain_tx_count <= metadata.base_height) {
+            error = "Invalid transaction count";
+            return false;
+        }
+
+        // Check the UTXO set against the hash the operator gave before
+        // writing anything. The hash in the header is only a hint, as whoever
+        // made the file chose it.
+        if (metadata.utxo_hash != expected_utxo_hash) {
+            error = strprintf("Snapshot header claims UTXO set hash %s, not the one given with -assumeutxo (%s)", metadata.utxo_hash.ToString(), expected_utxo_hash.ToString());
+            return false;
+        }
+        const long coins_pos = ftell(file.Get());
+        uint256 utxo_hash;
+        if (!ReadSnapshotCoins(file, metadata, [](const COutPoint&, Coin&&) { return true; }, utxo_hash, error)) {
+            return false;
+        }
+        if (utxo_hash != expected_utxo_hash) {
+            error = strprintf("UTXO set hash %s does not match the one given with -assumeutxo (%s)", utxo_hash.ToString(), expected_utxo_hash.ToString());
+            return false;
+        }
+
+        CValidationState state;
+        const CBlockIndex* pindex_header = nullptr;
+        if (!ProcessNewBlockHeaders(headers, state, chainparams, &pindex_header)) {
+            error = strprintf("Invalid block header: %s", FormatStateMessage(state));
+            return false;
+        }
+        CBlockIndex* pindex_base;
+        {
+            LOCK(cs_main);
+            pindex_base = LookupBlockIndex(metadata.base_blockhash);
+            assert(pindex_base && pindex_base == pindex_header);
+            if (pindex_base->nChainWork < UintToArith256(chainparams.GetConsensus().nMinimumChainWork)) {
+                error = "Snapshot chain has less work than the minimum chain work";
+                return false;
+            }
+        }
+        headers.clear();
+        headers.shrink_to_fit();
+
+        if (fseek(file.Get(), coins_pos, SEEK_SET) != 0) {
+            error = "Unable to seek in file";
+            return false;
+        }
+        std::vector<std::pair<COutPoint, Coin>> batch;
+        batch.reserve(SNAPSHOT_LOAD_BATCH_COINS);
+        auto write_coin = [&batch, &metadata, &coins_written](const COutPoint& outpoint, Coin&& coin) {
+            batch.emplace_back(outpoint, std::move(coin));
+            if (batch.size() < SNAPSHOT_LOAD_BATCH_COINS) {
+                return true;
+            }
+            coins_written = true;
+            bool ret = pcoinsdbview->WriteSnapshotBatch(batch, metadata.base_blockhash, false);
+            batch.clear();
+            return ret;
+        };
+        if (!ReadSnapshotCoins(file, metadata, write_coin, utxo_hash, error)) {
+            return false;
+        }
+        // The file may have changed since it was checked.
+        if (utxo_hash != expected_utxo_hash) {
+            error = strprintf("UTXO set hash %s changed while loading, and does not match the one given with -assumeutxo (%s)", utxo_hash.ToString(), expected_utxo_hash.ToString());
+            return false;
+        }
+        coins_written = true;
+        if (!pcoinsdbview->WriteSnapshotBatch(batch, metadata.base_blockhash, false)) {
+            error = "Unable to write coins database";
+            return false;
+        }
+
+        // Make the block index describe the snapshot chain before the coins
+        // database is marked as being at the base block.
+        if (!MarkUTXOSnapshotChain(chainparams, pindex_base, chain_tx_count)) {
+            error = "Unable to update the block index";
+            return false;
+        }
+        if (!pcoinsdbview->WriteSnapshotBatch({}, metadata.base_blockhash, true)) {
+            error = "Unable to write coins database";
+            return false;
+        }
+    } catch (const std::exception& e) {
+        error = strprintf("Failed to read snapshot: %s", e.what());
+        return false;
+    }
+    return true;
+}
+
+bool LoadUTXOSnapshot(const CChainParams& chainparams, const fs::path& path, const uint256& base_blockhash, const uint256& expected_utxo_hash, uint64_t chain_tx_count, std::string& error)
+{
+    bool coins_written = false;
+    const bool ret = LoadSnapshot(chainparams, path, base_blockhash, expected_utxo_hash, chain_tx_count, coins_written, error);
+    // Coins written before the load failed may not all have been checked
+    // against the UTXO set hash, so they must not become the chain state.
+    if (!ret && coins_written && !pcoinsdbview->EraseSnapshot()) {
+        error += "; unable to erase the coins written so far, restart with -reindex";
+    }
+    uiInterface.ShowProgress("", 100, false);
+    return ret;
+}
@@ -0,0 +1,87 @@
+// Copyright (c) 2019 The Kryptofranc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KRYPTOFRANC_NODE_UTXO_SNAPSHOT_H
+#define KRYPTOFRANC_NODE_UTXO_SNAPSHOT_H
+
+#include <fs.h>
+#include <serialize.h>
+#include <uint256.h>
+
+#include <stdint.h>
+#include <string>
+
+class CChainParams;
+
+/**
+ * Current version of the UTXO snapshot file format. Version 1 files carry a
+ * hash_serialized_2 UTXO set hash, which does not commit to coin heights or
+ * coinbase flags, and are no longer accepted.
+ */
+static const uint32_t UTXO_SNAPSHOT_VERSION = 2;
+
+/**
+ * Header of a UTXO snapshot file, describing the chain state it contains.
+ *
+ * The file consists of an 8 byte magic, this header, the block headers from
+ * height 1 up to and including the base block, and then the unspent outputs
+ * in coins database order. Outputs are grouped per transaction: the txid, the
+ * number of outputs, and for each output its index and the Coin itself.
+ */
+class SnapshotMetadata
+{
+public:
+    uint32_t nVersion{UTXO_SNAPSHOT_VERSION};
+    //! Block the UTXO set corresponds to
+    uint256 base_blockhash;
+    uint32_t base_height{0};
+    //! Number of transactions in the chain up to and including the base block.
+    //! Not covered by utxo_hash, so only a hint when loading.
+    uint64_t chain_tx_count{0};
+    uint64_t coins_count{0};
+    //! UTXO set hash, as reported by gettxoutsetinfo's hash_serialized_3
+    uint256 utxo_hash;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(nVersion);
+        READWRITE(base_blockhash);
+        READWRITE(base_height);
+        READWRITE(chain_tx_count);
+        READWRITE(coins_count);
+        READWRITE(utxo_hash);
+    }
+};
+
+/**
+ * Write the UTXO set at the current tip to a snapshot file at path. The chain
+ * state is flushed and a consistent view of the coins database is taken under
+ * cs_main; the coins themselves are written without holding it.
+ */
+bool DumpUTXOSnapshot(const fs::path& path, SnapshotMetadata& metadata, std::string& error);
+
+/**
+ * Bootstrap an empty chain state from a UTXO snapshot file (-loadutxosnapshot).
+ *
+ * The snapshot must be of the block base_blockhash, and its UTXO set must hash
+ * to utxo_hash. These and the chain's transaction count up to the base block
+ * come from the operator (-assumeutxo), never from the file itself, which
+ * could otherwise carry any UTXO set along with a matching hash.
+ * The snapshot's block headers are validated and added to the block index,
+ * and the UTXO set hash is checked before anything is written to the coins
+ * database. The coins are then written in large batches, and hashed again
+ * before the database is marked as being at the base block; if anything fails
+ * the coins written so far are erased.
+ *
+ * The blocks up to the base block are marked valid without their data, much
+ * like on a pruned node. They are not downloaded or validated later, so the
+ * node relies on the operator's -assumeutxo for the chain state up to there
+ * and does not serve those blocks. Must be called before the chain tip is
+ * loaded.
+ */
+bool LoadUTXOSnapshot(const CChainParams& chainparams, const fs::path& path, const uint256& base_blockhash, const uint256& utxo_hash, uint64_t chain_tx_count, std::string& error);
+
+#endif // KRYPTOFRANC_NODE_UTXO_SNAPSHOT_H
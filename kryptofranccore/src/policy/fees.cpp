@@ -123,6 +123,9 @@ public:
     TxConfirmStats(const std::vector<double>& defaultBuckets, const std::map<double, unsigned int>& defaultBucketMap,
                    unsigned int maxPeriods, double decay, unsigned int scale);
 
+    /** Copy the stats of other, referring to a copy of its buckets and bucketMap */
+    TxConfirmStats(const TxConfirmStats& other, const std::vector<double>& buckets, const std::map<double, unsigned int>& bucketMap);
+
     /** Roll the circular buffer for unconfirmed txs*/
     void ClearCurrent(unsigned int nBlockHeight);
 
@@ -197,6 +200,14 @@ TxConfirmStats::TxConfirmStats(const std::vector<double>& defaultBuckets,
     resizeInMemoryCounters(buckets.size());
 }
 
+TxConfirmStats::TxConfirmStats(const TxConfirmStats& other, const std::vector<double>& bucketsIn,
+                               const std::map<double, unsigned int>& bucketMapIn)
+    : buckets(bucketsIn), bucketMap(bucketMapIn), txCtAvg(other.txCtAvg), confAvg(other.confAvg), failAvg(other.failAvg),
+      avg(other.avg), decay(other.decay), scale(other.scale), unconfTxs(other.unconfTxs), oldUnconfTxs(other.oldUnconfTxs)
+{
+    assert(buckets.size() == other.buckets.size());
+}
+
 void TxConfirmStats::resizeInMemoryCounters(size_t newbuckets) {
     // newbuckets must be passed in because the buckets referred to during Read have not been updated yet.
     unconfTxs.resize(GetMaxConfirms());
@@ -542,6 +553,9 @@ CBlockPolicyEstimator::CBlockPolicyEstimator()
     feeStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(buckets, bucketMap, MED_BLOCK_PERIODS, MED_DECAY, MED_SCALE));
     shortStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(buckets, bucketMap, SHORT_BLOCK_PERIODS, SHORT_DECAY, SHORT_SCALE));
     longStats = std::unique_ptr<TxConfirmStats>(new TxConfirmStats(buckets, bucketMap, LONG_BLOCK_PERIODS, LONG_DECAY, LONG_SCALE));
+
+    LOCK(m_cs_fee_estimator);
+    PublishSmartFeeTable();
 }
 
 CBlockPolicyEstimator::~CBlockPolicyEstimator()
@@ -661,6 +675,8 @@ void CBlockPolicyEstimator::processBlock(unsigned int nBlockHeight,
 
     trackedTxs = 0;
     untrackedTxs = 0;
+
+    PublishSmartFeeTable();
 }
 
 CFeeRate CBlockPolicyEstimator::estimateFee(int confTarget) const
@@ -712,16 +728,12 @@ CFeeRate CBlockPolicyEstimator::estimateRawFee(int confTarget, double successThr
 
 unsigned int CBlockPolicyEstimator::HighestTargetTracked(FeeEstimateHorizon horizon) const
 {
-    LOCK(m_cs_fee_estimator);
+    const std::shared_ptr<const SmartFeeTable> table = std::atomic_load(&m_smart_fee_table);
     switch (horizon) {
-    case FeeEstimateHorizon::SHORT_HALFLIFE: {
-        return shortStats->GetMaxConfirms();
-    }
-    case FeeEstimateHorizon::MED_HALFLIFE: {
-        return feeStats->GetMaxConfirms();
-    }
+    case FeeEstimateHorizon::SHORT_HALFLIFE:
+    case FeeEstimateHorizon::MED_HALFLIFE:
     case FeeEstimateHorizon::LONG_HALFLIFE: {
-        return longStats->GetMaxConfirms();
+        return table->max_confirms[static_cast<int>(horizon)];
     }
     default: {
         throw std::out_of_range("CBlockPolicyEstimator::HighestTargetTracked unknown FeeEstimateHorizon");
@@ -753,11 +765,35 @@ unsigned int CBlockPolicyEstimator::MaxUsableEstimate() const
     return std::min(longStats->GetMaxConfirms(), std::max(BlockSpan(), HistoricalBlockSpan()) / 2);
 }
 
+struct CBlockPolicyEstimator::StatsSnapshot
+{
+    std::vector<double> buckets;
+    std::map<double, unsigned int> bucketMap;
+    std::unique_ptr<TxConfirmStats> feeStats;
+    std::unique_ptr<TxConfirmStats> shortStats;
+    std::unique_ptr<TxConfirmStats> longStats;
+    unsigned int nBestSeenHeight;
+    unsigned int maxUsableEstimate;
+
+    explicit StatsSnapshot(const CBlockPolicyEstimator& estimator) EXCLUSIVE_LOCKS_REQUIRED(estimator.m_cs_fee_estimator)
+        : buckets(estimator.buckets), bucketMap(estimator.bucketMap),
+          feeStats(new TxConfirmStats(*estimator.feeStats, buckets, bucketMap)),
+          shortStats(new TxConfirmStats(*estimator.shortStats, buckets, bucketMap)),
+          longStats(new TxConfirmStats(*estimator.longStats, buckets, bucketMap)),
+          nBestSeenHeight(estimator.nBestSeenHeight), maxUsableEstimate(estimator.MaxUsableEstimate())
+    {
+    }
+
+    double estimateCombinedFee(unsigned int confTarget, double successThreshold, bool checkShorterHorizon, EstimationResult *result) const;
+    double estimateConservativeFee(unsigned int doubleTarget, EstimationResult *result) const;
+    void estimateSmartFees(unsigned int confTarget, SmartFeeTable::Entry& economical, SmartFeeTable::Entry& conservative) const;
+};
+
 /** Return a fee estimate at the required successThreshold from the shortest
  * time horizon which tracks confirmations up to the desired target.  If
  * checkShorterHorizon is requested, also allow short time horizon estimates
  * for a lower target to reduce the given answer */
-double CBlockPolicyEstimator::estimateCombinedFee(unsigned int confTarget, double successThreshold, bool checkShorterHorizon, EstimationResult *result) const
+double CBlockPolicyEstimator::StatsSnapshot::estimateCombinedFee(unsigned int confTarget, double successThreshold, bool checkShorterHorizon, EstimationResult *result) const
 {
     double estimate = -1;
     if (confTarget >= 1 && confTarget <= longStats->GetMaxConfirms()) {
@@ -796,7 +832,7 @@ double CBlockPolicyEstimator::estimateCombinedFee(unsigned int confTarget, doubl
 /** Ensure that for a conservative estimate, the DOUBLE_SUCCESS_PCT is also met
  * at 2 * target for any longer time horizons.
  */
-double CBlockPolicyEstimator::estimateConservativeFee(unsigned int doubleTarget, EstimationResult *result) const
+double CBlockPolicyEstimator::StatsSnapshot::estimateConservativeFee(unsigned int doubleTarget, EstimationResult *result) const
 {
     double estimate = -1;
     EstimationResult tempResult;
@@ -819,83 +855,115 @@ double CBlockPolicyEstimator::estimateConservativeFee(unsigned int doubleTarget,
  * shortest time horizon which tracks the required target.  Conservative
  * estimates, however, required the 95% threshold at 2 * target be met for any
  * longer time horizons also.
+ *
+ * Both modes are answered together, as they share the target / 2 and target
+ * calculations and, where the economical answer needs it, the conservative one.
  */
+void CBlockPolicyEstimator::StatsSnapshot::estimateSmartFees(unsigned int confTarget, SmartFeeTable::Entry& economical, SmartFeeTable::Entry& conservative) const
+{
+    /** true is passed to estimateCombined fee for target/2 and target so
+     * that we check the max confirms for shorter time horizons as well.
+     * This is necessary to preserve monotonically increasing estimates.
+     * For non-conservative estimates we do the same thing for 2*target, but
+     * for conservative estimates we want to skip these shorter horizons
+     * checks for 2*target because we are taking the max over all time
+     * horizons so we already have monotonically increasing estimates and
+     * the purpose of conservative estimates is not to let short term
+     * fluctuations lower our estimates by too much.
+     */
+    EstimationResult halfResult, actualResult, consResult;
+    double halfEst = estimateCombinedFee(confTarget/2, HALF_SUCCESS_PCT, true, &halfResult);
+    double actualEst = estimateCombinedFee(confTarget, SUCCESS_PCT, true, &actualResult);
+    double consEst = estimateConservativeFee(2 * confTarget, &consResult);
+
+    for (bool isConservative : {false, true}) {
+        SmartFeeTable::Entry& entry = isConservative ? conservative : economical;
+        double median = halfEst;
+        entry.est = halfResult;
+        entry.reason = FeeReason::HALF_ESTIMATE;
+        if (actualEst > median) {
+            median = actualEst;
+            entry.est = actualResult;
+            entry.reason = FeeReason::FULL_ESTIMATE;
+        }
+        EstimationResult doubleResult;
+        double doubleEst = estimateCombinedFee(2 * confTarget, DOUBLE_SUCCESS_PCT, !isConservative, &doubleResult);
+        if (doubleEst > median) {
+            median = doubleEst;
+            entry.est = doubleResult;
+            entry.reason = FeeReason::DOUBLE_ESTIMATE;
+        }
+        if ((isConservative || median == -1) && consEst > median) {
+            median = consEst;
+            entry.est = consResult;
+            entry.reason = FeeReason::CONSERVATIVE;
+        }
+        // A negative median is the error condition, answered with 0
+        entry.feerate = median < 0 ? CFeeRate(0) : CFeeRate(llround(median));
+    }
+}
+
+CBlockPolicyEstimator::SmartFeeTable::SmartFeeTable(std::unique_ptr<const StatsSnapshot> snapshot)
+    : m_snapshot(std::move(snapshot)),
+      // Requests for other targets are answered at one of these, the way
+      // estimateSmartFee adjusts them.
+      m_targets(new Target[m_snapshot->maxUsableEstimate + 1])
+{
+    max_confirms[static_cast<int>(FeeEstimateHorizon::SHORT_HALFLIFE)] = m_snapshot->shortStats->GetMaxConfirms();
+    max_confirms[static_cast<int>(FeeEstimateHorizon::MED_HALFLIFE)] = m_snapshot->feeStats->GetMaxConfirms();
+    max_confirms[static_cast<int>(FeeEstimateHorizon::LONG_HALFLIFE)] = m_snapshot->longStats->GetMaxConfirms();
+    max_usable_estimate = m_snapshot->maxUsableEstimate;
+}
+
+CBlockPolicyEstimator::SmartFeeTable::~SmartFeeTable()
+{
+}
+
+CBlockPolicyEstimator::SmartFeeTable::Entry CBlockPolicyEstimator::SmartFeeTable::Get(unsigned int target, bool conservative) const
+{
+    assert(target >= 2 && target <= max_usable_estimate);
+    Target& t = m_targets[target];
+    std::call_once(t.computed, [this, target, &t] {
+        m_snapshot->estimateSmartFees(target, t.economical, t.conservative);
+    });
+    return conservative ? t.conservative : t.economical;
+}
+
+void CBlockPolicyEstimator::PublishSmartFeeTable()
+{
+    std::atomic_store(&m_smart_fee_table, std::make_shared<const SmartFeeTable>(std::unique_ptr<const StatsSnapshot>(new StatsSnapshot(*this))));
+}
+
 CFeeRate CBlockPolicyEstimator::estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const
 {
-    LOCK(m_cs_fee_estimator);
+    const std::shared_ptr<const SmartFeeTable> table = std::atomic_load(&m_smart_fee_table);
 
     if (feeCalc) {
         feeCalc->desiredTarget = confTarget;
         feeCalc->returnedTarget = confTarget;
     }
 
-    double median = -1;
-    EstimationResult tempResult;
-
     // Return failure if trying to analyze a target we're not tracking
-    if (confTarget <= 0 || (unsigned int)confTarget > longStats->GetMaxConfirms()) {
+    if (confTarget <= 0 || (unsigned int)confTarget > table->max_confirms[static_cast<int>(FeeEstimateHorizon::LONG_HALFLIFE)]) {
         return CFeeRate(0);  // error condition
     }
 
     // It's not possible to get reasonable estimates for confTarget of 1
     if (confTarget == 1) confTarget = 2;
 
-    unsigned int maxUsableEstimate = MaxUsableEstimate();
-    if ((unsigned int)confTarget > maxUsableEstimate) {
-        confTarget = maxUsableEstimate;
+    if ((unsigned int)confTarget > table->max_usable_estimate) {
+        confTarget = table->max_usable_estimate;
     }
     if (feeCalc) feeCalc->returnedTarget = confTarget;
 
     if (confTarget <= 1) return CFeeRate(0); // error condition
 
-    assert(confTarget > 0); //estimateCombinedFee and estimateConservativeFee take unsigned ints
-    /** true is passed to estimateCombined fee for target/2 and target so
-     * that we check the max confirms for shorter time horizons as well.
-     * This is necessary to preserve monotonically increasing estimates.
-     * For non-conservative estimates we do the same thing for 2*target, but
-     * for conservative estimates we want to skip these shorter horizons
-     * checks for 2*target because we are taking the max over all time
-     * horizons so we already have monotonically increasing estimates and
-     * the purpose of conservative estimates is not to let short term
-     * fluctuations lower our estimates by too much.
-     */
-    double halfEst = estimateCombinedFee(confTarget/2, HALF_SUCCESS_PCT, true, &tempResult);
+    const SmartFeeTable::Entry entry = table->Get(confTarget, conservative);
     if (feeCalc) {
-        feeCalc->est = tempResult;
-        feeCalc->reason = FeeReason::HALF_ESTIMATE;
-    }
-    median = halfEst;
-    double actualEst = estimateCombinedFee(confTarget, SUCCESS_PCT, true, &tempResult);
-    if (actualEst > median) {
-        median = actualEst;
-        if (feeCalc) {
-            feeCalc->est = tempResult;
-            feeCalc->reason = FeeReason::FULL_ESTIMATE;
-        }
-    }
-    double doubleEst = estimateCombinedFee(2 * confTarget, DOUBLE_SUCCESS_PCT, !conservative, &tempResult);
-    if (doubleEst > median) {
-        median = doubleEst;
-        if (feeCalc) {
-            feeCalc->est = tempResult;
-            feeCalc->reason = FeeReason::DOUBLE_ESTIMATE;
-        }
+        feeCalc->est = entry.est;
+        feeCalc->reason = entry.reason;
     }
-
-    if (conservative || median == -1) {
-        double consEst =  estimateConservativeFee(2 * confTarget, &tempResult);
-        if (consEst > median) {
-            median = consEst;
-            if (feeCalc) {
-                feeCalc->est = tempResult;
-                feeCalc->reason = FeeReason::CONSERVATIVE;
-            }
-        }
-    }
-
-    if (median < 0) return CFeeRate(0); // error condition
-
-    return CFeeRate(llround(median));
+    return entry.feerate;
 }
 
 
@@ -975,6 +1043,8 @@ bool CBlockPolicyEstimator::Read(CAutoFile& filein)
             nBestSeenHeight = nFileBestSeenHeight;
             historicalFirst = nFileHistoricalFirst;
             historicalBest = nFileHistoricalBest;
+
+            PublishSmartFeeTable();
         }
     }
     catch (const std::exception& e) {
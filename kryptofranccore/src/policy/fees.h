@@ -15,6 +15,7 @@
 
 #include <map>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
@@ -208,6 +209,9 @@ public:
      *  blocks. If no answer can be given at confTarget, return an estimate at
      *  the closest target where one can be given.  'conservative' estimates are
      *  valid over longer time horizons also.
+     *  Answered from the stats as of the last block, without taking
+     *  m_cs_fee_estimator. The first request for a target after a block
+     *  computes it; concurrent requests for that same target wait for it.
      */
     CFeeRate estimateSmartFee(int confTarget, FeeCalculation *feeCalc, bool conservative) const;
 
@@ -230,6 +234,52 @@ public:
     unsigned int HighestTargetTracked(FeeEstimateHorizon horizon) const;
 
 private:
+    /** The stats a SmartFeeTable is computed from, copied so that computing it needs no lock */
+    struct StatsSnapshot;
+
+    /**
+     * The answers of estimateSmartFee as of the last block, published with a
+     * copy of the stats by processBlock. Each target is computed from that
+     * copy the first time it is asked for, and kept until the next block
+     * replaces the table. Neither takes m_cs_fee_estimator, and different
+     * targets are computed independently of each other.
+     */
+    class SmartFeeTable
+    {
+    public:
+        struct Entry
+        {
+            CFeeRate feerate;
+            EstimationResult est;
+            FeeReason reason = FeeReason::NONE;
+        };
+
+        explicit SmartFeeTable(std::unique_ptr<const StatsSnapshot> snapshot);
+        ~SmartFeeTable();
+
+        //! HighestTargetTracked for each horizon
+        unsigned int max_confirms[3] = {0, 0, 0};
+        unsigned int max_usable_estimate = 0;
+
+        /** The answer for target, which must be from 2 up to max_usable_estimate */
+        Entry Get(unsigned int target, bool conservative) const;
+
+    private:
+        struct Target
+        {
+            std::once_flag computed;
+            Entry economical;
+            Entry conservative;
+        };
+
+        const std::unique_ptr<const StatsSnapshot> m_snapshot;
+        //! Indexed by target, up to max_usable_estimate
+        const std::unique_ptr<Target[]> m_targets;
+    };
+
+    //! Only accessed through std::atomic_load and std::atomic_store
+    std::shared_ptr<const SmartFeeTable> m_smart_fee_table;
+
     mutable CCriticalSection m_cs_fee_estimator;
 
     unsigned int nBestSeenHeight GUARDED_BY(m_cs_fee_estimator);
@@ -261,10 +311,8 @@ private:
     /** Process a transaction confirmed in a block*/
     bool processBlockTx(unsigned int nBlockHeight, const CTxMemPoolEntry* entry) EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
 
-    /** Helper for estimateSmartFee */
-    double estimateCombinedFee(unsigned int confTarget, double successThreshold, bool checkShorterHorizon, EstimationResult *result) const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
-    /** Helper for estimateSmartFee */
-    double estimateConservativeFee(unsigned int doubleTarget, EstimationResult *result) const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
+    /** Replace the SmartFeeTable with one for a copy of the current stats */
+    void PublishSmartFeeTable() EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
     /** Number of blocks of data recorded while fee estimates have been running */
     unsigned int BlockSpan() const EXCLUSIVE_LOCKS_REQUIRED(m_cs_fee_estimator);
     /** Number of blocks of recorded fee estimate data represented in saved data file */
@@ -240,6 +240,32 @@ extern const char *GETBLOCKTXN;
  * @since protocol version 70014 as described by BIP 152
  */
 extern const char *BLOCKTXN;
+/**
+ * Contains a 1-byte bool, a 4-byte version and an 8-byte salt.
+ * Offers to reconcile transaction announcements instead of flooding them.
+ * The bool is set by the side that made the connection, which requests
+ * reconciliations; the salts of both sides key the short transaction ids.
+ * Sent after verack, and only acted on if both sides sent it.
+ */
+extern const char *SENDRECON;
+/**
+ * Contains the 4-byte size of the sender's reconciliation set and a 2-byte
+ * fixed-point estimate of how much the sets differ.
+ * Peer should respond with a "sketch" message.
+ */
+extern const char *REQRECON;
+/**
+ * Contains a TxReconSketch of the sender's reconciliation set.
+ * Sent in response to a "reqrecon" message.
+ */
+extern const char *SKETCH;
+/**
+ * Contains a 1-byte bool telling whether the sketch could be decoded, and
+ * the short ids of the transactions the sender is missing. Peer should
+ * respond with an "inv" of those transactions, or of its whole set if the
+ * sketch could not be decoded.
+ */
+extern const char *RECONCILDIFF;
 };
 
 /* Get a vector of all valid message types (see above) */
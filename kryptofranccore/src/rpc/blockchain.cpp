@@ -8,6 +8,7 @@
 
 #include <amount.h>
 #include <base58.h>
+#include <blockcache.h>
 #include <chain.h>
 #include <chainparams.h>
 #include <checkpoints.h>
@@ -17,6 +18,8 @@
 #include <hash.h>
 #include <index/txindex.h>
 #include <key_io.h>
+#include <node/coinstats.h>
+#include <node/utxo_snapshot.h>
 #include <policy/feerate.h>
 #include <policy/policy.h>
 #include <policy/rbf.h>
@@ -32,6 +35,7 @@
 #include <util/system.h>
 #include <validation.h>
 #include <validationinterface.h>
+#include <validationstats.h>
 #include <versionbitsinfo.h>
 #include <warnings.h>
 
@@ -447,7 +451,7 @@ static void entryToJSON(UniValue &info, const CTxMemPoolEntry &e) EXCLUSIVE_LOCK
 
     UniValue spent(UniValue::VARR);
     const CTxMemPool::txiter &it = mempool.mapTx.find(tx.GetHash());
-    const CTxMemPool::setEntries &setChildren = mempool.GetMemPoolChildren(it);
+    const CTxMemPool::vecEntries &setChildren = mempool.GetMemPoolChildren(it);
     for (CTxMemPool::txiter childiter : setChildren) {
         spent.push_back(childiter->GetTx().GetHash().ToString());
     }
@@ -910,77 +914,6 @@ static UniValue getblock(const JSONRPCRequest& request)
     return blockToJSON(block, chainActive.Tip(), pblockindex, verbosity >= 2);
 }
 
-struct CCoinsStats
-{
-    int nHeight;
-    uint256 hashBlock;
-    uint64_t nTransactions;
-    uint64_t nTransactionOutputs;
-    uint64_t nBogoSize;
-    uint256 hashSerialized;
-    uint64_t nDiskSize;
-    CAmount nTotalAmount;
-
-    CCoinsStats() : nHeight(0), nTransactions(0), nTransactionOutputs(0), nBogoSize(0), nDiskSize(0), nTotalAmount(0) {}
-};
-
-static void ApplyStats(CCoinsStats &stats, CHashWriter& ss, const uint256& hash, const std::map<uint32_t, Coin>& outputs)
-{
-    assert(!outputs.empty());
-    ss << hash;
-    ss << VARINT(outputs.begin()->second.nHeight * 2 + outputs.begin()->second.fCoinBase ? 1u : 0u);
-    stats.nTransactions++;
-    for (const auto& output : outputs) {
-        ss << VARINT(output.first + 1);
-        ss << output.second.out.scriptPubKey;
-        ss << VARINT(output.second.out.nValue, VarIntMode::NONNEGATIVE_SIGNED);
-        stats.nTransactionOutputs++;
-        stats.nTotalAmount += output.second.out.nValue;
-        stats.nBogoSize += 32 /* txid */ + 4 /* vout index */ + 4 /* height + coinbase */ + 8 /* amount */ +
-                           2 /* scriptPubKey len */ + output.second.out.scriptPubKey.size() /* scriptPubKey */;
-    }
-    ss << VARINT(0u);
-}
-
-//! Calculate statistics about the unspent transaction output set
-static bool GetUTXOStats(CCoinsView *view, CCoinsStats &stats)
-{
-    std::unique_ptr<CCoinsViewCursor> pcursor(view->Cursor());
-    assert(pcursor);
-
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = pcursor->GetBestBlock();
-    {
-        LOCK(cs_main);
-        stats.nHeight = LookupBlockIndex(stats.hashBlock)->nHeight;
-    }
-    ss << stats.hashBlock;
-    uint256 prevkey;
-    std::map<uint32_t, Coin> outputs;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        COutPoint key;
-        Coin coin;
-        if (pcursor->GetKey(key) && pcursor->GetValue(coin)) {
-            if (!outputs.empty() && key.hash != prevkey) {
-                ApplyStats(stats, ss, prevkey, outputs);
-                outputs.clear();
-            }
-            prevkey = key.hash;
-            outputs[key.n] = std::move(coin);
-        } else {
-            return error("%s: unable to read value", __func__);
-        }
-        pcursor->Next();
-    }
-    if (!outputs.empty()) {
-        ApplyStats(stats, ss, prevkey, outputs);
-    }
-    stats.hashSerialized = ss.GetHash();
-    stats.nDiskSize = view->EstimateSize();
-    return true;
-}
-
 static UniValue pruneblockchain(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -1054,7 +987,8 @@ static UniValue gettxoutsetinfo(const JSONRPCRequest& request)
             "  \"transactions\": n,      (numeric) The number of transactions with unspent outputs\n"
             "  \"txouts\": n,            (numeric) The number of unspent transaction outputs\n"
             "  \"bogosize\": n,          (numeric) A meaningless metric for UTXO set size\n"
-            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash\n"
+            "  \"hash_serialized_2\": \"hash\", (string) The serialized hash. Does not commit to coin heights or coinbase flags\n"
+            "  \"hash_serialized_3\": \"hash\", (string) The serialized hash, committing to coin heights and coinbase flags\n"
             "  \"disk_size\": n,         (numeric) The estimated size of the chainstate on disk\n"
             "  \"total_amount\": x.xxx          (numeric) The total amount\n"
             "}\n"
@@ -1076,6 +1010,7 @@ static UniValue gettxoutsetinfo(const JSONRPCRequest& request)
         ret.pushKV("txouts", (int64_t)stats.nTransactionOutputs);
         ret.pushKV("bogosize", (int64_t)stats.nBogoSize);
         ret.pushKV("hash_serialized_2", stats.hashSerialized.GetHex());
+        ret.pushKV("hash_serialized_3", stats.hashSerialized3.GetHex());
         ret.pushKV("disk_size", stats.nDiskSize);
         ret.pushKV("total_amount", ValueFromAmount(stats.nTotalAmount));
     } else {
@@ -1531,6 +1466,42 @@ static UniValue getmempoolinfo(const JSONRPCRequest& request)
     return mempoolInfoToJSON();
 }
 
+static UniValue getblockcacheinfo(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 0)
+        throw std::runtime_error(
+            RPCHelpMan{"getblockcacheinfo",
+                "\nReturns statistics about the cache of serialized blocks served to peers and over REST.\n",
+                {},
+                RPCResult{
+            "{\n"
+            "  \"entries\": xxxxx,            (numeric) Number of cached blocks; witness and non-witness forms count separately\n"
+            "  \"bytes\": xxxxx,              (numeric) Total size of the cached blocks\n"
+            "  \"maxbytes\": xxxxx,           (numeric) Maximum size of the cache (see -blockcachesize)\n"
+            "  \"hits\": xxxxx,               (numeric) Number of requests answered from the cache; only if the cache is enabled\n"
+            "  \"misses\": xxxxx,             (numeric) Number of requests that read the block from disk; only if the cache is enabled\n"
+            "  \"hitrate\": x.xxx             (numeric) Fraction of requests answered from the cache; only if the cache is enabled\n"
+            "}\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("getblockcacheinfo", "")
+            + HelpExampleRpc("getblockcacheinfo", "")
+                },
+            }.ToString());
+
+    const CBlockCache::Stats stats = g_block_cache.GetStats();
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("entries", (uint64_t)stats.entries);
+    ret.pushKV("bytes", (uint64_t)stats.bytes);
+    ret.pushKV("maxbytes", (uint64_t)stats.max_bytes);
+    if (stats.max_bytes > 0) {
+        ret.pushKV("hits", stats.hits);
+        ret.pushKV("misses", stats.misses);
+        ret.pushKV("hitrate", stats.hits + stats.misses ? (double)stats.hits / (stats.hits + stats.misses) : 0.0);
+    }
+    return ret;
+}
+
 static UniValue preciousblock(const JSONRPCRequest& request)
 {
     if (request.fHelp || request.params.size() != 1)
@@ -1726,6 +1697,175 @@ static UniValue getchaintxstats(const JSONRPCRequest& request)
     return ret;
 }
 
+typedef int64_t BlockValidationTimes::*ValidationStatField;
+
+static const std::vector<std::pair<std::string, ValidationStatField>> VALIDATION_STAGES = {
+    {"sanity_checks", &BlockValidationTimes::sanity_checks},
+    {"fork_checks", &BlockValidationTimes::fork_checks},
+    {"connect_inputs", &BlockValidationTimes::connect_inputs},
+    {"verify_scripts", &BlockValidationTimes::verify_scripts},
+    {"index_writing", &BlockValidationTimes::index_writing},
+    {"callbacks", &BlockValidationTimes::callbacks},
+    {"load_block", &BlockValidationTimes::load_block},
+    {"prefetch_inputs", &BlockValidationTimes::prefetch_inputs},
+    {"connect_total", &BlockValidationTimes::connect_total},
+    {"flush_view", &BlockValidationTimes::flush_view},
+    {"write_chainstate", &BlockValidationTimes::write_chainstate},
+    {"postprocess", &BlockValidationTimes::postprocess},
+    {"total", &BlockValidationTimes::total},
+};
+
+static const std::vector<std::pair<std::string, ValidationStatField>> VALIDATION_COUNTS = {
+    {"txs", &BlockValidationTimes::txs},
+    {"inputs", &BlockValidationTimes::inputs},
+    {"sigops_cost", &BlockValidationTimes::sigops_cost},
+    {"script_checks", &BlockValidationTimes::script_checks},
+    {"prefetched_coins", &BlockValidationTimes::prefetched_coins},
+};
+
+static UniValue PercentilesToJSON(const std::vector<BlockValidationTimes>& blocks, ValidationStatField field, bool as_millis)
+{
+    std::vector<int64_t> samples;
+    samples.reserve(blocks.size());
+    for (const BlockValidationTimes& times : blocks) {
+        samples.push_back(times.*field);
+    }
+    const ValidationPercentiles percentiles = ComputeValidationPercentiles(std::move(samples));
+
+    UniValue ret(UniValue::VOBJ);
+    if (as_millis) {
+        ret.pushKV("p50", percentiles.p50 * 0.001);
+        ret.pushKV("p90", percentiles.p90 * 0.001);
+        ret.pushKV("p99", percentiles.p99 * 0.001);
+        ret.pushKV("max", percentiles.max * 0.001);
+    } else {
+        ret.pushKV("p50", percentiles.p50);
+        ret.pushKV("p90", percentiles.p90);
+        ret.pushKV("p99", percentiles.p99);
+        ret.pushKV("max", percentiles.max);
+    }
+    return ret;
+}
+
+static UniValue getvalidationstats(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 2)
+        throw std::runtime_error(
+            RPCHelpMan{"getvalidationstats",
+                "\nReturns latency percentiles for each stage of connecting a block to the tip, over the most recently connected blocks.\n"
+                "These are the timings that -debug=bench logs for every block. Times are in milliseconds.\n",
+                {
+                    {"nblocks", RPCArg::Type::NUM, /* default */ "all tracked blocks", "Only include this many of the most recent blocks"},
+                    {"verbose", RPCArg::Type::BOOL, /* default */ "false", "Also return the timings and counts of every block in the window"},
+                },
+                RPCResult{
+            "{\n"
+            "  \"window\": xxxxx,             (numeric) Maximum number of blocks tracked (-validationstatswindow)\n"
+            "  \"blocks\": xxxxx,             (numeric) Number of blocks the statistics are computed over\n"
+            "  \"first_height\": xxxxx,       (numeric) Height of the oldest block in the window. Only returned if \"blocks\" is > 0.\n"
+            "  \"last_height\": xxxxx,        (numeric) Height of the newest block in the window. Only returned if \"blocks\" is > 0.\n"
+            "  \"stages\": {                 (json object) Latency of each stage\n"
+            "    \"sanity_checks\": {        (json object) CheckBlock and assumevalid lookup\n"
+            "      \"p50\": x.xxx,           (numeric) Median\n"
+            "      \"p90\": x.xxx,           (numeric) 90th percentile\n"
+            "      \"p99\": x.xxx,           (numeric) 99th percentile\n"
+            "      \"max\": x.xxx            (numeric) Maximum\n"
+            "    },\n"
+            "    \"fork_checks\": {...},     (json object) BIP30 and deployment flag evaluation\n"
+            "    \"connect_inputs\": {...},  (json object) Fetching coins, checking inputs and queueing script checks\n"
+            "    \"verify_scripts\": {...},  (json object) Waiting for script checks still outstanding once all inputs are connected\n"
+            "    \"index_writing\": {...},   (json object) Writing undo data and updating the block index\n"
+            "    \"callbacks\": {...},       (json object) ConnectBlock callbacks\n"
+            "    \"load_block\": {...},      (json object) Reading the block from disk, if it was not supplied\n"
+            "    \"prefetch_inputs\": {...}, (json object) Loading the block's inputs into the coins cache in parallel\n"
+            "    \"connect_total\": {...},   (json object) All of ConnectBlock\n"
+            "    \"flush_view\": {...},      (json object) Flushing the block's coins view into the coins cache\n"
+            "    \"write_chainstate\": {...},(json object) Writing the chain state to disk, if necessary\n"
+            "    \"postprocess\": {...},     (json object) Mempool removal and tip update\n"
+            "    \"total\": {...}            (json object) Total time to connect the tip\n"
+            "  },\n"
+            "  \"counts\": {                 (json object) Per-block counts, with the same percentiles\n"
+            "    \"txs\": {...},             (json object) Transactions\n"
+            "    \"inputs\": {...},          (json object) Non-coinbase inputs\n"
+            "    \"sigops_cost\": {...},     (json object) Signature operation cost\n"
+            "    \"script_checks\": {...},   (json object) Input scripts executed (0 for blocks covered by -assumevalid)\n"
+            "    \"prefetched_coins\": {...} (json object) Input coins read from the coins database before connecting\n"
+            "  },\n"
+            "  \"block_list\": [             (json array) Only if verbose is true, oldest first\n"
+            "    {\n"
+            "      \"height\": xxxxx,         (numeric) Block height\n"
+            "      \"hash\": \"hex\",           (string) Block hash\n"
+            "      \"txs\": xxxxx,            (numeric) Number of transactions\n"
+            "      \"inputs\": xxxxx,         (numeric) Number of non-coinbase inputs\n"
+            "      \"sigops_cost\": xxxxx,    (numeric) Signature operation cost\n"
+            "      \"script_checks\": xxxxx,  (numeric) Number of input scripts executed\n"
+            "      \"prefetched_coins\": xxxxx, (numeric) Number of input coins prefetched\n"
+            "      \"stages\": {...}         (json object) Time spent in each stage\n"
+            "    },\n"
+            "    ...\n"
+            "  ]\n"
+            "}\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("getvalidationstats", "")
+            + HelpExampleCli("getvalidationstats", "24 true")
+            + HelpExampleRpc("getvalidationstats", "24, true")
+                },
+            }.ToString());
+
+    size_t count = g_validation_stats.GetWindow();
+    if (!request.params[0].isNull()) {
+        int nblocks = request.params[0].get_int();
+        if (nblocks < 1) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid block count: should be at least 1");
+        }
+        count = nblocks;
+    }
+    const bool verbose = !request.params[1].isNull() && request.params[1].get_bool();
+
+    const std::vector<BlockValidationTimes> blocks = g_validation_stats.GetRecent(count);
+
+    UniValue stages(UniValue::VOBJ);
+    for (const auto& stage : VALIDATION_STAGES) {
+        stages.pushKV(stage.first, PercentilesToJSON(blocks, stage.second, true));
+    }
+    UniValue counts(UniValue::VOBJ);
+    for (const auto& stat : VALIDATION_COUNTS) {
+        counts.pushKV(stat.first, PercentilesToJSON(blocks, stat.second, false));
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("window", (uint64_t)g_validation_stats.GetWindow());
+    ret.pushKV("blocks", (uint64_t)blocks.size());
+    if (!blocks.empty()) {
+        ret.pushKV("first_height", blocks.front().height);
+        ret.pushKV("last_height", blocks.back().height);
+    }
+    ret.pushKV("stages", stages);
+    ret.pushKV("counts", counts);
+
+    if (verbose) {
+        UniValue block_list(UniValue::VARR);
+        for (const BlockValidationTimes& times : blocks) {
+            UniValue entry(UniValue::VOBJ);
+            entry.pushKV("height", times.height);
+            entry.pushKV("hash", times.hash.GetHex());
+            for (const auto& stat : VALIDATION_COUNTS) {
+                entry.pushKV(stat.first, times.*stat.second);
+            }
+            UniValue block_stages(UniValue::VOBJ);
+            for (const auto& stage : VALIDATION_STAGES) {
+                block_stages.pushKV(stage.first, (times.*stage.second) * 0.001);
+            }
+            entry.pushKV("stages", block_stages);
+            block_list.push_back(entry);
+        }
+        ret.pushKV("block_list", block_list);
+    }
+
+    return ret;
+}
+
 template<typename T>
 static T CalculateTruncatedMedian(std::vector<T>& scores)
 {
@@ -2075,6 +2215,56 @@ static UniValue savemempool(const JSONRPCRequest& request)
     return NullUniValue;
 }
 
+static UniValue dumptxoutset(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() != 1) {
+        throw std::runtime_error(
+            RPCHelpMan{"dumptxoutset",
+                "\nWrite the UTXO set at the current tip to a snapshot file, which a new node can load with -loadutxosnapshot.\n"
+                "The chain state is flushed first. The block headers up to the tip are included, so the file does not\n"
+                "depend on any other data. The loading node must also be given -assumeutxo=<base_hash>:<hash_serialized_3>:<nchaintx>,\n"
+                "which it should take from a node it trusts rather than from whoever supplied the file.\n",
+                {
+                    {"path", RPCArg::Type::STR, RPCArg::Optional::NO, "Path to the output file. If relative, will be prefixed by datadir."},
+                },
+                RPCResult{
+            "{\n"
+            "  \"coins_written\": n,       (numeric) The number of unspent outputs written\n"
+            "  \"base_hash\": \"hash\",     (string) The hash of the block the UTXO set corresponds to\n"
+            "  \"base_height\": n,         (numeric) The height of that block\n"
+            "  \"hash_serialized_3\": \"hash\", (string) The serialized hash of the UTXO set, as in gettxoutsetinfo\n"
+            "  \"nchaintx\": n,            (numeric) The number of transactions in the chain up to and including that block\n"
+            "  \"path\": \"path\"           (string) The absolute path the snapshot was written to\n"
+            "}\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("dumptxoutset", "utxo.dat")
+            + HelpExampleRpc("dumptxoutset", "\"utxo.dat\"")
+                },
+            }.ToString());
+    }
+
+    const fs::path path = fs::absolute(request.params[0].get_str(), GetDataDir());
+    if (fs::exists(path)) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, path.string() + " already exists");
+    }
+
+    SnapshotMetadata metadata;
+    std::string error;
+    if (!DumpUTXOSnapshot(path, metadata, error)) {
+        throw JSONRPCError(RPC_MISC_ERROR, error);
+    }
+
+    UniValue ret(UniValue::VOBJ);
+    ret.pushKV("coins_written", metadata.coins_count);
+    ret.pushKV("base_hash", metadata.base_blockhash.GetHex());
+    ret.pushKV("base_height", (int64_t)metadata.base_height);
+    ret.pushKV("hash_serialized_3", metadata.utxo_hash.GetHex());
+    ret.pushKV("nchaintx", metadata.chain_tx_count);
+    ret.pushKV("path", path.string());
+    return ret;
+}
+
 //! Search for a given set of pubkey scripts
 bool FindScriptPubKey(std::atomic<int>& scan_progress, const std::atomic<bool>& should_abort, int64_t& count, CCoinsViewCursor* cursor, const std::set<CScript>& needles, std::map<COutPoint, Coin>& out_results) {
     scan_progress = 0;
@@ -2310,8 +2500,10 @@ static const CRPCCommand commands[] =
     { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      {} },
     { "blockchain",         "getchaintxstats",        &getchaintxstats,        {"nblocks", "blockhash"} },
     { "blockchain",         "getblockstats",          &getblockstats,          {"hash_or_height", "stats"} },
+    { "blockchain",         "getvalidationstats",     &getvalidationstats,     {"nblocks", "verbose"} },
     { "blockchain",         "getbestblockhash",       &getbestblockhash,       {} },
     { "blockchain",         "getblockcount",          &getblockcount,          {} },
+    { "blockchain",         "getblockcacheinfo",      &getblockcacheinfo,      {} },
     { "blockchain",         "getblock",               &getblock,               {"blockhash","verbosity|verbose"} },
     { "blockchain",         "getblockhash",           &getblockhash,           {"height"} },
     { "blockchain",         "getblockheader",         &getblockheader,         {"blockhash","verbose"} },
@@ -2326,6 +2518,7 @@ static const CRPCCommand commands[] =
     { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        {} },
     { "blockchain",         "pruneblockchain",        &pruneblockchain,        {"height"} },
     { "blockchain",         "savemempool",            &savemempool,            {} },
+    { "blockchain",         "dumptxoutset",           &dumptxoutset,           {"path"} },
     { "blockchain",         "verifychain",            &verifychain,            {"checklevel","nblocks"} },
 
     { "blockchain",         "preciousblock",          &preciousblock,          {"blockhash"} },
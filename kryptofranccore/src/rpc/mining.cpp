@@ -23,6 +23,7 @@
 #include <rpc/util.h>
 #include <shutdown.h>
 #include <txmempool.h>
+#include <util/moneystr.h>
 #include <util/strencodings.h>
 #include <util/system.h>
 #include <validation.h>
@@ -30,11 +31,18 @@
 #include <versionbitsinfo.h>
 #include <warnings.h>
 
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <list>
 #include <memory>
 
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <thread>
 #include <openssl/md5.h>
 
 
@@ -105,9 +113,16 @@ static UniValue getnetworkhashps(const JSONRPCRequest& request)
     return GetNetworkHashPS(!request.params[0].isNull() ? request.params[0].get_int() : 120, !request.params[1].isNull() ? request.params[1].get_int() : -1);
 }
 
-UniValue generateBlocks(std::shared_ptr<CReserveScript> coinbaseScript, int nGenerate, uint64_t nMaxTries, bool keepScript)
+//! Hash rate of the last generateBlocks call, for getmininginfo
+static std::atomic<int64_t> g_last_generate_hashps{-1};
+
+UniValue generateBlocks(std::shared_ptr<CReserveScript> coinbaseScript, int nGenerate, uint64_t nMaxTries, bool keepScript, int nThreads)
 {
     static const int nInnerLoopCount = 0x10000;
+    // Give every thread as many nonces per template as a single thread gets.
+    const uint32_t nNonceLimit = std::min<uint64_t>((uint64_t)nInnerLoopCount * nThreads, std::numeric_limits<uint32_t>::max());
+    int64_t nTimeStart = GetTimeMicros();
+    uint64_t nHashes = 0;
     int nHeightEnd = 0;
     int nHeight = 0;
 
@@ -128,14 +143,16 @@ UniValue generateBlocks(std::shared_ptr<CReserveScript> coinbaseScript, int nGen
             LOCK(cs_main);
             IncrementExtraNonce(pblock, chainActive.Tip(), nExtraNonce);
         }
-        while (nMaxTries > 0 && pblock->nNonce < nInnerLoopCount && !CheckProofOfWork(pblock->GetHash(), pblock->nBits, Params().GetConsensus())) {
-            ++pblock->nNonce;
-            --nMaxTries;
-        }
-        if (nMaxTries == 0) {
-            break;
+        bool fFound;
+        try {
+            fFound = ScanHeaderNonces(*pblock, Params().GetConsensus(), nNonceLimit, nThreads, nMaxTries, nHashes);
+        } catch (const std::runtime_error& e) {
+            throw JSONRPCError(RPC_INTERNAL_ERROR, e.what());
         }
-        if (pblock->nNonce == nInnerLoopCount) {
+        if (!fFound) {
+            if (nMaxTries == 0) {
+                break;
+            }
             continue;
         }
         std::shared_ptr<const CBlock> shared_pblock = std::make_shared<const CBlock>(*pblock);
@@ -150,12 +167,17 @@ UniValue generateBlocks(std::shared_ptr<CReserveScript> coinbaseScript, int nGen
             coinbaseScript->KeepScript();
         }
     }
+    const int64_t nTime = GetTimeMicros() - nTimeStart;
+    if (nTime > 0) {
+        g_last_generate_hashps = nHashes * 1000000 / nTime;
+        LogPrint(BCLog::RPC, "generateBlocks: %u hashes in %.2fms (%d hashes/s) using %d threads\n", nHashes, 0.001 * nTime, g_last_generate_hashps.load(), nThreads);
+    }
     return blockHashes;
 }
 
 static UniValue generatetoaddress(const JSONRPCRequest& request)
 {
-    if (request.fHelp || request.params.size() < 2 || request.params.size() > 3)
+    if (request.fHelp || request.params.size() < 2 || request.params.size() > 4)
         throw std::runtime_error(
             RPCHelpMan{"generatetoaddress",
                 "\nMine blocks immediately to a specified address (before the RPC call returns)\n",
@@ -163,6 +185,7 @@ static UniValue generatetoaddress(const JSONRPCRequest& request)
                     {"nblocks", RPCArg::Type::NUM, RPCArg::Optional::NO, "How many blocks are generated immediately."},
                     {"address", RPCArg::Type::STR, RPCArg::Optional::NO, "The address to send the newly generated kryptofranc to."},
                     {"maxtries", RPCArg::Type::NUM, /* default */ "1000000", "How many iterations to try."},
+                    {"threads", RPCArg::Type::NUM, /* default */ "1", "How many threads to search for nonces with (0 = number of cores). The hash rate is reported by getmininginfo."},
                 },
                 RPCResult{
             "[ blockhashes ]     (array) hashes of blocks generated\n"
@@ -180,6 +203,16 @@ static UniValue generatetoaddress(const JSONRPCRequest& request)
     if (!request.params[2].isNull()) {
         nMaxTries = request.params[2].get_int();
     }
+    int nThreads = 1;
+    if (!request.params[3].isNull()) {
+        nThreads = request.params[3].get_int();
+        if (nThreads < 0 || nThreads > MAX_GENERATE_THREADS) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("threads must be between 0 and %d", MAX_GENERATE_THREADS));
+        }
+        if (nThreads == 0) {
+            nThreads = std::max(1, std::min(GetNumCores(), MAX_GENERATE_THREADS));
+        }
+    }
 
     CTxDestination destination = DecodeDestination(request.params[1].get_str());
     if (!IsValidDestination(destination)) {
@@ -189,7 +222,7 @@ static UniValue generatetoaddress(const JSONRPCRequest& request)
     std::shared_ptr<CReserveScript> coinbaseScript = std::make_shared<CReserveScript>();
     coinbaseScript->reserveScript = GetScriptForDestination(destination);
 
-    return generateBlocks(coinbaseScript, nGenerate, nMaxTries, false);
+    return generateBlocks(coinbaseScript, nGenerate, nMaxTries, false, nThreads);
 }
 
 static UniValue getmininginfo(const JSONRPCRequest& request)
@@ -206,6 +239,7 @@ static UniValue getmininginfo(const JSONRPCRequest& request)
                     "  \"currentblocktx\": nnn,     (numeric, optional) The number of block transactions of the last assembled block (only present if a block was ever assembled)\n"
                     "  \"difficulty\": xxx.xxxxx    (numeric) The current difficulty\n"
                     "  \"networkhashps\": nnn,      (numeric) The network hashes per second\n"
+                    "  \"localhashps\": nnn,        (numeric, optional) The hashes per second of the last generatetoaddress call (only present if blocks were ever generated)\n"
                     "  \"pooledtx\": n              (numeric) The size of the mempool\n"
                     "  \"chain\": \"xxxx\",           (string) current network name as defined in BIP70 (main, test, regtest)\n"
                     "  \"warnings\": \"...\"          (string) any network and blockchain warnings\n"
@@ -226,6 +260,7 @@ static UniValue getmininginfo(const JSONRPCRequest& request)
     if (BlockAssembler::m_last_block_num_txs) obj.pushKV("currentblocktx", *BlockAssembler::m_last_block_num_txs);
     obj.pushKV("difficulty",       (double)GetDifficulty(chainActive.Tip()));
     obj.pushKV("networkhashps",    getnetworkhashps(request));
+    if (g_last_generate_hashps >= 0) obj.pushKV("localhashps", g_last_generate_hashps.load());
     obj.pushKV("pooledtx",         (uint64_t)mempool.size());
     obj.pushKV("chain",            Params().NetworkIDString());
     obj.pushKV("warnings",         GetWarnings("statusbar"));
@@ -300,210 +335,140 @@ static std::string gbt_vb_name(const Consensus::DeploymentPos pos) {
     return s;
 }
 
-static UniValue getblocktemplate(const JSONRPCRequest& request)
+/** A getblocktemplate long poll waiting for a new template */
+struct LongPollRequest
 {
-    if (request.fHelp || request.params.size() > 1)
-        throw std::runtime_error(
-            RPCHelpMan{"getblocktemplate",
-                "\nIf the request parameters include a 'mode' key, that is used to explicitly select between the default 'template' request or a 'proposal'.\n"
-                "It returns data needed to construct a block to work on.\n"
-                "For full specification, see BIPs 22, 23, 9, and 145:\n"
-                "    https://github.com/kryptofranc/bips/blob/master/bip-0022.mediawiki\n"
-                "    https://github.com/kryptofranc/bips/blob/master/bip-0023.mediawiki\n"
-                "    https://github.com/kryptofranc/bips/blob/master/bip-0009.mediawiki#getblocktemplate_changes\n"
-                "    https://github.com/kryptofranc/bips/blob/master/bip-0145.mediawiki\n",
-                {
-                    {"template_request", RPCArg::Type::OBJ, RPCArg::Optional::NO, "A json object in the following spec",
-                        {
-                            {"mode", RPCArg::Type::STR, /* treat as named arg */ RPCArg::Optional::OMITTED_NAMED_ARG, "This must be set to \"template\", \"proposal\" (see BIP 23), or omitted"},
-                            {"capabilities", RPCArg::Type::ARR, /* treat as named arg */ RPCArg::Optional::OMITTED_NAMED_ARG, "A list of strings",
-                                {
-                                    {"support", RPCArg::Type::STR, RPCArg::Optional::OMITTED, "client side supported feature, 'longpoll', 'coinbasetxn', 'coinbasevalue', 'proposal', 'serverlist', 'workid'"},
-                                },
-                                },
-                            {"rules", RPCArg::Type::ARR, RPCArg::Optional::NO, "A list of strings",
-                                {
-                                    {"support", RPCArg::Type::STR, RPCArg::Optional::OMITTED, "client side supported softfork deployment"},
-                                },
-                                },
-                        },
-                        "\"template_request\""},
-                },
-                RPCResult{
-            "{\n"
-            "  \"version\" : n,                    (numeric) The preferred block version\n"
-            "  \"rules\" : [ \"rulename\", ... ],    (array of strings) specific block rules that are to be enforced\n"
-            "  \"vbavailable\" : {                 (json object) set of pending, supported versionbit (BIP 9) softfork deployments\n"
-            "      \"rulename\" : bitnumber          (numeric) identifies the bit number as indicating acceptance and readiness for the named softfork rule\n"
-            "      ,...\n"
-            "  },\n"
-            "  \"vbrequired\" : n,                 (numeric) bit mask of versionbits the server requires set in submissions\n"
-            "  \"previousblockhash\" : \"xxxx\",     (string) The hash of current highest block\n"
-            "  \"transactions\" : [                (array) contents of non-coinbase transactions that should be included in the next block\n"
-            "      {\n"
-            "         \"data\" : \"xxxx\",             (string) transaction data encoded in hexadecimal (byte-for-byte)\n"
-            "         \"txid\" : \"xxxx\",             (string) transaction id encoded in little-endian hexadecimal\n"
-            "         \"hash\" : \"xxxx\",             (string) hash encoded in little-endian hexadecimal (including witness data)\n"
-            "         \"depends\" : [                (array) array of numbers \n"
-            "             n                          (numeric) transactions before this one (by 1-based index in 'transactions' list) that must be present in the final block if this one is\n"
-            "             ,...\n"
-            "         ],\n"
-            "         \"fee\": n,                    (numeric) difference in value between transaction inputs and outputs (in satoshis); for coinbase transactions, this is a negative Number of the total collected block fees (ie, not including the block subsidy); if key is not present, fee is unknown and clients MUST NOT assume there isn't one\n"
-            "         \"sigops\" : n,                (numeric) total SigOps cost, as counted for purposes of block limits; if key is not present, sigop cost is unknown and clients MUST NOT assume it is zero\n"
-            "         \"weight\" : n,                (numeric) total transaction weight, as counted for purposes of block limits\n"
-            "      }\n"
-            "      ,...\n"
-            "  ],\n"
-            "  \"coinbaseaux\" : {                 (json object) data that should be included in the coinbase's scriptSig content\n"
-            "      \"flags\" : \"xx\"                  (string) key name is to be ignored, and value included in scriptSig\n"
-            "  },\n"
-            "  \"coinbasevalue\" : n,              (numeric) maximum allowable input to coinbase transaction, including the generation award and transaction fees (in satoshis)\n"
-            "  \"coinbasetxn\" : { ... },          (json object) information for coinbase transaction\n"
-            "  \"target\" : \"xxxx\",                (string) The hash target\n"
-            "  \"mintime\" : xxx,                  (numeric) The minimum timestamp appropriate for next block time in seconds since epoch (Jan 1 1970 GMT)\n"
-            "  \"mutable\" : [                     (array of string) list of ways the block template may be changed \n"
-            "     \"value\"                          (string) A way the block template may be changed, e.g. 'time', 'transactions', 'prevblock'\n"
-            "     ,...\n"
-            "  ],\n"
-            "  \"noncerange\" : \"00000000ffffffff\",(string) A range of valid nonces\n"
-            "  \"sigoplimit\" : n,                 (numeric) limit of sigops in blocks\n"
-            "  \"sizelimit\" : n,                  (numeric) limit of block size\n"
-            "  \"weightlimit\" : n,                (numeric) limit of block weight\n"
-            "  \"curtime\" : ttt,                  (numeric) current timestamp in seconds since epoch (Jan 1 1970 GMT)\n"
-            "  \"bits\" : \"xxxxxxxx\",              (string) compressed target of next block\n"
-            "  \"height\" : n                      (numeric) The height of the next block\n"
-            "}\n"
-                },
-                RPCExamples{
-                    HelpExampleCli("getblocktemplate", "{\"rules\": [\"segwit\"]}")
-            + HelpExampleRpc("getblocktemplate", "{\"rules\": [\"segwit\"]}")
-                },
-            }.ToString());
+    std::set<std::string> setClientRules;
+    int64_t nMaxVersionPreVB;
+    //! Tip and mempool fee counter the client's template was built from
+    uint256 hashWatchedChain;
+    CAmount nFeesAddedLP;
+    //! New fees alone do not answer the request before this time
+    std::chrono::steady_clock::time_point checktxtime;
+    JSONRPCReplyFn reply;
+};
 
-    LOCK(cs_main);
+/**
+ * getblocktemplate long polls. Waiting requests are parked here instead of
+ * each holding an RPC thread, and are answered from a single thread when the
+ * tip changes, or once they have waited for a minute and at least
+ * -longpollfeedelta in fees has entered the mempool. Requests that are
+ * answered together share one block template.
+ */
+class LongPollQueue final : public CValidationInterface
+{
+private:
+    Mutex m_mutex;
+    std::condition_variable m_cv;
+    std::list<LongPollRequest> m_requests GUARDED_BY(m_mutex);
+    //! Total modified fees of the transactions added to the mempool since Start
+    CAmount m_fees_added GUARDED_BY(m_mutex) = 0;
+    CAmount m_fee_delta GUARDED_BY(m_mutex) = DEFAULT_LONGPOLL_FEE_DELTA;
+    bool m_stopping GUARDED_BY(m_mutex) = false;
+
+    std::once_flag m_start_once;
+    std::thread m_thread;
+    boost::signals2::scoped_connection m_conn_added;
+
+    bool FeesChanged(const LongPollRequest& lp) const EXCLUSIVE_LOCKS_REQUIRED(m_mutex)
+    {
+        return m_fees_added != lp.nFeesAddedLP &&
+            // A counter from before a restart may be ahead of ours
+            (m_fees_added < lp.nFeesAddedLP || m_fees_added - lp.nFeesAddedLP >= m_fee_delta);
+    }
 
-    std::string strMode = "template";
-    UniValue lpval = NullUniValue;
-    std::set<std::string> setClientRules;
-    int64_t nMaxVersionPreVB = -1;
-    if (!request.params[0].isNull())
+    void TransactionAdded(CTransactionRef tx)
     {
-        const UniValue& oparam = request.params[0].get_obj();
-        const UniValue& modeval = find_value(oparam, "mode");
-        if (modeval.isStr())
-            strMode = modeval.get_str();
-        else if (modeval.isNull())
+        CAmount nFee;
         {
-            /* Do nothing */
+            LOCK(mempool.cs);
+            CTxMemPool::txiter it = mempool.mapTx.find(tx->GetHash());
+            if (it == mempool.mapTx.end()) return;
+            nFee = it->GetModifiedFee();
         }
-        else
-            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid mode");
-        lpval = find_value(oparam, "longpollid");
-
-        if (strMode == "proposal")
-        {
-            const UniValue& dataval = find_value(oparam, "data");
-            if (!dataval.isStr())
-                throw JSONRPCError(RPC_TYPE_ERROR, "Missing data String key for proposal");
-
-            CBlock block;
-            if (!DecodeHexBlk(block, dataval.get_str()))
-                throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Block decode failed");
+        LOCK(m_mutex);
+        m_fees_added += nFee;
+        if (!m_requests.empty()) m_cv.notify_one();
+    }
 
-            uint256 hash = block.GetHash();
-            const CBlockIndex* pindex = LookupBlockIndex(hash);
-            if (pindex) {
-                if (pindex->IsValid(BLOCK_VALID_SCRIPTS))
-                    return "duplicate";
-                if (pindex->nStatus & BLOCK_FAILED_MASK)
-                    return "duplicate-invalid";
-                return "duplicate-inconclusive";
-            }
+    void ThreadServe();
 
-            CBlockIndex* const pindexPrev = chainActive.Tip();
-            // TestBlockValidity only supports blocks built on the current Tip
-            if (block.hashPrevBlock != pindexPrev->GetBlockHash())
-                return "inconclusive-not-best-prevblk";
-            CValidationState state;
-            TestBlockValidity(state, Params(), block, pindexPrev, false, true);
-            return BIP22ValidationResult(state);
-        }
+protected:
+    void UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload) override
+    {
+        LOCK(m_mutex);
+        m_cv.notify_one();
+    }
 
-        const UniValue& aClientRules = find_value(oparam, "rules");
-        if (aClientRules.isArray()) {
-            for (unsigned int i = 0; i < aClientRules.size(); ++i) {
-                const UniValue& v = aClientRules[i];
-                setClientRules.insert(v.get_str());
+public:
+    /** Start counting mempool fees and serving long polls, if not done yet */
+    void Start()
+    {
+        std::call_once(m_start_once, [this] {
+            // Checked in AppInitParameterInteraction
+            CAmount nFeeDelta = 0;
+            if (!gArgs.IsArgSet("-longpollfeedelta") || !ParseMoney(gArgs.GetArg("-longpollfeedelta", ""), nFeeDelta)) {
+                nFeeDelta = DEFAULT_LONGPOLL_FEE_DELTA;
             }
-        } else {
-            // NOTE: It is important that this NOT be read if versionbits is supported
-            const UniValue& uvMaxVersion = find_value(oparam, "maxversion");
-            if (uvMaxVersion.isNum()) {
-                nMaxVersionPreVB = uvMaxVersion.get_int64();
+            {
+                LOCK(m_mutex);
+                m_fee_delta = nFeeDelta;
             }
-        }
+            m_conn_added = mempool.NotifyEntryAdded.connect(std::bind(&LongPollQueue::TransactionAdded, this, std::placeholders::_1));
+            RegisterValidationInterface(this);
+            RPCServer::OnStopped(std::bind(&LongPollQueue::Stop, this));
+            m_thread = std::thread(&TraceThread<std::function<void()>>, "longpoll", std::function<void()>(std::bind(&LongPollQueue::ThreadServe, this)));
+        });
     }
 
-    if (strMode != "template")
-        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid mode");
-
-    if(!g_connman)
-        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
-
-    if (g_connman->GetNodeCount(CConnman::CONNECTIONS_ALL) == 0)
-        throw JSONRPCError(RPC_CLIENT_NOT_CONNECTED, "Kryptofranc is not connected!");
-
-    if (IsInitialBlockDownload())
-        throw JSONRPCError(RPC_CLIENT_IN_INITIAL_DOWNLOAD, "Kryptofranc is downloading blocks...");
-
-    static unsigned int nTransactionsUpdatedLast;
-
-    if (!lpval.isNull())
+    /** Stop serving, and answer the requests still waiting with an error */
+    void Stop()
     {
-        // Wait to respond until either the best block changes, OR a minute has passed and there are more transactions
-        uint256 hashWatchedChain;
-        std::chrono::steady_clock::time_point checktxtime;
-        unsigned int nTransactionsUpdatedLastLP;
-
-        if (lpval.isStr())
         {
-            // Format: <hashBestChain><nTransactionsUpdatedLast>
-            std::string lpstr = lpval.get_str();
-
-            hashWatchedChain = ParseHashV(lpstr.substr(0, 64), "longpollid");
-            nTransactionsUpdatedLastLP = atoi64(lpstr.substr(64));
+            LOCK(m_mutex);
+            m_stopping = true;
+            m_cv.notify_one();
         }
-        else
+        if (m_thread.joinable()) m_thread.join();
+        UnregisterValidationInterface(this);
+        m_conn_added.disconnect();
+
+        std::list<LongPollRequest> requests;
         {
-            // NOTE: Spec does not specify behaviour for non-string longpollid, but this makes testing easier
-            hashWatchedChain = chainActive.Tip()->GetBlockHash();
-            nTransactionsUpdatedLastLP = nTransactionsUpdatedLast;
+            LOCK(m_mutex);
+            requests.swap(m_requests);
         }
+        for (LongPollRequest& lp : requests) {
+            lp.reply(NullUniValue, JSONRPCError(RPC_CLIENT_NOT_CONNECTED, "Shutting down"));
+        }
+    }
 
-        // Release the wallet and main lock while waiting
-        LEAVE_CRITICAL_SECTION(cs_main);
+    /** Wait for a new template for lp. lp.reply may be called before this returns. */
+    void Park(LongPollRequest&& lp)
+    {
         {
-            checktxtime = std::chrono::steady_clock::now() + std::chrono::minutes(1);
-
-            WAIT_LOCK(g_best_block_mutex, lock);
-            while (g_best_block == hashWatchedChain && IsRPCRunning())
-            {
-                if (g_best_block_cv.wait_until(lock, checktxtime) == std::cv_status::timeout)
-                {
-                    // Timeout: Check transactions for update
-                    if (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLastLP)
-                        break;
-                    checktxtime += std::chrono::seconds(10);
-                }
+            LOCK(m_mutex);
+            if (!m_stopping && IsRPCRunning()) {
+                m_requests.push_back(std::move(lp));
+                m_cv.notify_one();
+                return;
             }
         }
-        ENTER_CRITICAL_SECTION(cs_main);
+        lp.reply(NullUniValue, JSONRPCError(RPC_CLIENT_NOT_CONNECTED, "Shutting down"));
+    }
 
-        if (!IsRPCRunning())
-            throw JSONRPCError(RPC_CLIENT_NOT_CONNECTED, "Shutting down");
-        // TODO: Maybe recheck connections/IBD and (if something wrong) send an expires-immediately template to stop miners?
+    CAmount FeesAdded()
+    {
+        LOCK(m_mutex);
+        return m_fees_added;
     }
+};
 
+static LongPollQueue g_longpolls;
+
+/** Build a block template for a client supporting setClientRules, reusing the last one if nothing changed */
+static UniValue BlockTemplateToJSON(const std::set<std::string>& setClientRules, int64_t nMaxVersionPreVB) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
     const struct VBDeploymentInfo& segwit_info = VersionBitsDeploymentInfo[Consensus::DEPLOYMENT_SEGWIT];
     // GBT must be called with 'segwit' set in the rules
     if (setClientRules.count(segwit_info.name) != 1) {
@@ -511,9 +476,16 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
     }
 
     // Update block
+    // The builder follows the mempool, so a refresh costs little more than
+    // the validity check of a changed selection. Mempool changes are still
+    // only picked up every 5 seconds, so that a stream of transactions does
+    // not run that check on every call.
+    static BlockTemplateBuilder builder(Params());
     static CBlockIndex* pindexPrev;
     static int64_t nStart;
     static std::unique_ptr<CBlockTemplate> pblocktemplate;
+    static unsigned int nTransactionsUpdatedLast;
+    static CAmount nFeesAddedLast;
     if (pindexPrev != chainActive.Tip() ||
         (mempool.GetTransactionsUpdated() != nTransactionsUpdatedLast && GetTime() - nStart > 5))
     {
@@ -522,12 +494,13 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
 
         // Store the pindexBest used before CreateNewBlock, to avoid races
         nTransactionsUpdatedLast = mempool.GetTransactionsUpdated();
+        nFeesAddedLast = g_longpolls.FeesAdded();
         CBlockIndex* pindexPrevNew = chainActive.Tip();
         nStart = GetTime();
 
         // Create new block
         CScript scriptDummy = CScript() << OP_TRUE;
-        pblocktemplate = BlockAssembler(Params()).CreateNewBlock(scriptDummy);
+        pblocktemplate = builder.CreateNewBlock(scriptDummy);
         if (!pblocktemplate)
             throw JSONRPCError(RPC_OUT_OF_MEMORY, "Out of memory");
 
@@ -657,7 +630,7 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
     result.pushKV("transactions", transactions);
     result.pushKV("coinbaseaux", aux);
     result.pushKV("coinbasevalue", (int64_t)pblock->vtx[0]->vout[0].nValue);
-    result.pushKV("longpollid", chainActive.Tip()->GetBlockHash().GetHex() + i64tostr(nTransactionsUpdatedLast));
+    result.pushKV("longpollid", chainActive.Tip()->GetBlockHash().GetHex() + i64tostr(nFeesAddedLast));
     result.pushKV("target", hashTarget.GetHex());
     result.pushKV("mintime", (int64_t)pindexPrev->GetMedianTimePast()+1);
     result.pushKV("mutable", aMutable);
@@ -686,6 +659,263 @@ static UniValue getblocktemplate(const JSONRPCRequest& request)
     return result;
 }
 
+void LongPollQueue::ThreadServe()
+{
+    WAIT_LOCK(m_mutex, lock);
+    while (!m_stopping) {
+        uint256 hashBestChain;
+        {
+            LOCK(g_best_block_mutex);
+            hashBestChain = g_best_block;
+        }
+        const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+        std::chrono::steady_clock::time_point next = std::chrono::steady_clock::time_point::max();
+        std::vector<LongPollRequest> ready;
+        for (auto it = m_requests.begin(); it != m_requests.end();) {
+            const bool fFeesChanged = FeesChanged(*it);
+            if (it->hashWatchedChain != hashBestChain || (fFeesChanged && now >= it->checktxtime)) {
+                ready.push_back(std::move(*it));
+                it = m_requests.erase(it);
+                continue;
+            }
+            if (fFeesChanged) next = std::min(next, it->checktxtime);
+            ++it;
+        }
+        if (ready.empty()) {
+            if (next == std::chrono::steady_clock::time_point::max()) {
+                m_cv.wait(lock);
+            } else {
+                m_cv.wait_until(lock, next);
+            }
+            continue;
+        }
+
+        lock.unlock();
+        {
+            // Nothing can change the tip or the mempool while cs_main is held,
+            // so all these requests are served from the same template.
+            LOCK(cs_main);
+            for (LongPollRequest& lp : ready) {
+                try {
+                    lp.reply(BlockTemplateToJSON(lp.setClientRules, lp.nMaxVersionPreVB), NullUniValue);
+                } catch (const UniValue& objError) {
+                    lp.reply(NullUniValue, objError);
+                } catch (const std::exception& e) {
+                    lp.reply(NullUniValue, JSONRPCError(RPC_MISC_ERROR, e.what()));
+                }
+            }
+        }
+        LogPrint(BCLog::RPC, "Answered %u getblocktemplate long polls\n", ready.size());
+        lock.lock();
+    }
+}
+
+static UniValue getblocktemplate(const JSONRPCRequest& request)
+{
+    if (request.fHelp || request.params.size() > 1)
+        throw std::runtime_error(
+            RPCHelpMan{"getblocktemplate",
+                "\nIf the request parameters include a 'mode' key, that is used to explicitly select between the default 'template' request or a 'proposal'.\n"
+                "It returns data needed to construct a block to work on.\n"
+                "For full specification, see BIPs 22, 23, 9, and 145:\n"
+                "    https://github.com/kryptofranc/bips/blob/master/bip-0022.mediawiki\n"
+                "    https://github.com/kryptofranc/bips/blob/master/bip-0023.mediawiki\n"
+                "    https://github.com/kryptofranc/bips/blob/master/bip-0009.mediawiki#getblocktemplate_changes\n"
+                "    https://github.com/kryptofranc/bips/blob/master/bip-0145.mediawiki\n",
+                {
+                    {"template_request", RPCArg::Type::OBJ, RPCArg::Optional::NO, "A json object in the following spec",
+                        {
+                            {"mode", RPCArg::Type::STR, /* treat as named arg */ RPCArg::Optional::OMITTED_NAMED_ARG, "This must be set to \"template\", \"proposal\" (see BIP 23), or omitted"},
+                            {"capabilities", RPCArg::Type::ARR, /* treat as named arg */ RPCArg::Optional::OMITTED_NAMED_ARG, "A list of strings",
+                                {
+                                    {"support", RPCArg::Type::STR, RPCArg::Optional::OMITTED, "client side supported feature, 'longpoll', 'coinbasetxn', 'coinbasevalue', 'proposal', 'serverlist', 'workid'"},
+                                },
+                                },
+                            {"rules", RPCArg::Type::ARR, RPCArg::Optional::NO, "A list of strings",
+                                {
+                                    {"support", RPCArg::Type::STR, RPCArg::Optional::OMITTED, "client side supported softfork deployment"},
+                                },
+                                },
+                        },
+                        "\"template_request\""},
+                },
+                RPCResult{
+            "{\n"
+            "  \"version\" : n,                    (numeric) The preferred block version\n"
+            "  \"rules\" : [ \"rulename\", ... ],    (array of strings) specific block rules that are to be enforced\n"
+            "  \"vbavailable\" : {                 (json object) set of pending, supported versionbit (BIP 9) softfork deployments\n"
+            "      \"rulename\" : bitnumber          (numeric) identifies the bit number as indicating acceptance and readiness for the named softfork rule\n"
+            "      ,...\n"
+            "  },\n"
+            "  \"vbrequired\" : n,                 (numeric) bit mask of versionbits the server requires set in submissions\n"
+            "  \"previousblockhash\" : \"xxxx\",     (string) The hash of current highest block\n"
+            "  \"transactions\" : [                (array) contents of non-coinbase transactions that should be included in the next block\n"
+            "      {\n"
+            "         \"data\" : \"xxxx\",             (string) transaction data encoded in hexadecimal (byte-for-byte)\n"
+            "         \"txid\" : \"xxxx\",             (string) transaction id encoded in little-endian hexadecimal\n"
+            "         \"hash\" : \"xxxx\",             (string) hash encoded in little-endian hexadecimal (including witness data)\n"
+            "         \"depends\" : [                (array) array of numbers \n"
+            "             n                          (numeric) transactions before this one (by 1-based index in 'transactions' list) that must be present in the final block if this one is\n"
+            "             ,...\n"
+            "         ],\n"
+            "         \"fee\": n,                    (numeric) difference in value between transaction inputs and outputs (in satoshis); for coinbase transactions, this is a negative Number of the total collected block fees (ie, not including the block subsidy); if key is not present, fee is unknown and clients MUST NOT assume there isn't one\n"
+            "         \"sigops\" : n,                (numeric) total SigOps cost, as counted for purposes of block limits; if key is not present, sigop cost is unknown and clients MUST NOT assume it is zero\n"
+            "         \"weight\" : n,                (numeric) total transaction weight, as counted for purposes of block limits\n"
+            "      }\n"
+            "      ,...\n"
+            "  ],\n"
+            "  \"coinbaseaux\" : {                 (json object) data that should be included in the coinbase's scriptSig content\n"
+            "      \"flags\" : \"xx\"                  (string) key name is to be ignored, and value included in scriptSig\n"
+            "  },\n"
+            "  \"coinbasevalue\" : n,              (numeric) maximum allowable input to coinbase transaction, including the generation award and transaction fees (in satoshis)\n"
+            "  \"coinbasetxn\" : { ... },          (json object) information for coinbase transaction\n"
+            "  \"target\" : \"xxxx\",                (string) The hash target\n"
+            "  \"mintime\" : xxx,                  (numeric) The minimum timestamp appropriate for next block time in seconds since epoch (Jan 1 1970 GMT)\n"
+            "  \"mutable\" : [                     (array of string) list of ways the block template may be changed \n"
+            "     \"value\"                          (string) A way the block template may be changed, e.g. 'time', 'transactions', 'prevblock'\n"
+            "     ,...\n"
+            "  ],\n"
+            "  \"noncerange\" : \"00000000ffffffff\",(string) A range of valid nonces\n"
+            "  \"sigoplimit\" : n,                 (numeric) limit of sigops in blocks\n"
+            "  \"sizelimit\" : n,                  (numeric) limit of block size\n"
+            "  \"weightlimit\" : n,                (numeric) limit of block weight\n"
+            "  \"curtime\" : ttt,                  (numeric) current timestamp in seconds since epoch (Jan 1 1970 GMT)\n"
+            "  \"bits\" : \"xxxxxxxx\",              (string) compressed target of next block\n"
+            "  \"height\" : n                      (numeric) The height of the next block\n"
+            "}\n"
+                },
+                RPCExamples{
+                    HelpExampleCli("getblocktemplate", "{\"rules\": [\"segwit\"]}")
+            + HelpExampleRpc("getblocktemplate", "{\"rules\": [\"segwit\"]}")
+                },
+            }.ToString());
+
+    LOCK(cs_main);
+
+    std::string strMode = "template";
+    UniValue lpval = NullUniValue;
+    std::set<std::string> setClientRules;
+    int64_t nMaxVersionPreVB = -1;
+    if (!request.params[0].isNull())
+    {
+        const UniValue& oparam = request.params[0].get_obj();
+        const UniValue& modeval = find_value(oparam, "mode");
+        if (modeval.isStr())
+            strMode = modeval.get_str();
+        else if (modeval.isNull())
+        {
+            /* Do nothing */
+        }
+        else
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid mode");
+        lpval = find_value(oparam, "longpollid");
+
+        if (strMode == "proposal")
+        {
+            const UniValue& dataval = find_value(oparam, "data");
+            if (!dataval.isStr())
+                throw JSONRPCError(RPC_TYPE_ERROR, "Missing data String key for proposal");
+
+            CBlock block;
+            if (!DecodeHexBlk(block, dataval.get_str()))
+                throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "Block decode failed");
+
+            uint256 hash = block.GetHash();
+            const CBlockIndex* pindex = LookupBlockIndex(hash);
+            if (pindex) {
+                if (pindex->IsValid(BLOCK_VALID_SCRIPTS))
+                    return "duplicate";
+                if (pindex->nStatus & BLOCK_FAILED_MASK)
+                    return "duplicate-invalid";
+                return "duplicate-inconclusive";
+            }
+
+            CBlockIndex* const pindexPrev = chainActive.Tip();
+            // TestBlockValidity only supports blocks built on the current Tip
+            if (block.hashPrevBlock != pindexPrev->GetBlockHash())
+                return "inconclusive-not-best-prevblk";
+            CValidationState state;
+            TestBlockValidity(state, Params(), block, pindexPrev, false, true);
+            return BIP22ValidationResult(state);
+        }
+
+        const UniValue& aClientRules = find_value(oparam, "rules");
+        if (aClientRules.isArray()) {
+            for (unsigned int i = 0; i < aClientRules.size(); ++i) {
+                const UniValue& v = aClientRules[i];
+                setClientRules.insert(v.get_str());
+            }
+        } else {
+            // NOTE: It is important that this NOT be read if versionbits is supported
+            const UniValue& uvMaxVersion = find_value(oparam, "maxversion");
+            if (uvMaxVersion.isNum()) {
+                nMaxVersionPreVB = uvMaxVersion.get_int64();
+            }
+        }
+    }
+
+    if (strMode != "template")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid mode");
+
+    if(!g_connman)
+        throw JSONRPCError(RPC_CLIENT_P2P_DISABLED, "Error: Peer-to-peer functionality missing or disabled");
+
+    if (g_connman->GetNodeCount(CConnman::CONNECTIONS_ALL) == 0)
+        throw JSONRPCError(RPC_CLIENT_NOT_CONNECTED, "Kryptofranc is not connected!");
+
+    if (IsInitialBlockDownload())
+        throw JSONRPCError(RPC_CLIENT_IN_INITIAL_DOWNLOAD, "Kryptofranc is downloading blocks...");
+
+    g_longpolls.Start();
+
+    if (!lpval.isNull())
+    {
+        // Wait to respond until either the best block changes, OR a minute has passed and there are new fees
+        LongPollRequest lp;
+        lp.setClientRules = setClientRules;
+        lp.nMaxVersionPreVB = nMaxVersionPreVB;
+        lp.checktxtime = std::chrono::steady_clock::now() + std::chrono::minutes(1);
+
+        if (lpval.isStr())
+        {
+            // Format: <hashBestChain><nFeesAddedLast>
+            std::string lpstr = lpval.get_str();
+
+            lp.hashWatchedChain = ParseHashV(lpstr.substr(0, 64), "longpollid");
+            lp.nFeesAddedLP = atoi64(lpstr.substr(64));
+        }
+        else
+        {
+            // NOTE: Spec does not specify behaviour for non-string longpollid, but this makes testing easier
+            lp.hashWatchedChain = chainActive.Tip()->GetBlockHash();
+            lp.nFeesAddedLP = g_longpolls.FeesAdded();
+        }
+
+        if (request.defer) {
+            // Reply from the long poll thread, without holding this one
+            lp.reply = request.defer();
+            g_longpolls.Park(std::move(lp));
+            return NullUniValue;
+        }
+
+        // The transport cannot reply later, so wait here
+        std::promise<std::pair<UniValue, UniValue>> promise;
+        std::future<std::pair<UniValue, UniValue>> future = promise.get_future();
+        lp.reply = [&promise](const UniValue& result, const UniValue& error) {
+            promise.set_value(std::make_pair(result, error));
+        };
+        // Release the main lock while waiting
+        LEAVE_CRITICAL_SECTION(cs_main);
+        g_longpolls.Park(std::move(lp));
+        std::pair<UniValue, UniValue> reply = future.get();
+        ENTER_CRITICAL_SECTION(cs_main);
+        if (!reply.second.isNull()) throw reply.second;
+        return reply.first;
+    }
+
+    return BlockTemplateToJSON(setClientRules, nMaxVersionPreVB);
+}
+
 class submitblock_StateCatcher : public CValidationInterface
 {
 public:
@@ -993,7 +1223,7 @@ static const CRPCCommand commands[] =
     { "mining",             "submitheader",           &submitheader,           {"hexdata"} },
 
 
-    { "generating",         "generatetoaddress",      &generatetoaddress,      {"nblocks","address","maxtries"} },
+    { "generating",         "generatetoaddress",      &generatetoaddress,      {"nblocks","address","maxtries","threads"} },
 
     { "util",               "estimatesmartfee",       &estimatesmartfee,       {"conf_target", "estimate_mode"} },
 
@@ -5,11 +5,18 @@
 #ifndef KRYPTOFRANC_RPC_MINING_H
 #define KRYPTOFRANC_RPC_MINING_H
 
+#include <amount.h>
 #include <script/script.h>
 
 #include <univalue.h>
 
-/** Generate blocks (mine) */
-UniValue generateBlocks(std::shared_ptr<CReserveScript> coinbaseScript, int nGenerate, uint64_t nMaxTries, bool keepScript);
+/** Default for -longpollfeedelta: any new fees answer a long poll */
+static const CAmount DEFAULT_LONGPOLL_FEE_DELTA = 0;
+
+/** Maximum number of threads generatetoaddress searches for nonces with */
+static const int MAX_GENERATE_THREADS = 256;
+
+/** Generate blocks (mine), searching for nonces with nThreads threads */
+UniValue generateBlocks(std::shared_ptr<CReserveScript> coinbaseScript, int nGenerate, uint64_t nMaxTries, bool keepScript, int nThreads = 1);
 
 #endif
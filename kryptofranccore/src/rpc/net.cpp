@@ -111,6 +111,9 @@ static UniValue getpeerinfo(const JSONRPCRequest& request)
             "       n,                        (numeric) The heights of blocks we're currently asking from this peer\n"
             "       ...\n"
             "    ],\n"
+            "    \"txreconciliation\": true|false, (boolean) Whether transaction announcements are reconciled with this peer\n"
+            "    \"reconciliations\": n,      (numeric) The number of reconciliations completed with this peer\n"
+            "    \"reconciliation_failures\": n, (numeric) How many of them fell back to announcing every transaction\n"
             "    \"whitelisted\": true|false, (boolean) Whether the peer is whitelisted\n"
             "    \"minfeefilter\": n,         (numeric) The minimum fee rate for transactions this peer accepts\n"
             "    \"bytessent_per_msg\": {\n"
@@ -184,6 +187,11 @@ static UniValue getpeerinfo(const JSONRPCRequest& request)
                 heights.push_back(height);
             }
             obj.pushKV("inflight", heights);
+            obj.pushKV("txreconciliation", statestats.fTxReconciliation);
+            if (statestats.fTxReconciliation) {
+                obj.pushKV("reconciliations", statestats.nReconciliations);
+                obj.pushKV("reconciliation_failures", statestats.nReconciliationFailures);
+            }
         }
         obj.pushKV("whitelisted", stats.fWhitelisted);
         obj.pushKV("minfeefilter", ValueFromAmount(stats.minFeeFilter));
@@ -1047,13 +1047,22 @@ static UniValue sendrawtransaction(const JSONRPCRequest& request)
         throw std::runtime_error(
             RPCHelpMan{"sendrawtransaction",
                 "\nSubmits raw transaction (serialized, hex-encoded) to local node and network.\n"
+                "\nAn array of raw transactions is validated as one batch, in order, so later ones may spend earlier ones.\n"
                 "\nAlso see createrawtransaction and signrawtransactionwithkey calls.\n",
                 {
-                    {"hexstring", RPCArg::Type::STR_HEX, RPCArg::Optional::NO, "The hex string of the raw transaction"},
+                    {"hexstring", RPCArg::Type::STR_HEX, RPCArg::Optional::NO, "The hex string of the raw transaction, or a JSON array of them"},
                     {"allowhighfees", RPCArg::Type::BOOL, /* default */ "false", "Allow high fees"},
                 },
                 RPCResult{
             "\"hex\"             (string) The transaction hash in hex\n"
+            "\nResult (for an array of raw transactions):\n"
+            "[                   (array) The result for each raw transaction in the input array\n"
+            " {\n"
+            "  \"txid\"           (string) The transaction hash in hex\n"
+            "  \"sent\"           (boolean) If the transaction was accepted and broadcast\n"
+            "  \"error\"          (string) Error message (only present when 'sent' is false)\n"
+            " }\n"
+            "]\n"
                 },
                 RPCExamples{
             "\nCreate a transaction\n"
@@ -1063,11 +1072,44 @@ static UniValue sendrawtransaction(const JSONRPCRequest& request)
             "\nSend the transaction (signed hex)\n"
             + HelpExampleCli("sendrawtransaction", "\"signedhex\"") +
             "\nAs a JSON-RPC call\n"
-            + HelpExampleRpc("sendrawtransaction", "\"signedhex\"")
+            + HelpExampleRpc("sendrawtransaction", "\"signedhex\"") +
+            "\nSend a parent and its child as a JSON-RPC call\n"
+            + HelpExampleRpc("sendrawtransaction", "[\"signedparenthex\", \"signedchildhex\"]")
                 },
             }.ToString());
 
-    RPCTypeCheck(request.params, {UniValue::VSTR, UniValue::VBOOL});
+    RPCTypeCheck(request.params, {request.params[0].isArray() ? UniValue::VARR : UniValue::VSTR, UniValue::VBOOL});
+
+    bool allowhighfees = false;
+    if (!request.params[1].isNull()) allowhighfees = request.params[1].get_bool();
+    const CAmount highfee{allowhighfees ? 0 : ::maxTxFee};
+
+    if (request.params[0].isArray()) {
+        const UniValue& rawtxs = request.params[0].get_array();
+        std::vector<CTransactionRef> txs;
+        for (size_t i = 0; i < rawtxs.size(); i++) {
+            CMutableTransaction mtx;
+            if (!rawtxs[i].isStr() || !DecodeHexTx(mtx, rawtxs[i].get_str()))
+                throw JSONRPCError(RPC_DESERIALIZATION_ERROR, strprintf("TX decode failed for transaction %u", i));
+            txs.push_back(MakeTransactionRef(std::move(mtx)));
+        }
+
+        std::vector<TransactionError> errors;
+        std::vector<std::string> err_strings;
+        BroadcastTransactions(txs, errors, err_strings, highfee);
+
+        UniValue result(UniValue::VARR);
+        for (size_t i = 0; i < txs.size(); i++) {
+            UniValue entry(UniValue::VOBJ);
+            entry.pushKV("txid", txs[i]->GetHash().GetHex());
+            entry.pushKV("sent", errors[i] == TransactionError::OK);
+            if (errors[i] != TransactionError::OK) {
+                entry.pushKV("error", err_strings[i].empty() ? TransactionErrorString(errors[i]) : err_strings[i]);
+            }
+            result.push_back(std::move(entry));
+        }
+        return result;
+    }
 
     // parse hex string from parameter
     CMutableTransaction mtx;
@@ -1075,9 +1117,6 @@ static UniValue sendrawtransaction(const JSONRPCRequest& request)
         throw JSONRPCError(RPC_DESERIALIZATION_ERROR, "TX decode failed");
     CTransactionRef tx(MakeTransactionRef(std::move(mtx)));
 
-    bool allowhighfees = false;
-    if (!request.params[1].isNull()) allowhighfees = request.params[1].get_bool();
-    const CAmount highfee{allowhighfees ? 0 : ::maxTxFee};
     uint256 txid;
     std::string err_string;
     const TransactionError err = BroadcastTransaction(tx, txid, err_string, highfee);
@@ -12,6 +12,7 @@
 #include <rpc/protocol.h>
 #include <uint256.h>
 
+#include <functional>
 #include <list>
 #include <map>
 #include <stdint.h>
@@ -38,6 +39,9 @@ struct UniValueType {
     UniValue::VType type;
 };
 
+/** Sends the reply to a request: the result, or an error object if error is not null */
+typedef std::function<void(const UniValue& result, const UniValue& error)> JSONRPCReplyFn;
+
 class JSONRPCRequest
 {
 public:
@@ -48,6 +52,14 @@ public:
     std::string URI;
     std::string authUser;
     std::string peerAddr;
+    /**
+     * Set by transports that can reply after the method has returned. A
+     * method that waits for an event calls this to take over the reply,
+     * instead of blocking its thread. The returned function must then be
+     * called exactly once, from any thread, and whatever the method returns
+     * is ignored. Do not throw after calling it.
+     */
+    std::function<JSONRPCReplyFn()> defer;
 
     JSONRPCRequest() : id(NullUniValue), params(NullUniValue), fHelp(false) {}
     void parse(const UniValue& valRequest);
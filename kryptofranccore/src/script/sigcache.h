@@ -55,4 +55,13 @@ public:
 
 void InitSignatureCache();
 
+/** Copy the signature cache's nonce and entries, to save them to disk. */
+void GetSignatureCacheEntries(uint256& nonce, std::vector<uint256>& entries);
+/**
+ * Restore signature cache entries saved by GetSignatureCacheEntries, along
+ * with the nonce they were computed with. Replaces the cache's own nonce, so
+ * it must be called before the cache is first used.
+ */
+void LoadSignatureCacheEntries(const uint256& nonce, const std::vector<uint256>& entries);
+
 #endif // KRYPTOFRANC_SCRIPT_SIGCACHE_H
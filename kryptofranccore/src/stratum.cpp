@@ -0,0 +1,639 @@
+// Copyright (c) 2019 The Kryptofranc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <stratum.h>
+
+#include <arith_uint256.h>
+#include <chain.h>
+#include <chainparams.h>
+#include <consensus/merkle.h>
+#include <key_io.h>
+#include <miner.h>
+#include <netbase.h>
+#include <primitives/block.h>
+#include <random.h>
+#include <script/standard.h>
+#include <streams.h>
+#include <timedata.h>
+#include <txmempool.h>
+#include <ui_interface.h>
+#include <univalue.h>
+#include <util/strencodings.h>
+#include <util/system.h>
+#include <validation.h>
+#include <validationinterface.h>
+#include <version.h>
+
+#include <deque>
+#include <limits>
+#include <map>
+#include <memory>
+#include <set>
+#include <thread>
+
+#include <event2/buffer.h>
+#include <event2/bufferevent.h>
+#include <event2/event.h>
+#include <event2/listener.h>
+#include <event2/thread.h>
+#include <event2/util.h>
+
+/** Maximum length of a request line; longer lines disconnect the client */
+static const size_t MAX_STRATUM_LINE_LENGTH = 16 * 1024;
+/** Maximum number of connected clients */
+static const size_t MAX_STRATUM_CLIENTS = 128;
+/** Number of recent jobs that shares are still accepted for */
+static const size_t MAX_STRATUM_JOBS = 16;
+/** Seconds between checks for a fresher template while the tip stays the same */
+static const int STRATUM_REFRESH_INTERVAL = 30;
+/** Sizes of the server-assigned and the miner-rolled parts of the extranonce */
+static const size_t EXTRANONCE1_SIZE = 4;
+static const size_t EXTRANONCE2_SIZE = 4;
+/**
+ * Target of difficulty 1, the one stratum miners compute share targets from.
+ * It is Bitcoin's, not this chain's proof-of-work limit, so difficulties
+ * below 1 are common here.
+ */
+static const uint32_t STRATUM_DIFF1_BITS = 0x1d00ffff;
+
+namespace {
+
+/** diff1_target / difficulty, for difficulties below 1 as well */
+arith_uint256 ShareTarget(const arith_uint256& diff1_target, double difficulty)
+{
+    // Divide by the difficulty in 32.32 fixed point, and scale back up.
+    const double fixed = difficulty * 4294967296.0;
+    if (fixed < 1) return ~arith_uint256();
+    const uint64_t divisor = fixed < 18446744073709551615.0 ? (uint64_t)fixed : std::numeric_limits<uint64_t>::max();
+    arith_uint256 target = diff1_target / arith_uint256(divisor);
+    if (target.bits() > 256 - 32) return ~arith_uint256();
+    return target << 32;
+}
+
+/** A unit of work sent to clients with mining.notify */
+struct StratumJob
+{
+    std::string id;
+    std::unique_ptr<CBlockTemplate> blocktemplate;
+    //! Serialized coinbase (without witness) before and after the extranonce
+    std::vector<unsigned char> coinb1;
+    std::vector<unsigned char> coinb2;
+    std::vector<uint256> merkle_branch;
+    arith_uint256 block_target;
+    arith_uint256 share_target;
+    double share_difficulty;
+    //! Hashes of the shares accepted for this job, to refuse duplicates
+    std::set<uint256> shares;
+};
+
+class StratumServer;
+
+struct StratumClient
+{
+    StratumServer* server;
+    struct bufferevent* bev;
+    std::string address;
+    std::vector<unsigned char> extranonce1;
+    bool subscribed = false;
+    bool authorized = false;
+    std::string worker;
+};
+
+/**
+ * The server runs a libevent loop on its own thread. All client and job
+ * state is only touched from that thread; the validation interface merely
+ * wakes it up when the tip changes.
+ */
+class StratumServer final : public CValidationInterface
+{
+public:
+    StratumServer(struct event_base* base, const CScript& script, double share_difficulty, std::vector<CSubNet> allow_subnets);
+    ~StratumServer();
+
+    bool Listen(const CService& bind);
+
+protected:
+    void UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload) override;
+
+private:
+    struct event_base* m_base;
+    struct evconnlistener* m_listener = nullptr;
+    //! Fires periodically and whenever the tip changes
+    struct event* m_job_event = nullptr;
+    //! Networks clients may connect from (-stratumallowip and localhost)
+    const std::vector<CSubNet> m_allow_subnets;
+
+    const CScript m_script;
+    const arith_uint256 m_diff1_target;
+    const double m_share_difficulty;
+    BlockTemplateBuilder m_builder;
+
+    std::map<const StratumClient*, std::unique_ptr<StratumClient>> m_clients;
+    std::deque<StratumJob> m_jobs;
+    unsigned int m_transactions_updated = 0;
+    uint32_t m_next_extranonce1;
+    uint64_t m_next_job_id = 0;
+
+    static void AcceptCallback(struct evconnlistener* listener, evutil_socket_t fd, struct sockaddr* addr, int socklen, void* ctx);
+    static void ReadCallback(struct bufferevent* bev, void* ctx);
+    static void EventCallback(struct bufferevent* bev, short what, void* ctx);
+    static void JobCallback(evutil_socket_t fd, short what, void* ctx);
+
+    void Disconnect(StratumClient& client);
+    void Send(StratumClient& client, const UniValue& message);
+    void HandleRequest(StratumClient& client, const std::string& line);
+    UniValue Submit(StratumClient& client, const UniValue& params);
+    void SendJob(StratumClient& client, const StratumJob& job, bool clean);
+    void UpdateJob();
+};
+
+/** Encode a 32-bit header field the way stratum does: big endian hex */
+std::string HexUint32(uint32_t n)
+{
+    return strprintf("%08x", n);
+}
+
+bool ParseHexUint32(const UniValue& value, uint32_t& n)
+{
+    if (!value.isStr() || value.get_str().size() != 8 || !IsHex(value.get_str())) return false;
+    n = std::stoul(value.get_str(), nullptr, 16);
+    return true;
+}
+
+/**
+ * Encode the previous block hash the way stratum does: the header bytes with
+ * every 32-bit word byte-swapped.
+ */
+std::string HexPrevHash(const uint256& hash)
+{
+    std::vector<unsigned char> bytes(hash.begin(), hash.end());
+    for (size_t i = 0; i < bytes.size(); i += 4) {
+        std::reverse(bytes.begin() + i, bytes.begin() + i + 4);
+    }
+    return HexStr(bytes);
+}
+
+UniValue StratumError(int code, const std::string& message)
+{
+    UniValue error(UniValue::VARR);
+    error.push_back(code);
+    error.push_back(message);
+    error.push_back(NullUniValue);
+    return error;
+}
+
+StratumServer::StratumServer(struct event_base* base, const CScript& script, double share_difficulty, std::vector<CSubNet> allow_subnets) :
+    m_base(base), m_allow_subnets(std::move(allow_subnets)), m_script(script),
+    m_diff1_target(arith_uint256().SetCompact(STRATUM_DIFF1_BITS)),
+    m_share_difficulty(share_difficulty), m_builder(Params()),
+    m_next_extranonce1(GetRand(std::numeric_limits<uint32_t>::max()))
+{
+    m_job_event = event_new(m_base, -1, EV_PERSIST, JobCallback, this);
+    struct timeval tv = {STRATUM_REFRESH_INTERVAL, 0};
+    event_add(m_job_event, &tv);
+    event_active(m_job_event, EV_TIMEOUT, 0);
+}
+
+StratumServer::~StratumServer()
+{
+    for (auto& client : m_clients) {
+        bufferevent_free(client.second->bev);
+    }
+    if (m_listener) evconnlistener_free(m_listener);
+    if (m_job_event) event_free(m_job_event);
+}
+
+bool StratumServer::Listen(const CService& bind)
+{
+    struct sockaddr_storage addr;
+    socklen_t addrlen = sizeof(addr);
+    if (!bind.GetSockAddr((struct sockaddr*)&addr, &addrlen)) {
+        return false;
+    }
+    m_listener = evconnlistener_new_bind(m_base, AcceptCallback, this, LEV_OPT_CLOSE_ON_FREE | LEV_OPT_REUSEABLE, -1, (struct sockaddr*)&addr, addrlen);
+    return m_listener != nullptr;
+}
+
+void StratumServer::UpdatedBlockTip(const CBlockIndex* pindexNew, const CBlockIndex* pindexFork, bool fInitialDownload)
+{
+    if (!fInitialDownload) {
+        event_active(m_job_event, EV_TIMEOUT, 0);
+    }
+}
+
+void StratumServer::AcceptCallback(struct evconnlistener* listener, evutil_socket_t fd, struct sockaddr* addr, int socklen, void* ctx)
+{
+    StratumServer* self = static_cast<StratumServer*>(ctx);
+    CService peer;
+    peer.SetSockAddr(addr);
+    bool allowed = false;
+    for (const CSubNet& subnet : self->m_allow_subnets) {
+        if (subnet.Match(peer)) {
+            allowed = true;
+            break;
+        }
+    }
+    if (!allowed) {
+        LogPrint(BCLog::STRATUM, "stratum: Refusing connection from %s, network is not allowed\n", peer.ToString());
+        evutil_closesocket(fd);
+        return;
+    }
+    if (self->m_clients.size() >= MAX_STRATUM_CLIENTS) {
+        LogPrint(BCLog::STRATUM, "stratum: Refusing connection from %s, too many clients\n", peer.ToString());
+        evutil_closesocket(fd);
+        return;
+    }
+    struct bufferevent* bev = bufferevent_socket_new(self->m_base, fd, BEV_OPT_CLOSE_ON_FREE);
+    if (!bev) {
+        evutil_closesocket(fd);
+        return;
+    }
+    std::unique_ptr<StratumClient> client(new StratumClient());
+    client->server = self;
+    client->bev = bev;
+    client->address = peer.ToString();
+    uint32_t extranonce1 = self->m_next_extranonce1++;
+    client->extranonce1.assign((unsigned char*)&extranonce1, (unsigned char*)&extranonce1 + EXTRANONCE1_SIZE);
+    bufferevent_setcb(bev, ReadCallback, nullptr, EventCallback, client.get());
+    bufferevent_enable(bev, EV_READ | EV_WRITE);
+    LogPrint(BCLog::STRATUM, "stratum: New connection from %s\n", client->address);
+    self->m_clients.emplace(client.get(), std::move(client));
+}
+
+void StratumServer::ReadCallback(struct bufferevent* bev, void* ctx)
+{
+    StratumClient* client = static_cast<StratumClient*>(ctx);
+    struct evbuffer* input = bufferevent_get_input(bev);
+    size_t n_read_out = 0;
+    char* line;
+    while ((line = evbuffer_readln(input, &n_read_out, EVBUFFER_EOL_CRLF)) != nullptr) {
+        std::string s(line, n_read_out);
+        free(line);
+        if (s.size() > MAX_STRATUM_LINE_LENGTH) {
+            LogPrint(BCLog::STRATUM, "stratum: Disconnecting %s, line too long\n", client->address);
+            client->server->Disconnect(*client);
+            return;
+        }
+        if (s.empty()) continue;
+        StratumServer* server = client->server;
+        server->HandleRequest(*client, s);
+        // The request may have caused a disconnect.
+        if (!server->m_clients.count(client)) return;
+    }
+    // Everything left is an incomplete line.
+    if (evbuffer_get_length(input) > MAX_STRATUM_LINE_LENGTH) {
+        LogPrint(BCLog::STRATUM, "stratum: Disconnecting %s, line too long\n", client->address);
+        client->server->Disconnect(*client);
+    }
+}
+
+void StratumServer::EventCallback(struct bufferevent* bev, short what, void* ctx)
+{
+    StratumClient* client = static_cast<StratumClient*>(ctx);
+    if (what & (BEV_EVENT_EOF | BEV_EVENT_ERROR)) {
+        LogPrint(BCLog::STRATUM, "stratum: %s disconnected\n", client->address);
+        client->server->Disconnect(*client);
+    }
+}
+
+void StratumServer::JobCallback(evutil_socket_t fd, short what, void* ctx)
+{
+    static_cast<StratumServer*>(ctx)->UpdateJob();
+}
+
+void StratumServer::Disconnect(StratumClient& client)
+{
+    bufferevent_free(client.bev);
+    m_clients.erase(&client);
+}
+
+void StratumServer::Send(StratumClient& client, const UniValue& message)
+{
+    std::string s = message.write() + "\n";
+    evbuffer_add(bufferevent_get_output(client.bev), s.data(), s.size());
+}
+
+void StratumServer::HandleRequest(StratumClient& client, const std::string& line)
+{
+    UniValue request;
+    if (!request.read(line) || !request.isObject()) {
+        LogPrint(BCLog::STRATUM, "stratum: Disconnecting %s, invalid JSON\n", client.address);
+        Disconnect(client);
+        return;
+    }
+    const UniValue& id = find_value(request, "id");
+    const UniValue& method = find_value(request, "method");
+    const UniValue& params = find_value(request, "params");
+
+    UniValue result = NullUniValue;
+    UniValue error = NullUniValue;
+    if (!method.isStr() || !params.isArray()) {
+        error = StratumError(20, "Invalid request");
+    } else if (method.get_str() == "mining.subscribe") {
+        client.subscribed = true;
+        const std::string subscription = HexStr(client.extranonce1);
+        UniValue subscriptions(UniValue::VARR);
+        for (const char* notification : {"mining.set_difficulty", "mining.notify"}) {
+            UniValue entry(UniValue::VARR);
+            entry.push_back(notification);
+            entry.push_back(subscription);
+            subscriptions.push_back(entry);
+        }
+        result = UniValue(UniValue::VARR);
+        result.push_back(subscriptions);
+        result.push_back(HexStr(client.extranonce1));
+        result.push_back((int)EXTRANONCE2_SIZE);
+    } else if (method.get_str() == "mining.authorize") {
+        // Only clients from -stratumallowip networks get this far, and every
+        // block pays -stratumaddress, so the worker name is just a label.
+        client.authorized = true;
+        client.worker = params.size() > 0 && params[0].isStr() ? params[0].get_str() : "";
+        result = true;
+    } else if (method.get_str() == "mining.submit") {
+        if (!client.authorized) {
+            error = StratumError(24, "Unauthorized worker");
+        } else {
+            try {
+                result = Submit(client, params);
+            } catch (const std::exception& e) {
+                LogPrintf("stratum: Error processing share from %s: %s\n", client.address, e.what());
+                result = StratumError(20, "Internal error");
+            }
+            if (result.isArray()) {
+                error = result;
+                result = NullUniValue;
+            }
+        }
+    } else if (method.get_str() == "mining.extranonce.subscribe") {
+        result = false;
+    } else {
+        error = StratumError(20, "Method not found");
+    }
+
+    UniValue reply(UniValue::VOBJ);
+    reply.pushKV("id", id);
+    reply.pushKV("result", result);
+    reply.pushKV("error", error);
+    Send(client, reply);
+
+    // Hand out work once the client is ready for it.
+    if (method.isStr() && (method.get_str() == "mining.subscribe" || method.get_str() == "mining.authorize") &&
+            client.subscribed && client.authorized && !m_jobs.empty()) {
+        SendJob(client, m_jobs.back(), true);
+    }
+}
+
+/** Returns true for an accepted share, or an error array */
+UniValue StratumServer::Submit(StratumClient& client, const UniValue& params)
+{
+    // [worker, job id, extranonce2, ntime, nonce]
+    if (params.size() < 5 || !params[1].isStr() || !params[2].isStr()) {
+        return StratumError(20, "Invalid parameters");
+    }
+    auto job = std::find_if(m_jobs.begin(), m_jobs.end(), [&](const StratumJob& j) { return j.id == params[1].get_str(); });
+    if (job == m_jobs.end()) {
+        return StratumError(21, "Job not found");
+    }
+    const std::string& extranonce2_hex = params[2].get_str();
+    uint32_t nTime;
+    uint32_t nNonce;
+    if (extranonce2_hex.size() != 2 * EXTRANONCE2_SIZE || !IsHex(extranonce2_hex) ||
+            !ParseHexUint32(params[3], nTime) || !ParseHexUint32(params[4], nNonce)) {
+        return StratumError(20, "Invalid parameters");
+    }
+    CBlock block = job->blocktemplate->block;
+    if (nTime < block.nTime || nTime > GetAdjustedTime() + MAX_FUTURE_BLOCK_TIME) {
+        return StratumError(20, "Time out of range");
+    }
+
+    // Put the coinbase back together with the extranonce the miner used.
+    std::vector<unsigned char> coinbase(job->coinb1);
+    coinbase.insert(coinbase.end(), client.extranonce1.begin(), client.extranonce1.end());
+    const std::vector<unsigned char> extranonce2 = ParseHex(extranonce2_hex);
+    coinbase.insert(coinbase.end(), extranonce2.begin(), extranonce2.end());
+    coinbase.insert(coinbase.end(), job->coinb2.begin(), job->coinb2.end());
+    CMutableTransaction coinbase_tx;
+    CDataStream ss(coinbase, SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS);
+    ss >> coinbase_tx;
+    coinbase_tx.vin[0].scriptWitness = block.vtx[0]->vin[0].scriptWitness;
+    block.vtx[0] = MakeTransactionRef(std::move(coinbase_tx));
+    block.hashMerkleRoot = BlockMerkleRoot(block);
+    block.nTime = nTime;
+    block.nNonce = nNonce;
+
+    const uint256 hash = block.GetHash();
+    const arith_uint256 hash_value = UintToArith256(hash);
+    if (hash_value > job->share_target) {
+        return StratumError(23, "Low difficulty share");
+    }
+    if (!job->shares.insert(hash).second) {
+        return StratumError(22, "Duplicate share");
+    }
+    LogPrint(BCLog::STRATUM, "stratum: Share from %s (%s) for job %s\n", client.address, client.worker, job->id);
+    if (hash_value <= job->block_target) {
+        bool fNewBlock = false;
+        if (!ProcessNewBlock(Params(), std::make_shared<const CBlock>(block), true, &fNewBlock)) {
+            LogPrintf("stratum: Block %s from %s was rejected\n", hash.ToString(), client.address);
+            return StratumError(20, "Block rejected");
+        }
+        LogPrintf("stratum: Block %s found by %s (%s)\n", hash.ToString(), client.address, client.worker);
+    }
+    return true;
+}
+
+void StratumServer::SendJob(StratumClient& client, const StratumJob& job, bool clean)
+{
+    const CBlock& block = job.blocktemplate->block;
+
+    UniValue difficulty(UniValue::VARR);
+    difficulty.push_back(job.share_difficulty);
+    UniValue set_difficulty(UniValue::VOBJ);
+    set_difficulty.pushKV("id", NullUniValue);
+    set_difficulty.pushKV("method", "mining.set_difficulty");
+    set_difficulty.pushKV("params", difficulty);
+    Send(client, set_difficulty);
+
+    UniValue branch(UniValue::VARR);
+    for (const uint256& hash : job.merkle_branch) {
+        branch.push_back(HexStr(hash.begin(), hash.end()));
+    }
+    UniValue params(UniValue::VARR);
+    params.push_back(job.id);
+    params.push_back(HexPrevHash(block.hashPrevBlock));
+    params.push_back(HexStr(job.coinb1));
+    params.push_back(HexStr(job.coinb2));
+    params.push_back(branch);
+    params.push_back(HexUint32(block.nVersion));
+    params.push_back(HexUint32(block.nBits));
+    params.push_back(HexUint32(block.nTime));
+    params.push_back(clean);
+    UniValue notify(UniValue::VOBJ);
+    notify.pushKV("id", NullUniValue);
+    notify.pushKV("method", "mining.notify");
+    notify.pushKV("params", params);
+    Send(client, notify);
+}
+
+void StratumServer::UpdateJob()
+{
+    if (IsInitialBlockDownload()) return;
+
+    int nHeight;
+    {
+        LOCK(cs_main);
+        const CBlockIndex* tip = chainActive.Tip();
+        const bool fNewTip = m_jobs.empty() || m_jobs.back().blocktemplate->block.hashPrevBlock != tip->GetBlockHash();
+        if (!fNewTip && mempool.GetTransactionsUpdated() == m_transactions_updated) return;
+        m_transactions_updated = mempool.GetTransactionsUpdated();
+        nHeight = tip->nHeight + 1;
+    }
+
+    StratumJob job;
+    try {
+        job.blocktemplate = m_builder.CreateNewBlock(m_script);
+    } catch (const std::exception& e) {
+        LogPrintf("stratum: Unable to create block template: %s\n", e.what());
+        return;
+    }
+    CBlock& block = job.blocktemplate->block;
+    // The builder may have seen a newer tip than the one above.
+    {
+        LOCK(cs_main);
+        const CBlockIndex* pindexPrev = LookupBlockIndex(block.hashPrevBlock);
+        assert(pindexPrev);
+        nHeight = pindexPrev->nHeight + 1;
+    }
+
+    // Leave room for the extranonce in the coinbase input script, right after
+    // the height. The coinbase is split around it; clients hash it without
+    // the witness, like the txid.
+    CMutableTransaction coinbase_tx(*block.vtx[0]);
+    const CScript prefix = CScript() << nHeight;
+    coinbase_tx.vin[0].scriptSig = (CScript(prefix) << std::vector<unsigned char>(EXTRANONCE1_SIZE + EXTRANONCE2_SIZE)) + COINBASE_FLAGS;
+    assert(coinbase_tx.vin[0].scriptSig.size() <= 100);
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION | SERIALIZE_TRANSACTION_NO_WITNESS);
+    ss << coinbase_tx;
+    // version, input count, prevout, script length, height, push opcode
+    const size_t offset = 4 + 1 + 36 + GetSizeOfCompactSize(coinbase_tx.vin[0].scriptSig.size()) + prefix.size() + 1;
+    job.coinb1.assign(ss.begin(), ss.begin() + offset);
+    job.coinb2.assign(ss.begin() + offset + EXTRANONCE1_SIZE + EXTRANONCE2_SIZE, ss.end());
+    block.vtx[0] = MakeTransactionRef(std::move(coinbase_tx));
+    job.merkle_branch = BlockMerkleBranch(block, 0);
+
+    job.id = strprintf("%x", m_next_job_id++);
+    job.block_target.SetCompact(block.nBits);
+    job.share_target = ShareTarget(m_diff1_target, m_share_difficulty);
+    if (job.share_target < job.block_target) {
+        // Blocks are easier than shares, so every block is a share.
+        job.share_target = job.block_target;
+    }
+    job.share_difficulty = m_diff1_target.getdouble() / job.share_target.getdouble();
+
+    const bool clean = m_jobs.empty() || m_jobs.back().blocktemplate->block.hashPrevBlock != block.hashPrevBlock;
+    if (clean) {
+        // Work on the old tip is stale.
+        m_jobs.clear();
+    }
+    m_jobs.push_back(std::move(job));
+    while (m_jobs.size() > MAX_STRATUM_JOBS) {
+        m_jobs.pop_front();
+    }
+    LogPrint(BCLog::STRATUM, "stratum: New job %s at height %d with %u transactions\n", m_jobs.back().id, nHeight, block.vtx.size() - 1);
+
+    for (auto& client : m_clients) {
+        if (client.second->subscribed && client.second->authorized) {
+            SendJob(*client.second, m_jobs.back(), clean);
+        }
+    }
+}
+
+} // namespace
+
+static struct event_base* g_stratum_base = nullptr;
+static std::unique_ptr<StratumServer> g_stratum_server;
+static std::thread g_stratum_thread;
+
+static void StratumThread()
+{
+    event_base_dispatch(g_stratum_base);
+}
+
+bool StartStratumServer()
+{
+    assert(!g_stratum_base);
+
+    CTxDestination destination = DecodeDestination(gArgs.GetArg("-stratumaddress", ""));
+    if (!IsValidDestination(destination)) {
+        return InitError(_("-stratum requires a valid -stratumaddress to pay block rewards to"));
+    }
+    double share_difficulty = DEFAULT_STRATUM_DIFFICULTY;
+    if (gArgs.IsArgSet("-stratumdifficulty")) {
+        const std::string difficulty_str = gArgs.GetArg("-stratumdifficulty", "");
+        if (!ParseDouble(difficulty_str, &share_difficulty) || !(share_difficulty > 0)) {
+            return InitError(strprintf(_("Invalid -stratumdifficulty: '%s'"), difficulty_str));
+        }
+    }
+    CService bind;
+    const std::string bind_str = gArgs.GetArg("-stratumbind", DEFAULT_STRATUM_BIND);
+    if (!Lookup(bind_str.c_str(), bind, gArgs.GetArg("-stratumport", DEFAULT_STRATUM_PORT), false)) {
+        return InitError(strprintf(_("Invalid -stratumbind address: '%s'"), bind_str));
+    }
+    std::vector<CSubNet> allow_subnets;
+    CNetAddr localv4;
+    CNetAddr localv6;
+    LookupHost("127.0.0.1", localv4, false);
+    LookupHost("::1", localv6, false);
+    allow_subnets.push_back(CSubNet(localv4, 8));
+    allow_subnets.push_back(CSubNet(localv6));
+    for (const std::string& allow : gArgs.GetArgs("-stratumallowip")) {
+        CSubNet subnet;
+        LookupSubNet(allow.c_str(), subnet);
+        if (!subnet.IsValid()) {
+            return InitError(strprintf(_("Invalid -stratumallowip subnet specification: %s"), allow));
+        }
+        allow_subnets.push_back(subnet);
+    }
+
+#ifdef WIN32
+    evthread_use_windows_threads();
+#else
+    evthread_use_pthreads();
+#endif
+    g_stratum_base = event_base_new();
+    if (!g_stratum_base) {
+        return InitError(_("Unable to create the stratum server event base"));
+    }
+    g_stratum_server.reset(new StratumServer(g_stratum_base, GetScriptForDestination(destination), share_difficulty, std::move(allow_subnets)));
+    if (!g_stratum_server->Listen(bind)) {
+        g_stratum_server.reset();
+        event_base_free(g_stratum_base);
+        g_stratum_base = nullptr;
+        return InitError(strprintf(_("Unable to bind the stratum server to %s"), bind.ToString()));
+    }
+    RegisterValidationInterface(g_stratum_server.get());
+    LogPrintf("stratum: Listening on %s\n", bind.ToString());
+
+    g_stratum_thread = std::thread(std::bind(&TraceThread<void (*)()>, "stratum", &StratumThread));
+    return true;
+}
+
+void InterruptStratumServer()
+{
+    if (g_stratum_base) {
+        event_base_once(g_stratum_base, -1, EV_TIMEOUT, [](evutil_socket_t, short, void*) {
+            event_base_loopbreak(g_stratum_base);
+        }, nullptr, nullptr);
+    }
+}
+
+void StopStratumServer()
+{
+    if (g_stratum_base) {
+        UnregisterValidationInterface(g_stratum_server.get());
+        g_stratum_thread.join();
+        g_stratum_server.reset();
+        event_base_free(g_stratum_base);
+        g_stratum_base = nullptr;
+    }
+}
@@ -0,0 +1,30 @@
+// Copyright (c) 2019 The Kryptofranc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+/**
+ * Stratum v1 mining server.
+ */
+#ifndef KRYPTOFRANC_STRATUM_H
+#define KRYPTOFRANC_STRATUM_H
+
+#include <stdint.h>
+
+static const bool DEFAULT_STRATUM_ENABLE = false;
+static const char* const DEFAULT_STRATUM_BIND = "127.0.0.1";
+static const uint16_t DEFAULT_STRATUM_PORT = 3333;
+/** Default share difficulty handed to stratum clients */
+static const double DEFAULT_STRATUM_DIFFICULTY = 1;
+
+/**
+ * Start the stratum server (-stratum). It builds work from the node's own
+ * block templates, pushes a new job to all clients as soon as the tip
+ * changes, and passes solved blocks straight to ProcessNewBlock.
+ */
+bool StartStratumServer();
+/** Interrupt the stratum server's event loop */
+void InterruptStratumServer();
+/** Stop the stratum server and disconnect all clients */
+void StopStratumServer();
+
+#endif // KRYPTOFRANC_STRATUM_H
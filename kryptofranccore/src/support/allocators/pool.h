@@ -0,0 +1,122 @@
+// Copyright (c) 2019 The Kryptofranc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KRYPTOFRANC_SUPPORT_ALLOCATORS_POOL_H
+#define KRYPTOFRANC_SUPPORT_ALLOCATORS_POOL_H
+
+#include <memusage.h>
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <limits>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+/**
+ * Pool of objects of a single type, for containers that allocate one node per
+ * element.
+ *
+ * Objects are referred to by a 32-bit index rather than a pointer, which lets
+ * containers store half-size references to them. Memory is obtained in chunks
+ * of CHUNK_OBJECTS objects. Destroyed objects go on a free list and are reused
+ * by the next New(); memory is only returned to the system by Clear() or when
+ * the pool is destroyed. Compared to allocating every node separately this
+ * avoids the per-allocation malloc overhead and keeps nodes close together.
+ *
+ * The pool does not keep track of which objects are alive: all objects must
+ * be destroyed with Delete() before Clear() is called or the pool goes away.
+ */
+template <typename T>
+class NodePool
+{
+public:
+    //! Index of an object in the pool. Index 0 is never used, so it can mean "none".
+    typedef uint32_t Index;
+
+private:
+    static const int CHUNK_BITS = 8;
+    static const Index CHUNK_OBJECTS = 1 << CHUNK_BITS;
+
+    union Slot {
+        Index next_free;
+        typename std::aligned_storage<sizeof(T), alignof(T)>::type storage;
+    };
+
+    std::vector<std::unique_ptr<Slot[]>> m_chunks;
+    //! Lowest index that was never handed out
+    Index m_next = 1;
+    //! Head of the list of freed indexes
+    Index m_free = 0;
+
+    Slot& At(Index index) const { return m_chunks[index >> CHUNK_BITS][index & (CHUNK_OBJECTS - 1)]; }
+
+    Index Allocate()
+    {
+        if (m_free) {
+            Index index = m_free;
+            m_free = At(index).next_free;
+            return index;
+        }
+        assert(m_next != std::numeric_limits<Index>::max());
+        if ((m_next >> CHUNK_BITS) == m_chunks.size()) {
+            m_chunks.emplace_back(new Slot[CHUNK_OBJECTS]);
+        }
+        return m_next++;
+    }
+
+public:
+    NodePool() = default;
+    NodePool(const NodePool&) = delete;
+    NodePool& operator=(const NodePool&) = delete;
+
+    template <typename... Args>
+    Index New(Args&&... args)
+    {
+        Index index = Allocate();
+        try {
+            new (&At(index).storage) T(std::forward<Args>(args)...);
+        } catch (...) {
+            At(index).next_free = m_free;
+            m_free = index;
+            throw;
+        }
+        return index;
+    }
+
+    void Delete(Index index)
+    {
+        (*this)[index].~T();
+        At(index).next_free = m_free;
+        m_free = index;
+    }
+
+    T& operator[](Index index) { return *reinterpret_cast<T*>(&At(index).storage); }
+    const T& operator[](Index index) const { return *reinterpret_cast<const T*>(&At(index).storage); }
+
+    //! Release all memory. All objects must have been destroyed.
+    void Clear()
+    {
+        std::vector<std::unique_ptr<Slot[]>>().swap(m_chunks);
+        m_next = 1;
+        m_free = 0;
+    }
+
+    void swap(NodePool& other)
+    {
+        m_chunks.swap(other.m_chunks);
+        std::swap(m_next, other.m_next);
+        std::swap(m_free, other.m_free);
+    }
+
+    size_t DynamicMemoryUsage() const
+    {
+        return memusage::MallocUsage(sizeof(Slot) * CHUNK_OBJECTS) * m_chunks.size() + memusage::DynamicUsage(m_chunks);
+    }
+};
+
+#endif // KRYPTOFRANC_SUPPORT_ALLOCATORS_POOL_H
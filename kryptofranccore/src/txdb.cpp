@@ -58,14 +58,34 @@ CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(Get
 }
 
 bool CCoinsViewDB::GetCoin(const COutPoint &outpoint, Coin &coin) const {
+    if (m_flush_pending || m_flush_failed) {
+        boost::unique_lock<boost::mutex> lock(m_flush_mutex);
+        CCoinsMap::const_iterator it = m_flushing.find(outpoint);
+        if (it != m_flushing.end()) {
+            if (it->second.coin.IsSpent()) return false;
+            coin = it->second.coin;
+            return true;
+        }
+    }
     return db.Read(CoinEntry(&outpoint), coin);
 }
 
 bool CCoinsViewDB::HaveCoin(const COutPoint &outpoint) const {
+    if (m_flush_pending || m_flush_failed) {
+        boost::unique_lock<boost::mutex> lock(m_flush_mutex);
+        CCoinsMap::const_iterator it = m_flushing.find(outpoint);
+        if (it != m_flushing.end()) {
+            return !it->second.coin.IsSpent();
+        }
+    }
     return db.Exists(CoinEntry(&outpoint));
 }
 
 uint256 CCoinsViewDB::GetBestBlock() const {
+    if (m_flush_pending || m_flush_failed) {
+        boost::unique_lock<boost::mutex> lock(m_flush_mutex);
+        if (m_flush_pending || m_flush_failed) return m_flushing_block;
+    }
     uint256 hashBestChain;
     if (!db.Read(DB_BEST_BLOCK, hashBestChain))
         return uint256();
@@ -81,6 +101,27 @@ std::vector<uint256> CCoinsViewDB::GetHeadBlocks() const {
 }
 
 bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
+    {
+        // Waiting here must not be an interruption point for the calling thread.
+        boost::this_thread::disable_interruption no_interrupt;
+        boost::unique_lock<boost::mutex> lock(m_flush_mutex);
+        // Only one flush can be in progress at a time.
+        while (m_flush_pending) m_flush_cond.wait(lock);
+        if (m_flush_failed) return false;
+        if (m_background_flush) {
+            m_flushing.swap(mapCoins);
+            m_flushing_block = hashBlock;
+            m_flush_pending = true;
+            m_flush_cond.notify_all();
+            return true;
+        }
+    }
+    bool ret = WriteCoins(mapCoins, hashBlock);
+    mapCoins.clear();
+    return ret;
+}
+
+bool CCoinsViewDB::WriteCoins(const CCoinsMap &mapCoins, const uint256 &hashBlock) {
     CDBBatch batch(db);
     size_t count = 0;
     size_t changed = 0;
@@ -88,8 +129,8 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     int crash_simulate = gArgs.GetArg("-dbcrashratio", 0);
     assert(!hashBlock.IsNull());
 
-    uint256 old_tip = GetBestBlock();
-    if (old_tip.IsNull()) {
+    uint256 old_tip;
+    if (!db.Read(DB_BEST_BLOCK, old_tip)) {
         // We may be in the middle of replaying.
         std::vector<uint256> old_heads = GetHeadBlocks();
         if (old_heads.size() == 2) {
@@ -105,7 +146,7 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     batch.Erase(DB_BEST_BLOCK);
     batch.Write(DB_HEAD_BLOCKS, std::vector<uint256>{hashBlock, old_tip});
 
-    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end();) {
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); ++it) {
         if (it->second.flags & CCoinsCacheEntry::DIRTY) {
             CoinEntry entry(&it->first);
             if (it->second.coin.IsSpent())
@@ -115,8 +156,6 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
             changed++;
         }
         count++;
-        CCoinsMap::iterator itOld = it++;
-        mapCoins.erase(itOld);
         if (batch.SizeEstimate() > batch_size) {
             LogPrint(BCLog::COINDB, "Writing partial batch of %.2f MiB\n", batch.SizeEstimate() * (1.0 / 1048576.0));
             db.WriteBatch(batch);
@@ -141,6 +180,103 @@ bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) {
     return ret;
 }
 
+void CCoinsViewDB::FinishFlush() {
+    bool ret = false;
+    try {
+        ret = WriteCoins(m_flushing, m_flushing_block);
+    } catch (const std::exception& e) {
+        LogPrintf("%s: %s\n", __func__, e.what());
+    }
+    if (!ret) {
+        LogPrintf("*** Failed to write to coin database in the background\n");
+    }
+    CCoinsMap written;
+    {
+        boost::unique_lock<boost::mutex> lock(m_flush_mutex);
+        // The database never received coins that failed to be written, so
+        // keep serving reads from them until shutdown.
+        if (ret) written.swap(m_flushing);
+        else m_flush_failed = true;
+        m_flush_pending = false;
+    }
+    m_flush_cond.notify_all();
+    // The written coins are freed here, without blocking readers.
+}
+
+void CCoinsViewDB::ThreadFlush() {
+    {
+        boost::unique_lock<boost::mutex> lock(m_flush_mutex);
+        m_background_flush = true;
+    }
+    try {
+        while (true) {
+            {
+                boost::unique_lock<boost::mutex> lock(m_flush_mutex);
+                while (!m_flush_pending) m_flush_cond.wait(lock);
+            }
+            FinishFlush();
+        }
+    } catch (const boost::thread_interrupted&) {
+        // Write whatever was handed over last; flushes from now on are
+        // synchronous again.
+        {
+            boost::unique_lock<boost::mutex> lock(m_flush_mutex);
+            m_background_flush = false;
+        }
+        if (m_flush_pending) FinishFlush();
+        throw;
+    }
+}
+
+bool CCoinsViewDB::WaitForFlush() const {
+    boost::this_thread::disable_interruption no_interrupt;
+    boost::unique_lock<boost::mutex> lock(m_flush_mutex);
+    while (m_flush_pending) m_flush_cond.wait(lock);
+    return !m_flush_failed;
+}
+
+bool CCoinsViewDB::WriteSnapshotBatch(const std::vector<std::pair<COutPoint, Coin>>& coins, const uint256 &hashBlock, bool final) {
+    CDBBatch batch(db);
+    assert(!hashBlock.IsNull());
+
+    batch.Erase(DB_BEST_BLOCK);
+    batch.Write(DB_HEAD_BLOCKS, std::vector<uint256>{hashBlock, uint256()});
+    for (const auto& entry : coins) {
+        batch.Write(CoinEntry(&entry.first), entry.second);
+    }
+    if (final) {
+        batch.Erase(DB_HEAD_BLOCKS);
+        batch.Write(DB_BEST_BLOCK, hashBlock);
+    }
+
+    LogPrint(BCLog::COINDB, "Writing snapshot batch of %u coins (%.2f MiB)\n", (unsigned int)coins.size(), batch.SizeEstimate() * (1.0 / 1048576.0));
+    return db.WriteBatch(batch, final);
+}
+
+bool CCoinsViewDB::EraseSnapshot() {
+    std::unique_ptr<CDBIterator> pcursor(db.NewIterator());
+    CDBBatch batch(db);
+    size_t batch_size = (size_t)gArgs.GetArg("-dbbatchsize", nDefaultDbBatchSize);
+    COutPoint outpoint;
+    CoinEntry entry(&outpoint);
+    for (pcursor->Seek(DB_COIN); pcursor->Valid(); pcursor->Next()) {
+        if (!pcursor->GetKey(entry) || entry.key != DB_COIN) {
+            break;
+        }
+        batch.Erase(entry);
+        if (batch.SizeEstimate() > batch_size) {
+            if (!db.WriteBatch(batch)) {
+                return false;
+            }
+            batch.Clear();
+        }
+    }
+    batch.Erase(DB_HEAD_BLOCKS);
+    batch.Erase(DB_BEST_BLOCK);
+    LogPrintf("Erased the coins of a UTXO snapshot that failed to load\n");
+    return db.WriteBatch(batch, true);
+}
+
 size_t CCoinsViewDB::EstimateSize() const
 {
     return db.EstimateSize(DB_COIN, (char)(DB_COIN+1));
@@ -170,10 +306,30 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
 
 CCoinsViewCursor *CCoinsViewDB::Cursor() const
 {
-    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(const_cast<CDBWrapper&>(db).NewIterator(), GetBestBlock());
     /* It seems that there are no "const iterators" for LevelDB.  Since we
        only need read operations on it, use a const-cast to get around
        that restriction.  */
+    std::unique_ptr<CDBIterator> pcursor;
+    {
+        // The cursor reads the database directly, so let a background flush
+        // finish first, and create it before another one can start.
+        boost::this_thread::disable_interruption no_interrupt;
+        boost::unique_lock<boost::mutex> lock(m_flush_mutex);
+        while (m_flush_pending) m_flush_cond.wait(lock);
+        pcursor.reset(const_cast<CDBWrapper&>(db).NewIterator());
+    }
+    // The iterator sees a snapshot of the database. Take the best block from
+    // that same snapshot, so that it matches the coins even if a write was
+    // under way; in the middle of one there is no best block, and a null
+    // hash is reported. The same goes for a database that is missing coins
+    // from a failed background flush.
+    uint256 hashBestChain;
+    char key;
+    pcursor->Seek(DB_BEST_BLOCK);
+    if (m_flush_failed || !pcursor->Valid() || !pcursor->GetKey(key) || key != DB_BEST_BLOCK || !pcursor->GetValue(hashBestChain)) {
+        hashBestChain.SetNull();
+    }
+    CCoinsViewDBCursor *i = new CCoinsViewDBCursor(pcursor.release(), hashBestChain);
     i->pcursor->Seek(DB_COIN);
     // Cache key of first record
     if (i->pcursor->Valid()) {
@@ -13,12 +13,16 @@
 #include <chain.h>
 #include <primitives/block.h>
 
+#include <atomic>
 #include <map>
 #include <memory>
 #include <string>
 #include <utility>
 #include <vector>
 
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
 class CBlockIndex;
 class CCoinsViewDBCursor;
 class uint256;
@@ -29,6 +33,8 @@ static constexpr int MAX_BLOCK_COINSDB_USAGE = 10;
 static const int64_t nDefaultDbCache = 450;
 //! -dbbatchsize default (bytes)
 static const int64_t nDefaultDbBatchSize = 16 << 20;
+//! -backgroundflush default
+static const bool DEFAULT_BACKGROUND_FLUSH = true;
 //! max. -dbcache (MiB)
 static const int64_t nMaxDbCache = sizeof(void*) > 4 ? 16384 : 1024;
 //! min. -dbcache (MiB)
@@ -47,6 +53,28 @@ class CCoinsViewDB final : public CCoinsView
 {
 protected:
     CDBWrapper db;
+
+    /**
+     * Background flushing. While ThreadFlush runs, BatchWrite hands the coins
+     * to it and returns right away. Until they are written, reads are served
+     * from m_flushing first, so the database appears to already contain them.
+     * If writing them fails they are kept there, and reads are served from
+     * them until shutdown, as the database never received them.
+     * The coins are written in -dbbatchsize chunks with the usual head blocks
+     * marker, so a crash in the middle of a flush is recovered by ReplayBlocks.
+     */
+    mutable boost::mutex m_flush_mutex;
+    mutable boost::condition_variable m_flush_cond;
+    bool m_background_flush = false;
+    std::atomic<bool> m_flush_pending{false};
+    std::atomic<bool> m_flush_failed{false};
+    //! Coins being written by ThreadFlush. Only modified with m_flush_mutex held and no flush in progress.
+    CCoinsMap m_flushing;
+    uint256 m_flushing_block;
+
+    bool WriteCoins(const CCoinsMap &mapCoins, const uint256 &hashBlock);
+    void FinishFlush();
+
 public:
     explicit CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
@@ -57,9 +85,27 @@ public:
     bool BatchWrite(CCoinsMap &mapCoins, const uint256 &hashBlock) override;
     CCoinsViewCursor *Cursor() const override;
 
+    /**
+     * Write coins loaded from a UTXO snapshot whose base block is hashBlock.
+     * Until the final batch is written the database is marked as being in
+     * transition to hashBlock, so an interrupted load is detected on restart.
+     */
+    bool WriteSnapshotBatch(const std::vector<std::pair<COutPoint, Coin>>& coins, const uint256 &hashBlock, bool final);
+    //! Erase the coins of a snapshot that failed to load, leaving an empty database again.
+    bool EraseSnapshot();
+
     //! Attempt to update from an older database format. Returns whether an error occurred.
     bool Upgrade();
     size_t EstimateSize() const override;
+
+    /** Write coins passed to BatchWrite in the background until interrupted. */
+    void ThreadFlush();
+    //! Whether a background flush is in progress
+    bool IsFlushing() const { return m_flush_pending; }
+    //! Whether a background flush failed; no further writes are accepted if so
+    bool FlushFailed() const { return m_flush_failed; }
+    //! Wait for a background flush in progress to finish. Returns false if it failed.
+    bool WaitForFlush() const;
 };
 
 /** Specialization of CCoinsViewCursor to iterate over a CCoinsViewDB */
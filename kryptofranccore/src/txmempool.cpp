@@ -18,6 +18,11 @@
 #include <util/moneystr.h>
 #include <util/time.h>
 
+#include <queue>
+
+/** Clusters up to this many transactions are linearized by ancestor set feerate, larger ones by individual feerate */
+static const size_t MAX_CLUSTER_LINEARIZE = 64;
+
 CTxMemPoolEntry::CTxMemPoolEntry(const CTransactionRef& _tx, const CAmount& _nFee,
                                  int64_t _nTime, unsigned int _entryHeight,
                                  bool _spendsCoinbase, int64_t _sigOpsCost, LockPoints lp)
@@ -58,39 +63,46 @@ size_t CTxMemPoolEntry::GetTxSize() const
 // descendants.
 void CTxMemPool::UpdateForDescendants(txiter updateIt, cacheMap &cachedDescendants, const std::set<uint256> &setExclude)
 {
-    setEntries stageEntries, setAllDescendants;
-    stageEntries = GetMemPoolChildren(updateIt);
+    EpochGuard epoch(*this);
+    vecEntries& stageEntries = m_walk_stage;
+    vecEntries allDescendants;
+    stageEntries.clear();
+    visited(updateIt);
+    for (txiter childEntry : GetMemPoolChildren(updateIt)) {
+        if (!visited(childEntry)) stageEntries.push_back(childEntry);
+    }
 
     while (!stageEntries.empty()) {
-        const txiter cit = *stageEntries.begin();
-        setAllDescendants.insert(cit);
-        stageEntries.erase(cit);
-        const setEntries &setChildren = GetMemPoolChildren(cit);
-        for (txiter childEntry : setChildren) {
+        const txiter cit = stageEntries.back();
+        stageEntries.pop_back();
+        allDescendants.push_back(cit);
+        const vecEntries &children = GetMemPoolChildren(cit);
+        for (txiter childEntry : children) {
             cacheMap::iterator cacheIt = cachedDescendants.find(childEntry);
             if (cacheIt != cachedDescendants.end()) {
                 // We've already calculated this one, just add the entries for this set
                 // but don't traverse again.
                 for (txiter cacheEntry : cacheIt->second) {
-                    setAllDescendants.insert(cacheEntry);
+                    if (!visited(cacheEntry)) allDescendants.push_back(cacheEntry);
                 }
-            } else if (!setAllDescendants.count(childEntry)) {
+            } else if (!visited(childEntry)) {
                 // Schedule for later processing
-                stageEntries.insert(childEntry);
+                stageEntries.push_back(childEntry);
             }
         }
     }
-    // setAllDescendants now contains all in-mempool descendants of updateIt.
+    // allDescendants now contains all in-mempool descendants of updateIt.
     // Update and add to cached descendant map
     int64_t modifySize = 0;
     CAmount modifyFee = 0;
     int64_t modifyCount = 0;
-    for (txiter cit : setAllDescendants) {
+    vecEntries& cached = cachedDescendants[updateIt];
+    for (txiter cit : allDescendants) {
         if (!setExclude.count(cit->GetTx().GetHash())) {
             modifySize += cit->GetTxSize();
             modifyFee += cit->GetModifiedFee();
             modifyCount++;
-            cachedDescendants[updateIt].insert(cit);
+            cached.push_back(cit);
             // Update ancestor state for each descendant
             mapTx.modify(cit, update_ancestor_state(updateIt->GetTxSize(), updateIt->GetModifiedFee(), 1, updateIt->GetSigOpCost()));
         }
@@ -144,11 +156,26 @@ void CTxMemPool::UpdateTransactionsFromBlock(const std::vector<uint256> &vHashes
         }
         UpdateForDescendants(it, mapMemPoolDescendantsToUpdate, setAlreadyIncluded);
     }
+
+    // The links found above may have joined the transactions' clusters to
+    // others. Linearize each cluster they are in once.
+    std::set<uint64_t> setLinearized;
+    for (const uint256 &hash : vHashesToUpdate) {
+        txiter it = mapTx.find(hash);
+        if (it == mapTx.end() || setLinearized.count(it->m_cluster)) continue;
+        LinearizeCluster(it);
+        setLinearized.insert(it->m_cluster);
+    }
 }
 
 bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntries &setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string &errString, bool fSearchForParents /* = true */) const
 {
-    setEntries parentHashes;
+    EpochGuard epoch(*this);
+    vecEntries& parentHashes = m_walk_stage;
+    parentHashes.clear();
+    for (txiter ancestorIt : setAncestors) {
+        visited(ancestorIt);
+    }
     const CTransaction &tx = entry.GetTx();
 
     if (fSearchForParents) {
@@ -157,8 +184,8 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         // iterate mapTx to find parents.
         for (unsigned int i = 0; i < tx.vin.size(); i++) {
             boost::optional<txiter> piter = GetIter(tx.vin[i].prevout.hash);
-            if (piter) {
-                parentHashes.insert(*piter);
+            if (piter && !visited(*piter)) {
+                parentHashes.push_back(*piter);
                 if (parentHashes.size() + 1 > limitAncestorCount) {
                     errString = strprintf("too many unconfirmed parents [limit: %u]", limitAncestorCount);
                     return false;
@@ -169,16 +196,18 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
         // If we're not searching for parents, we require this to be an
         // entry in the mempool already.
         txiter it = mapTx.iterator_to(entry);
-        parentHashes = GetMemPoolParents(it);
+        for (txiter piter : GetMemPoolParents(it)) {
+            if (!visited(piter)) parentHashes.push_back(piter);
+        }
     }
 
     size_t totalSizeWithAncestors = entry.GetTxSize();
 
     while (!parentHashes.empty()) {
-        txiter stageit = *parentHashes.begin();
+        txiter stageit = parentHashes.back();
 
         setAncestors.insert(stageit);
-        parentHashes.erase(stageit);
+        parentHashes.pop_back();
         totalSizeWithAncestors += stageit->GetTxSize();
 
         if (stageit->GetSizeWithDescendants() + entry.GetTxSize() > limitDescendantSize) {
@@ -192,11 +221,11 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
             return false;
         }
 
-        const setEntries & setMemPoolParents = GetMemPoolParents(stageit);
+        const vecEntries & setMemPoolParents = GetMemPoolParents(stageit);
         for (txiter phash : setMemPoolParents) {
             // If this is a new ancestor, add it.
-            if (setAncestors.count(phash) == 0) {
-                parentHashes.insert(phash);
+            if (!visited(phash)) {
+                parentHashes.push_back(phash);
             }
             if (parentHashes.size() + setAncestors.size() + 1 > limitAncestorCount) {
                 errString = strprintf("too many unconfirmed ancestors [limit: %u]", limitAncestorCount);
@@ -208,17 +237,47 @@ bool CTxMemPool::CalculateMemPoolAncestors(const CTxMemPoolEntry &entry, setEntr
     return true;
 }
 
-void CTxMemPool::UpdateAncestorsOf(bool add, txiter it, setEntries &setAncestors)
+void CTxMemPool::WalkAncestors(txiter it, vecEntries& ancestors) const
+{
+    EpochGuard epoch(*this);
+    ancestors.clear();
+    visited(it);
+    for (txiter parent : GetMemPoolParents(it)) {
+        if (!visited(parent)) ancestors.push_back(parent);
+    }
+    // ancestors doubles as the queue of entries whose parents are still to be visited
+    for (size_t i = 0; i < ancestors.size(); i++) {
+        for (txiter parent : GetMemPoolParents(ancestors[i])) {
+            if (!visited(parent)) ancestors.push_back(parent);
+        }
+    }
+}
+
+void CTxMemPool::WalkDescendants(txiter it, vecEntries& descendants) const
+{
+    EpochGuard epoch(*this);
+    descendants.clear();
+    visited(it);
+    for (txiter child : GetMemPoolChildren(it)) {
+        if (!visited(child)) descendants.push_back(child);
+    }
+    for (size_t i = 0; i < descendants.size(); i++) {
+        for (txiter child : GetMemPoolChildren(descendants[i])) {
+            if (!visited(child)) descendants.push_back(child);
+        }
+    }
+}
+
+void CTxMemPool::UpdateAncestorsOf(bool add, txiter it, const vecEntries &ancestors)
 {
-    setEntries parentIters = GetMemPoolParents(it);
     // add or remove this tx as a child of each parent
-    for (txiter piter : parentIters) {
+    for (txiter piter : GetMemPoolParents(it)) {
         UpdateChild(piter, it, add);
     }
     const int64_t updateCount = (add ? 1 : -1);
     const int64_t updateSize = updateCount * it->GetTxSize();
     const CAmount updateFee = updateCount * it->GetModifiedFee();
-    for (txiter ancestorIt : setAncestors) {
+    for (txiter ancestorIt : ancestors) {
         mapTx.modify(ancestorIt, update_descendant_state(updateSize, updateFee, updateCount));
     }
 }
@@ -239,7 +298,7 @@ void CTxMemPool::UpdateEntryForAncestors(txiter it, const setEntries &setAncesto
 
 void CTxMemPool::UpdateChildrenForRemoval(txiter it)
 {
-    const setEntries &setMemPoolChildren = GetMemPoolChildren(it);
+    const vecEntries &setMemPoolChildren = GetMemPoolChildren(it);
     for (txiter updateIt : setMemPoolChildren) {
         UpdateParent(updateIt, it, false);
     }
@@ -249,51 +308,46 @@ void CTxMemPool::UpdateForRemoveFromMempool(const setEntries &entriesToRemove, b
 {
     // For each entry, walk back all ancestors and decrement size associated with this
     // transaction
-    const uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
+    vecEntries walk;
     if (updateDescendants) {
         // updateDescendants should be true whenever we're not recursively
         // removing a tx and all its descendants, eg when a transaction is
         // confirmed in a block.
-        // Here we only update statistics and not data in mapLinks (which
+        // Here we only update statistics and not data in vTxLinks (which
         // we need to preserve until we're finished with all operations that
         // need to traverse the mempool).
         for (txiter removeIt : entriesToRemove) {
-            setEntries setDescendants;
-            CalculateDescendants(removeIt, setDescendants);
-            setDescendants.erase(removeIt); // don't update state for self
+            WalkDescendants(removeIt, walk); // doesn't include self
             int64_t modifySize = -((int64_t)removeIt->GetTxSize());
             CAmount modifyFee = -removeIt->GetModifiedFee();
             int modifySigOps = -removeIt->GetSigOpCost();
-            for (txiter dit : setDescendants) {
+            for (txiter dit : walk) {
                 mapTx.modify(dit, update_ancestor_state(modifySize, modifyFee, -1, modifySigOps));
             }
         }
     }
     for (txiter removeIt : entriesToRemove) {
-        setEntries setAncestors;
-        const CTxMemPoolEntry &entry = *removeIt;
-        std::string dummy;
-        // Since this is a tx that is already in the mempool, we can call CMPA
-        // with fSearchForParents = false.  If the mempool is in a consistent
-        // state, then using true or false should both be correct, though false
-        // should be a bit faster.
+        // Since this is a tx that is already in the mempool, we can walk its
+        // ancestors through the links rather than searching its inputs.  If
+        // the mempool is in a consistent state, then both should give the
+        // same result, though walking the links is a bit faster.
         // However, if we happen to be in the middle of processing a reorg, then
         // the mempool can be in an inconsistent state.  In this case, the set
-        // of ancestors reachable via mapLinks will be the same as the set of
+        // of ancestors reachable via vTxLinks will be the same as the set of
         // ancestors whose packages include this transaction, because when we
         // add a new transaction to the mempool in addUnchecked(), we assume it
         // has no children, and in the case of a reorg where that assumption is
         // false, the in-mempool children aren't linked to the in-block tx's
         // until UpdateTransactionsFromBlock() is called.
         // So if we're being called during a reorg, ie before
-        // UpdateTransactionsFromBlock() has been called, then mapLinks[] will
+        // UpdateTransactionsFromBlock() has been called, then vTxLinks will
         // differ from the set of mempool parents we'd calculate by searching,
-        // and it's important that we use the mapLinks[] notion of ancestor
+        // and it's important that we use the vTxLinks notion of ancestor
         // transactions as the set of things to update for removal.
-        CalculateMemPoolAncestors(entry, setAncestors, nNoLimit, nNoLimit, nNoLimit, nNoLimit, dummy, false);
+        WalkAncestors(removeIt, walk);
         // Note that UpdateAncestorsOf severs the child links that point to
         // removeIt in the entries for the parents of removeIt.
-        UpdateAncestorsOf(false, removeIt, setAncestors);
+        UpdateAncestorsOf(false, removeIt, walk);
     }
     // After updating all the ancestor sizes, we can now sever the link between each
     // transaction being removed and any mempool children (ie, update setMemPoolParents
@@ -323,6 +377,20 @@ void CTxMemPoolEntry::UpdateAncestorState(int64_t modifySize, CAmount modifyFee,
     assert(int(nSigOpCostWithAncestors) >= 0);
 }
 
+CTxMemPool::EpochGuard::EpochGuard(const CTxMemPool& pool) : m_pool(pool)
+{
+    assert(!m_pool.m_has_epoch_guard);
+    ++m_pool.m_epoch;
+    m_pool.m_has_epoch_guard = true;
+}
+
+CTxMemPool::EpochGuard::~EpochGuard()
+{
+    // Entries visited in this epoch are now behind the current one
+    ++m_pool.m_epoch;
+    m_pool.m_has_epoch_guard = false;
+}
+
 CTxMemPool::CTxMemPool(CBlockPolicyEstimator* estimator) :
     nTransactionsUpdated(0), minerPolicyEstimator(estimator)
 {
@@ -352,14 +420,15 @@ void CTxMemPool::AddTransactionsUpdated(unsigned int n)
     nTransactionsUpdated += n;
 }
 
-void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAncestors, bool validFeeEstimate)
+void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAncestors, bool validFeeEstimate, bool fTentative)
 {
-    NotifyEntryAdded(entry.GetSharedTx());
     // Add to memory pool without checking anything.
     // Used by AcceptToMemoryPool(), which DOES do
     // all the appropriate checks.
     indexed_transaction_set::iterator newit = mapTx.insert(entry).first;
-    mapLinks.insert(make_pair(newit, TxLinks()));
+    vTxHashes.emplace_back(newit->GetTx().GetWitnessHash(), newit);
+    vTxLinks.emplace_back();
+    newit->vTxHashesIdx = vTxHashes.size() - 1;
 
     // Update transaction for any feeDelta created by PrioritiseTransaction
     // TODO: refactor so that the fee delta is calculated before inserting
@@ -376,10 +445,8 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAnces
     cachedInnerUsage += entry.DynamicMemoryUsage();
 
     const CTransaction& tx = newit->GetTx();
-    std::set<uint256> setParentTransactions;
     for (unsigned int i = 0; i < tx.vin.size(); i++) {
         mapNextTx.insert(std::make_pair(&tx.vin[i].prevout, &tx));
-        setParentTransactions.insert(tx.vin[i].prevout.hash);
     }
     // Don't bother worrying about child transactions of this one.
     // Normal case of a new transaction arriving is that there can't be any
@@ -389,40 +456,62 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, setEntries &setAnces
     // to clean up the mess we're leaving here.
 
     // Update ancestors with information about this tx
-    for (const auto& pit : GetIterSet(setParentTransactions)) {
-            UpdateParent(newit, pit, true);
+    for (const CTxIn& txin : tx.vin) {
+        boost::optional<txiter> pit = GetIter(txin.prevout.hash);
+        if (pit) UpdateParent(newit, *pit, true);
     }
-    UpdateAncestorsOf(true, newit, setAncestors);
+    UpdateAncestorsOf(true, newit, vecEntries(setAncestors.begin(), setAncestors.end()));
     UpdateEntryForAncestors(newit, setAncestors);
+    // Join the clusters of the parents, if any
+    newit->m_cluster = 0;
+    LinearizeCluster(newit);
 
     nTransactionsUpdated++;
     totalTxSize += entry.GetTxSize();
     if (minerPolicyEstimator) {minerPolicyEstimator->processTransaction(entry, validFeeEstimate);}
 
-    vTxHashes.emplace_back(tx.GetWitnessHash(), newit);
-    newit->vTxHashesIdx = vTxHashes.size() - 1;
+    // Notify once the entry and its links are in place, so that listeners can
+    // look it up.
+    if (fTentative) {
+        setTentative.insert(newit->GetTx().GetHash());
+    } else {
+        NotifyEntryAdded(entry.GetSharedTx());
+    }
+}
+
+void CTxMemPool::ConfirmTentative(txiter it)
+{
+    if (setTentative.erase(it->GetTx().GetHash())) {
+        NotifyEntryAdded(it->GetSharedTx());
+    }
 }
 
 void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 {
-    NotifyEntryRemoved(it->GetSharedTx(), reason);
     const uint256 hash = it->GetTx().GetHash();
+    // Nobody was told about a tentative entry
+    if (!setTentative.erase(hash)) {
+        NotifyEntryRemoved(it->GetSharedTx(), reason);
+    }
     for (const CTxIn& txin : it->GetTx().vin)
         mapNextTx.erase(txin.prevout);
 
-    if (vTxHashes.size() > 1) {
-        vTxHashes[it->vTxHashesIdx] = std::move(vTxHashes.back());
-        vTxHashes[it->vTxHashesIdx].second->vTxHashesIdx = it->vTxHashesIdx;
-        vTxHashes.pop_back();
-        if (vTxHashes.size() * 2 < vTxHashes.capacity())
-            vTxHashes.shrink_to_fit();
-    } else
-        vTxHashes.clear();
+    const size_t idx = it->vTxHashesIdx;
+    cachedInnerUsage -= memusage::DynamicUsage(vTxLinks[idx].parents) + memusage::DynamicUsage(vTxLinks[idx].children);
+    if (idx + 1 < vTxHashes.size()) {
+        vTxHashes[idx] = std::move(vTxHashes.back());
+        vTxLinks[idx] = std::move(vTxLinks.back());
+        vTxHashes[idx].second->vTxHashesIdx = idx;
+    }
+    vTxHashes.pop_back();
+    vTxLinks.pop_back();
+    if (vTxHashes.size() * 2 < vTxHashes.capacity()) {
+        vTxHashes.shrink_to_fit();
+        vTxLinks.shrink_to_fit();
+    }
 
     totalTxSize -= it->GetTxSize();
     cachedInnerUsage -= it->DynamicMemoryUsage();
-    cachedInnerUsage -= memusage::DynamicUsage(mapLinks[it].parents) + memusage::DynamicUsage(mapLinks[it].children);
-    mapLinks.erase(it);
     mapTx.erase(it);
     nTransactionsUpdated++;
     if (minerPolicyEstimator) {minerPolicyEstimator->removeTx(hash, false);}
@@ -436,22 +525,24 @@ void CTxMemPool::removeUnchecked(txiter it, MemPoolRemovalReason reason)
 // can save time by not iterating over those entries.
 void CTxMemPool::CalculateDescendants(txiter entryit, setEntries& setDescendants) const
 {
-    setEntries stage;
-    if (setDescendants.count(entryit) == 0) {
-        stage.insert(entryit);
-    }
+    if (setDescendants.count(entryit)) return;
+    EpochGuard epoch(*this);
+    vecEntries& stage = m_walk_stage;
+    stage.clear();
+    visited(entryit);
+    stage.push_back(entryit);
     // Traverse down the children of entry, only adding children that are not
     // accounted for in setDescendants already (because those children have either
     // already been walked, or will be walked in this iteration).
     while (!stage.empty()) {
-        txiter it = *stage.begin();
+        txiter it = stage.back();
         setDescendants.insert(it);
-        stage.erase(it);
+        stage.pop_back();
 
-        const setEntries &setChildren = GetMemPoolChildren(it);
+        const vecEntries &setChildren = GetMemPoolChildren(it);
         for (txiter childiter : setChildren) {
-            if (!setDescendants.count(childiter)) {
-                stage.insert(childiter);
+            if (!visited(childiter) && !setDescendants.count(childiter)) {
+                stage.push_back(childiter);
             }
         }
     }
@@ -550,24 +641,24 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
 {
     LOCK(cs);
     std::vector<const CTxMemPoolEntry*> entries;
+    setEntries stage;
     for (const auto& tx : vtx)
     {
         uint256 hash = tx->GetHash();
 
         indexed_transaction_set::iterator i = mapTx.find(hash);
-        if (i != mapTx.end())
+        if (i != mapTx.end()) {
             entries.push_back(&*i);
+            stage.insert(i);
+        }
     }
     // Before the txs in the new block have been removed from the mempool, update policy estimates
     if (minerPolicyEstimator) {minerPolicyEstimator->processBlock(nBlockHeight, entries);}
+    // Remove them all at once, so that each cluster they leave is linearized
+    // again once rather than once per transaction.
+    RemoveStaged(stage, true, MemPoolRemovalReason::BLOCK);
     for (const auto& tx : vtx)
     {
-        txiter it = mapTx.find(tx->GetHash());
-        if (it != mapTx.end()) {
-            setEntries stage;
-            stage.insert(it);
-            RemoveStaged(stage, true, MemPoolRemovalReason::BLOCK);
-        }
         removeConflicts(*tx);
         ClearPrioritisation(tx->GetHash());
     }
@@ -577,7 +668,10 @@ void CTxMemPool::removeForBlock(const std::vector<CTransactionRef>& vtx, unsigne
 
 void CTxMemPool::_clear()
 {
-    mapLinks.clear();
+    vTxHashes.clear();
+    vTxLinks.clear();
+    setChunks.clear();
+    mapClusters.clear();
     mapTx.clear();
     mapNextTx.clear();
     totalTxSize = 0;
@@ -626,9 +720,8 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         checkTotal += it->GetTxSize();
         innerUsage += it->DynamicMemoryUsage();
         const CTransaction& tx = it->GetTx();
-        txlinksMap::const_iterator linksiter = mapLinks.find(it);
-        assert(linksiter != mapLinks.end());
-        const TxLinks &links = linksiter->second;
+        assert(it->vTxHashesIdx < vTxHashes.size() && vTxHashes[it->vTxHashesIdx].second == it);
+        const TxLinks &links = vTxLinks[it->vTxHashesIdx];
         innerUsage += memusage::DynamicUsage(links.parents) + memusage::DynamicUsage(links.children);
         bool fDependsWait = false;
         setEntries setParentCheck;
@@ -650,7 +743,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
             assert(it3->second == &tx);
             i++;
         }
-        assert(setParentCheck == GetMemPoolParents(it));
+        assert(vecEntries(setParentCheck.begin(), setParentCheck.end()) == GetMemPoolParents(it));
         // Verify ancestor state is correct.
         setEntries setAncestors;
         uint64_t nNoLimit = std::numeric_limits<uint64_t>::max();
@@ -683,7 +776,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
                 child_sizes += childit->GetTxSize();
             }
         }
-        assert(setChildrenCheck == GetMemPoolChildren(it));
+        assert(vecEntries(setChildrenCheck.begin(), setChildrenCheck.end()) == GetMemPoolChildren(it));
         // Also check to make sure size is greater than sum with immediate children.
         // just a sanity check, not definitive that this calc is correct...
         assert(it->GetSizeWithDescendants() >= child_sizes + it->GetTxSize());
@@ -715,6 +808,32 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
         assert(&tx == it->second);
     }
 
+    // Every entry is in one cluster, after its parents, and every chunk of
+    // a cluster is indexed.
+    size_t nClusterTxs = 0;
+    size_t nChunks = 0;
+    for (const auto& cluster : mapClusters) {
+        for (size_t pos = 0; pos < cluster.second.txs.size(); pos++) {
+            txiter it = cluster.second.txs[pos];
+            assert(it->m_cluster == cluster.first && it->m_cluster_pos == pos);
+            for (txiter parent : GetMemPoolParents(it)) {
+                assert(parent->m_cluster == cluster.first && parent->m_cluster_pos < pos);
+            }
+        }
+        size_t chunkBegin = 0;
+        for (const Chunk& chunk : cluster.second.chunks) {
+            assert(chunk.cluster == cluster.first && chunk.begin == chunkBegin && chunk.end > chunk.begin);
+            assert(setChunks.count(chunk));
+            chunkBegin = chunk.end;
+        }
+        assert(chunkBegin == cluster.second.txs.size());
+        nClusterTxs += cluster.second.txs.size();
+        nChunks += cluster.second.chunks.size();
+        innerUsage += memusage::DynamicUsage(cluster.second.txs) + memusage::DynamicUsage(cluster.second.chunks);
+    }
+    assert(nClusterTxs == mapTx.size());
+    assert(nChunks == setChunks.size());
+
     assert(totalTxSize == checkTotal);
     assert(innerUsage == cachedInnerUsage);
 }
@@ -837,7 +956,9 @@ void CTxMemPool::PrioritiseTransaction(const uint256& hash, const CAmount& nFeeD
             for (txiter descendantIt : setDescendants) {
                 mapTx.modify(descendantIt, update_ancestor_state(0, nFeeDelta, 0, 0));
             }
+            LinearizeCluster(it);
             ++nTransactionsUpdated;
+            NotifyEntryPrioritised(it->GetSharedTx());
         }
     }
     LogPrintf("PrioritiseTransaction: %s feerate += %s\n", hash.ToString(), FormatMoney(nFeeDelta));
@@ -911,15 +1032,29 @@ bool CCoinsViewMemPool::GetCoin(const COutPoint &outpoint, Coin &coin) const {
 size_t CTxMemPool::DynamicMemoryUsage() const {
     LOCK(cs);
     // Estimate the overhead of mapTx to be 12 pointers + an allocation, as no exact formula for boost::multi_index_contained is implemented.
-    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(mapLinks) + memusage::DynamicUsage(vTxHashes) + cachedInnerUsage;
+    return memusage::MallocUsage(sizeof(CTxMemPoolEntry) + 12 * sizeof(void*)) * mapTx.size() + memusage::DynamicUsage(mapNextTx) + memusage::DynamicUsage(mapDeltas) + memusage::DynamicUsage(vTxHashes) + memusage::DynamicUsage(vTxLinks) + memusage::DynamicUsage(setChunks) + memusage::DynamicUsage(mapClusters) + cachedInnerUsage;
 }
 
 void CTxMemPool::RemoveStaged(setEntries &stage, bool updateDescendants, MemPoolRemovalReason reason) {
     AssertLockHeld(cs);
+    // Take the clusters of the removed entries apart. What is left of them
+    // may have split up, and is linearized again once the links are updated.
+    vecEntries remaining;
+    for (txiter it : stage) {
+        auto cluster = mapClusters.find(it->m_cluster);
+        if (cluster == mapClusters.end()) continue;
+        for (txiter clusterit : cluster->second.txs) {
+            if (!stage.count(clusterit)) remaining.push_back(clusterit);
+        }
+        RemoveCluster(it->m_cluster);
+    }
     UpdateForRemoveFromMempool(stage, updateDescendants);
     for (txiter it : stage) {
         removeUnchecked(it, reason);
     }
+    for (txiter it : remaining) {
+        if (it->m_cluster == 0) LinearizeCluster(it);
+    }
 }
 
 int CTxMemPool::Expire(int64_t time) {
@@ -947,40 +1082,199 @@ void CTxMemPool::addUnchecked(const CTxMemPoolEntry &entry, bool validFeeEstimat
     return addUnchecked(entry, setAncestors, validFeeEstimate);
 }
 
-void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add)
+// Add it to or remove it from links, which are sorted by txid
+static void UpdateLinks(CTxMemPool::vecEntries& links, CTxMemPool::txiter it, bool add)
 {
-    setEntries s;
-    if (add && mapLinks[entry].children.insert(child).second) {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && mapLinks[entry].children.erase(child)) {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
+    auto pos = std::lower_bound(links.begin(), links.end(), it, CTxMemPool::CompareIteratorByHash());
+    const bool found = pos != links.end() && *pos == it;
+    if (add && !found) {
+        links.insert(pos, it);
+    } else if (!add && found) {
+        links.erase(pos);
     }
 }
 
+void CTxMemPool::UpdateChild(txiter entry, txiter child, bool add)
+{
+    vecEntries& children = vTxLinks[entry->vTxHashesIdx].children;
+    cachedInnerUsage -= memusage::DynamicUsage(children);
+    UpdateLinks(children, child, add);
+    cachedInnerUsage += memusage::DynamicUsage(children);
+}
+
 void CTxMemPool::UpdateParent(txiter entry, txiter parent, bool add)
 {
-    setEntries s;
-    if (add && mapLinks[entry].parents.insert(parent).second) {
-        cachedInnerUsage += memusage::IncrementalDynamicUsage(s);
-    } else if (!add && mapLinks[entry].parents.erase(parent)) {
-        cachedInnerUsage -= memusage::IncrementalDynamicUsage(s);
-    }
+    vecEntries& parents = vTxLinks[entry->vTxHashesIdx].parents;
+    cachedInnerUsage -= memusage::DynamicUsage(parents);
+    UpdateLinks(parents, parent, add);
+    cachedInnerUsage += memusage::DynamicUsage(parents);
 }
 
-const CTxMemPool::setEntries & CTxMemPool::GetMemPoolParents(txiter entry) const
+const CTxMemPool::vecEntries & CTxMemPool::GetMemPoolParents(txiter entry) const
 {
     assert (entry != mapTx.end());
-    txlinksMap::const_iterator it = mapLinks.find(entry);
-    assert(it != mapLinks.end());
-    return it->second.parents;
+    assert(entry->vTxHashesIdx < vTxLinks.size());
+    return vTxLinks[entry->vTxHashesIdx].parents;
 }
 
-const CTxMemPool::setEntries & CTxMemPool::GetMemPoolChildren(txiter entry) const
+const CTxMemPool::vecEntries & CTxMemPool::GetMemPoolChildren(txiter entry) const
 {
     assert (entry != mapTx.end());
-    txlinksMap::const_iterator it = mapLinks.find(entry);
-    assert(it != mapLinks.end());
-    return it->second.children;
+    assert(entry->vTxHashesIdx < vTxLinks.size());
+    return vTxLinks[entry->vTxHashesIdx].children;
+}
+
+const CTxMemPool::vecEntries & CTxMemPool::GetClusterTxs(uint64_t cluster) const
+{
+    auto it = mapClusters.find(cluster);
+    assert(it != mapClusters.end());
+    return it->second.txs;
+}
+
+size_t CTxMemPool::CountClusterTxs(const setEntries& entries) const
+{
+    std::set<uint64_t> clusters;
+    size_t count = 0;
+    for (txiter it : entries) {
+        if (clusters.insert(it->m_cluster).second) {
+            count += GetClusterTxs(it->m_cluster).size();
+        }
+    }
+    return count;
+}
+
+void CTxMemPool::RemoveCluster(uint64_t cluster)
+{
+    auto it = mapClusters.find(cluster);
+    if (it == mapClusters.end()) return;
+    for (const Chunk& chunk : it->second.chunks) {
+        setChunks.erase(chunk);
+    }
+    for (txiter entry : it->second.txs) {
+        entry->m_cluster = 0;
+    }
+    cachedInnerUsage -= memusage::DynamicUsage(it->second.txs) + memusage::DynamicUsage(it->second.chunks);
+    mapClusters.erase(it);
+}
+
+void CTxMemPool::LinearizeCluster(txiter start)
+{
+    // Collect everything connected to start
+    vecEntries txs;
+    {
+        EpochGuard epoch(*this);
+        visited(start);
+        txs.push_back(start);
+        for (size_t i = 0; i < txs.size(); i++) {
+            for (txiter parent : GetMemPoolParents(txs[i])) {
+                if (!visited(parent)) txs.push_back(parent);
+            }
+            for (txiter child : GetMemPoolChildren(txs[i])) {
+                if (!visited(child)) txs.push_back(child);
+            }
+        }
+    }
+    for (txiter it : txs) {
+        if (it->m_cluster != 0) RemoveCluster(it->m_cluster);
+    }
+    const size_t n = txs.size();
+
+    // Put the transactions in an order that has parents first, taking the
+    // best individual feerate among those whose parents are placed.
+    std::vector<size_t> vMissingParents(n);
+    auto worse = [&txs](size_t a, size_t b) {
+        return (double)txs[a]->GetModifiedFee() * txs[b]->GetTxSize() < (double)txs[b]->GetModifiedFee() * txs[a]->GetTxSize();
+    };
+    std::priority_queue<size_t, std::vector<size_t>, decltype(worse)> ready(worse);
+    for (size_t i = 0; i < n; i++) {
+        txs[i]->m_cluster_pos = i;
+        vMissingParents[i] = GetMemPoolParents(txs[i]).size();
+        if (vMissingParents[i] == 0) ready.push(i);
+    }
+    vecEntries order;
+    order.reserve(n);
+    while (!ready.empty()) {
+        const size_t i = ready.top();
+        ready.pop();
+        order.push_back(txs[i]);
+        for (txiter child : GetMemPoolChildren(txs[i])) {
+            if (--vMissingParents[child->m_cluster_pos] == 0) ready.push(child->m_cluster_pos);
+        }
+    }
+    assert(order.size() == n);
+
+    if (n <= MAX_CLUSTER_LINEARIZE) {
+        // Repeatedly take the transaction whose ancestors not taken yet have
+        // the best feerate, along with those ancestors. Ancestor sets are
+        // bitmasks over the order above, so a set comes out in that order.
+        std::vector<uint64_t> vAncestors(n);
+        std::vector<CAmount> vAncestorFees(n, 0);
+        std::vector<int64_t> vAncestorSizes(n, 0);
+        for (size_t i = 0; i < n; i++) {
+            order[i]->m_cluster_pos = i;
+            vAncestors[i] = uint64_t{1} << i;
+            for (txiter parent : GetMemPoolParents(order[i])) {
+                vAncestors[i] |= vAncestors[parent->m_cluster_pos];
+            }
+            for (size_t j = 0; j <= i; j++) {
+                if (vAncestors[i] >> j & 1) {
+                    vAncestorFees[i] += order[j]->GetModifiedFee();
+                    vAncestorSizes[i] += order[j]->GetTxSize();
+                }
+            }
+        }
+        uint64_t remaining = n == 64 ? ~uint64_t{0} : (uint64_t{1} << n) - 1;
+        vecEntries linearization;
+        linearization.reserve(n);
+        while (remaining) {
+            size_t best = n;
+            for (size_t i = 0; i < n; i++) {
+                if (!(remaining >> i & 1)) continue;
+                if (best == n || (double)vAncestorFees[i] * vAncestorSizes[best] > (double)vAncestorFees[best] * vAncestorSizes[i]) {
+                    best = i;
+                }
+            }
+            const uint64_t taken = vAncestors[best] & remaining;
+            remaining &= ~taken;
+            for (size_t j = 0; j < n; j++) {
+                if (!(taken >> j & 1)) continue;
+                linearization.push_back(order[j]);
+                for (size_t i = 0; i < n; i++) {
+                    if ((remaining >> i & 1) && (vAncestors[i] >> j & 1)) {
+                        vAncestorFees[i] -= order[j]->GetModifiedFee();
+                        vAncestorSizes[i] -= order[j]->GetTxSize();
+                    }
+                }
+            }
+        }
+        order = std::move(linearization);
+    }
+
+    // Cut the linearization into chunks: a transaction joins the chunk before
+    // it as long as that raises the chunk's feerate.
+    const uint64_t id = ++nClusterSequence;
+    Cluster& cluster = mapClusters[id];
+    cluster.txs = std::move(order);
+    for (size_t i = 0; i < n; i++) {
+        txiter it = cluster.txs[i];
+        it->m_cluster = id;
+        it->m_cluster_pos = i;
+        cluster.chunks.push_back(Chunk{id, i, i + 1, it->GetModifiedFee(), (int64_t)it->GetTxSize(), it->GetSigOpCost()});
+        while (cluster.chunks.size() > 1) {
+            Chunk& last = cluster.chunks.back();
+            Chunk& prev = cluster.chunks[cluster.chunks.size() - 2];
+            if ((double)last.fee * prev.size <= (double)prev.fee * last.size) break;
+            prev.end = last.end;
+            prev.fee += last.fee;
+            prev.size += last.size;
+            prev.sigOpCost += last.sigOpCost;
+            cluster.chunks.pop_back();
+        }
+    }
+    for (const Chunk& chunk : cluster.chunks) {
+        setChunks.insert(chunk);
+    }
+    cachedInnerUsage += memusage::DynamicUsage(cluster.txs) + memusage::DynamicUsage(cluster.chunks);
 }
 
 CFeeRate CTxMemPool::GetMinFee(size_t sizelimit) const {
@@ -1020,20 +1314,22 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpends
 
     unsigned nTxnRemoved = 0;
     CFeeRate maxFeeRateRemoved(0);
-    while (!mapTx.empty() && DynamicMemoryUsage() > sizelimit) {
-        indexed_transaction_set::index<descendant_score>::type::iterator it = mapTx.get<descendant_score>().begin();
+    while (!setChunks.empty() && DynamicMemoryUsage() > sizelimit) {
+        // The worst chunk is the last one of its cluster, so nothing else in
+        // the mempool depends on it.
+        const Chunk& chunk = *setChunks.rbegin();
 
         // We set the new mempool min fee to the feerate of the removed set, plus the
         // "minimum reasonable fee rate" (ie some value under which we consider txn
         // to have 0 fee). This way, we don't allow txn to enter mempool with feerate
         // equal to txn which were removed with no block in between.
-        CFeeRate removed(it->GetModFeesWithDescendants(), it->GetSizeWithDescendants());
+        CFeeRate removed(chunk.fee, chunk.size);
         removed += incrementalRelayFee;
         trackPackageRemoved(removed);
         maxFeeRateRemoved = std::max(maxFeeRateRemoved, removed);
 
-        setEntries stage;
-        CalculateDescendants(mapTx.project<0>(it), stage);
+        const vecEntries& clusterTxs = GetClusterTxs(chunk.cluster);
+        setEntries stage(clusterTxs.begin() + chunk.begin, clusterTxs.begin() + chunk.end);
         nTxnRemoved += stage.size();
 
         std::vector<CTransaction> txn;
@@ -1060,15 +1356,16 @@ void CTxMemPool::TrimToSize(size_t sizelimit, std::vector<COutPoint>* pvNoSpends
 
 uint64_t CTxMemPool::CalculateDescendantMaximum(txiter entry) const {
     // find parent with highest descendant count
-    std::vector<txiter> candidates;
-    setEntries counted;
+    EpochGuard epoch(*this);
+    vecEntries& candidates = m_walk_stage;
+    candidates.clear();
     candidates.push_back(entry);
     uint64_t maximum = 0;
     while (candidates.size()) {
         txiter candidate = candidates.back();
         candidates.pop_back();
-        if (!counted.insert(candidate).second) continue;
-        const setEntries& parents = GetMemPoolParents(candidate);
+        if (visited(candidate)) continue;
+        const vecEntries& parents = GetMemPoolParents(candidate);
         if (parents.size() == 0) {
             maximum = std::max(maximum, candidate->GetCountWithDescendants());
         } else {
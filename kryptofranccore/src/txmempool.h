@@ -131,7 +131,10 @@ public:
     CAmount GetModFeesWithAncestors() const { return nModFeesWithAncestors; }
     int64_t GetSigOpCostWithAncestors() const { return nSigOpCostWithAncestors; }
 
-    mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes
+    mutable size_t vTxHashesIdx; //!< Index in mempool's vTxHashes and vTxLinks
+    mutable uint64_t m_epoch{0}; //!< Epoch of the last mempool walk that visited this entry
+    mutable uint64_t m_cluster{0}; //!< Sequence number of the entry's cluster, 0 while it has none
+    mutable size_t m_cluster_pos{0}; //!< Position of the entry in its cluster's linearization
 };
 
 // Helpers for modifying CTxMemPool::mapTx, which is a boost multi_index.
@@ -201,48 +204,6 @@ struct mempoolentry_txid
     }
 };
 
-/** \class CompareTxMemPoolEntryByDescendantScore
- *
- *  Sort an entry by max(score/size of entry's tx, score/size with all descendants).
- */
-class CompareTxMemPoolEntryByDescendantScore
-{
-public:
-    bool operator()(const CTxMemPoolEntry& a, const CTxMemPoolEntry& b) const
-    {
-        double a_mod_fee, a_size, b_mod_fee, b_size;
-
-        GetModFeeAndSize(a, a_mod_fee, a_size);
-        GetModFeeAndSize(b, b_mod_fee, b_size);
-
-        // Avoid division by rewriting (a/b > c/d) as (a*d > c*b).
-        double f1 = a_mod_fee * b_size;
-        double f2 = a_size * b_mod_fee;
-
-        if (f1 == f2) {
-            return a.GetTime() >= b.GetTime();
-        }
-        return f1 < f2;
-    }
-
-    // Return the fee/size we're using for sorting this entry.
-    void GetModFeeAndSize(const CTxMemPoolEntry &a, double &mod_fee, double &size) const
-    {
-        // Compare feerate with descendants to feerate of the transaction, and
-        // return the fee/size for the max.
-        double f1 = (double)a.GetModifiedFee() * a.GetSizeWithDescendants();
-        double f2 = (double)a.GetModFeesWithDescendants() * a.GetTxSize();
-
-        if (f2 > f1) {
-            mod_fee = a.GetModFeesWithDescendants();
-            size = a.GetSizeWithDescendants();
-        } else {
-            mod_fee = a.GetModifiedFee();
-            size = a.GetTxSize();
-        }
-    }
-};
-
 /** \class CompareTxMemPoolEntryByScore
  *
  *  Sort by feerate of entry (fee/size) in descending order
@@ -273,54 +234,8 @@ public:
     }
 };
 
-/** \class CompareTxMemPoolEntryByAncestorScore
- *
- *  Sort an entry by min(score/size of entry's tx, score/size with all ancestors).
- */
-class CompareTxMemPoolEntryByAncestorFee
-{
-public:
-    template<typename T>
-    bool operator()(const T& a, const T& b) const
-    {
-        double a_mod_fee, a_size, b_mod_fee, b_size;
-
-        GetModFeeAndSize(a, a_mod_fee, a_size);
-        GetModFeeAndSize(b, b_mod_fee, b_size);
-
-        // Avoid division by rewriting (a/b > c/d) as (a*d > c*b).
-        double f1 = a_mod_fee * b_size;
-        double f2 = a_size * b_mod_fee;
-
-        if (f1 == f2) {
-            return a.GetTx().GetHash() < b.GetTx().GetHash();
-        }
-        return f1 > f2;
-    }
-
-    // Return the fee/size we're using for sorting this entry.
-    template <typename T>
-    void GetModFeeAndSize(const T &a, double &mod_fee, double &size) const
-    {
-        // Compare feerate with ancestors to feerate of the transaction, and
-        // return the fee/size for the min.
-        double f1 = (double)a.GetModifiedFee() * a.GetSizeWithAncestors();
-        double f2 = (double)a.GetModFeesWithAncestors() * a.GetTxSize();
-
-        if (f1 > f2) {
-            mod_fee = a.GetModFeesWithAncestors();
-            size = a.GetSizeWithAncestors();
-        } else {
-            mod_fee = a.GetModifiedFee();
-            size = a.GetTxSize();
-        }
-    }
-};
-
 // Multi_index tag names
-struct descendant_score {};
 struct entry_time {};
-struct ancestor_score {};
 
 class CBlockPolicyEstimator;
 
@@ -384,20 +299,34 @@ public:
  *
  * CTxMemPool::mapTx, and CTxMemPoolEntry bookkeeping:
  *
- * mapTx is a boost::multi_index that sorts the mempool on 4 criteria:
+ * mapTx is a boost::multi_index that sorts the mempool on 2 criteria:
  * - transaction hash
- * - descendant feerate [we use max(feerate of tx, feerate of tx with all descendants)]
  * - time in mempool
- * - ancestor feerate [we use min(feerate of tx, feerate of tx with all unconfirmed ancestors)]
  *
  * Note: the term "descendant" refers to in-mempool transactions that depend on
  * this one, while "ancestor" refers to in-mempool transactions that a given
  * transaction depends on.
  *
- * In order for the feerate sort to remain correct, we must update transactions
- * in the mempool when new descendants arrive.  To facilitate this, we track
- * the set of in-mempool direct parents and direct children in mapLinks.  Within
- * each CTxMemPoolEntry, we track the size and fees of all descendants.
+ * We track the set of in-mempool direct parents and direct children in
+ * vTxLinks.  Within each CTxMemPoolEntry, we track the size and fees of all
+ * ancestors and descendants, which the ancestor and descendant limits are
+ * checked against.
+ *
+ * Clusters and chunks:
+ *
+ * The transactions connected to each other by links form a cluster.  Each
+ * cluster is kept linearized: its transactions are put in an order that
+ * mines parents before children, picking the best feerate first, and that
+ * order is cut into chunks of non-increasing feerate.  setChunks holds the
+ * chunks of all clusters, best feerate first, which is the order block
+ * assembly takes them in.  Its worst chunk is always the last one of its
+ * cluster, so that nothing depends on it, and TrimToSize evicts from that
+ * end.  Mining and eviction thus agree on what the mempool's worst
+ * transactions are.  A cluster is linearized again whenever it changes: when
+ * a transaction joins it, when some of it leaves and when a fee is
+ * prioritised.  The cluster limit caps how many transactions that is; it is
+ * checked when a transaction is accepted, like the ancestor and descendant
+ * limits, and can likewise be exceeded after a reorg.
  *
  * Usually when a new transaction is added to the mempool, it has no in-mempool
  * children (because any such children would be an orphan).  So in
@@ -429,7 +358,7 @@ public:
  * state, to account for in-mempool, out-of-block descendants for all the
  * in-block transactions by calling UpdateTransactionsFromBlock().  Note that
  * until this is called, the mempool state is not consistent, and in particular
- * mapLinks may not be correct (and therefore functions like
+ * vTxLinks may not be correct (and therefore functions like
  * CalculateMemPoolAncestors() and CalculateDescendants() that rely
  * on them to walk the mempool are not generally safe to use).
  *
@@ -440,6 +369,11 @@ public:
  * CalculateMemPoolAncestors() takes configurable limits that are designed to
  * prevent these calculations from being too CPU intensive.
  *
+ * Walks over the transaction graph do not allocate per visited entry: each
+ * walk starts a new epoch, entries are marked visited by storing the epoch in
+ * them, and the entries still to visit are kept in a vector that is reused
+ * from one walk to the next.
+ *
  */
 class CTxMemPool
 {
@@ -466,23 +400,11 @@ public:
         boost::multi_index::indexed_by<
             // sorted by txid
             boost::multi_index::hashed_unique<mempoolentry_txid, SaltedTxidHasher>,
-            // sorted by fee rate
-            boost::multi_index::ordered_non_unique<
-                boost::multi_index::tag<descendant_score>,
-                boost::multi_index::identity<CTxMemPoolEntry>,
-                CompareTxMemPoolEntryByDescendantScore
-            >,
             // sorted by entry time
             boost::multi_index::ordered_non_unique<
                 boost::multi_index::tag<entry_time>,
                 boost::multi_index::identity<CTxMemPoolEntry>,
                 CompareTxMemPoolEntryByEntryTime
-            >,
-            // sorted by fee rate with ancestors
-            boost::multi_index::ordered_non_unique<
-                boost::multi_index::tag<ancestor_score>,
-                boost::multi_index::identity<CTxMemPoolEntry>,
-                CompareTxMemPoolEntryByAncestorFee
             >
         >
     > indexed_transaction_set;
@@ -535,26 +457,107 @@ public:
         }
     };
     typedef std::set<txiter, CompareIteratorByHash> setEntries;
+    //! Entries in a vector; direct parents and children are kept sorted by txid
+    typedef std::vector<txiter> vecEntries;
 
-    const setEntries & GetMemPoolParents(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
-    const setEntries & GetMemPoolChildren(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+    const vecEntries & GetMemPoolParents(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+    const vecEntries & GetMemPoolChildren(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
     uint64_t CalculateDescendantMaximum(txiter entry) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    /** A run of transactions in a cluster's linearization that is mined, or evicted, as a unit */
+    struct Chunk {
+        uint64_t cluster;   //!< Sequence number of the cluster
+        size_t begin;       //!< Position of the first transaction in the linearization
+        size_t end;         //!< ... and one past the last
+        CAmount fee;        //!< Modified fees of the transactions
+        int64_t size;       //!< ... their virtual size
+        int64_t sigOpCost;  //!< ... and their sigop cost
+    };
+
+    /** Best feerate first; chunks of equal feerate in the same cluster keep their order */
+    struct CompareChunkByFeerate {
+        bool operator()(const Chunk& a, const Chunk& b) const
+        {
+            // Avoid division by rewriting (a/b > c/d) as (a*d > c*b).
+            double f1 = (double)a.fee * b.size;
+            double f2 = (double)b.fee * a.size;
+            if (f1 != f2) return f1 > f2;
+            if (a.cluster != b.cluster) return a.cluster < b.cluster;
+            return a.begin < b.begin;
+        }
+    };
+    typedef std::set<Chunk, CompareChunkByFeerate> indexed_chunk_set;
+
+    //! The chunks of all clusters, in the order they are mined; the reverse order is the eviction order
+    indexed_chunk_set setChunks GUARDED_BY(cs);
+
+    /** The linearization of a cluster: its transactions, parents before children */
+    const vecEntries & GetClusterTxs(uint64_t cluster) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Number of transactions in the clusters of the given entries, each cluster counted once */
+    size_t CountClusterTxs(const setEntries& entries) const EXCLUSIVE_LOCKS_REQUIRED(cs);
 private:
-    typedef std::map<txiter, setEntries, CompareIteratorByHash> cacheMap;
+    typedef std::map<txiter, vecEntries, CompareIteratorByHash> cacheMap;
 
     struct TxLinks {
-        setEntries parents;
-        setEntries children;
+        vecEntries parents;
+        vecEntries children;
     };
 
-    typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
-    txlinksMap mapLinks;
+    //! Links of each entry in mapTx, at the entry's vTxHashesIdx
+    std::vector<TxLinks> vTxLinks;
 
     void UpdateParent(txiter entry, txiter parent, bool add);
     void UpdateChild(txiter entry, txiter child, bool add);
 
+    //! Epoch of the current walk over the mempool graph
+    mutable uint64_t m_epoch{0};
+    mutable bool m_has_epoch_guard{false};
+    //! Entries still to visit in the current walk, reused between walks
+    mutable vecEntries m_walk_stage;
+
+    /** Starts a new epoch for a walk, for as long as it is in scope. Walks cannot be nested. */
+    class EpochGuard
+    {
+    public:
+        explicit EpochGuard(const CTxMemPool& pool);
+        ~EpochGuard();
+    private:
+        const CTxMemPool& m_pool;
+    };
+
+    /** Whether the current walk has visited it already; marks it visited. */
+    bool visited(txiter it) const EXCLUSIVE_LOCKS_REQUIRED(cs)
+    {
+        assert(m_has_epoch_guard);
+        const bool ret = it->m_epoch >= m_epoch;
+        it->m_epoch = std::max(it->m_epoch, m_epoch);
+        return ret;
+    }
+
+    /** Collect all in-mempool ancestors of it, not including it, by walking the links */
+    void WalkAncestors(txiter it, vecEntries& ancestors) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Collect all in-mempool descendants of it, not including it, by walking the links */
+    void WalkDescendants(txiter it, vecEntries& descendants) const EXCLUSIVE_LOCKS_REQUIRED(cs);
+
     std::vector<indexed_transaction_set::const_iterator> GetSortedDepthAndScore() const EXCLUSIVE_LOCKS_REQUIRED(cs);
 
+    struct Cluster {
+        vecEntries txs;
+        std::vector<Chunk> chunks;
+    };
+
+    //! Clusters by sequence number
+    std::map<uint64_t, Cluster> mapClusters GUARDED_BY(cs);
+    uint64_t nClusterSequence GUARDED_BY(cs){0};
+
+    /** Replace the clusters of everything connected to it with a single, newly linearized one */
+    void LinearizeCluster(txiter it) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    /** Drop a cluster and its chunks, leaving its entries without one */
+    void RemoveCluster(uint64_t cluster) EXCLUSIVE_LOCKS_REQUIRED(cs);
+
+    //! Tentative entries, whose addition has not been announced yet
+    std::set<uint256> setTentative GUARDED_BY(cs);
+
 public:
     indirectmap<COutPoint, const CTransaction*> mapNextTx GUARDED_BY(cs);
     std::map<uint256, CAmount> mapDeltas;
@@ -580,7 +583,12 @@ public:
     // and any other callers may break wallet's in-mempool tracking (due to
     // lack of CValidationInterface::TransactionAddedToMempool callbacks).
     void addUnchecked(const CTxMemPoolEntry& entry, bool validFeeEstimate = true) EXCLUSIVE_LOCKS_REQUIRED(cs, cs_main);
-    void addUnchecked(const CTxMemPoolEntry& entry, setEntries& setAncestors, bool validFeeEstimate = true) EXCLUSIVE_LOCKS_REQUIRED(cs, cs_main);
+    // A tentative entry is not announced through NotifyEntryAdded until
+    // ConfirmTentative is called for it, and removing it before then is not
+    // announced through NotifyEntryRemoved either.
+    void addUnchecked(const CTxMemPoolEntry& entry, setEntries& setAncestors, bool validFeeEstimate = true, bool fTentative = false) EXCLUSIVE_LOCKS_REQUIRED(cs, cs_main);
+    /** Announce a tentative entry, which has now passed all checks */
+    void ConfirmTentative(txiter it) EXCLUSIVE_LOCKS_REQUIRED(cs);
 
     void removeRecursive(const CTransaction &tx, MemPoolRemovalReason reason = MemPoolRemovalReason::UNKNOWN);
     void removeForReorg(const CCoinsViewCache *pcoins, unsigned int nMemPoolHeight, int flags) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
@@ -642,7 +650,7 @@ public:
      *  limitDescendantSize = max size of descendants any ancestor can have
      *  errString = populated with error reason if any limits are hit
      *  fSearchForParents = whether to search a tx's vin for in-mempool parents, or
-     *    look up parents from mapLinks. Must be true for entries not in the mempool
+     *    look up parents from vTxLinks. Must be true for entries not in the mempool
      */
     bool CalculateMemPoolAncestors(const CTxMemPoolEntry& entry, setEntries& setAncestors, uint64_t limitAncestorCount, uint64_t limitAncestorSize, uint64_t limitDescendantCount, uint64_t limitDescendantSize, std::string& errString, bool fSearchForParents = true) const EXCLUSIVE_LOCKS_REQUIRED(cs);
 
@@ -659,7 +667,8 @@ public:
       */
     CFeeRate GetMinFee(size_t sizelimit) const;
 
-    /** Remove transactions from the mempool until its dynamic size is <= sizelimit.
+    /** Remove transactions from the mempool until its dynamic size is <= sizelimit,
+      *  worst chunk first.
       *  pvNoSpendsRemaining, if set, will be populated with the list of outpoints
       *  which are not in mempool which no longer have any spends in this mempool.
       */
@@ -700,6 +709,8 @@ public:
 
     boost::signals2::signal<void (CTransactionRef)> NotifyEntryAdded;
     boost::signals2::signal<void (CTransactionRef, MemPoolRemovalReason)> NotifyEntryRemoved;
+    //! The modified fee of an entry was changed by PrioritiseTransaction
+    boost::signals2::signal<void (CTransactionRef)> NotifyEntryPrioritised;
 
 private:
     /** UpdateForDescendants is used by UpdateTransactionsFromBlock to update
@@ -719,7 +730,7 @@ private:
             cacheMap &cachedDescendants,
             const std::set<uint256> &setExclude) EXCLUSIVE_LOCKS_REQUIRED(cs);
     /** Update ancestors of hash to add/remove it as a descendant transaction. */
-    void UpdateAncestorsOf(bool add, txiter hash, setEntries &setAncestors) EXCLUSIVE_LOCKS_REQUIRED(cs);
+    void UpdateAncestorsOf(bool add, txiter hash, const vecEntries &ancestors) EXCLUSIVE_LOCKS_REQUIRED(cs);
     /** Set ancestor state for an entry */
     void UpdateEntryForAncestors(txiter it, const setEntries &setAncestors) EXCLUSIVE_LOCKS_REQUIRED(cs);
     /** For each transaction being removed, update ancestors and any direct children.
@@ -0,0 +1,125 @@
+// Copyright (c) 2019 The Kryptofranc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <txreconciliation.h>
+
+#include <crypto/siphash.h>
+
+#include <algorithm>
+#include <cmath>
+
+/** Seeds for the three cell positions of an id, and for its check sum */
+static const uint32_t SKETCH_SEEDS[4] = {0x2b7e1516, 0x28aed2a6, 0xabf71588, 0x09cf4f3c};
+
+static uint32_t SketchHash(uint32_t x, uint32_t seed)
+{
+    x ^= seed;
+    x ^= x >> 16;
+    x *= 0x85ebca6b;
+    x ^= x >> 13;
+    x *= 0xc2b2ae35;
+    x ^= x >> 16;
+    return x;
+}
+
+TxReconSketch::TxReconSketch(size_t nCells) : m_cells(std::max<size_t>((nCells + 2) / 3, 1) * 3)
+{
+}
+
+size_t TxReconSketch::CellsFor(size_t nLocalSize, size_t nRemoteSize, double q)
+{
+    // Estimate the difference from the sizes and what was measured before,
+    // then leave room for the table to decode reliably.
+    const size_t nMin = std::min(nLocalSize, nRemoteSize);
+    const size_t nDiff = std::max(nLocalSize, nRemoteSize) - nMin + (size_t)std::ceil(q * nMin) + 1;
+    return std::min(2 * nDiff + 12, MAX_RECON_SKETCH_CELLS);
+}
+
+void TxReconSketch::Update(uint32_t short_id, int32_t delta)
+{
+    const size_t nPart = m_cells.size() / 3;
+    const uint32_t check = SketchHash(short_id, SKETCH_SEEDS[3]);
+    for (int i = 0; i < 3; i++) {
+        Cell& cell = m_cells[i * nPart + SketchHash(short_id, SKETCH_SEEDS[i]) % nPart];
+        cell.count += delta;
+        cell.key_sum ^= short_id;
+        cell.check_sum ^= check;
+    }
+}
+
+bool TxReconSketch::Subtract(const TxReconSketch& other)
+{
+    if (other.m_cells.size() != m_cells.size()) return false;
+    for (size_t i = 0; i < m_cells.size(); i++) {
+        m_cells[i].count -= other.m_cells[i].count;
+        m_cells[i].key_sum ^= other.m_cells[i].key_sum;
+        m_cells[i].check_sum ^= other.m_cells[i].check_sum;
+    }
+    return true;
+}
+
+bool TxReconSketch::Decode(std::vector<uint32_t>& only_ours, std::vector<uint32_t>& only_theirs) const
+{
+    TxReconSketch sketch(*this);
+    auto pure = [&sketch](size_t i) {
+        const Cell& cell = sketch.m_cells[i];
+        return (cell.count == 1 || cell.count == -1) && cell.check_sum == SketchHash(cell.key_sum, SKETCH_SEEDS[3]);
+    };
+
+    // Peel off ids from cells that hold only one of them, which may leave
+    // other cells with only one.
+    std::vector<size_t> vPure;
+    for (size_t i = 0; i < m_cells.size(); i++) {
+        if (pure(i)) vPure.push_back(i);
+    }
+    while (!vPure.empty()) {
+        const size_t i = vPure.back();
+        vPure.pop_back();
+        if (!pure(i)) continue;
+        // A well-formed sketch cannot hold more ids than cells; a crafted
+        // one could otherwise keep us peeling forever.
+        if (only_ours.size() + only_theirs.size() >= m_cells.size()) return false;
+        const uint32_t short_id = sketch.m_cells[i].key_sum;
+        const int32_t count = sketch.m_cells[i].count;
+        (count > 0 ? only_ours : only_theirs).push_back(short_id);
+        sketch.Update(short_id, -count);
+        const size_t nPart = m_cells.size() / 3;
+        for (int j = 0; j < 3; j++) {
+            const size_t k = j * nPart + SketchHash(short_id, SKETCH_SEEDS[j]) % nPart;
+            if (pure(k)) vPure.push_back(k);
+        }
+    }
+
+    for (const Cell& cell : sketch.m_cells) {
+        if (cell.count != 0 || cell.key_sum != 0 || cell.check_sum != 0) return false;
+    }
+    return true;
+}
+
+TxReconState::TxReconState(bool initiator, bool flood, uint64_t local_salt, uint64_t remote_salt) :
+    m_initiator(initiator), m_flood(flood),
+    m_k0(std::min(local_salt, remote_salt)), m_k1(std::max(local_salt, remote_salt))
+{
+}
+
+uint32_t TxReconState::ShortId(const uint256& txid) const
+{
+    return (uint32_t)SipHashUint256(m_k0, m_k1, txid);
+}
+
+bool TxReconState::Add(const uint256& txid)
+{
+    if (m_flood || m_local_set.size() >= MAX_RECON_SET_SIZE) return false;
+    // On a short id collision the second transaction is flooded
+    return m_local_set.emplace(ShortId(txid), txid).second;
+}
+
+TxReconSketch TxReconState::Sketch(const std::map<uint32_t, uint256>& set, size_t nCells) const
+{
+    TxReconSketch sketch(nCells);
+    for (const auto& entry : set) {
+        sketch.Add(entry.first);
+    }
+    return sketch;
+}
@@ -0,0 +1,132 @@
+// Copyright (c) 2019 The Kryptofranc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KRYPTOFRANC_TXRECONCILIATION_H
+#define KRYPTOFRANC_TXRECONCILIATION_H
+
+#include <serialize.h>
+#include <uint256.h>
+
+#include <map>
+#include <stdint.h>
+#include <vector>
+
+/** Default for -txreconciliation */
+static const bool DEFAULT_TXRECONCILIATION = false;
+/** Version of the reconciliation protocol, announced in sendrecon */
+static const uint32_t TXRECONCILIATION_VERSION = 1;
+/** Seconds between reconciliations requested from each peer */
+static const int64_t RECON_REQUEST_INTERVAL = 8;
+/** Number of reconciling outbound peers that still get transactions flooded to them */
+static const int RECON_OUTBOUND_FLOOD_PEERS = 2;
+/** Transactions pending reconciliation with a peer beyond this many are flooded instead */
+static const size_t MAX_RECON_SET_SIZE = 4000;
+/** Largest sketch sent or accepted, in cells */
+static const size_t MAX_RECON_SKETCH_CELLS = 3 * MAX_RECON_SET_SIZE;
+/** Estimate of the fraction of the smaller set missing from the larger one, before any reconciliation */
+static const double RECON_DEFAULT_Q = 0.25;
+/** q is sent as a fixed-point number with this denominator */
+static const uint16_t RECON_Q_PRECISION = (1 << 15) - 1;
+
+/**
+ * Invertible Bloom lookup table of 32-bit short transaction ids.
+ *
+ * Each id is added to one cell in each of three equal parts of the table.
+ * Subtracting the sketch of one set from a sketch of the same size of
+ * another leaves a sketch of their symmetric difference, which can be
+ * decoded when it has comfortably more cells than the difference has
+ * elements. Reconciling two sets thus costs in proportion to how much they
+ * differ rather than to their size.
+ */
+class TxReconSketch
+{
+public:
+    struct Cell {
+        int32_t count{0};
+        uint32_t key_sum{0};
+        uint32_t check_sum{0};
+
+        ADD_SERIALIZE_METHODS;
+
+        template <typename Stream, typename Operation>
+        inline void SerializationOp(Stream& s, Operation ser_action) {
+            READWRITE(count);
+            READWRITE(key_sum);
+            READWRITE(check_sum);
+        }
+    };
+
+    TxReconSketch() = default;
+    /** An empty sketch of at least nCells cells */
+    explicit TxReconSketch(size_t nCells);
+
+    /** The number of cells needed to reconcile sets of these sizes, given q */
+    static size_t CellsFor(size_t nLocalSize, size_t nRemoteSize, double q);
+
+    size_t GetCells() const { return m_cells.size(); }
+    /** Whether the sketch has a size that could have been produced by the constructor */
+    bool IsValid() const { return !m_cells.empty() && m_cells.size() % 3 == 0 && m_cells.size() <= MAX_RECON_SKETCH_CELLS; }
+
+    void Add(uint32_t short_id) { Update(short_id, 1); }
+    /** Subtract another sketch of the same size. Returns false if the sizes differ. */
+    bool Subtract(const TxReconSketch& other);
+    /**
+     * Decode a difference sketch into the ids only in our set and those only
+     * in the subtracted one. Returns false if there are too many to decode.
+     */
+    bool Decode(std::vector<uint32_t>& only_ours, std::vector<uint32_t>& only_theirs) const;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action) {
+        READWRITE(m_cells);
+    }
+
+private:
+    std::vector<Cell> m_cells;
+
+    void Update(uint32_t short_id, int32_t delta);
+};
+
+/**
+ * Transaction reconciliation state for one peer.
+ *
+ * Transactions we would announce to the peer are collected in m_local_set
+ * instead. The side that made the connection periodically asks the other for
+ * a sketch of its set, subtracts it from a sketch of its own, announces what
+ * the peer is missing and asks for announcements of what it is missing
+ * itself.
+ */
+struct TxReconState
+{
+    //! Whether we ask for sketches (we made the connection) or send them
+    const bool m_initiator;
+    //! Whether transactions are still flooded to this peer rather than reconciled
+    const bool m_flood;
+    //! Keys for short ids, from both sides' salts
+    const uint64_t m_k0, m_k1;
+
+    //! Transactions to announce to the peer, by short id
+    std::map<uint32_t, uint256> m_local_set;
+    //! As responder: m_local_set when the peer asked for a sketch, until it says what it is missing
+    std::map<uint32_t, uint256> m_snapshot;
+    //! As initiator: when to ask for the next sketch (in microseconds), and whether we are waiting for one
+    int64_t m_next_request{0};
+    bool m_awaiting_sketch{false};
+    //! As initiator: q measured in the last reconciliation
+    double m_q{RECON_DEFAULT_Q};
+
+    uint64_t m_reconciliations{0};
+    uint64_t m_failures{0};
+
+    TxReconState(bool initiator, bool flood, uint64_t local_salt, uint64_t remote_salt);
+
+    uint32_t ShortId(const uint256& txid) const;
+    /** Queue txid for reconciliation. Returns false if it has to be flooded instead. */
+    bool Add(const uint256& txid);
+    TxReconSketch Sketch(const std::map<uint32_t, uint256>& set, size_t nCells) const;
+};
+
+#endif // KRYPTOFRANC_TXRECONCILIATION_H
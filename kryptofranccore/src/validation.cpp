@@ -19,6 +19,7 @@
 #include <cuckoocache.h>
 #include <hash.h>
 #include <index/txindex.h>
+#include <mempooljournal.h>
 #include <policy/fees.h>
 #include <policy/policy.h>
 #include <policy/rbf.h>
@@ -41,6 +42,7 @@
 #include <util/moneystr.h>
 #include <util/strencodings.h>
 #include <validationinterface.h>
+#include <validationstats.h>
 #include <warnings.h>
 
 #include <future>
@@ -185,6 +187,7 @@ public:
     bool ReplayBlocks(const CChainParams& params, CCoinsView* view);
     bool RewindBlockIndex(const CChainParams& params);
     bool LoadGenesisBlock(const CChainParams& chainparams);
+    bool MarkUTXOSnapshotChain(const CChainParams& chainparams, CBlockIndex* pindexBase, uint64_t nChainTx) EXCLUSIVE_LOCKS_REQUIRED(cs_main);
 
     void PruneBlockIndexCandidates();
 
@@ -236,6 +239,7 @@ int nScriptCheckThreads = 0;
 std::atomic_bool fImporting(false);
 std::atomic_bool fReindex(false);
 bool fHavePruned = false;
+bool fHaveUTXOSnapshot = false;
 bool fPruneMode = false;
 bool fIsBareMultisigStd = DEFAULT_PERMIT_BAREMULTISIG;
 bool fRequireStandard = true;
@@ -320,7 +324,7 @@ enum class FlushStateMode {
 static bool FlushStateToDisk(const CChainParams& chainParams, CValidationState &state, FlushStateMode mode, int nManualPruneHeight=0);
 static void FindFilesToPruneManual(std::set<int>& setFilesToPrune, int nManualPruneHeight);
 static void FindFilesToPrune(std::set<int>& setFilesToPrune, uint64_t nPruneAfterHeight);
-bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks = nullptr);
+bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks = nullptr, size_t* pnChecks = nullptr);
 static FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 
 bool CheckFinalTx(const CTransaction &tx, int flags)
@@ -569,14 +573,41 @@ static bool CheckInputsFromMempoolAndCache(const CTransaction& tx, CValidationSt
     return CheckInputs(tx, state, view, true, flags, cacheSigStore, true, txdata);
 }
 
-static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool& pool, CValidationState& state, const CTransactionRef& ptx,
-                              bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
-                              bool bypass_limits, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache, bool test_accept) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+namespace {
+
+/** State of one transaction as it goes through the stages of AcceptToMemoryPool */
+struct ATMPWorkspace
 {
-    const CTransaction& tx = *ptx;
-    const uint256 hash = tx.GetHash();
-    AssertLockHeld(cs_main);
-    LOCK(pool.cs); // mempool "read lock" (held through GetMainSignals().TransactionAddedToMempool())
+    explicit ATMPWorkspace(const CTransactionRef& ptx) : m_ptx(ptx), m_hash(ptx->GetHash()), m_view(&m_dummy), m_txdata(*ptx) {}
+
+    const CTransactionRef m_ptx;
+    const uint256 m_hash;
+    std::set<uint256> m_conflicts;
+    CCoinsView m_dummy;
+    //! Coins spent by the transaction, cached so that the mempool does not have to stay locked
+    CCoinsViewCache m_view;
+    LockPoints m_lp;
+    std::unique_ptr<CTxMemPoolEntry> m_entry;
+    CAmount m_fees{0};
+    CAmount m_modified_fees{0};
+    CTxMemPool::setEntries m_ancestors;
+    CTxMemPool::setEntries m_all_conflicting;
+    CAmount m_conflicting_fees{0};
+    size_t m_conflicting_size{0};
+    bool m_replacement{false};
+    PrecomputedTransactionData m_txdata;
+};
+
+} // namespace
+
+static CCheckQueue<CScriptCheck> scriptcheckqueue(1024);
+
+/** Policy and consensus checks that do not execute scripts, up to deciding what a replacement evicts */
+static bool PreChecks(CTxMemPool& pool, ATMPWorkspace& ws, CValidationState& state, bool* pfMissingInputs, int64_t nAcceptTime,
+                      bool bypass_limits, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache) EXCLUSIVE_LOCKS_REQUIRED(cs_main, pool.cs)
+{
+    const CTransaction& tx = *ws.m_ptx;
+    const uint256& hash = ws.m_hash;
     if (pfMissingInputs) {
         *pfMissingInputs = false;
     }
@@ -611,7 +642,7 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
     }
 
     // Check for conflicts with in-memory transactions
-    std::set<uint256> setConflicts;
+    std::set<uint256>& setConflicts = ws.m_conflicts;
     for (const CTxIn &txin : tx.vin)
     {
         const CTransaction* ptxConflicting = pool.GetConflictTx(txin.prevout);
@@ -651,325 +682,391 @@ static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool
         }
     }
 
-    {
-        CCoinsView dummy;
-        CCoinsViewCache view(&dummy);
+    CCoinsView& dummy = ws.m_dummy;
+    CCoinsViewCache& view = ws.m_view;
+    LockPoints& lp = ws.m_lp;
 
-        LockPoints lp;
-        CCoinsViewMemPool viewMemPool(pcoinsTip.get(), pool);
-        view.SetBackend(viewMemPool);
+    CCoinsViewMemPool viewMemPool(pcoinsTip.get(), pool);
+    view.SetBackend(viewMemPool);
 
-        // do all inputs exist?
-        for (const CTxIn& txin : tx.vin) {
-            if (!pcoinsTip->HaveCoinInCache(txin.prevout)) {
-                coins_to_uncache.push_back(txin.prevout);
-            }
-            if (!view.HaveCoin(txin.prevout)) {
-                // Are inputs missing because we already have the tx?
-                for (size_t out = 0; out < tx.vout.size(); out++) {
-                    // Optimistically just do efficient check of cache for outputs
-                    if (pcoinsTip->HaveCoinInCache(COutPoint(hash, out))) {
-                        return state.Invalid(false, REJECT_DUPLICATE, "txn-already-known");
-                    }
-                }
-                // Otherwise assume this might be an orphan tx for which we just haven't seen parents yet
-                if (pfMissingInputs) {
-                    *pfMissingInputs = true;
+    // do all inputs exist?
+    for (const CTxIn& txin : tx.vin) {
+        if (!pcoinsTip->HaveCoinInCache(txin.prevout)) {
+            coins_to_uncache.push_back(txin.prevout);
+        }
+        if (!view.HaveCoin(txin.prevout)) {
+            // Are inputs missing because we already have the tx?
+            for (size_t out = 0; out < tx.vout.size(); out++) {
+                // Optimistically just do efficient check of cache for outputs
+                if (pcoinsTip->HaveCoinInCache(COutPoint(hash, out))) {
+                    return state.Invalid(false, REJECT_DUPLICATE, "txn-already-known");
                 }
-                return false; // fMissingInputs and !state.IsInvalid() is used to detect this condition, don't set state.Invalid()
             }
+            // Otherwise assume this might be an orphan tx for which we just haven't seen parents yet
+            if (pfMissingInputs) {
+                *pfMissingInputs = true;
+            }
+            return false; // fMissingInputs and !state.IsInvalid() is used to detect this condition, don't set state.Invalid()
         }
+    }
 
-        // Bring the best block into scope
-        view.GetBestBlock();
-
-        // we have all inputs cached now, so switch back to dummy, so we don't need to keep lock on mempool
-        view.SetBackend(dummy);
+    // Bring the best block into scope
+    view.GetBestBlock();
 
-        // Only accept BIP68 sequence locked transactions that can be mined in the next
-        // block; we don't want our mempool filled up with transactions that can't
-        // be mined yet.
-        // Must keep pool.cs for this unless we change CheckSequenceLocks to take a
-        // CoinsViewCache instead of create its own
-        if (!CheckSequenceLocks(pool, tx, STANDARD_LOCKTIME_VERIFY_FLAGS, &lp))
-            return state.DoS(0, false, REJECT_NONSTANDARD, "non-BIP68-final");
+    // we have all inputs cached now, so switch back to dummy, so we don't need to keep lock on mempool
+    view.SetBackend(dummy);
 
-        CAmount nFees = 0;
-        if (!Consensus::CheckTxInputs(tx, state, view, GetSpendHeight(view), nFees)) {
-            return error("%s: Consensus::CheckTxInputs: %s, %s", __func__, tx.GetHash().ToString(), FormatStateMessage(state));
+    // Only accept BIP68 sequence locked transactions that can be mined in the next
+    // block; we don't want our mempool filled up with transactions that can't
+    // be mined yet.
+    // Must keep pool.cs for this unless we change CheckSequenceLocks to take a
+    // CoinsViewCache instead of create its own
+    if (!CheckSequenceLocks(pool, tx, STANDARD_LOCKTIME_VERIFY_FLAGS, &lp))
+        return state.DoS(0, false, REJECT_NONSTANDARD, "non-BIP68-final");
+
+    CAmount& nFees = ws.m_fees;
+    if (!Consensus::CheckTxInputs(tx, state, view, GetSpendHeight(view), nFees)) {
+        return error("%s: Consensus::CheckTxInputs: %s, %s", __func__, tx.GetHash().ToString(), FormatStateMessage(state));
+    }
+
+    // Check for non-standard pay-to-script-hash in inputs
+    if (fRequireStandard && !AreInputsStandard(tx, view))
+        return state.Invalid(false, REJECT_NONSTANDARD, "bad-txns-nonstandard-inputs");
+
+    // Check for non-standard witness in P2WSH
+    if (tx.HasWitness() && fRequireStandard && !IsWitnessStandard(tx, view))
+        return state.DoS(0, false, REJECT_NONSTANDARD, "bad-witness-nonstandard", true);
+
+    int64_t nSigOpsCost = GetTransactionSigOpCost(tx, view, STANDARD_SCRIPT_VERIFY_FLAGS);
+
+    // nModifiedFees includes any fee deltas from PrioritiseTransaction
+    CAmount& nModifiedFees = ws.m_modified_fees;
+    nModifiedFees = nFees;
+    pool.ApplyDelta(hash, nModifiedFees);
+
+    // Keep track of transactions that spend a coinbase, which we re-scan
+    // during reorgs to ensure COINBASE_MATURITY is still met.
+    bool fSpendsCoinbase = false;
+    for (const CTxIn &txin : tx.vin) {
+        const Coin &coin = view.AccessCoin(txin.prevout);
+        if (coin.IsCoinBase()) {
+            fSpendsCoinbase = true;
+            break;
         }
+    }
 
-        // Check for non-standard pay-to-script-hash in inputs
-        if (fRequireStandard && !AreInputsStandard(tx, view))
-            return state.Invalid(false, REJECT_NONSTANDARD, "bad-txns-nonstandard-inputs");
-
-        // Check for non-standard witness in P2WSH
-        if (tx.HasWitness() && fRequireStandard && !IsWitnessStandard(tx, view))
-            return state.DoS(0, false, REJECT_NONSTANDARD, "bad-witness-nonstandard", true);
-
-        int64_t nSigOpsCost = GetTransactionSigOpCost(tx, view, STANDARD_SCRIPT_VERIFY_FLAGS);
-
-        // nModifiedFees includes any fee deltas from PrioritiseTransaction
-        CAmount nModifiedFees = nFees;
-        pool.ApplyDelta(hash, nModifiedFees);
-
-        // Keep track of transactions that spend a coinbase, which we re-scan
-        // during reorgs to ensure COINBASE_MATURITY is still met.
-        bool fSpendsCoinbase = false;
-        for (const CTxIn &txin : tx.vin) {
-            const Coin &coin = view.AccessCoin(txin.prevout);
-            if (coin.IsCoinBase()) {
-                fSpendsCoinbase = true;
-                break;
-            }
-        }
+    ws.m_entry = MakeUnique<CTxMemPoolEntry>(ws.m_ptx, nFees, nAcceptTime, chainActive.Height(),
+                                             fSpendsCoinbase, nSigOpsCost, lp);
+    const CTxMemPoolEntry& entry = *ws.m_entry;
+    unsigned int nSize = entry.GetTxSize();
 
-        CTxMemPoolEntry entry(ptx, nFees, nAcceptTime, chainActive.Height(),
-                              fSpendsCoinbase, nSigOpsCost, lp);
-        unsigned int nSize = entry.GetTxSize();
+    // Check that the transaction doesn't have an excessive number of
+    // sigops, making it impossible to mine. Since the coinbase transaction
+    // itself can contain sigops MAX_STANDARD_TX_SIGOPS is less than
+    // MAX_BLOCK_SIGOPS; we still consider this an invalid rather than
+    // merely non-standard transaction.
+    if (nSigOpsCost > MAX_STANDARD_TX_SIGOPS_COST)
+        return state.DoS(0, false, REJECT_NONSTANDARD, "bad-txns-too-many-sigops", false,
+            strprintf("%d", nSigOpsCost));
 
-        // Check that the transaction doesn't have an excessive number of
-        // sigops, making it impossible to mine. Since the coinbase transaction
-        // itself can contain sigops MAX_STANDARD_TX_SIGOPS is less than
-        // MAX_BLOCK_SIGOPS; we still consider this an invalid rather than
-        // merely non-standard transaction.
-        if (nSigOpsCost > MAX_STANDARD_TX_SIGOPS_COST)
-            return state.DoS(0, false, REJECT_NONSTANDARD, "bad-txns-too-many-sigops", false,
-                strprintf("%d", nSigOpsCost));
+    CAmount mempoolRejectFee = pool.GetMinFee(gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
+    if (!bypass_limits && mempoolRejectFee > 0 && nModifiedFees < mempoolRejectFee) {
+        return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool min fee not met", false, strprintf("%d < %d", nModifiedFees, mempoolRejectFee));
+    }
 
-        CAmount mempoolRejectFee = pool.GetMinFee(gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000).GetFee(nSize);
-        if (!bypass_limits && mempoolRejectFee > 0 && nModifiedFees < mempoolRejectFee) {
-            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool min fee not met", false, strprintf("%d < %d", nModifiedFees, mempoolRejectFee));
-        }
+    // No transactions are allowed below minRelayTxFee except from disconnected blocks
+    if (!bypass_limits && nModifiedFees < ::minRelayTxFee.GetFee(nSize)) {
+        return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "min relay fee not met", false, strprintf("%d < %d", nModifiedFees, ::minRelayTxFee.GetFee(nSize)));
+    }
 
-        // No transactions are allowed below minRelayTxFee except from disconnected blocks
-        if (!bypass_limits && nModifiedFees < ::minRelayTxFee.GetFee(nSize)) {
-            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "min relay fee not met", false, strprintf("%d < %d", nModifiedFees, ::minRelayTxFee.GetFee(nSize)));
-        }
+    if (nAbsurdFee && nFees > nAbsurdFee)
+        return state.Invalid(false,
+            REJECT_HIGHFEE, "absurdly-high-fee",
+            strprintf("%d > %d", nFees, nAbsurdFee));
 
-        if (nAbsurdFee && nFees > nAbsurdFee)
-            return state.Invalid(false,
-                REJECT_HIGHFEE, "absurdly-high-fee",
-                strprintf("%d > %d", nFees, nAbsurdFee));
+    // Calculate in-mempool ancestors, up to a limit.
+    CTxMemPool::setEntries& setAncestors = ws.m_ancestors;
+    size_t nLimitAncestors = gArgs.GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
+    size_t nLimitAncestorSize = gArgs.GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT)*1000;
+    size_t nLimitDescendants = gArgs.GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
+    size_t nLimitDescendantSize = gArgs.GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT)*1000;
+    std::string errString;
+    if (!pool.CalculateMemPoolAncestors(entry, setAncestors, nLimitAncestors, nLimitAncestorSize, nLimitDescendants, nLimitDescendantSize, errString)) {
+        return state.DoS(0, false, REJECT_NONSTANDARD, "too-long-mempool-chain", false, errString);
+    }
 
-        // Calculate in-mempool ancestors, up to a limit.
-        CTxMemPool::setEntries setAncestors;
-        size_t nLimitAncestors = gArgs.GetArg("-limitancestorcount", DEFAULT_ANCESTOR_LIMIT);
-        size_t nLimitAncestorSize = gArgs.GetArg("-limitancestorsize", DEFAULT_ANCESTOR_SIZE_LIMIT)*1000;
-        size_t nLimitDescendants = gArgs.GetArg("-limitdescendantcount", DEFAULT_DESCENDANT_LIMIT);
-        size_t nLimitDescendantSize = gArgs.GetArg("-limitdescendantsize", DEFAULT_DESCENDANT_SIZE_LIMIT)*1000;
-        std::string errString;
-        if (!pool.CalculateMemPoolAncestors(entry, setAncestors, nLimitAncestors, nLimitAncestorSize, nLimitDescendants, nLimitDescendantSize, errString)) {
-            return state.DoS(0, false, REJECT_NONSTANDARD, "too-long-mempool-chain", false, errString);
-        }
+    // The clusters of its in-mempool ancestors are joined by it into one.
+    size_t nLimitCluster = gArgs.GetArg("-limitclustercount", DEFAULT_CLUSTER_LIMIT);
+    size_t nClusterCount = pool.CountClusterTxs(setAncestors) + 1;
+    if (nClusterCount > nLimitCluster) {
+        return state.DoS(0, false, REJECT_NONSTANDARD, "too-large-cluster", false,
+                         strprintf("too many transactions in cluster [%u > limit %u]", nClusterCount, nLimitCluster));
+    }
 
-        // A transaction that spends outputs that would be replaced by it is invalid. Now
-        // that we have the set of all ancestors we can detect this
-        // pathological case by making sure setConflicts and setAncestors don't
-        // intersect.
-        for (CTxMemPool::txiter ancestorIt : setAncestors)
+    // A transaction that spends outputs that would be replaced by it is invalid. Now
+    // that we have the set of all ancestors we can detect this
+    // pathological case by making sure setConflicts and setAncestors don't
+    // intersect.
+    for (CTxMemPool::txiter ancestorIt : setAncestors)
+    {
+        const uint256 &hashAncestor = ancestorIt->GetTx().GetHash();
+        if (setConflicts.count(hashAncestor))
         {
-            const uint256 &hashAncestor = ancestorIt->GetTx().GetHash();
-            if (setConflicts.count(hashAncestor))
+            return state.DoS(10, false,
+                             REJECT_INVALID, "bad-txns-spends-conflicting-tx", false,
+                             strprintf("%s spends conflicting transaction %s",
+                                       hash.ToString(),
+                                       hashAncestor.ToString()));
+        }
+    }
+
+    // Check if it's economically rational to mine this transaction rather
+    // than the ones it replaces.
+    CAmount& nConflictingFees = ws.m_conflicting_fees;
+    size_t& nConflictingSize = ws.m_conflicting_size;
+    uint64_t nConflictingCount = 0;
+    CTxMemPool::setEntries& allConflicting = ws.m_all_conflicting;
+
+    // If we don't hold the lock allConflicting might be incomplete; the
+    // subsequent RemoveStaged() and addUnchecked() calls don't guarantee
+    // mempool consistency for us.
+    ws.m_replacement = setConflicts.size();
+    const bool fReplacementTransaction = ws.m_replacement;
+    if (fReplacementTransaction)
+    {
+        CFeeRate newFeeRate(nModifiedFees, nSize);
+        std::set<uint256> setConflictsParents;
+        const int maxDescendantsToVisit = 100;
+        const CTxMemPool::setEntries setIterConflicting = pool.GetIterSet(setConflicts);
+        for (const auto& mi : setIterConflicting) {
+            // Don't allow the replacement to reduce the feerate of the
+            // mempool.
+            //
+            // We usually don't want to accept replacements with lower
+            // feerates than what they replaced as that would lower the
+            // feerate of the next block. Requiring that the feerate always
+            // be increased is also an easy-to-reason about way to prevent
+            // DoS attacks via replacements.
+            //
+            // We only consider the feerates of transactions being directly
+            // replaced, not their indirect descendants. While that does
+            // mean high feerate children are ignored when deciding whether
+            // or not to replace, we do require the replacement to pay more
+            // overall fees too, mitigating most cases.
+            CFeeRate oldFeeRate(mi->GetModifiedFee(), mi->GetTxSize());
+            if (newFeeRate <= oldFeeRate)
             {
-                return state.DoS(10, false,
-                                 REJECT_INVALID, "bad-txns-spends-conflicting-tx", false,
-                                 strprintf("%s spends conflicting transaction %s",
-                                           hash.ToString(),
-                                           hashAncestor.ToString()));
-            }
-        }
-
-        // Check if it's economically rational to mine this transaction rather
-        // than the ones it replaces.
-        CAmount nConflictingFees = 0;
-        size_t nConflictingSize = 0;
-        uint64_t nConflictingCount = 0;
-        CTxMemPool::setEntries allConflicting;
-
-        // If we don't hold the lock allConflicting might be incomplete; the
-        // subsequent RemoveStaged() and addUnchecked() calls don't guarantee
-        // mempool consistency for us.
-        const bool fReplacementTransaction = setConflicts.size();
-        if (fReplacementTransaction)
-        {
-            CFeeRate newFeeRate(nModifiedFees, nSize);
-            std::set<uint256> setConflictsParents;
-            const int maxDescendantsToVisit = 100;
-            const CTxMemPool::setEntries setIterConflicting = pool.GetIterSet(setConflicts);
-            for (const auto& mi : setIterConflicting) {
-                // Don't allow the replacement to reduce the feerate of the
-                // mempool.
-                //
-                // We usually don't want to accept replacements with lower
-                // feerates than what they replaced as that would lower the
-                // feerate of the next block. Requiring that the feerate always
-                // be increased is also an easy-to-reason about way to prevent
-                // DoS attacks via replacements.
-                //
-                // We only consider the feerates of transactions being directly
-                // replaced, not their indirect descendants. While that does
-                // mean high feerate children are ignored when deciding whether
-                // or not to replace, we do require the replacement to pay more
-                // overall fees too, mitigating most cases.
-                CFeeRate oldFeeRate(mi->GetModifiedFee(), mi->GetTxSize());
-                if (newFeeRate <= oldFeeRate)
-                {
-                    return state.DoS(0, false,
-                            REJECT_INSUFFICIENTFEE, "insufficient fee", false,
-                            strprintf("rejecting replacement %s; new feerate %s <= old feerate %s",
-                                  hash.ToString(),
-                                  newFeeRate.ToString(),
-                                  oldFeeRate.ToString()));
-                }
-
-                for (const CTxIn &txin : mi->GetTx().vin)
-                {
-                    setConflictsParents.insert(txin.prevout.hash);
-                }
-
-                nConflictingCount += mi->GetCountWithDescendants();
-            }
-            // This potentially overestimates the number of actual descendants
-            // but we just want to be conservative to avoid doing too much
-            // work.
-            if (nConflictingCount <= maxDescendantsToVisit) {
-                // If not too many to replace, then calculate the set of
-                // transactions that would have to be evicted
-                for (CTxMemPool::txiter it : setIterConflicting) {
-                    pool.CalculateDescendants(it, allConflicting);
-                }
-                for (CTxMemPool::txiter it : allConflicting) {
-                    nConflictingFees += it->GetModifiedFee();
-                    nConflictingSize += it->GetTxSize();
-                }
-            } else {
                 return state.DoS(0, false,
-                        REJECT_NONSTANDARD, "too many potential replacements", false,
-                        strprintf("rejecting replacement %s; too many potential replacements (%d > %d)\n",
-                            hash.ToString(),
-                            nConflictingCount,
-                            maxDescendantsToVisit));
+                        REJECT_INSUFFICIENTFEE, "insufficient fee", false,
+                        strprintf("rejecting replacement %s; new feerate %s <= old feerate %s",
+                              hash.ToString(),
+                              newFeeRate.ToString(),
+                              oldFeeRate.ToString()));
             }
 
-            for (unsigned int j = 0; j < tx.vin.size(); j++)
+            for (const CTxIn &txin : mi->GetTx().vin)
             {
-                // We don't want to accept replacements that require low
-                // feerate junk to be mined first. Ideally we'd keep track of
-                // the ancestor feerates and make the decision based on that,
-                // but for now requiring all new inputs to be confirmed works.
-                if (!setConflictsParents.count(tx.vin[j].prevout.hash))
-                {
-                    // Rather than check the UTXO set - potentially expensive -
-                    // it's cheaper to just check if the new input refers to a
-                    // tx that's in the mempool.
-                    if (pool.exists(tx.vin[j].prevout.hash)) {
-                        return state.DoS(0, false,
-                                         REJECT_NONSTANDARD, "replacement-adds-unconfirmed", false,
-                                         strprintf("replacement %s adds unconfirmed input, idx %d",
-                                                  hash.ToString(), j));
-                    }
-                }
+                setConflictsParents.insert(txin.prevout.hash);
             }
 
-            // The replacement must pay greater fees than the transactions it
-            // replaces - if we did the bandwidth used by those conflicting
-            // transactions would not be paid for.
-            if (nModifiedFees < nConflictingFees)
-            {
-                return state.DoS(0, false,
-                                 REJECT_INSUFFICIENTFEE, "insufficient fee", false,
-                                 strprintf("rejecting replacement %s, less fees than conflicting txs; %s < %s",
-                                          hash.ToString(), FormatMoney(nModifiedFees), FormatMoney(nConflictingFees)));
+            nConflictingCount += mi->GetCountWithDescendants();
+        }
+        // This potentially overestimates the number of actual descendants
+        // but we just want to be conservative to avoid doing too much
+        // work.
+        if (nConflictingCount <= maxDescendantsToVisit) {
+            // If not too many to replace, then calculate the set of
+            // transactions that would have to be evicted
+            for (CTxMemPool::txiter it : setIterConflicting) {
+                pool.CalculateDescendants(it, allConflicting);
+            }
+            for (CTxMemPool::txiter it : allConflicting) {
+                nConflictingFees += it->GetModifiedFee();
+                nConflictingSize += it->GetTxSize();
             }
+        } else {
+            return state.DoS(0, false,
+                    REJECT_NONSTANDARD, "too many potential replacements", false,
+                    strprintf("rejecting replacement %s; too many potential replacements (%d > %d)\n",
+                        hash.ToString(),
+                        nConflictingCount,
+                        maxDescendantsToVisit));
+        }
 
-            // Finally in addition to paying more fees than the conflicts the
-            // new transaction must pay for its own bandwidth.
-            CAmount nDeltaFees = nModifiedFees - nConflictingFees;
-            if (nDeltaFees < ::incrementalRelayFee.GetFee(nSize))
+        for (unsigned int j = 0; j < tx.vin.size(); j++)
+        {
+            // We don't want to accept replacements that require low
+            // feerate junk to be mined first. Ideally we'd keep track of
+            // the ancestor feerates and make the decision based on that,
+            // but for now requiring all new inputs to be confirmed works.
+            if (!setConflictsParents.count(tx.vin[j].prevout.hash))
             {
-                return state.DoS(0, false,
-                        REJECT_INSUFFICIENTFEE, "insufficient fee", false,
-                        strprintf("rejecting replacement %s, not enough additional fees to relay; %s < %s",
-                              hash.ToString(),
-                              FormatMoney(nDeltaFees),
-                              FormatMoney(::incrementalRelayFee.GetFee(nSize))));
+                // Rather than check the UTXO set - potentially expensive -
+                // it's cheaper to just check if the new input refers to a
+                // tx that's in the mempool.
+                if (pool.exists(tx.vin[j].prevout.hash)) {
+                    return state.DoS(0, false,
+                                     REJECT_NONSTANDARD, "replacement-adds-unconfirmed", false,
+                                     strprintf("replacement %s adds unconfirmed input, idx %d",
+                                              hash.ToString(), j));
+                }
             }
         }
 
-        constexpr unsigned int scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
-
-        // Check against previous transactions
-        // This is done last to help prevent CPU exhaustion denial-of-service attacks.
-        PrecomputedTransactionData txdata(tx);
-        if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, false, txdata)) {
-            // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
-            // need to turn both off, and compare against just turning off CLEANSTACK
-            // to see if the failure is specifically due to witness validation.
-            CValidationState stateDummy; // Want reported failures to be from first CheckInputs
-            if (!tx.HasWitness() && CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags & ~(SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_CLEANSTACK), true, false, txdata) &&
-                !CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags & ~SCRIPT_VERIFY_CLEANSTACK, true, false, txdata)) {
-                // Only the witness is missing, so the transaction itself may be fine.
-                state.SetCorruptionPossible();
-            }
-            return false; // state filled in by CheckInputs
-        }
-
-        // Check again against the current block tip's script verification
-        // flags to cache our script execution flags. This is, of course,
-        // useless if the next block has different script flags from the
-        // previous one, but because the cache tracks script flags for us it
-        // will auto-invalidate and we'll just have a few blocks of extra
-        // misses on soft-fork activation.
-        //
-        // This is also useful in case of bugs in the standard flags that cause
-        // transactions to pass as valid when they're actually invalid. For
-        // instance the STRICTENC flag was incorrectly allowing certain
-        // CHECKSIG NOT scripts to pass, even though they were invalid.
-        //
-        // There is a similar check in CreateNewBlock() to prevent creating
-        // invalid blocks (using TestBlockValidity), however allowing such
-        // transactions into the mempool can be exploited as a DoS attack.
-        unsigned int currentBlockScriptVerifyFlags = GetBlockScriptFlags(chainActive.Tip(), chainparams.GetConsensus());
-        if (!CheckInputsFromMempoolAndCache(tx, state, view, pool, currentBlockScriptVerifyFlags, true, txdata)) {
-            return error("%s: BUG! PLEASE REPORT THIS! CheckInputs failed against latest-block but not STANDARD flags %s, %s",
-                    __func__, hash.ToString(), FormatStateMessage(state));
-        }
-
-        if (test_accept) {
-            // Tx was accepted, but not added
-            return true;
+        // The replacement must pay greater fees than the transactions it
+        // replaces - if we did the bandwidth used by those conflicting
+        // transactions would not be paid for.
+        if (nModifiedFees < nConflictingFees)
+        {
+            return state.DoS(0, false,
+                             REJECT_INSUFFICIENTFEE, "insufficient fee", false,
+                             strprintf("rejecting replacement %s, less fees than conflicting txs; %s < %s",
+                                      hash.ToString(), FormatMoney(nModifiedFees), FormatMoney(nConflictingFees)));
         }
 
-        // Remove conflicting transactions from the mempool
-        for (CTxMemPool::txiter it : allConflicting)
+        // Finally in addition to paying more fees than the conflicts the
+        // new transaction must pay for its own bandwidth.
+        CAmount nDeltaFees = nModifiedFees - nConflictingFees;
+        if (nDeltaFees < ::incrementalRelayFee.GetFee(nSize))
         {
-            LogPrint(BCLog::MEMPOOL, "replacing tx %s with %s for %s KYF additional fees, %d delta bytes\n",
-                    it->GetTx().GetHash().ToString(),
-                    hash.ToString(),
-                    FormatMoney(nModifiedFees - nConflictingFees),
-                    (int)nSize - (int)nConflictingSize);
-            if (plTxnReplaced)
-                plTxnReplaced->push_back(it->GetSharedTx());
+            return state.DoS(0, false,
+                    REJECT_INSUFFICIENTFEE, "insufficient fee", false,
+                    strprintf("rejecting replacement %s, not enough additional fees to relay; %s < %s",
+                          hash.ToString(),
+                          FormatMoney(nDeltaFees),
+                          FormatMoney(::incrementalRelayFee.GetFee(nSize))));
         }
-        pool.RemoveStaged(allConflicting, false, MemPoolRemovalReason::REPLACED);
+    }
 
-        // This transaction should only count for fee estimation if:
-        // - it isn't a BIP 125 replacement transaction (may not be widely supported)
-        // - it's not being re-added during a reorg which bypasses typical mempool fee limits
-        // - the node is not behind
-        // - the transaction is not dependent on any other transactions in the mempool
-        bool validForFeeEstimation = !fReplacementTransaction && !bypass_limits && IsCurrentForFeeEstimation() && pool.HasNoInputsOf(tx);
+    return true;
+}
 
-        // Store transaction in memory
-        pool.addUnchecked(entry, setAncestors, validForFeeEstimation);
+/**
+ * Run the transaction's scripts under the standard flags, or hand the checks
+ * to the caller in pvChecks so that they can run on the script check threads.
+ */
+static bool PolicyScriptChecks(ATMPWorkspace& ws, CValidationState& state, std::vector<CScriptCheck>* pvChecks = nullptr) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    const CTransaction& tx = *ws.m_ptx;
+    const CCoinsViewCache& view = ws.m_view;
+    PrecomputedTransactionData& txdata = ws.m_txdata;
+    constexpr unsigned int scriptVerifyFlags = STANDARD_SCRIPT_VERIFY_FLAGS;
+
+    // Check against previous transactions
+    // This is done last to help prevent CPU exhaustion denial-of-service attacks.
+    if (!CheckInputs(tx, state, view, true, scriptVerifyFlags, true, false, txdata, pvChecks)) {
+        // SCRIPT_VERIFY_CLEANSTACK requires SCRIPT_VERIFY_WITNESS, so we
+        // need to turn both off, and compare against just turning off CLEANSTACK
+        // to see if the failure is specifically due to witness validation.
+        CValidationState stateDummy; // Want reported failures to be from first CheckInputs
+        if (!tx.HasWitness() && CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags & ~(SCRIPT_VERIFY_WITNESS | SCRIPT_VERIFY_CLEANSTACK), true, false, txdata) &&
+            !CheckInputs(tx, stateDummy, view, true, scriptVerifyFlags & ~SCRIPT_VERIFY_CLEANSTACK, true, false, txdata)) {
+            // Only the witness is missing, so the transaction itself may be fine.
+            state.SetCorruptionPossible();
+        }
+        return false; // state filled in by CheckInputs
+    }
 
-        // trim mempool and check if tx was trimmed
-        if (!bypass_limits) {
-            LimitMempoolSize(pool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
-            if (!pool.exists(hash))
-                return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
-        }
+    return true;
+}
+
+static bool ConsensusScriptChecks(const CChainParams& chainparams, CTxMemPool& pool, ATMPWorkspace& ws, CValidationState& state) EXCLUSIVE_LOCKS_REQUIRED(cs_main, pool.cs)
+{
+    const CTransaction& tx = *ws.m_ptx;
+    const uint256& hash = ws.m_hash;
+    const CCoinsViewCache& view = ws.m_view;
+    PrecomputedTransactionData& txdata = ws.m_txdata;
+
+    // Check again against the current block tip's script verification
+    // flags to cache our script execution flags. This is, of course,
+    // useless if the next block has different script flags from the
+    // previous one, but because the cache tracks script flags for us it
+    // will auto-invalidate and we'll just have a few blocks of extra
+    // misses on soft-fork activation.
+    //
+    // This is also useful in case of bugs in the standard flags that cause
+    // transactions to pass as valid when they're actually invalid. For
+    // instance the STRICTENC flag was incorrectly allowing certain
+    // CHECKSIG NOT scripts to pass, even though they were invalid.
+    //
+    // There is a similar check in CreateNewBlock() to prevent creating
+    // invalid blocks (using TestBlockValidity), however allowing such
+    // transactions into the mempool can be exploited as a DoS attack.
+    unsigned int currentBlockScriptVerifyFlags = GetBlockScriptFlags(chainActive.Tip(), chainparams.GetConsensus());
+    if (!CheckInputsFromMempoolAndCache(tx, state, view, pool, currentBlockScriptVerifyFlags, true, txdata)) {
+        return error("%s: BUG! PLEASE REPORT THIS! CheckInputs failed against latest-block but not STANDARD flags %s, %s",
+                __func__, hash.ToString(), FormatStateMessage(state));
+    }
+
+    return true;
+}
+
+/**
+ * Evict what the transaction replaces and add it to the mempool, without
+ * trimming the mempool. A tentative entry, whose scripts are still being
+ * checked, is not announced until CTxMemPool::ConfirmTentative.
+ */
+static void Finalize(CTxMemPool& pool, ATMPWorkspace& ws, std::list<CTransactionRef>* plTxnReplaced, bool bypass_limits, bool fTentative = false) EXCLUSIVE_LOCKS_REQUIRED(cs_main, pool.cs)
+{
+    const CTransaction& tx = *ws.m_ptx;
+    const uint256& hash = ws.m_hash;
+    const CTxMemPoolEntry& entry = *ws.m_entry;
+    const CAmount nModifiedFees = ws.m_modified_fees;
+    const CAmount nConflictingFees = ws.m_conflicting_fees;
+    const size_t nConflictingSize = ws.m_conflicting_size;
+    const bool fReplacementTransaction = ws.m_replacement;
+    CTxMemPool::setEntries& allConflicting = ws.m_all_conflicting;
+    CTxMemPool::setEntries& setAncestors = ws.m_ancestors;
+
+    // Remove conflicting transactions from the mempool
+    for (CTxMemPool::txiter it : allConflicting)
+    {
+        LogPrint(BCLog::MEMPOOL, "replacing tx %s with %s for %s KYF additional fees, %d delta bytes\n",
+                it->GetTx().GetHash().ToString(),
+                hash.ToString(),
+                FormatMoney(nModifiedFees - nConflictingFees),
+                (int)entry.GetTxSize() - (int)nConflictingSize);
+        if (plTxnReplaced)
+            plTxnReplaced->push_back(it->GetSharedTx());
+    }
+    pool.RemoveStaged(allConflicting, false, MemPoolRemovalReason::REPLACED);
+
+    // This transaction should only count for fee estimation if:
+    // - it isn't a BIP 125 replacement transaction (may not be widely supported)
+    // - it's not being re-added during a reorg which bypasses typical mempool fee limits
+    // - the node is not behind
+    // - the transaction is not dependent on any other transactions in the mempool
+    bool validForFeeEstimation = !fReplacementTransaction && !bypass_limits && IsCurrentForFeeEstimation() && pool.HasNoInputsOf(tx);
+
+    // Store transaction in memory
+    pool.addUnchecked(entry, setAncestors, validForFeeEstimation, fTentative);
+}
+
+static bool AcceptToMemoryPoolWorker(const CChainParams& chainparams, CTxMemPool& pool, CValidationState& state, const CTransactionRef& ptx,
+                              bool* pfMissingInputs, int64_t nAcceptTime, std::list<CTransactionRef>* plTxnReplaced,
+                              bool bypass_limits, const CAmount& nAbsurdFee, std::vector<COutPoint>& coins_to_uncache, bool test_accept) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    const uint256 hash = ptx->GetHash();
+    AssertLockHeld(cs_main);
+    LOCK(pool.cs); // mempool "read lock" (held through GetMainSignals().TransactionAddedToMempool())
+
+    ATMPWorkspace ws(ptx);
+    if (!PreChecks(pool, ws, state, pfMissingInputs, nAcceptTime, bypass_limits, nAbsurdFee, coins_to_uncache)) return false;
+    if (!PolicyScriptChecks(ws, state)) return false;
+    if (!ConsensusScriptChecks(chainparams, pool, ws, state)) return false;
+
+    if (test_accept) {
+        // Tx was accepted, but not added
+        return true;
+    }
+
+    Finalize(pool, ws, plTxnReplaced, bypass_limits);
+
+    // trim mempool and check if tx was trimmed
+    if (!bypass_limits) {
+        LimitMempoolSize(pool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+        if (!pool.exists(hash))
+            return state.DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
     }
 
     GetMainSignals().TransactionAddedToMempool(ptx);
@@ -1002,6 +1099,130 @@ bool AcceptToMemoryPool(CTxMemPool& pool, CValidationState &state, const CTransa
     return AcceptToMemoryPoolWithTime(chainparams, pool, state, tx, pfMissingInputs, GetTime(), plTxnReplaced, bypass_limits, nAbsurdFee, test_accept);
 }
 
+static void AcceptToMemoryPoolBatchWithTime(const CChainParams& chainparams, CTxMemPool& pool, const std::vector<CTransactionRef>& txs,
+                                            const std::vector<int64_t>& accept_times, std::vector<CValidationState>& states,
+                                            std::vector<bool>& accepted, std::vector<bool>& missing_inputs,
+                                            std::list<CTransactionRef>* plTxnReplaced, const CAmount nAbsurdFee) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    AssertLockHeld(cs_main);
+    states.assign(txs.size(), CValidationState());
+    accepted.assign(txs.size(), false);
+    missing_inputs.assign(txs.size(), false);
+    std::vector<std::vector<COutPoint>> coins_to_uncache(txs.size());
+
+    {
+    LOCK(pool.cs);
+
+    // Transactions are added to the mempool as soon as they pass the checks
+    // that do not run scripts, so that later ones in the batch can spend
+    // them. Their scripts run on the script check threads meanwhile, and
+    // whatever turns out to be invalid is taken back out before anything
+    // else sees the mempool. Until then the entries are tentative, so
+    // mempool listeners only hear about the ones that stay.
+    std::vector<std::unique_ptr<ATMPWorkspace>> workspaces(txs.size());
+    std::map<uint256, size_t> batch_index;
+    std::vector<size_t> pending;
+    std::unique_ptr<CCheckQueueControl<CScriptCheck>> control;
+
+    auto flush = [&]() {
+        AssertLockHeld(pool.cs);
+        if (pending.empty()) return;
+        const bool scripts_ok = control->Wait();
+        control.reset();
+        for (size_t i : pending) {
+            ATMPWorkspace& ws = *workspaces[i];
+            CTxMemPool::txiter it = pool.mapTx.find(ws.m_hash);
+            // Already taken out with a failed ancestor
+            if (it == pool.mapTx.end()) continue;
+            // On failure the checks do not say which transaction failed, so
+            // run the policy checks again for each of them.
+            if ((scripts_ok || PolicyScriptChecks(ws, states[i])) && ConsensusScriptChecks(chainparams, pool, ws, states[i])) {
+                pool.ConfirmTentative(it);
+                accepted[i] = true;
+                continue;
+            }
+            CTxMemPool::setEntries to_remove;
+            pool.CalculateDescendants(it, to_remove);
+            for (CTxMemPool::txiter desc : to_remove) {
+                const size_t j = batch_index.at(desc->GetTx().GetHash());
+                if (j != i) missing_inputs[j] = true;
+            }
+            pool.RemoveStaged(to_remove, false, MemPoolRemovalReason::UNKNOWN);
+        }
+        pending.clear();
+    };
+
+    for (size_t i = 0; i < txs.size(); i++) {
+        batch_index.emplace(txs[i]->GetHash(), i);
+        bool fMissingInputs = false;
+        std::unique_ptr<ATMPWorkspace> ws = MakeUnique<ATMPWorkspace>(txs[i]);
+        if (!PreChecks(pool, *ws, states[i], &fMissingInputs, accept_times[i], false, nAbsurdFee, coins_to_uncache[i])) {
+            missing_inputs[i] = fMissingInputs;
+            continue;
+        }
+
+        // Evicting what a replacement conflicts with cannot be undone, so
+        // replacements are checked in full before they are added, against a
+        // mempool with no unchecked transactions left in it.
+        if (ws->m_replacement && !pending.empty()) {
+            flush();
+            ws = MakeUnique<ATMPWorkspace>(txs[i]);
+            if (!PreChecks(pool, *ws, states[i], &fMissingInputs, accept_times[i], false, nAbsurdFee, coins_to_uncache[i])) {
+                missing_inputs[i] = fMissingInputs;
+                continue;
+            }
+        }
+        if (ws->m_replacement || !nScriptCheckThreads) {
+            if (PolicyScriptChecks(*ws, states[i]) && ConsensusScriptChecks(chainparams, pool, *ws, states[i])) {
+                Finalize(pool, *ws, plTxnReplaced, false);
+                accepted[i] = true;
+            }
+            continue;
+        }
+
+        std::vector<CScriptCheck> vChecks;
+        if (!PolicyScriptChecks(*ws, states[i], &vChecks)) continue;
+        if (!control) control = MakeUnique<CCheckQueueControl<CScriptCheck>>(&scriptcheckqueue);
+        control->Add(vChecks);
+        Finalize(pool, *ws, plTxnReplaced, false, true /* fTentative */);
+        workspaces[i] = std::move(ws);
+        pending.push_back(i);
+    }
+    flush();
+
+    // trim mempool and check if any of the batch was trimmed
+    LimitMempoolSize(pool, gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000, gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60);
+    for (size_t i = 0; i < txs.size(); i++) {
+        if (accepted[i] && !pool.exists(txs[i]->GetHash())) {
+            accepted[i] = false;
+            states[i].DoS(0, false, REJECT_INSUFFICIENTFEE, "mempool full");
+        }
+    }
+
+    for (size_t i = 0; i < txs.size(); i++) {
+        if (accepted[i]) GetMainSignals().TransactionAddedToMempool(txs[i]);
+    }
+    }
+
+    for (size_t i = 0; i < txs.size(); i++) {
+        if (accepted[i]) continue;
+        for (const COutPoint& hashTx : coins_to_uncache[i]) {
+            pcoinsTip->Uncache(hashTx);
+        }
+    }
+    // After we've (potentially) uncached entries, ensure our coins cache is still within its size limits
+    CValidationState stateDummy;
+    FlushStateToDisk(chainparams, stateDummy, FlushStateMode::PERIODIC);
+}
+
+void AcceptToMemoryPoolBatch(CTxMemPool& pool, const std::vector<CTransactionRef>& txs, std::vector<CValidationState>& states,
+                             std::vector<bool>& accepted, std::vector<bool>& missing_inputs,
+                             std::list<CTransactionRef>* plTxnReplaced, const CAmount nAbsurdFee)
+{
+    const std::vector<int64_t> accept_times(txs.size(), GetTime());
+    AcceptToMemoryPoolBatchWithTime(Params(), pool, txs, accept_times, states, accepted, missing_inputs, plTxnReplaced, nAbsurdFee);
+}
+
 /**
  * Return transaction in txOut, and if it was found inside a block, its hash is placed in hashBlock.
  * If blockIndex is provided, the transaction is fetched from the corresponding block.
@@ -1396,13 +1617,16 @@ void InitScriptExecutionCache() {
  * script checks which are not necessary (eg due to script execution cache hits) are, obviously,
  * not pushed onto pvChecks/run.
  *
+ * If pnChecks is not nullptr, it is increased by the number of script checks pushed or run, which
+ * is the same either way.
+ *
  * Setting cacheSigStore/cacheFullScriptStore to false will remove elements from the corresponding cache
  * which are matched. This is useful for checking blocks where we will likely never need the cache
  * entry again.
  *
  * Non-static (and re-declared) in src/test/txvalidationcache_tests.cpp
  */
-bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &inputs, bool fScriptChecks, unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, PrecomputedTransactionData& txdata, std::vector<CScriptCheck> *pvChecks, size_t* pnChecks) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
 {
     if (!tx.IsCoinBase())
     {
@@ -1447,6 +1671,7 @@ bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsVi
 
                 // Verify signature
                 CScriptCheck check(coin.out, tx, i, flags, cacheSigStore, &txdata);
+                if (pnChecks) ++*pnChecks;
                 if (pvChecks) {
                     pvChecks->push_back(CScriptCheck());
                     check.swap(pvChecks->back());
@@ -1707,13 +1932,108 @@ static bool WriteUndoDataForBlock(const CBlockUndo& blockundo, CValidationState&
     return true;
 }
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
-
 void ThreadScriptCheck() {
     RenameThread("kryptofranc-scriptch");
     scriptcheckqueue.Thread();
 }
 
+/**
+ * Closure representing one coin database lookup done ahead of ConnectBlock.
+ * Lookup failures are not fatal: the coin is simply left spent, and
+ * ConnectBlock fetches it through pcoinsTip as usual.
+ */
+class CCoinsPrefetchCheck
+{
+private:
+    const CCoinsView* m_view;
+    const COutPoint* m_outpoint;
+    Coin* m_coin;
+
+public:
+    CCoinsPrefetchCheck() : m_view(nullptr), m_outpoint(nullptr), m_coin(nullptr) {}
+    CCoinsPrefetchCheck(const CCoinsView* view, const COutPoint* outpoint, Coin* coin) : m_view(view), m_outpoint(outpoint), m_coin(coin) {}
+
+    bool operator()() {
+        try {
+            if (!m_view->GetCoin(*m_outpoint, *m_coin)) {
+                m_coin->Clear();
+            }
+        } catch (const std::runtime_error&) {
+            m_coin->Clear();
+        }
+        return true;
+    }
+
+    void swap(CCoinsPrefetchCheck& check) {
+        std::swap(m_view, check.m_view);
+        std::swap(m_outpoint, check.m_outpoint);
+        std::swap(m_coin, check.m_coin);
+    }
+};
+
+static CCheckQueue<CCoinsPrefetchCheck> coinsprefetchqueue(1024);
+
+void ThreadCoinsPrefetch() {
+    RenameThread("kryptofranc-prefetch");
+    coinsprefetchqueue.Thread();
+}
+
+void ThreadCoinsFlush() {
+    RenameThread("kryptofranc-coinsflush");
+    pcoinsdbview->ThreadFlush();
+}
+
+/**
+ * Read the coins spent by a block that are not yet in pcoinsTip from the coins
+ * database, spreading the lookups over the prefetch threads, and add them to
+ * pcoinsTip. This way ConnectBlock finds all of its inputs in the cache instead
+ * of doing one synchronous database read per input. Coins created within the
+ * block itself are skipped. Returns the number of coins loaded.
+ */
+static size_t PrefetchBlockInputs(const CBlock& block) EXCLUSIVE_LOCKS_REQUIRED(cs_main)
+{
+    if (!nScriptCheckThreads || !pcoinsdbview || block.vtx.size() < 2) {
+        return 0;
+    }
+
+    std::set<uint256> block_txids;
+    for (const auto& tx : block.vtx) {
+        block_txids.insert(tx->GetHash());
+    }
+    std::vector<COutPoint> outpoints;
+    for (size_t i = 1; i < block.vtx.size(); i++) {
+        for (const CTxIn& txin : block.vtx[i]->vin) {
+            if (!block_txids.count(txin.prevout.hash) && !pcoinsTip->HaveCoinInCache(txin.prevout)) {
+                outpoints.push_back(txin.prevout);
+            }
+        }
+    }
+    if (outpoints.empty()) {
+        return 0;
+    }
+
+    std::vector<Coin> coins(outpoints.size());
+    {
+        CCheckQueueControl<CCoinsPrefetchCheck> control(&coinsprefetchqueue);
+        std::vector<CCoinsPrefetchCheck> vChecks;
+        vChecks.reserve(outpoints.size());
+        for (size_t i = 0; i < outpoints.size(); i++) {
+            vChecks.emplace_back(pcoinsdbview.get(), &outpoints[i], &coins[i]);
+        }
+        control.Add(vChecks);
+        control.Wait();
+    }
+
+    size_t loaded = 0;
+    for (size_t i = 0; i < outpoints.size(); i++) {
+        if (!coins[i].IsSpent()) {
+            pcoinsTip->PreloadCoin(outpoints[i], std::move(coins[i]));
+            loaded++;
+        }
+    }
+    return loaded;
+}
+
 VersionBitsCache versionbitscache GUARDED_BY(cs_main);
 
 int32_t ComputeBlockVersion(const CBlockIndex* pindexPrev, const Consensus::Params& params)
@@ -1821,6 +2141,8 @@ static int64_t nTimeIndex = 0;
 static int64_t nTimeCallbacks = 0;
 static int64_t nTimeTotal = 0;
 static int64_t nBlocksTotal = 0;
+/** Stage timings of the last ConnectBlock call, picked up by ConnectTip for getvalidationstats */
+static BlockValidationTimes g_connect_block_times GUARDED_BY(cs_main);
 
 /** Apply the effects of this block (with given index) on the UTXO set represented by coins.
  *  Validity checks that depend on the UTXO set are also done; ConnectBlock()
@@ -1832,6 +2154,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     assert(pindex);
     assert(*pindex->phashBlock == block.GetHash());
     int64_t nTimeStart = GetTimeMicros();
+    g_connect_block_times = BlockValidationTimes();
 
     // Check it again in case a previous version let a bad block in
     // NOTE: We don't currently (re-)invoke ContextualCheckBlock() or
@@ -1897,6 +2220,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     }
 
     int64_t nTime1 = GetTimeMicros(); nTimeCheck += nTime1 - nTimeStart;
+    g_connect_block_times.sanity_checks = nTime1 - nTimeStart;
     LogPrint(BCLog::BENCH, "    - Sanity checks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime1 - nTimeStart), nTimeCheck * MICRO, nTimeCheck * MILLI / nBlocksTotal);
 
     // Do not allow blocks that contain transactions which 'overwrite' older transactions,
@@ -1999,6 +2323,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     unsigned int flags = GetBlockScriptFlags(pindex, chainparams.GetConsensus());
 
     int64_t nTime2 = GetTimeMicros(); nTimeForks += nTime2 - nTime1;
+    g_connect_block_times.fork_checks = nTime2 - nTime1;
     LogPrint(BCLog::BENCH, "    - Fork checks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime2 - nTime1), nTimeForks * MICRO, nTimeForks * MILLI / nBlocksTotal);
 
     CBlockUndo blockundo;
@@ -2009,6 +2334,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     CAmount nFees = 0;
     int nInputs = 0;
     int64_t nSigOpsCost = 0;
+    size_t nScriptChecks = 0;
     blockundo.vtxundo.reserve(block.vtx.size() - 1);
     std::vector<PrecomputedTransactionData> txdata;
     txdata.reserve(block.vtx.size()); // Required so that pointers to individual PrecomputedTransactionData don't get invalidated
@@ -2058,7 +2384,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
         {
             std::vector<CScriptCheck> vChecks;
             bool fCacheResults = fJustCheck; /* Don't cache results if we're actually connecting blocks (still consult the cache, though) */
-            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, fCacheResults, txdata[i], nScriptCheckThreads ? &vChecks : nullptr))
+            if (!CheckInputs(tx, state, view, fScriptChecks, flags, fCacheResults, fCacheResults, txdata[i], nScriptCheckThreads ? &vChecks : nullptr, &nScriptChecks))
                 return error("ConnectBlock(): CheckInputs on %s failed with %s",
                     tx.GetHash().ToString(), FormatStateMessage(state));
             control.Add(vChecks);
@@ -2071,6 +2397,7 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
         UpdateCoins(tx, view, i == 0 ? undoDummy : blockundo.vtxundo.back(), pindex->nHeight);
     }
     int64_t nTime3 = GetTimeMicros(); nTimeConnect += nTime3 - nTime2;
+    g_connect_block_times.connect_inputs = nTime3 - nTime2;
     LogPrint(BCLog::BENCH, "      - Connect %u transactions: %.2fms (%.3fms/tx, %.3fms/txin) [%.2fs (%.2fms/blk)]\n", (unsigned)block.vtx.size(), MILLI * (nTime3 - nTime2), MILLI * (nTime3 - nTime2) / block.vtx.size(), nInputs <= 1 ? 0 : MILLI * (nTime3 - nTime2) / (nInputs-1), nTimeConnect * MICRO, nTimeConnect * MILLI / nBlocksTotal);
 
     CAmount blockReward = nFees + GetBlockSubsidy(pindex->nHeight, chainparams.GetConsensus());
@@ -2083,6 +2410,11 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     if (!control.Wait())
         return state.DoS(100, error("%s: CheckQueue failed", __func__), REJECT_INVALID, "block-validation-failed");
     int64_t nTime4 = GetTimeMicros(); nTimeVerify += nTime4 - nTime2;
+    g_connect_block_times.verify_scripts = nTime4 - nTime3;
+    g_connect_block_times.txs = block.vtx.size();
+    g_connect_block_times.inputs = nInputs - 1;
+    g_connect_block_times.sigops_cost = nSigOpsCost;
+    g_connect_block_times.script_checks = nScriptChecks;
     LogPrint(BCLog::BENCH, "    - Verify %u txins: %.2fms (%.3fms/txin) [%.2fs (%.2fms/blk)]\n", nInputs - 1, MILLI * (nTime4 - nTime2), nInputs <= 1 ? 0 : MILLI * (nTime4 - nTime2) / (nInputs-1), nTimeVerify * MICRO, nTimeVerify * MILLI / nBlocksTotal);
 
     if (fJustCheck)
@@ -2101,9 +2433,11 @@ bool CChainState::ConnectBlock(const CBlock& block, CValidationState& state, CBl
     view.SetBestBlock(pindex->GetBlockHash());
 
     int64_t nTime5 = GetTimeMicros(); nTimeIndex += nTime5 - nTime4;
+    g_connect_block_times.index_writing = nTime5 - nTime4;
     LogPrint(BCLog::BENCH, "    - Index writing: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime5 - nTime4), nTimeIndex * MICRO, nTimeIndex * MILLI / nBlocksTotal);
 
     int64_t nTime6 = GetTimeMicros(); nTimeCallbacks += nTime6 - nTime5;
+    g_connect_block_times.callbacks = nTime6 - nTime5;
     LogPrint(BCLog::BENCH, "    - Callbacks: %.2fms [%.2fs (%.2fms/blk)]\n", MILLI * (nTime6 - nTime5), nTimeCallbacks * MICRO, nTimeCallbacks * MILLI / nBlocksTotal);
 
     return true;
@@ -2123,9 +2457,22 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
     LOCK(cs_main);
     static int64_t nLastWrite = 0;
     static int64_t nLastFlush = 0;
+    //! Memory used by the coins last handed to the background flush thread
+    static int64_t nBackgroundFlushUsage = 0;
+    //! Chain tip of the coins handed to the background flush thread, while they are not yet reported as flushed
+    static CBlockLocator locatorBackgroundFlush;
+    static bool fBackgroundFlushUnreported = false;
     std::set<int> setFilesToPrune;
     bool full_flush_completed = false;
     try {
+    if (pcoinsdbview->FlushFailed()) {
+        return AbortNode(state, "Failed to write to coin database");
+    }
+    if (fBackgroundFlushUnreported && !pcoinsdbview->IsFlushing() && !pcoinsdbview->FlushFailed()) {
+        // The background flush has finished, and its coins are on disk now.
+        fBackgroundFlushUnreported = false;
+        GetMainSignals().ChainStateFlushed(locatorBackgroundFlush);
+    }
     {
         bool fFlushForPrune = false;
         bool fDoFullFlush = false;
@@ -2154,16 +2501,20 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             nLastFlush = nNow;
         }
         int64_t nMempoolSizeMax = gArgs.GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000;
-        int64_t cacheSize = pcoinsTip->DynamicMemoryUsage();
+        int64_t nTipUsage = pcoinsTip->DynamicMemoryUsage();
+        // Coins still being written in the background count towards the cache size.
+        const bool fFlushInProgress = pcoinsdbview->IsFlushing();
+        int64_t cacheSize = nTipUsage + (fFlushInProgress ? nBackgroundFlushUsage : 0);
         int64_t nTotalSpace = nCoinCacheUsage + std::max<int64_t>(nMempoolSizeMax - nMempoolUsage, 0);
         // The cache is large and we're within 10% and 10 MiB of the limit, but we have time now (not in the middle of a block processing).
-        bool fCacheLarge = mode == FlushStateMode::PERIODIC && cacheSize > std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024);
+        // Don't wait for a background flush in progress for this.
+        bool fCacheLarge = mode == FlushStateMode::PERIODIC && !fFlushInProgress && cacheSize > std::max((9 * nTotalSpace) / 10, nTotalSpace - MAX_BLOCK_COINSDB_USAGE * 1024 * 1024);
         // The cache is over the limit, we have to write now.
         bool fCacheCritical = mode == FlushStateMode::IF_NEEDED && cacheSize > nTotalSpace;
         // It's been a while since we wrote the block index to disk. Do this frequently, so we don't need to redownload after a crash.
         bool fPeriodicWrite = mode == FlushStateMode::PERIODIC && nNow > nLastWrite + (int64_t)DATABASE_WRITE_INTERVAL * 1000000;
         // It's been very long since we flushed the cache. Do this infrequently, to optimize cache usage.
-        bool fPeriodicFlush = mode == FlushStateMode::PERIODIC && nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
+        bool fPeriodicFlush = mode == FlushStateMode::PERIODIC && !fFlushInProgress && nNow > nLastFlush + (int64_t)DATABASE_FLUSH_INTERVAL * 1000000;
         // Combine all conditions that result in a full cache flush.
         fDoFullFlush = (mode == FlushStateMode::ALWAYS) || fCacheLarge || fCacheCritical || fPeriodicFlush || fFlushForPrune;
         // Write blocks and block index to disk.
@@ -2191,9 +2542,13 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
                     return AbortNode(state, "Failed to write to block index database");
                 }
             }
-            // Finally remove any pruned files
-            if (fFlushForPrune)
+            // Finally remove any pruned files. A background flush in progress
+            // may still need their blocks to be replayed after a crash.
+            if (fFlushForPrune) {
+                if (!pcoinsdbview->WaitForFlush())
+                    return AbortNode(state, "Failed to write to coin database");
                 UnlinkPrunedFiles(setFilesToPrune);
+            }
             nLastWrite = nNow;
         }
         // Flush best chain related state. This can only be done if the blocks / block index write was also done.
@@ -2206,10 +2561,22 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
             if (!CheckDiskSpace(48 * 2 * 2 * pcoinsTip->GetCacheSize()))
                 return state.Error("out of disk space");
             // Flush the chainstate (which may refer to block index entries).
-            if (!pcoinsTip->Flush())
+            // With -backgroundflush this only waits for a previous flush, and
+            // the coins are written by the coins flush thread; callers asking
+            // for a flush to always happen get it written before returning.
+            if (!pcoinsTip->Flush() || (mode == FlushStateMode::ALWAYS && !pcoinsdbview->WaitForFlush()))
                 return AbortNode(state, "Failed to write to coin database");
+            nBackgroundFlushUsage = nTipUsage;
             nLastFlush = nNow;
-            full_flush_completed = true;
+            // Coins still being written are reported as flushed once they
+            // are on disk, by a later call.
+            if (!pcoinsdbview->IsFlushing() && !pcoinsdbview->FlushFailed()) {
+                full_flush_completed = true;
+                fBackgroundFlushUnreported = false;
+            } else {
+                locatorBackgroundFlush = chainActive.GetLocator();
+                fBackgroundFlushUnreported = true;
+            }
         }
     }
     if (full_flush_completed) {
@@ -2222,12 +2589,14 @@ bool static FlushStateToDisk(const CChainParams& chainparams, CValidationState &
     return true;
 }
 
-void FlushStateToDisk() {
+bool FlushStateToDisk() {
     CValidationState state;
     const CChainParams& chainparams = Params();
     if (!FlushStateToDisk(chainparams, state, FlushStateMode::ALWAYS)) {
         LogPrintf("%s: failed to flush state (%s)\n", __func__, FormatStateMessage(state));
+        return false;
     }
+    return true;
 }
 
 void PruneAndFlush() {
@@ -2363,6 +2732,7 @@ bool CChainState::DisconnectTip(CValidationState& state, const CChainParams& cha
 }
 
 static int64_t nTimeReadFromDisk = 0;
+static int64_t nTimePrefetch = 0;
 static int64_t nTimeConnectTotal = 0;
 static int64_t nTimeFlush = 0;
 static int64_t nTimeChainState = 0;
@@ -2454,7 +2824,12 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
     // Apply the block atomically to the chain state.
     int64_t nTime2 = GetTimeMicros(); nTimeReadFromDisk += nTime2 - nTime1;
     int64_t nTime3;
+    BlockValidationTimes times;
     LogPrint(BCLog::BENCH, "  - Load block from disk: %.2fms [%.2fs]\n", (nTime2 - nTime1) * MILLI, nTimeReadFromDisk * MICRO);
+    // Warm the coins cache with the block's inputs before connecting it.
+    size_t nPrefetched = PrefetchBlockInputs(blockConnecting);
+    int64_t nTimePrefetched = GetTimeMicros(); nTimePrefetch += nTimePrefetched - nTime2;
+    LogPrint(BCLog::BENCH, "  - Prefetch %u inputs: %.2fms [%.2fs]\n", (unsigned)nPrefetched, (nTimePrefetched - nTime2) * MILLI, nTimePrefetch * MICRO);
     {
         CCoinsViewCache view(pcoinsTip.get());
         bool rv = ConnectBlock(blockConnecting, state, pindexNew, view, chainparams);
@@ -2464,8 +2839,9 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
                 InvalidBlockFound(pindexNew, state);
             return error("%s: ConnectBlock %s failed, %s", __func__, pindexNew->GetBlockHash().ToString(), FormatStateMessage(state));
         }
-        nTime3 = GetTimeMicros(); nTimeConnectTotal += nTime3 - nTime2;
-        LogPrint(BCLog::BENCH, "  - Connect total: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime3 - nTime2) * MILLI, nTimeConnectTotal * MICRO, nTimeConnectTotal * MILLI / nBlocksTotal);
+        nTime3 = GetTimeMicros(); nTimeConnectTotal += nTime3 - nTimePrefetched;
+        times = g_connect_block_times;
+        LogPrint(BCLog::BENCH, "  - Connect total: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime3 - nTimePrefetched) * MILLI, nTimeConnectTotal * MICRO, nTimeConnectTotal * MILLI / nBlocksTotal);
         bool flushed = view.Flush();
         assert(flushed);
     }
@@ -2487,6 +2863,18 @@ bool CChainState::ConnectTip(CValidationState& state, const CChainParams& chainp
     LogPrint(BCLog::BENCH, "  - Connect postprocess: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime5) * MILLI, nTimePostConnect * MICRO, nTimePostConnect * MILLI / nBlocksTotal);
     LogPrint(BCLog::BENCH, "- Connect block: %.2fms [%.2fs (%.2fms/blk)]\n", (nTime6 - nTime1) * MILLI, nTimeTotal * MICRO, nTimeTotal * MILLI / nBlocksTotal);
 
+    times.height = pindexNew->nHeight;
+    times.hash = pindexNew->GetBlockHash();
+    times.load_block = nTime2 - nTime1;
+    times.prefetch_inputs = nTimePrefetched - nTime2;
+    times.prefetched_coins = nPrefetched;
+    times.connect_total = nTime3 - nTimePrefetched;
+    times.flush_view = nTime4 - nTime3;
+    times.write_chainstate = nTime5 - nTime4;
+    times.postprocess = nTime6 - nTime5;
+    times.total = nTime6 - nTime1;
+    g_validation_stats.Add(times);
+
     connectTrace.BlockConnected(pindexNew, std::move(pthisBlock));
     return true;
 }
@@ -3983,6 +4371,11 @@ bool static LoadBlockIndexDB(const CChainParams& chainparams) EXCLUSIVE_LOCKS_RE
     if (fHavePruned)
         LogPrintf("LoadBlockIndexDB(): Block files have previously been pruned\n");
 
+    // Check whether the chain state was bootstrapped from a UTXO snapshot
+    pblocktree->ReadFlag("utxosnapshot", fHaveUTXOSnapshot);
+    if (fHaveUTXOSnapshot)
+        LogPrintf("LoadBlockIndexDB(): Chain state was loaded from a UTXO snapshot\n");
+
     // Check whether we need to continue reindexing
     bool fReindexing = false;
     pblocktree->ReadReindexing(fReindexing);
@@ -4063,8 +4456,8 @@ bool CVerifyDB::VerifyDB(const CChainParams& chainparams, CCoinsView *coinsview,
         uiInterface.ShowProgress(_("Verifying blocks..."), percentageDone, false);
         if (pindex->nHeight <= chainActive.Height()-nCheckDepth)
             break;
-        if (fPruneMode && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
-            // If pruning, only go back as far as we have data.
+        if ((fPruneMode || fHaveUTXOSnapshot) && !(pindex->nStatus & BLOCK_HAVE_DATA)) {
+            // If pruning, or below a UTXO snapshot, only go back as far as we have data.
             LogPrintf("VerifyDB(): block verification stopping at height %d (pruning, no data)\n", pindex->nHeight);
             break;
         }
@@ -4354,6 +4747,44 @@ bool CChainState::RewindBlockIndex(const CChainParams& params)
     return true;
 }
 
+bool CChainState::MarkUTXOSnapshotChain(const CChainParams& chainparams, CBlockIndex* pindexBase, uint64_t nChainTx)
+{
+    // Walk up from genesis. The data of these blocks is never downloaded, so
+    // each gets a placeholder transaction count of one, and the base block
+    // makes up the difference to the snapshot's chain transaction count.
+    std::vector<CBlockIndex*> vChain;
+    for (CBlockIndex* pindex = pindexBase; pindex->pprev; pindex = pindex->pprev) {
+        vChain.push_back(pindex);
+    }
+    const CBlockIndex* pindexGenesis = vChain.empty() ? pindexBase : vChain.back()->pprev;
+    if (!pindexGenesis->HaveTxsDownloaded() || nChainTx < pindexGenesis->nChainTx + vChain.size()) {
+        return error("%s: invalid chain transaction count %u", __func__, nChainTx);
+    }
+    for (CBlockIndex* pindex : reverse_iterate(vChain)) {
+        pindex->nTx = pindex == pindexBase ? nChainTx - pindex->pprev->nChainTx : 1;
+        pindex->nChainTx = pindex->pprev->nChainTx + pindex->nTx;
+        if (IsWitnessEnabled(pindex->pprev, chainparams.GetConsensus())) {
+            pindex->nStatus |= BLOCK_OPT_WITNESS;
+        }
+        pindex->RaiseValidity(BLOCK_VALID_SCRIPTS);
+        setDirtyBlockIndex.insert(pindex);
+    }
+    setBlockIndexCandidates.insert(pindexBase);
+
+    fHaveUTXOSnapshot = true;
+    if (!pblocktree->WriteFlag("utxosnapshot", true)) {
+        return false;
+    }
+    std::vector<const CBlockIndex*> vBlocks(setDirtyBlockIndex.begin(), setDirtyBlockIndex.end());
+    setDirtyBlockIndex.clear();
+    return pblocktree->WriteBatchSync({}, nLastBlockFile, vBlocks);
+}
+
+bool MarkUTXOSnapshotChain(const CChainParams& chainparams, CBlockIndex* pindexBase, uint64_t nChainTx) {
+    LOCK(cs_main);
+    return g_chainstate.MarkUTXOSnapshotChain(chainparams, pindexBase, nChainTx);
+}
+
 bool RewindBlockIndex(const CChainParams& params) {
     if (!g_chainstate.RewindBlockIndex(params)) {
         return false;
@@ -4404,6 +4835,7 @@ void UnloadBlockIndex()
     }
     mapBlockIndex.clear();
     fHavePruned = false;
+    fHaveUTXOSnapshot = false;
 
     g_chainstate.UnloadBlockIndex();
 }
@@ -4460,53 +4892,244 @@ bool LoadGenesisBlock(const CChainParams& chainparams)
     return g_chainstate.LoadGenesisBlock(chainparams);
 }
 
+namespace {
+
+//! How far ahead of the oldest block still being imported LoadExternalBlockFile scans
+static const uint64_t IMPORT_WINDOW_SIZE = 32 * 1024 * 1024;
+//! Maximum number of blocks in the import pipeline at once
+static const size_t MAX_IMPORT_BLOCKS_IN_FLIGHT = 4096;
+
+/** A block found in an external block file, on its way through the import pipeline. */
+struct PendingImportBlock
+{
+    //! File position of the block's message start, where scanning resumes if the block turns out to be corrupt
+    uint64_t nStartPos = 0;
+    //! File position and size of the serialized block
+    uint64_t nBlockPos = 0;
+    unsigned int nSize = 0;
+    //! Serialized block as read from the file
+    CDataStream data{SER_DISK, CLIENT_VERSION};
+
+    // Filled in by an import worker.
+    std::shared_ptr<CBlock> pblock;
+    uint256 hash;
+    //! Number of serialized bytes the block actually used
+    uint64_t nConsumed = 0;
+    std::string strError;
+    bool fDone = false;
+};
+
+/**
+ * Pool of threads that deserializes the blocks read by LoadExternalBlockFile.
+ *
+ * Deserializing a block computes all of its transaction hashes, and the
+ * workers also compute the block hash and run the context-free CheckBlock, so
+ * that by the time AcceptBlock sees a block only the contextual checks and
+ * the block index update are left for the import thread. Blocks are handed
+ * out in the order they were queued, and the import thread waits for them in
+ * that same order. Without worker threads, blocks are processed inline when
+ * queued.
+ */
+class CBlockImportWorkers
+{
+private:
+    const Consensus::Params& m_consensus;
+    std::mutex m_mutex;
+    std::condition_variable m_cond_work;
+    std::condition_variable m_cond_done;
+    std::deque<std::shared_ptr<PendingImportBlock>> m_queue;
+    bool m_stop = false;
+    boost::thread_group m_threads;
+
+    void Process(PendingImportBlock& job) const
+    {
+        try {
+            std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
+            job.data >> *pblock;
+            job.nConsumed = job.nSize - job.data.size();
+            job.hash = pblock->GetHash();
+            // A failure is reported again, and acted upon, by AcceptBlock.
+            CValidationState state;
+            CheckBlock(*pblock, state, m_consensus);
+            job.pblock = std::move(pblock);
+        } catch (const std::exception& e) {
+            job.strError = e.what();
+        }
+        // The raw bytes are no longer needed.
+        job.data = CDataStream(SER_DISK, CLIENT_VERSION);
+    }
+
+    void Thread()
+    {
+        RenameThread("kryptofranc-loadblkw");
+        while (true) {
+            std::shared_ptr<PendingImportBlock> job;
+            {
+                std::unique_lock<std::mutex> lock(m_mutex);
+                m_cond_work.wait(lock, [this] { return m_stop || !m_queue.empty(); });
+                if (m_stop) return;
+                job = std::move(m_queue.front());
+                m_queue.pop_front();
+            }
+            Process(*job);
+            {
+                std::lock_guard<std::mutex> lock(m_mutex);
+                job->fDone = true;
+            }
+            m_cond_done.notify_all();
+        }
+    }
+
+public:
+    CBlockImportWorkers(const Consensus::Params& consensus, int nThreads) : m_consensus(consensus)
+    {
+        for (int i = 0; i < nThreads; i++) {
+            m_threads.create_thread([this] { Thread(); });
+        }
+    }
+
+    ~CBlockImportWorkers()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_stop = true;
+        }
+        m_cond_work.notify_all();
+        m_threads.join_all();
+    }
+
+    void Push(const std::shared_ptr<PendingImportBlock>& job)
+    {
+        if (m_threads.size() == 0) {
+            Process(*job);
+            job->fDone = true;
+            return;
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            m_queue.push_back(job);
+        }
+        m_cond_work.notify_one();
+    }
+
+    void Wait(const PendingImportBlock& job)
+    {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_cond_done.wait(lock, [&job] { return job.fDone; });
+    }
+
+    //! Drop blocks that no worker has started on yet
+    void Clear()
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (const auto& job : m_queue) {
+            job->fDone = true;
+        }
+        m_queue.clear();
+    }
+};
+
+} // namespace
+
 bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp)
 {
     // Map of disk positions for blocks with unknown parent (only used for reindex)
     static std::multimap<uint256, CDiskBlockPos> mapBlocksUnknownParent;
     int64_t nStart = GetTimeMillis();
 
+    // The file is read in three stages: this thread scans ahead for blocks
+    // and queues their serialized bytes, the import workers deserialize and
+    // check them in parallel, and this thread then accepts the results in
+    // file order. Scanning stops IMPORT_WINDOW_SIZE bytes ahead of the oldest
+    // block still in the pipeline, and the file buffer keeps that much
+    // history so that scanning can resume right after a corrupt block.
+    CBlockImportWorkers workers(chainparams.GetConsensus(), nScriptCheckThreads);
+    std::deque<std::shared_ptr<PendingImportBlock>> vPending;
+
     int nLoaded = 0;
     try {
         // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
-        CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
+        CBufferedFile blkdat(fileIn, IMPORT_WINDOW_SIZE + 2*MAX_BLOCK_SERIALIZED_SIZE + 16, IMPORT_WINDOW_SIZE + MAX_BLOCK_SERIALIZED_SIZE + 8, SER_DISK, CLIENT_VERSION);
         uint64_t nRewind = blkdat.GetPos();
-        while (!blkdat.eof()) {
+        bool fEof = false;
+        while (true) {
             boost::this_thread::interruption_point();
 
-            blkdat.SetPos(nRewind);
-            nRewind++; // start one byte further next time, in case of failure
-            blkdat.SetLimit(); // remove former limit
-            unsigned int nSize = 0;
-            try {
-                // locate a header
-                unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
-                blkdat.FindByte(chainparams.MessageStart()[0]);
-                nRewind = blkdat.GetPos()+1;
-                blkdat >> buf;
-                if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
-                    continue;
-                // read size
-                blkdat >> nSize;
-                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
-                    continue;
-            } catch (const std::exception&) {
-                // no valid block header found; don't complain
-                break;
+            // Scan ahead for blocks and queue them for the workers.
+            while (!fEof && !blkdat.eof() && vPending.size() < MAX_IMPORT_BLOCKS_IN_FLIGHT &&
+                   (vPending.empty() || nRewind < vPending.front()->nStartPos + IMPORT_WINDOW_SIZE)) {
+                blkdat.SetPos(nRewind);
+                nRewind++; // start one byte further next time, in case of failure
+                blkdat.SetLimit(); // remove former limit
+                unsigned int nSize = 0;
+                uint64_t nStartPos;
+                try {
+                    // locate a header
+                    unsigned char buf[CMessageHeader::MESSAGE_START_SIZE];
+                    blkdat.FindByte(chainparams.MessageStart()[0]);
+                    nStartPos = blkdat.GetPos();
+                    nRewind = nStartPos + 1;
+                    blkdat >> buf;
+                    if (memcmp(buf, chainparams.MessageStart(), CMessageHeader::MESSAGE_START_SIZE))
+                        continue;
+                    // read size
+                    blkdat >> nSize;
+                    if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                        continue;
+                } catch (const std::exception&) {
+                    // no valid block header found; don't complain
+                    fEof = true;
+                    break;
+                }
+                try {
+                    std::shared_ptr<PendingImportBlock> job = std::make_shared<PendingImportBlock>();
+                    job->nStartPos = nStartPos;
+                    job->nBlockPos = blkdat.GetPos();
+                    job->nSize = nSize;
+                    job->data.resize(nSize);
+                    blkdat.read(job->data.data(), nSize);
+                    nRewind = blkdat.GetPos();
+                    vPending.push_back(job);
+                    workers.Push(job);
+                } catch (const std::exception& e) {
+                    // A truncated block at the end of the file
+                    LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+                }
             }
+            if (vPending.empty()) break;
+
+            std::shared_ptr<PendingImportBlock> job = std::move(vPending.front());
+            vPending.pop_front();
+            workers.Wait(*job);
+
+            if (!job->pblock || job->nConsumed < job->nSize) {
+                // Not a valid block, or the size field overstated it. Throw
+                // away everything scanned after it and resume scanning where
+                // the previous single-stage importer would have.
+                uint64_t nResume = job->pblock ? job->nBlockPos + job->nConsumed : job->nStartPos + 1;
+                if (!job->pblock) {
+                    LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, job->strError);
+                }
+                workers.Clear();
+                for (const auto& pending : vPending) {
+                    workers.Wait(*pending);
+                }
+                vPending.clear();
+                if (!blkdat.SetPos(nResume)) {
+                    LogPrintf("%s: Unable to rewind to file position %u, continuing at %u\n", __func__, nResume, blkdat.GetPos());
+                    nResume = blkdat.GetPos();
+                }
+                nRewind = nResume;
+                fEof = false;
+                if (!job->pblock) continue;
+            }
+
             try {
-                // read block
-                uint64_t nBlockPos = blkdat.GetPos();
                 if (dbp)
-                    dbp->nPos = nBlockPos;
-                blkdat.SetLimit(nBlockPos + nSize);
-                blkdat.SetPos(nBlockPos);
-                std::shared_ptr<CBlock> pblock = std::make_shared<CBlock>();
-                CBlock& block = *pblock;
-                blkdat >> block;
-                nRewind = blkdat.GetPos();
-
-                uint256 hash = block.GetHash();
+                    dbp->nPos = job->nBlockPos;
+                std::shared_ptr<CBlock> pblock = std::move(job->pblock);
+                const CBlock& block = *pblock;
+                const uint256& hash = job->hash;
                 {
                     LOCK(cs_main);
                     // detect out of order blocks, and store them for later
@@ -4593,8 +5216,9 @@ void CChainState::CheckBlockIndex(const Consensus::Params& consensusParams)
     // During a reindex, we read the genesis block and call CheckBlockIndex before ActivateBestChain,
     // so we have the genesis block in mapBlockIndex but no active chain.  (A few of the tests when
     // iterating the block tree require that chainActive has been initialized.)
+    // The headers of a UTXO snapshot are added before there is an active chain too.
     if (chainActive.Height() < 0) {
-        assert(mapBlockIndex.size() <= 1);
+        assert(mapBlockIndex.size() <= 1 || gArgs.IsArgSet("-loadutxosnapshot"));
         return;
     }
 
@@ -4642,7 +5266,7 @@ void CChainState::CheckBlockIndex(const Consensus::Params& consensusParams)
         if (!pindex->HaveTxsDownloaded()) assert(pindex->nSequenceId <= 0); // nSequenceId can't be set positive for blocks that aren't linked (negative is used for preciousblock)
         // VALID_TRANSACTIONS is equivalent to nTx > 0 for all nodes (whether or not pruning has occurred).
         // HAVE_DATA is only equivalent to nTx > 0 (or VALID_TRANSACTIONS) if no pruning has occurred.
-        if (!fHavePruned) {
+        if (!fHavePruned && !fHaveUTXOSnapshot) {
             // If we've never pruned, then HAVE_DATA should be equivalent to nTx > 0
             assert(!(pindex->nStatus & BLOCK_HAVE_DATA) == (pindex->nTx == 0));
             assert(pindexFirstMissing == pindexFirstNeverProcessed);
@@ -4701,7 +5325,7 @@ void CChainState::CheckBlockIndex(const Consensus::Params& consensusParams)
         if (pindexFirstMissing == nullptr) assert(!foundInUnlinked); // We aren't missing data for any parent -- cannot be in mapBlocksUnlinked.
         if (pindex->pprev && (pindex->nStatus & BLOCK_HAVE_DATA) && pindexFirstNeverProcessed == nullptr && pindexFirstMissing != nullptr) {
             // We HAVE_DATA for this block, have received data for all parents at some point, but we're currently missing data for some parent.
-            assert(fHavePruned); // We must have pruned.
+            assert(fHavePruned || fHaveUTXOSnapshot); // We must have pruned, or started from a snapshot.
             // This block may have entered mapBlocksUnlinked if:
             //  - it has a descendant that at some point had more work than the
             //    tip, and
@@ -4796,16 +5420,16 @@ int VersionBitsTipStateSinceHeight(const Consensus::Params& params, Consensus::D
     return VersionBitsStateSinceHeight(chainActive.Tip(), params, pos, versionbitscache);
 }
 
-static const uint64_t MEMPOOL_DUMP_VERSION = 1;
+/** Number of transactions validated together when loading the mempool */
+static const size_t MEMPOOL_LOAD_BATCH_SIZE = 1000;
 
 bool LoadMempool()
 {
     const CChainParams& chainparams = Params();
     int64_t nExpiryTimeout = gArgs.GetArg("-mempoolexpiry", DEFAULT_MEMPOOL_EXPIRY) * 60 * 60;
-    FILE* filestr = fsbridge::fopen(GetDataDir() / "mempool.dat", "rb");
-    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
-    if (file.IsNull()) {
-        LogPrintf("Failed to open mempool file from disk. Continuing anyway.\n");
+    std::vector<MempoolDiskEntry> entries;
+    std::map<uint256, CAmount> mapDeltas;
+    if (!ReadMempoolFiles(GetDataDir(), entries, mapDeltas)) {
         return false;
     }
 
@@ -4815,60 +5439,54 @@ bool LoadMempool()
     int64_t already_there = 0;
     int64_t nNow = GetTime();
 
-    try {
-        uint64_t version;
-        file >> version;
-        if (version != MEMPOOL_DUMP_VERSION) {
-            return false;
+    std::vector<CTransactionRef> txs;
+    std::vector<int64_t> accept_times;
+    for (const MempoolDiskEntry& entry : entries) {
+        CAmount amountdelta = entry.nFeeDelta;
+        if (amountdelta) {
+            mempool.PrioritiseTransaction(entry.tx->GetHash(), amountdelta);
         }
-        uint64_t num;
-        file >> num;
-        while (num--) {
-            CTransactionRef tx;
-            int64_t nTime;
-            int64_t nFeeDelta;
-            file >> tx;
-            file >> nTime;
-            file >> nFeeDelta;
-
-            CAmount amountdelta = nFeeDelta;
-            if (amountdelta) {
-                mempool.PrioritiseTransaction(tx->GetHash(), amountdelta);
-            }
-            CValidationState state;
-            if (nTime + nExpiryTimeout > nNow) {
-                LOCK(cs_main);
-                AcceptToMemoryPoolWithTime(chainparams, mempool, state, tx, nullptr /* pfMissingInputs */, nTime,
-                                           nullptr /* plTxnReplaced */, false /* bypass_limits */, 0 /* nAbsurdFee */,
-                                           false /* test_accept */);
-                if (state.IsValid()) {
-                    ++count;
+        if (entry.nTime + nExpiryTimeout > nNow) {
+            txs.push_back(entry.tx);
+            accept_times.push_back(entry.nTime);
+        } else {
+            ++expired;
+        }
+    }
+
+    // Entries come parents first, so each batch only depends on earlier
+    // ones. Their scripts are verified in parallel, and cs_main is released
+    // between batches.
+    for (size_t start = 0; start < txs.size(); start += MEMPOOL_LOAD_BATCH_SIZE) {
+        const size_t end = std::min(txs.size(), start + MEMPOOL_LOAD_BATCH_SIZE);
+        const std::vector<CTransactionRef> batch(txs.begin() + start, txs.begin() + end);
+        const std::vector<int64_t> batch_times(accept_times.begin() + start, accept_times.begin() + end);
+        std::vector<CValidationState> states;
+        std::vector<bool> accepted, missing_inputs;
+        LOCK(cs_main);
+        AcceptToMemoryPoolBatchWithTime(chainparams, mempool, batch, batch_times, states, accepted, missing_inputs,
+                                        nullptr /* plTxnReplaced */, 0 /* nAbsurdFee */);
+        for (size_t i = 0; i < batch.size(); i++) {
+            if (accepted[i]) {
+                ++count;
+            } else {
+                // mempool may contain the transaction already, e.g. from
+                // wallet(s) having loaded it while we were processing
+                // mempool transactions; consider these as valid, instead of
+                // failed, but mark them as 'already there'
+                if (mempool.exists(batch[i]->GetHash())) {
+                    ++already_there;
                 } else {
-                    // mempool may contain the transaction already, e.g. from
-                    // wallet(s) having loaded it while we were processing
-                    // mempool transactions; consider these as valid, instead of
-                    // failed, but mark them as 'already there'
-                    if (mempool.exists(tx->GetHash())) {
-                        ++already_there;
-                    } else {
-                        ++failed;
-                    }
+                    ++failed;
                 }
-            } else {
-                ++expired;
             }
-            if (ShutdownRequested())
-                return false;
         }
-        std::map<uint256, CAmount> mapDeltas;
-        file >> mapDeltas;
+        if (ShutdownRequested())
+            return false;
+    }
 
-        for (const auto& i : mapDeltas) {
-            mempool.PrioritiseTransaction(i.first, i.second);
-        }
-    } catch (const std::exception& e) {
-        LogPrintf("Failed to deserialize mempool data on disk: %s. Continuing anyway.\n", e.what());
-        return false;
+    for (const auto& i : mapDeltas) {
+        mempool.PrioritiseTransaction(i.first, i.second);
     }
 
     LogPrintf("Imported mempool transactions from disk: %i succeeded, %i failed, %i expired, %i already there\n", count, failed, expired, already_there);
@@ -4877,6 +5495,11 @@ bool LoadMempool()
 
 bool DumpMempool()
 {
+    // The journal keeps its own snapshot in step with it
+    if (g_mempool_journal && g_mempool_journal->IsActive()) {
+        return g_mempool_journal->Compact();
+    }
+
     int64_t start = GetTimeMicros();
 
     std::map<uint256, CAmount> mapDeltas;
@@ -4895,34 +5518,131 @@ bool DumpMempool()
 
     int64_t mid = GetTimeMicros();
 
+    uint64_t bytes;
+    if (!WriteMempoolSnapshot(GetDataDir(), 0 /* journal_id */, vinfo, std::move(mapDeltas), bytes)) {
+        return false;
+    }
+    int64_t last = GetTimeMicros();
+    LogPrintf("Dumped mempool: %gs to copy, %gs to dump\n", (mid-start)*MICRO, (last-mid)*MICRO);
+    return true;
+}
+
+static const uint64_t SIGCACHE_DUMP_VERSION = 1;
+
+/**
+ * The signature caches are saved as the dump version, the client version and
+ * the genesis block hash, followed by the nonce and entries of the signature
+ * cache and of the script execution cache, and a hash of everything before
+ * it. Script execution cache entries depend on the meaning of the script
+ * verification flags, so they are only loaded by the client version that
+ * saved them.
+ */
+template <typename Stream>
+static void SerializeSignatureCaches(Stream& s, const uint256& sig_nonce, const std::vector<uint256>& sig_entries, const uint256& script_nonce, const std::vector<uint256>& script_entries)
+{
+    s << SIGCACHE_DUMP_VERSION << CLIENT_VERSION << Params().GetConsensus().hashGenesisBlock;
+    s << sig_nonce << (uint64_t)sig_entries.size();
+    for (const uint256& entry : sig_entries) s << entry;
+    s << script_nonce << (uint64_t)script_entries.size();
+    for (const uint256& entry : script_entries) s << entry;
+}
+
+template <typename Stream>
+static void UnserializeCacheEntries(Stream& s, uint256& nonce, std::vector<uint256>& entries)
+{
+    uint64_t count;
+    s >> nonce >> count;
+    entries.reserve(std::min<uint64_t>(count, 1 << 20));
+    while (count--) {
+        uint256 entry;
+        s >> entry;
+        entries.push_back(entry);
+    }
+}
+
+bool LoadSignatureCaches()
+{
+    FILE* filestr = fsbridge::fopen(GetDataDir() / "sigcache.dat", "rb");
+    CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    if (file.IsNull()) {
+        LogPrintf("Failed to open signature cache file from disk. Continuing anyway.\n");
+        return false;
+    }
+
+    uint256 sig_nonce, script_nonce;
+    std::vector<uint256> sig_entries, script_entries;
+    int nClientVersion;
     try {
-        FILE* filestr = fsbridge::fopen(GetDataDir() / "mempool.dat.new", "wb");
-        if (!filestr) {
+        CHashVerifier<CAutoFile> verifier(&file);
+        uint64_t version;
+        verifier >> version;
+        if (version != SIGCACHE_DUMP_VERSION) {
+            return false;
+        }
+        uint256 hashGenesis;
+        verifier >> nClientVersion >> hashGenesis;
+        if (hashGenesis != Params().GetConsensus().hashGenesisBlock) {
+            LogPrintf("Signature cache file on disk is for a different network. Ignoring it.\n");
             return false;
         }
+        UnserializeCacheEntries(verifier, sig_nonce, sig_entries);
+        UnserializeCacheEntries(verifier, script_nonce, script_entries);
+        uint256 hash;
+        file >> hash;
+        if (hash != verifier.GetHash()) {
+            LogPrintf("Signature cache file on disk is corrupt. Ignoring it.\n");
+            return false;
+        }
+    } catch (const std::exception& e) {
+        LogPrintf("Failed to deserialize signature cache data on disk: %s. Continuing anyway.\n", e.what());
+        return false;
+    }
 
-        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+    LoadSignatureCacheEntries(sig_nonce, sig_entries);
+    if (nClientVersion == CLIENT_VERSION) {
+        LOCK(cs_main);
+        scriptExecutionCacheNonce = script_nonce;
+        for (const uint256& entry : script_entries) {
+            scriptExecutionCache.insert(entry);
+        }
+    } else {
+        script_entries.clear();
+    }
+    LogPrintf("Imported signature caches from disk: %u signature and %u script execution entries\n", sig_entries.size(), script_entries.size());
+    return true;
+}
 
-        uint64_t version = MEMPOOL_DUMP_VERSION;
-        file << version;
+bool DumpSignatureCaches()
+{
+    int64_t start = GetTimeMicros();
 
-        file << (uint64_t)vinfo.size();
-        for (const auto& i : vinfo) {
-            file << *(i.tx);
-            file << (int64_t)i.nTime;
-            file << (int64_t)i.nFeeDelta;
-            mapDeltas.erase(i.tx->GetHash());
+    uint256 sig_nonce, script_nonce;
+    std::vector<uint256> sig_entries, script_entries;
+    GetSignatureCacheEntries(sig_nonce, sig_entries);
+    {
+        LOCK(cs_main);
+        script_nonce = scriptExecutionCacheNonce;
+        scriptExecutionCache.get_entries(script_entries);
+    }
+
+    try {
+        FILE* filestr = fsbridge::fopen(GetDataDir() / "sigcache.dat.new", "wb");
+        if (!filestr) {
+            return false;
         }
 
-        file << mapDeltas;
+        CAutoFile file(filestr, SER_DISK, CLIENT_VERSION);
+        CHashWriter hasher(SER_DISK, CLIENT_VERSION);
+        SerializeSignatureCaches(file, sig_nonce, sig_entries, script_nonce, script_entries);
+        SerializeSignatureCaches(hasher, sig_nonce, sig_entries, script_nonce, script_entries);
+        file << hasher.GetHash();
         if (!FileCommit(file.Get()))
             throw std::runtime_error("FileCommit failed");
         file.fclose();
-        RenameOver(GetDataDir() / "mempool.dat.new", GetDataDir() / "mempool.dat");
-        int64_t last = GetTimeMicros();
-        LogPrintf("Dumped mempool: %gs to copy, %gs to dump\n", (mid-start)*MICRO, (last-mid)*MICRO);
+        RenameOver(GetDataDir() / "sigcache.dat.new", GetDataDir() / "sigcache.dat");
+        LogPrintf("Dumped signature caches: %u signature and %u script execution entries in %gs\n", sig_entries.size(), script_entries.size(), (GetTimeMicros() - start) * MICRO);
     } catch (const std::exception& e) {
-        LogPrintf("Failed to dump mempool: %s. Continuing anyway.\n", e.what());
+        LogPrintf("Failed to dump signature caches: %s. Continuing anyway.\n", e.what());
         return false;
     }
     return true;
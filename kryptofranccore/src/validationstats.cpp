@@ -0,0 +1,63 @@
+// Copyright (c) 2019 The Kryptofranc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <validationstats.h>
+
+#include <algorithm>
+
+CValidationStats g_validation_stats(DEFAULT_VALIDATION_STATS_WINDOW);
+
+static int64_t NearestRank(const std::vector<int64_t>& sorted, int percentile)
+{
+    size_t rank = (sorted.size() * percentile + 99) / 100;
+    return sorted[std::max<size_t>(rank, 1) - 1];
+}
+
+ValidationPercentiles ComputeValidationPercentiles(std::vector<int64_t> samples)
+{
+    ValidationPercentiles ret;
+    if (samples.empty()) {
+        return ret;
+    }
+    std::sort(samples.begin(), samples.end());
+    ret.p50 = NearestRank(samples, 50);
+    ret.p90 = NearestRank(samples, 90);
+    ret.p99 = NearestRank(samples, 99);
+    ret.max = samples.back();
+    return ret;
+}
+
+void CValidationStats::SetWindow(size_t window)
+{
+    LOCK(cs);
+    m_window = window;
+    while (m_blocks.size() > m_window) {
+        m_blocks.pop_front();
+    }
+}
+
+size_t CValidationStats::GetWindow() const
+{
+    LOCK(cs);
+    return m_window;
+}
+
+void CValidationStats::Add(const BlockValidationTimes& times)
+{
+    LOCK(cs);
+    if (m_window == 0) {
+        return;
+    }
+    while (m_blocks.size() >= m_window) {
+        m_blocks.pop_front();
+    }
+    m_blocks.push_back(times);
+}
+
+std::vector<BlockValidationTimes> CValidationStats::GetRecent(size_t count) const
+{
+    LOCK(cs);
+    count = std::min(count, m_blocks.size());
+    return std::vector<BlockValidationTimes>(m_blocks.end() - count, m_blocks.end());
+}
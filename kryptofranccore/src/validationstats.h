@@ -0,0 +1,91 @@
+// Copyright (c) 2019 The Kryptofranc Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef KRYPTOFRANC_VALIDATIONSTATS_H
+#define KRYPTOFRANC_VALIDATIONSTATS_H
+
+#include <sync.h>
+#include <uint256.h>
+
+#include <deque>
+#include <stdint.h>
+#include <vector>
+
+/** Default number of recently connected blocks kept by getvalidationstats (one day of blocks) */
+static const unsigned int DEFAULT_VALIDATION_STATS_WINDOW = 576;
+
+/**
+ * Wall clock time spent in each stage of connecting one block to the tip,
+ * in microseconds. These are the same measurements that -debug=bench logs.
+ */
+struct BlockValidationTimes
+{
+    int height{0};
+    uint256 hash;
+    int64_t txs{0};
+    int64_t inputs{0};
+    int64_t sigops_cost{0};
+    //! Number of input scripts handed to the script interpreter (0 below assumevalid)
+    int64_t script_checks{0};
+    //! Number of input coins read from the coins database ahead of ConnectBlock
+    int64_t prefetched_coins{0};
+
+    // Stages of ConnectBlock.
+    int64_t sanity_checks{0};
+    int64_t fork_checks{0};
+    //! Fetching coins, CheckTxInputs and queueing script checks
+    int64_t connect_inputs{0};
+    //! Waiting for outstanding script checks after all inputs were connected
+    int64_t verify_scripts{0};
+    int64_t index_writing{0};
+    int64_t callbacks{0};
+
+    // Stages of ConnectTip.
+    int64_t load_block{0};
+    int64_t prefetch_inputs{0};
+    int64_t connect_total{0};
+    int64_t flush_view{0};
+    int64_t write_chainstate{0};
+    int64_t postprocess{0};
+    int64_t total{0};
+};
+
+/** Nearest-rank percentiles of a set of samples. */
+struct ValidationPercentiles
+{
+    int64_t p50{0};
+    int64_t p90{0};
+    int64_t p99{0};
+    int64_t max{0};
+};
+
+ValidationPercentiles ComputeValidationPercentiles(std::vector<int64_t> samples);
+
+/**
+ * Sliding window of per-block validation timings for the most recently
+ * connected blocks. Kept under its own lock so that reading the statistics
+ * does not contend with cs_main.
+ */
+class CValidationStats
+{
+private:
+    mutable CCriticalSection cs;
+    std::deque<BlockValidationTimes> m_blocks GUARDED_BY(cs);
+    size_t m_window GUARDED_BY(cs);
+
+public:
+    explicit CValidationStats(size_t window) : m_window(window) {}
+
+    void SetWindow(size_t window);
+    size_t GetWindow() const;
+
+    void Add(const BlockValidationTimes& times);
+
+    /** Return up to count of the most recent entries, oldest first. */
+    std::vector<BlockValidationTimes> GetRecent(size_t count) const;
+};
+
+extern CValidationStats g_validation_stats;
+
+#endif // KRYPTOFRANC_VALIDATIONSTATS_H